@@ -0,0 +1,52 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "storage.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Rows per batch: large enough to amortize per-call overhead, small enough that a
+// batch's columns stay in L1/L2 while the operators above the scan work on them
+const size_t BATCH_SIZE = 1024;
+
+// One column of a batch. INT, FLOAT and DATE values of consecutive rows point straight
+// into the mapped column file, and values gathered from scattered rows (join output)
+// or decoded from a frame of reference point into gathered; BOOL and STRING are decoded
+// into the arrays below. A dictionary-encoded STRING column also has its codes, so
+// that predicates can test each distinct value once.
+struct ColumnVector
+{
+    ColumnInfo info;
+    const int64_t *ints = nullptr;
+    const double *floats = nullptr;
+    const int32_t *dates = nullptr;
+    uint8_t bools[BATCH_SIZE];       // 1 TRUE, 0 FALSE
+    string_view strings[BATCH_SIZE]; // views into the mapped .str file or the dictionary
+    uint8_t nulls[BATCH_SIZE];       // 1 where the value is NULL
+    const StringDictionary *dictionary = nullptr; // set when codes holds the values' codes
+    uint16_t codes[BATCH_SIZE];
+    union
+    {
+        int64_t ints[BATCH_SIZE];
+        double floats[BATCH_SIZE];
+        int32_t dates[BATCH_SIZE];
+    } gathered;
+};
+
+// Up to BATCH_SIZE consecutive rows of a scan. Operators drop rows by shrinking the
+// selection vector rather than moving values, and narrow the output columns through
+// the projection rather than copying them.
+struct Batch
+{
+    uint64_t firstRow = 0;          // table row of position 0
+    size_t size = 0;                // rows in the batch
+    vector<ColumnVector> columns;   // one per scan slot
+    uint16_t selection[BATCH_SIZE]; // positions still qualifying, ascending
+    size_t selected = 0;
+    vector<size_t> projection;      // scan slots of the output columns, in order
+};
+
+#endif // BATCH_H
@@ -0,0 +1,242 @@
+#include "bloom.h"
+#include "bufferpool.h"
+#include "hashindex.h"
+#include "globals.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+const uint64_t PAGE_BITS = PAGE_SIZE * 8;
+const size_t HEADER_NAME = 40; // offset of the column name
+const uint32_t MAX_HASHES = 16;
+
+// Spreads a key word over all 64 bits (the splitmix64 finalizer)
+static uint64_t mix(uint64_t word)
+{
+    word ^= word >> 30;
+    word *= 0xBF58476D1CE4E5B9ULL;
+    word ^= word >> 27;
+    word *= 0x94D049BB133111EBULL;
+    return word ^ (word >> 31);
+}
+
+BloomIndex::BloomIndex(const string &path) : path(path)
+{
+    fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        cerr << RED << "Failed to open index " << path << RESET << endl;
+        return;
+    }
+    char page[PAGE_SIZE];
+    uint32_t header[6] = {};
+    ssize_t n;
+    while ((n = pread(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    if (n == static_cast<ssize_t>(PAGE_SIZE))
+    {
+        memcpy(header, page, sizeof(header));
+        memcpy(&fpp, page + 24, sizeof(fpp));
+        memcpy(&indexed, page + 32, sizeof(indexed));
+    }
+    if (n != static_cast<ssize_t>(PAGE_SIZE) || header[0] != BLOOM_MAGIC || header[1] != BLOOM_VERSION ||
+        header[2] == TYPE_BOOL || header[2] > TYPE_DATE || header[3] == 0 || header[4] == 0 ||
+        header[4] > MAX_HASHES || header[5] > PAGE_SIZE - HEADER_NAME)
+    {
+        cerr << RED << "Corrupt or unsupported index " << path << RESET << endl;
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    column.type = static_cast<int>(header[2]);
+    blockPages = header[3];
+    hashes = header[4];
+    column.name.assign(page + HEADER_NAME, header[5]);
+}
+
+BloomIndex::~BloomIndex()
+{
+    close();
+}
+
+void BloomIndex::close()
+{
+    if (fd < 0)
+        return;
+    bufferPool().dropFile(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+static bool writeHeaderPage(int fd, const ColumnInfo &column, uint32_t blockPages, uint32_t hashes, double fpp,
+                            uint64_t indexed)
+{
+    char page[PAGE_SIZE] = {};
+    uint32_t nameLength = static_cast<uint32_t>(min(column.name.size(), PAGE_SIZE - HEADER_NAME));
+    uint32_t header[6] = {BLOOM_MAGIC, BLOOM_VERSION, static_cast<uint32_t>(column.type), blockPages, hashes,
+                          nameLength};
+    memcpy(page, header, sizeof(header));
+    memcpy(page + 24, &fpp, sizeof(fpp));
+    memcpy(page + 32, &indexed, sizeof(indexed));
+    memcpy(page + HEADER_NAME, column.name.data(), nameLength);
+    ssize_t n;
+    while ((n = pwrite(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    return n == static_cast<ssize_t>(PAGE_SIZE) && fdatasync(fd) == 0;
+}
+
+bool BloomIndex::writeHeader()
+{
+    if (writeHeaderPage(fd, column, blockPages, hashes, fpp, indexed))
+        return true;
+    cerr << RED << "Failed to write the header of index " << path << RESET << endl;
+    return false;
+}
+
+// Sizes each block's filter for ZONE_ROWS distinct keys at the requested rate, in
+// whole pages, and picks the hash count that is best for the size it ends up with
+bool createBloomIndexFile(const string &path, const ColumnInfo &column, double fpp)
+{
+    double bits = -static_cast<double>(ZONE_ROWS) * log(fpp) / (M_LN2 * M_LN2);
+    uint32_t blockPages = static_cast<uint32_t>(max(1.0, ceil(bits / PAGE_BITS)));
+    double perKey = static_cast<double>(blockPages) * PAGE_BITS / ZONE_ROWS;
+    uint32_t hashes = static_cast<uint32_t>(clamp(lround(perKey * M_LN2), 1L, static_cast<long>(MAX_HASHES)));
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = writeHeaderPage(fd, column, blockPages, hashes, fpp, 0);
+    close(fd);
+    return ok;
+}
+
+bool BloomIndex::keyWordOf(const Value &value, uint64_t &word) const
+{
+    if (value.type != column.type)
+        return false;
+    switch (value.type)
+    {
+    case TYPE_INT:
+        word = intKeyWord(value.i);
+        return true;
+    case TYPE_FLOAT:
+        word = floatKeyWord(value.f);
+        return true;
+    case TYPE_DATE:
+        word = intKeyWord(value.d);
+        return true;
+    case TYPE_STRING:
+        word = stringKeyWord(value.s);
+        return true;
+    }
+    return false;
+}
+
+// Where a key's bits are: the page of its block's filter, counted from the block's
+// first page, and the first bit and stride of its probes within it (double hashing)
+struct BloomProbe
+{
+    uint32_t page;
+    uint32_t first, step;
+};
+
+static BloomProbe probeOf(uint32_t blockPages, uint64_t word)
+{
+    uint64_t hash = mix(word);
+    uint32_t low = static_cast<uint32_t>(hash), high = static_cast<uint32_t>(hash >> 32);
+    return {static_cast<uint32_t>(mix(hash) % blockPages), low, high | 1};
+}
+
+// Adds the key words of rows firstRow, firstRow + 1, ..., skipping NULLs. The pages of
+// each block are pinned once for all of its rows.
+bool BloomIndex::addRows(uint64_t firstRow, const vector<uint64_t> &words, const vector<uint8_t> &nulls)
+{
+    vector<char *> pages(blockPages);
+    for (size_t start = 0; start < words.size();)
+    {
+        uint64_t block = (firstRow + start) / ZONE_ROWS;
+        size_t end = min<uint64_t>(words.size(), (block + 1) * ZONE_ROWS - firstRow);
+        uint64_t base = 1 + block * blockPages;
+        bool ok = true;
+        for (uint32_t p = 0; p < blockPages; p++)
+        {
+            pages[p] = bufferPool().pin(fd, base + p);
+            ok = ok && pages[p];
+        }
+        for (size_t r = start; ok && r < end; r++)
+        {
+            if (nulls[r])
+                continue;
+            BloomProbe probe = probeOf(blockPages, words[r]);
+            char *data = pages[probe.page];
+            uint32_t bit = probe.first;
+            for (uint32_t i = 0; i < hashes; i++, bit += probe.step)
+            {
+                uint32_t b = bit % PAGE_BITS;
+                data[b / 8] |= static_cast<char>(1 << (b % 8));
+            }
+        }
+        for (uint32_t p = 0; p < blockPages; p++)
+        {
+            if (pages[p])
+                bufferPool().unpin(fd, base + p, true);
+        }
+        if (!ok)
+            return false;
+        changed = true;
+        start = end;
+    }
+    return true;
+}
+
+// False only if no row of the block has the key
+bool BloomIndex::mayContain(uint64_t block, uint64_t word)
+{
+    BloomProbe probe = probeOf(blockPages, word);
+    PinnedPage page(fd, 1 + block * blockPages + probe.page);
+    if (!page.data)
+        return true;
+    pagesRead++;
+    uint32_t bit = probe.first;
+    for (uint32_t i = 0; i < hashes; i++, bit += probe.step)
+    {
+        uint32_t b = bit % PAGE_BITS;
+        if (!(page.data[b / 8] & (1 << (b % 8))))
+            return false;
+    }
+    return true;
+}
+
+// Empties the filters of block and every one after it, for the rows to be added again
+bool BloomIndex::resetFrom(uint64_t block)
+{
+    if (!bufferPool().flushFile(fd))
+        return false;
+    bufferPool().dropFile(fd);
+    if (ftruncate(fd, (1 + block * blockPages) * PAGE_SIZE) != 0)
+        return false;
+    indexed = min(indexed, block * ZONE_ROWS);
+    return writeHeader();
+}
+
+// Makes the filters as of rows table rows durable: pages first, then the header
+bool BloomIndex::checkpoint(uint64_t rows)
+{
+    if (!changed && indexed == rows)
+        return true;
+    if (!bufferPool().flushFile(fd) || fdatasync(fd) != 0)
+    {
+        cerr << RED << "Failed to flush index " << path << RESET << endl;
+        return false;
+    }
+    changed = false;
+    indexed = rows;
+    return writeHeader();
+}
@@ -0,0 +1,62 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "storage.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// On-disk layout of a Bloom filter index, <table dir>/<index>.bloom:
+//   page 0      header: magic, format version, key type, pages per block, hash count,
+//               false positive rate, rows added at the last checkpoint, column name
+//   page 1..    one filter per block of ZONE_ROWS rows, of pages per block pages
+// A key sets its bits in a single page of its block's filter, picked by its hash, so
+// adding or testing a key pins one page (a blocked Bloom filter). Keys are the key
+// words of the primary key index (hashindex.h). Bits are only ever set, so a filter
+// with more rows in it than the table holds is still correct: it just answers "maybe"
+// more often. NULLs are not added.
+
+const uint32_t BLOOM_MAGIC = 0x4D4F4C42; // "BLOM"
+const uint32_t BLOOM_VERSION = 1;
+const double BLOOM_DEFAULT_FPP = 0.01;
+
+class BloomIndex
+{
+private:
+    string path;
+    int fd = -1;
+    ColumnInfo column;
+    double fpp = BLOOM_DEFAULT_FPP;
+    uint32_t blockPages = 1;
+    uint32_t hashes = 1;
+    uint64_t indexed = 0;
+    bool changed = false; // bits set since the last checkpoint
+    uint64_t pagesRead = 0;
+
+    bool writeHeader();
+
+public:
+    explicit BloomIndex(const string &path);
+    ~BloomIndex();
+    BloomIndex(const BloomIndex &) = delete;
+    BloomIndex &operator=(const BloomIndex &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    const ColumnInfo &columnInfo() const { return column; }
+    double falsePositiveRate() const { return fpp; }
+    uint64_t indexedRows() const { return indexed; }
+    uint64_t pageReads() const { return pagesRead; }
+
+    bool keyWordOf(const Value &value, uint64_t &word) const;
+    bool addRows(uint64_t firstRow, const vector<uint64_t> &words, const vector<uint8_t> &nulls);
+    bool mayContain(uint64_t block, uint64_t word);
+    bool resetFrom(uint64_t block);
+    bool checkpoint(uint64_t rows);
+    void close();
+};
+
+bool createBloomIndexFile(const string &path, const ColumnInfo &column, double fpp);
+
+#endif // BLOOM_H
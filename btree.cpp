@@ -0,0 +1,517 @@
+#include "btree.h"
+#include "bufferpool.h"
+#include "globals.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+const size_t NODE_HEADER = 16;
+
+size_t indexKeyWidth(int type)
+{
+    switch (type)
+    {
+    case TYPE_INT:
+    case TYPE_FLOAT:
+    case TYPE_DATE:
+        return sizeof(uint64_t);
+    case TYPE_STRING:
+        return INDEX_KEY_MAX;
+    default:
+        return 0; // BOOL: two values are no use to a tree
+    }
+}
+
+static void storeBigEndian(uint64_t value, char *out)
+{
+    for (int i = 7; i >= 0; i--)
+    {
+        out[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static uint64_t loadBigEndian(const char *in)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | static_cast<uint8_t>(in[i]);
+    return value;
+}
+
+// Flipping the sign bit orders two's complement values as unsigned ones
+void intKey(int64_t value, char *key)
+{
+    storeBigEndian(static_cast<uint64_t>(value) ^ (1ULL << 63), key);
+}
+
+// Non-negative doubles order like their bits with the sign bit set, negative ones
+// like their bits all flipped
+void floatKey(double value, char *key)
+{
+    if (value == 0)
+        value = 0; // -0.0 equals 0.0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    storeBigEndian((bits >> 63) ? ~bits : bits | (1ULL << 63), key);
+}
+
+void stringKey(string_view value, char *key)
+{
+    size_t n = min(value.size(), INDEX_KEY_MAX);
+    memcpy(key, value.data(), n);
+    memset(key + n, 0, INDEX_KEY_MAX - n);
+}
+
+static bool isLeaf(const char *node) { return node[0] != 0; }
+
+static size_t nodeCount(const char *node)
+{
+    uint16_t count;
+    memcpy(&count, node + 2, sizeof(count));
+    return count;
+}
+
+static uint64_t nodeLink(const char *node)
+{
+    uint64_t link;
+    memcpy(&link, node + 8, sizeof(link));
+    return link;
+}
+
+static uint64_t loadPage(const char *in)
+{
+    uint64_t page;
+    memcpy(&page, in, sizeof(page));
+    return page;
+}
+
+static void initNode(char *node, bool leaf, size_t count, uint64_t link)
+{
+    uint16_t n = static_cast<uint16_t>(count);
+    memset(node, 0, NODE_HEADER);
+    node[0] = leaf ? 1 : 0;
+    memcpy(node + 2, &n, sizeof(n));
+    memcpy(node + 8, &link, sizeof(link));
+}
+
+// First of n slots whose entry (the slot's leading width bytes) is above entry, or
+// with strict false, not below it
+static size_t searchSlots(const char *slots, size_t n, size_t stride, const char *entry, size_t width, bool strict)
+{
+    size_t low = 0, high = n;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int c = memcmp(slots + mid * stride, entry, width);
+        if (c < 0 || (strict && c == 0))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+BTreeIndex::BTreeIndex(const string &path) : path(path)
+{
+    fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        cerr << RED << "Failed to open index " << path << RESET << endl;
+        return;
+    }
+    char page[PAGE_SIZE];
+    uint32_t header[4], flag, nameLength;
+    uint64_t counts[3];
+    ssize_t n;
+    while ((n = pread(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    if (n == static_cast<ssize_t>(PAGE_SIZE))
+    {
+        memcpy(header, page, sizeof(header));
+        memcpy(counts, page + 16, sizeof(counts));
+        memcpy(&flag, page + 40, sizeof(flag));
+        memcpy(&nameLength, page + 44, sizeof(nameLength));
+    }
+    if (n != static_cast<ssize_t>(PAGE_SIZE) || header[0] != INDEX_MAGIC || header[1] != INDEX_VERSION ||
+        indexKeyWidth(header[2]) == 0 || header[3] != indexKeyWidth(header[2]) || nameLength > PAGE_SIZE - 48)
+    {
+        cerr << RED << "Corrupt or unsupported index " << path << RESET << endl;
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    column.type = static_cast<int>(header[2]);
+    column.name.assign(page + 48, nameLength);
+    keyWidth = header[3];
+    root = counts[0];
+    pageCount = counts[1];
+    indexed = counts[2];
+    clean = flag != 0;
+}
+
+BTreeIndex::~BTreeIndex()
+{
+    close();
+}
+
+void BTreeIndex::close()
+{
+    if (fd < 0)
+        return;
+    bufferPool().dropFile(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+static bool writeHeaderPage(int fd, const ColumnInfo &column, uint64_t root, uint64_t pageCount, uint64_t indexed,
+                            bool clean)
+{
+    char page[PAGE_SIZE] = {};
+    uint32_t header[4] = {INDEX_MAGIC, INDEX_VERSION, static_cast<uint32_t>(column.type),
+                          static_cast<uint32_t>(indexKeyWidth(column.type))};
+    uint64_t counts[3] = {root, pageCount, indexed};
+    uint32_t flag = clean ? 1 : 0, nameLength = static_cast<uint32_t>(column.name.size());
+    memcpy(page, header, sizeof(header));
+    memcpy(page + 16, counts, sizeof(counts));
+    memcpy(page + 40, &flag, sizeof(flag));
+    memcpy(page + 44, &nameLength, sizeof(nameLength));
+    memcpy(page + 48, column.name.data(), min<size_t>(nameLength, PAGE_SIZE - 48));
+    ssize_t n;
+    while ((n = pwrite(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    return n == static_cast<ssize_t>(PAGE_SIZE) && fdatasync(fd) == 0;
+}
+
+bool BTreeIndex::writeHeader()
+{
+    if (writeHeaderPage(fd, column, root, pageCount, indexed, clean))
+        return true;
+    cerr << RED << "Failed to write the header of index " << path << RESET << endl;
+    return false;
+}
+
+bool createIndexFile(const string &path, const ColumnInfo &column)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = writeHeaderPage(fd, column, 0, 1, 0, true);
+    close(fd);
+    return ok;
+}
+
+uint64_t BTreeIndex::allocatePage()
+{
+    return pageCount++;
+}
+
+bool BTreeIndex::keyOf(const Value &value, char *key) const
+{
+    if (value.type != column.type)
+        return false;
+    switch (value.type)
+    {
+    case TYPE_INT:
+        intKey(value.i, key);
+        return true;
+    case TYPE_FLOAT:
+        floatKey(value.f, key);
+        return true;
+    case TYPE_DATE:
+        intKey(value.d, key);
+        return true;
+    case TYPE_STRING:
+        stringKey(value.s, key);
+        return true;
+    }
+    return false;
+}
+
+// The header is marked dirty on disk before the first change after a checkpoint, so a
+// crash part way through the changes is noticed when the index is next opened
+bool BTreeIndex::markDirty()
+{
+    if (!clean)
+        return true;
+    clean = false;
+    return writeHeader();
+}
+
+// Inserts a slot (an entry, followed in an internal node by its child page) into a
+// node. A full node is split with a new right sibling, whose page and separator entry
+// are returned for the parent; appends along the right edge leave the left node full,
+// so ascending inserts pack the tree as tightly as a bulk build does.
+bool BTreeIndex::insertSlot(uint64_t pageNo, bool rightEdge, const char *slot, char *separator, uint64_t &sibling)
+{
+    sibling = 0;
+    PinnedPage node(fd, pageNo);
+    if (!node.data)
+        return false;
+    bool leaf = isLeaf(node.data);
+    size_t width = leaf ? entrySize() : entrySize() + sizeof(uint64_t);
+    size_t n = nodeCount(node.data);
+    char *slots = node.data + NODE_HEADER;
+    size_t pos = searchSlots(slots, n, width, slot, entrySize(), true);
+    node.dirty = true;
+    if (n < (PAGE_SIZE - NODE_HEADER) / width)
+    {
+        memmove(slots + (pos + 1) * width, slots + pos * width, (n - pos) * width);
+        memcpy(slots + pos * width, slot, width);
+        initNode(node.data, leaf, n + 1, nodeLink(node.data));
+        return true;
+    }
+
+    string all(slots, n * width);
+    all.insert(pos * width, slot, width);
+    size_t keep = rightEdge && pos == n ? n : (n + 1) / 2;
+    sibling = allocatePage();
+    PinnedPage right(fd, sibling);
+    if (!right.data)
+        return false;
+    right.dirty = true;
+    const char *moved = all.data() + keep * width;
+    memcpy(separator, moved, entrySize());
+    if (leaf)
+    {
+        initNode(right.data, true, n + 1 - keep, nodeLink(node.data));
+        memcpy(right.data + NODE_HEADER, moved, (n + 1 - keep) * width);
+        initNode(node.data, true, keep, sibling);
+    }
+    else
+    {
+        // The middle slot moves up: its entry separates the nodes, its child leads the right one
+        initNode(right.data, false, n - keep, loadPage(moved + entrySize()));
+        memcpy(right.data + NODE_HEADER, moved + width, (n - keep) * width);
+        initNode(node.data, false, keep, nodeLink(node.data));
+    }
+    memcpy(slots, all.data(), keep * width);
+    return true;
+}
+
+bool BTreeIndex::insert(const char *key, uint64_t rowId)
+{
+    char entry[INDEX_KEY_MAX + sizeof(uint64_t)];
+    memcpy(entry, key, keyWidth);
+    storeBigEndian(rowId, entry + keyWidth);
+
+    if (root == 0)
+    {
+        root = allocatePage();
+        PinnedPage node(fd, root);
+        if (!node.data)
+            return false;
+        initNode(node.data, true, 1, 0);
+        memcpy(node.data + NODE_HEADER, entry, entrySize());
+        node.dirty = true;
+        return true;
+    }
+
+    // Descend to the leaf, remembering the path for splits
+    vector<pair<uint64_t, bool>> path; // internal node, on the right edge
+    uint64_t pageNo = root;
+    bool rightEdge = true;
+    while (true)
+    {
+        PinnedPage node(fd, pageNo);
+        if (!node.data)
+            return false;
+        if (isLeaf(node.data))
+            break;
+        path.push_back({pageNo, rightEdge});
+        size_t n = nodeCount(node.data), width = entrySize() + sizeof(uint64_t);
+        const char *slots = node.data + NODE_HEADER;
+        size_t i = searchSlots(slots, n, width, entry, entrySize(), true);
+        rightEdge = rightEdge && i == n;
+        pageNo = i == 0 ? nodeLink(node.data) : loadPage(slots + (i - 1) * width + entrySize());
+    }
+
+    char slot[INDEX_KEY_MAX + 2 * sizeof(uint64_t)];
+    uint64_t sibling;
+    if (!insertSlot(pageNo, rightEdge, entry, slot, sibling))
+        return false;
+    while (sibling != 0)
+    {
+        memcpy(slot + entrySize(), &sibling, sizeof(sibling));
+        if (path.empty())
+        {
+            // The root split: the tree grows a level
+            uint64_t oldRoot = root;
+            root = allocatePage();
+            PinnedPage node(fd, root);
+            if (!node.data)
+                return false;
+            initNode(node.data, false, 1, oldRoot);
+            memcpy(node.data + NODE_HEADER, slot, entrySize() + sizeof(uint64_t));
+            node.dirty = true;
+            break;
+        }
+        auto [parent, parentEdge] = path.back();
+        path.pop_back();
+        if (!insertSlot(parent, parentEdge, slot, slot, sibling))
+            return false;
+    }
+    return true;
+}
+
+// Adds an entry to a buffer being collected for build()
+void BTreeIndex::addEntry(string &entries, const char *key, uint64_t rowId) const
+{
+    char id[sizeof(uint64_t)];
+    storeBigEndian(rowId, id);
+    entries.append(key, keyWidth);
+    entries.append(id, sizeof(id));
+}
+
+// Sorts fixed-size entries in place, as byte strings
+template <size_t N>
+static void sortEntries(string &entries)
+{
+    struct Entry
+    {
+        char bytes[N];
+    };
+    vector<Entry> sorted(entries.size() / N);
+    memcpy(sorted.data(), entries.data(), sorted.size() * N);
+    sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) { return memcmp(a.bytes, b.bytes, N) < 0; });
+    memcpy(entries.data(), sorted.data(), sorted.size() * N);
+}
+
+// Replaces the tree with one built bottom-up from unsorted entries: full leaves
+// first, then each level of internal nodes over the one below, on consecutive pages
+bool BTreeIndex::build(string &entries, uint64_t rows)
+{
+    if (!reset())
+        return false;
+    size_t e = entrySize();
+    if (e == 16)
+        sortEntries<16>(entries);
+    else
+        sortEntries<INDEX_KEY_MAX + sizeof(uint64_t)>(entries);
+
+    size_t n = entries.size() / e, leafCapacity = (PAGE_SIZE - NODE_HEADER) / e;
+    vector<pair<const char *, uint64_t>> level; // first entry and page of each node
+    for (size_t first = 0; first < n; first += leafCapacity)
+    {
+        size_t count = min(leafCapacity, n - first);
+        uint64_t pageNo = allocatePage();
+        PinnedPage node(fd, pageNo);
+        if (!node.data)
+            return false;
+        initNode(node.data, true, count, first + count < n ? pageNo + 1 : 0);
+        memcpy(node.data + NODE_HEADER, entries.data() + first * e, count * e);
+        node.dirty = true;
+        level.push_back({entries.data() + first * e, pageNo});
+    }
+
+    size_t width = e + sizeof(uint64_t), fanout = (PAGE_SIZE - NODE_HEADER) / width + 1;
+    while (level.size() > 1)
+    {
+        vector<pair<const char *, uint64_t>> parents;
+        for (size_t first = 0; first < level.size(); first += fanout)
+        {
+            size_t count = min(fanout, level.size() - first);
+            uint64_t pageNo = allocatePage();
+            PinnedPage node(fd, pageNo);
+            if (!node.data)
+                return false;
+            initNode(node.data, false, count - 1, level[first].second);
+            for (size_t i = 1; i < count; i++)
+            {
+                char *slot = node.data + NODE_HEADER + (i - 1) * width;
+                memcpy(slot, level[first + i].first, e);
+                memcpy(slot + e, &level[first + i].second, sizeof(uint64_t));
+            }
+            node.dirty = true;
+            parents.push_back({level[first].first, pageNo});
+        }
+        level = move(parents);
+    }
+    root = level.empty() ? 0 : level[0].second;
+    indexed = rows;
+    return true;
+}
+
+// Empties the tree; it stays dirty until the next checkpoint
+bool BTreeIndex::reset()
+{
+    if (!markDirty())
+        return false;
+    bufferPool().dropFile(fd);
+    if (ftruncate(fd, PAGE_SIZE) != 0)
+        return false;
+    root = 0;
+    pageCount = 1;
+    indexed = 0;
+    return true;
+}
+
+// Appends the row IDs of the entries in range, in key order. Gives up, returning false,
+// once more than limit match. Entries compare as key then row ID, so a bound followed
+// by row ID all zeros sorts before every entry of its key and all ones after them;
+// STRING prefixes cannot tell a strict bound from its neighbours and keep them all.
+bool BTreeIndex::lookup(const IndexRange &range, uint64_t limit, vector<uint64_t> &rowIds)
+{
+    if (root == 0)
+        return true;
+    size_t e = entrySize();
+    bool lossy = column.type == TYPE_STRING;
+    char low[INDEX_KEY_MAX + sizeof(uint64_t)], high[INDEX_KEY_MAX + sizeof(uint64_t)];
+    memcpy(low, range.low, keyWidth);
+    memset(low + keyWidth, range.lowInclusive || lossy ? 0 : 0xFF, sizeof(uint64_t));
+    memcpy(high, range.high, keyWidth);
+    memset(high + keyWidth, range.highInclusive || lossy ? 0xFF : 0, sizeof(uint64_t));
+
+    uint64_t pageNo = root;
+    bool seeking = range.hasLow;
+    while (pageNo != 0)
+    {
+        PinnedPage node(fd, pageNo);
+        if (!node.data)
+            return false;
+        pagesRead++;
+        size_t n = nodeCount(node.data);
+        const char *slots = node.data + NODE_HEADER;
+        if (!isLeaf(node.data))
+        {
+            size_t width = e + sizeof(uint64_t);
+            size_t i = seeking ? searchSlots(slots, n, width, low, e, true) : 0;
+            pageNo = i == 0 ? nodeLink(node.data) : loadPage(slots + (i - 1) * width + e);
+            continue;
+        }
+        size_t i = seeking ? searchSlots(slots, n, e, low, e, false) : 0;
+        seeking = false;
+        for (; i < n; i++)
+        {
+            const char *entry = slots + i * e;
+            if (range.hasHigh && memcmp(entry, high, e) >= 0)
+                return true;
+            if (rowIds.size() >= limit)
+                return false;
+            rowIds.push_back(loadBigEndian(entry + keyWidth));
+        }
+        pageNo = nodeLink(node.data);
+    }
+    return true;
+}
+
+// Makes the tree as of rows table rows durable: pages first, then the clean header
+bool BTreeIndex::checkpoint(uint64_t rows)
+{
+    if (clean && indexed == rows)
+        return true;
+    if (!bufferPool().flushFile(fd) || fdatasync(fd) != 0)
+    {
+        cerr << RED << "Failed to flush index " << path << RESET << endl;
+        return false;
+    }
+    clean = true;
+    indexed = rows;
+    return writeHeader();
+}
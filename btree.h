@@ -0,0 +1,84 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "storage.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// On-disk layout of a secondary index, <table dir>/<index>.idx:
+//   page 0      header: magic, format version, key type and width, root page, page
+//               count, rows indexed at the last checkpoint, clean flag, column name
+//   page 1..    B+tree nodes: 16 byte node header (leaf flag, entry count, and the
+//               next leaf, or an internal node's leftmost child), then entries
+// An entry is the key followed by the row ID, both big-endian, so entries compare
+// with memcmp and are unique even where keys repeat. Internal entries carry the
+// page of the child holding entries from that entry up. Node pages go through the
+// buffer pool; the header is written directly, and only by the index itself.
+// NULLs are not indexed. STRING keys are prefixes, so callers recheck matches.
+
+const uint32_t INDEX_MAGIC = 0x58444942; // "BIDX"
+const uint32_t INDEX_VERSION = 1;
+const size_t INDEX_KEY_MAX = 24; // STRING prefix bytes
+
+size_t indexKeyWidth(int type); // 0 for types that cannot be indexed
+void intKey(int64_t value, char *key); // INT and DATE
+void floatKey(double value, char *key);
+void stringKey(string_view value, char *key);
+
+// Bounds of an index range scan; a missing bound is open
+struct IndexRange
+{
+    bool hasLow = false, hasHigh = false;
+    bool lowInclusive = true, highInclusive = true;
+    char low[INDEX_KEY_MAX] = {}, high[INDEX_KEY_MAX] = {};
+};
+
+class BTreeIndex
+{
+private:
+    string path;
+    int fd = -1;
+    ColumnInfo column;
+    size_t keyWidth = 0;
+    uint64_t root = 0; // 0 while empty
+    uint64_t pageCount = 1;
+    uint64_t indexed = 0;
+    bool clean = true;
+    uint64_t pagesRead = 0;
+
+    bool writeHeader();
+    uint64_t allocatePage();
+    bool insertSlot(uint64_t pageNo, bool rightEdge, const char *slot, char *separator, uint64_t &sibling);
+
+public:
+    explicit BTreeIndex(const string &path);
+    ~BTreeIndex();
+    BTreeIndex(const BTreeIndex &) = delete;
+    BTreeIndex &operator=(const BTreeIndex &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    const ColumnInfo &columnInfo() const { return column; }
+    size_t keySize() const { return keyWidth; }
+    size_t entrySize() const { return keyWidth + sizeof(uint64_t); }
+    uint64_t indexedRows() const { return indexed; }
+    bool isClean() const { return clean; }
+    uint64_t pageReads() const { return pagesRead; }
+
+    bool keyOf(const Value &value, char *key) const;
+    bool markDirty();
+    bool insert(const char *key, uint64_t rowId);
+    void addEntry(string &entries, const char *key, uint64_t rowId) const;
+    bool build(string &entries, uint64_t rows); // sorts entries in place
+    bool reset();
+    bool lookup(const IndexRange &range, uint64_t limit, vector<uint64_t> &rowIds);
+    bool checkpoint(uint64_t rows);
+    void close();
+};
+
+bool createIndexFile(const string &path, const ColumnInfo &column);
+
+#endif // BTREE_H
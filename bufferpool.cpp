@@ -0,0 +1,220 @@
+#include "bufferpool.h"
+#include "globals.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+using namespace std;
+
+BufferPool::BufferPool(size_t capacityPages)
+    : capacity(max(capacityPages, size_t(16))), arena(new char[max(capacityPages, size_t(16)) * PAGE_SIZE]),
+      frames(max(capacityPages, size_t(16)))
+{
+}
+
+bool BufferPool::writeBack(size_t index)
+{
+    Frame &frame = frames[index];
+    if (!frame.dirty)
+        return true;
+
+    const char *p = frameData(index);
+    size_t size = PAGE_SIZE;
+    uint64_t offset = frame.pageNo * PAGE_SIZE;
+    while (size > 0)
+    {
+        ssize_t n = pwrite(frame.fd, p, size, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            cerr << RED << "Buffer pool failed to write page " << frame.pageNo << ": " << strerror(errno) << RESET << endl;
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    frame.dirty = false;
+    auto it = dirtyFrames.find(frame.fd);
+    if (it != dirtyFrames.end())
+    {
+        it->second.erase(index);
+        if (it->second.empty())
+            dirtyFrames.erase(it);
+    }
+    return true;
+}
+
+// CLOCK: give every referenced frame a second chance, skip pinned frames
+bool BufferPool::findVictim(size_t &index)
+{
+    if (used < capacity)
+    {
+        index = used++;
+        return true;
+    }
+
+    for (size_t scanned = 0; scanned < 2 * capacity; scanned++)
+    {
+        Frame &frame = frames[clockHand];
+        size_t current = clockHand;
+        clockHand = (clockHand + 1) % capacity;
+        if (frame.pinCount > 0)
+            continue;
+        if (frame.referenced)
+        {
+            frame.referenced = false;
+            continue;
+        }
+        if (!writeBack(current))
+            return false;
+        pageTable.erase(key(frame.fd, frame.pageNo));
+        frame.fd = -1;
+        index = current;
+        return true;
+    }
+    cerr << RED << "Buffer pool exhausted: all " << capacity << " pages are pinned" << RESET << endl;
+    return false;
+}
+
+char *BufferPool::pin(int fd, uint64_t pageNo)
+{
+    lock_guard<recursive_mutex> lock(mtx);
+    auto it = pageTable.find(key(fd, pageNo));
+    if (it != pageTable.end())
+    {
+        Frame &frame = frames[it->second];
+        frame.pinCount++;
+        frame.referenced = true;
+        return frameData(it->second);
+    }
+
+    size_t index;
+    if (!findVictim(index))
+        return nullptr;
+
+    // Pages past the end of the file read as zeros; a failed read leaves the frame free
+    char *data = frameData(index);
+    size_t filled = 0;
+    while (filled < PAGE_SIZE)
+    {
+        ssize_t n = pread(fd, data + filled, PAGE_SIZE - filled, pageNo * PAGE_SIZE + filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            cerr << RED << "Buffer pool failed to read page " << pageNo << ": " << strerror(errno) << RESET << endl;
+            frames[index] = Frame();
+            return nullptr;
+        }
+        if (n == 0)
+            break;
+        filled += n;
+    }
+    memset(data + filled, 0, PAGE_SIZE - filled);
+
+    Frame &frame = frames[index];
+    frame.fd = fd;
+    frame.pageNo = pageNo;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frame.referenced = true;
+    pageTable[key(fd, pageNo)] = index;
+    return data;
+}
+
+void BufferPool::unpin(int fd, uint64_t pageNo, bool dirty)
+{
+    lock_guard<recursive_mutex> lock(mtx);
+    auto it = pageTable.find(key(fd, pageNo));
+    if (it == pageTable.end())
+        return;
+    Frame &frame = frames[it->second];
+    if (frame.pinCount > 0)
+        frame.pinCount--;
+    if (dirty && !frame.dirty)
+    {
+        frame.dirty = true;
+        dirtyFrames[fd].insert(it->second);
+    }
+}
+
+bool BufferPool::read(int fd, void *data, size_t size, uint64_t offset)
+{
+    char *out = static_cast<char *>(data);
+    while (size > 0)
+    {
+        uint64_t pageNo = offset / PAGE_SIZE;
+        size_t inPage = offset % PAGE_SIZE;
+        size_t chunk = min(size, PAGE_SIZE - inPage);
+        char *page = pin(fd, pageNo);
+        if (!page)
+            return false;
+        memcpy(out, page + inPage, chunk);
+        unpin(fd, pageNo, false);
+        out += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool BufferPool::write(int fd, const void *data, size_t size, uint64_t offset)
+{
+    const char *in = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        uint64_t pageNo = offset / PAGE_SIZE;
+        size_t inPage = offset % PAGE_SIZE;
+        size_t chunk = min(size, PAGE_SIZE - inPage);
+        char *page = pin(fd, pageNo);
+        if (!page)
+            return false;
+        memcpy(page + inPage, in, chunk);
+        unpin(fd, pageNo, true);
+        in += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool BufferPool::flushFile(int fd)
+{
+    lock_guard<recursive_mutex> lock(mtx);
+    auto it = dirtyFrames.find(fd);
+    if (it == dirtyFrames.end())
+        return true;
+
+    // Write in page order so the file is extended sequentially
+    vector<size_t> pending(it->second.begin(), it->second.end());
+    sort(pending.begin(), pending.end(), [&](size_t a, size_t b) { return frames[a].pageNo < frames[b].pageNo; });
+    for (size_t index : pending)
+    {
+        if (!writeBack(index))
+            return false;
+    }
+    return true;
+}
+
+void BufferPool::dropFile(int fd)
+{
+    lock_guard<recursive_mutex> lock(mtx);
+    for (size_t i = 0; i < used; i++)
+    {
+        Frame &frame = frames[i];
+        if (frame.fd != fd)
+            continue;
+        pageTable.erase(key(frame.fd, frame.pageNo));
+        frame = Frame();
+    }
+    dirtyFrames.erase(fd);
+}
+
+BufferPool &bufferPool()
+{
+    static BufferPool pool(bufferPoolBytes / PAGE_SIZE);
+    return pool;
+}
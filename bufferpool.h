@@ -0,0 +1,84 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+const size_t PAGE_SIZE = 4096;
+
+// Shared cache of fixed-size file pages. A page is identified by (file descriptor,
+// page number); page N covers bytes [N * PAGE_SIZE, (N + 1) * PAGE_SIZE) of the file.
+// Victims are chosen with the CLOCK algorithm and dirty victims are written back first.
+class BufferPool
+{
+private:
+    struct Frame
+    {
+        int fd = -1;
+        uint64_t pageNo = 0;
+        int pinCount = 0;
+        bool dirty = false;
+        bool referenced = false;
+    };
+
+    size_t capacity;
+    unique_ptr<char[]> arena;
+    vector<Frame> frames;
+    unordered_map<uint64_t, size_t> pageTable;        // page key -> frame index
+    unordered_map<int, unordered_set<size_t>> dirtyFrames; // fd -> dirty frame indexes
+    size_t clockHand = 0;
+    size_t used = 0;
+    recursive_mutex mtx;
+
+    static uint64_t key(int fd, uint64_t pageNo) { return (static_cast<uint64_t>(fd) << 40) | pageNo; }
+    char *frameData(size_t index) { return arena.get() + index * PAGE_SIZE; }
+    bool writeBack(size_t index);
+    bool findVictim(size_t &index);
+
+public:
+    explicit BufferPool(size_t capacityPages);
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    char *pin(int fd, uint64_t pageNo);
+    void unpin(int fd, uint64_t pageNo, bool dirty);
+
+    bool read(int fd, void *data, size_t size, uint64_t offset);
+    bool write(int fd, const void *data, size_t size, uint64_t offset);
+
+    bool flushFile(int fd);
+    void dropFile(int fd);
+};
+
+BufferPool &bufferPool();
+
+// A page pinned in the shared pool while the object lives; data is null if it could
+// not be read. Set dirty once the page is changed.
+class PinnedPage
+{
+private:
+    int fd;
+    uint64_t pageNo;
+
+public:
+    char *data;
+    bool dirty = false;
+
+    PinnedPage(int fd, uint64_t pageNo) : fd(fd), pageNo(pageNo), data(bufferPool().pin(fd, pageNo)) {}
+    ~PinnedPage()
+    {
+        if (data)
+            bufferPool().unpin(fd, pageNo, dirty);
+    }
+    PinnedPage(const PinnedPage &) = delete;
+    PinnedPage &operator=(const PinnedPage &) = delete;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,261 @@
+#include "table.h"
+#include "storage.h"
+#include "globals.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// Input is split into chunks of roughly this size, cut at line boundaries
+static const size_t COPY_CHUNK_BYTES = 4 << 20;
+static const size_t COPY_REJECTS_SHOWN = 10;
+
+struct CopyChunk
+{
+    uint64_t start = 0, end = 0;
+};
+
+struct CopyChunkResult
+{
+    EncodedBatch batch;
+    size_t lines = 0;
+    vector<pair<size_t, string>> rejected; // line within the chunk, reason
+    bool readFailed = false;
+};
+
+// A field that is empty or NULL and was not quoted is a NULL
+static ParamValue csvField(string &field, bool wasQuoted)
+{
+    if (!wasQuoted && (field.empty() || field == "NULL"))
+        return ParamValue::null();
+    ParamValue value(move(field));
+    value.quoted = wasQuoted;
+    return value;
+}
+
+// Splits one CSV record. Double quotes may enclose separators ("" is a literal quote).
+static vector<ParamValue> splitCsvLine(const char *p, size_t n)
+{
+    vector<ParamValue> fields;
+    string field;
+    bool quoted = false, wasQuoted = false;
+    for (size_t i = 0; i < n; i++)
+    {
+        char c = p[i];
+        if (quoted)
+        {
+            if (c == '"' && i + 1 < n && p[i + 1] == '"')
+            {
+                field += '"';
+                i++;
+            }
+            else if (c == '"')
+            {
+                quoted = false;
+            }
+            else
+            {
+                field += c;
+            }
+        }
+        else if (c == '"')
+        {
+            quoted = wasQuoted = true;
+        }
+        else if (c == ',')
+        {
+            fields.push_back(csvField(field, wasQuoted));
+            field.clear();
+            wasQuoted = false;
+        }
+        else
+        {
+            field += c;
+        }
+    }
+    fields.push_back(csvField(field, wasQuoted));
+    return fields;
+}
+
+static CopyChunkResult parseChunk(int fd, CopyChunk chunk, const TableStorage &storage)
+{
+    CopyChunkResult result;
+    string data(chunk.end - chunk.start, '\0');
+    size_t filled = 0;
+    while (filled < data.size())
+    {
+        ssize_t n = pread(fd, &data[filled], data.size() - filled, chunk.start + filled);
+        if (n <= 0)
+        {
+            result.readFailed = true;
+            return result;
+        }
+        filled += n;
+    }
+
+    vector<ColumnInfo> schema;
+    for (const auto &file : storage.columnFiles())
+        schema.push_back(file.info);
+    vector<Row> rows;
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        size_t newline = data.find('\n', pos);
+        size_t lineEnd = newline == string::npos ? data.size() : newline;
+        size_t length = lineEnd - pos;
+        if (length > 0 && data[pos + length - 1] == '\r')
+            length--;
+        size_t line = result.lines++;
+
+        if (length > 0)
+        {
+            // Same type rules as Table::insert
+            Row row;
+            string error;
+            vector<ParamValue> fields = splitCsvLine(data.data() + pos, length);
+            if (fields.size() != schema.size())
+                result.rejected.push_back({line, "expected " + to_string(schema.size()) + " fields, got " + to_string(fields.size())});
+            else if (!parseRow(schema, fields, row, error))
+                result.rejected.push_back({line, error});
+            else
+                rows.push_back(move(row));
+        }
+        pos = lineEnd + 1;
+    }
+
+    storage.encodeRows(rows, result.batch);
+    return result;
+}
+
+// Offset just past the first newline at or after pos, or size if there is none
+static uint64_t nextLineStart(int fd, uint64_t pos, uint64_t size)
+{
+    char buf[4096];
+    while (pos < size)
+    {
+        ssize_t n = pread(fd, buf, sizeof(buf), pos);
+        if (n <= 0)
+            return size;
+        const char *newline = static_cast<const char *>(memchr(buf, '\n', n));
+        if (newline)
+            return pos + (newline - buf) + 1;
+        pos += n;
+    }
+    return size;
+}
+
+// Cuts [start, size) into chunks that each end just after a newline
+static vector<CopyChunk> planChunks(int fd, uint64_t start, uint64_t size)
+{
+    vector<CopyChunk> chunks;
+    while (start < size)
+    {
+        uint64_t end = start + COPY_CHUNK_BYTES >= size ? size : nextLineStart(fd, start + COPY_CHUNK_BYTES, size);
+        chunks.push_back({start, end});
+        start = end;
+    }
+    return chunks;
+}
+
+void copyFrom(Database &db, const string &tableName, const string &path, bool header)
+{
+    Table table = selectTable(db, tableName);
+    if (table.getName().empty())
+    {
+        return;
+    }
+    TableStorage *storage = table.openStorage();
+    if (!storage)
+    {
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        cerr << RED << "Failed to open " << path << ": " << strerror(errno) << RESET << endl;
+        return;
+    }
+    uint64_t size = lseek(fd, 0, SEEK_END);
+
+    auto started = chrono::steady_clock::now();
+
+    vector<CopyChunk> chunks = planChunks(fd, header ? nextLineStart(fd, 0, size) : 0, size);
+
+    if (!storage->beginBulkLoad())
+    {
+        cerr << RED << "Failed to prepare table " << tableName << " for bulk load" << RESET << endl;
+        close(fd);
+        return;
+    }
+
+    // Chunks are parsed in parallel and appended strictly in input order; a bounded
+    // window of chunks in flight keeps memory flat for large files.
+    ThreadPool pool;
+    size_t window = pool.size() * 2;
+    vector<future<CopyChunkResult>> pending(chunks.size());
+    size_t submitted = 0;
+    auto submitNext = [&]()
+    {
+        auto task = make_shared<packaged_task<CopyChunkResult()>>(
+            [fd, chunk = chunks[submitted], storage]() { return parseChunk(fd, chunk, *storage); });
+        pending[submitted++] = task->get_future();
+        pool.submit([task]() { (*task)(); });
+    };
+
+    uint64_t loaded = 0, lineBase = header ? 1 : 0;
+    vector<pair<uint64_t, string>> rejected;
+    bool ok = true;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        while (submitted < chunks.size() && submitted < i + window)
+            submitNext();
+
+        CopyChunkResult result = pending[i].get();
+        if (ok && result.readFailed)
+        {
+            cerr << RED << "Failed to read " << path << RESET << endl;
+            ok = false;
+        }
+        if (ok && !storage->bulkAppend(result.batch))
+            ok = false;
+        if (!ok)
+        {
+            // Tasks already handed to the pool still read from fd
+            for (size_t j = i + 1; j < submitted; j++)
+                pending[j].wait();
+            break;
+        }
+
+        loaded += result.batch.rows;
+        for (auto &reject : result.rejected)
+            rejected.push_back({lineBase + reject.first + 1, move(reject.second)});
+        lineBase += result.lines;
+    }
+    close(fd);
+
+    if (!ok || !storage->endBulkLoad())
+    {
+        storage->abortBulkLoad();
+        cerr << RED << "COPY into " << tableName << " failed; no rows were loaded." << RESET << endl;
+        return;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout << GREEN << "Loaded " << loaded << " rows into " << tableName << " in " << seconds << "s ("
+         << static_cast<uint64_t>(seconds > 0 ? loaded / seconds : loaded) << " rows/sec)." << RESET << endl;
+    if (!rejected.empty())
+    {
+        cerr << ORANGE << "Rejected " << rejected.size() << " line(s):" << RESET << endl;
+        for (size_t i = 0; i < rejected.size() && i < COPY_REJECTS_SHOWN; i++)
+            cerr << ORANGE << "  line " << rejected[i].first << ": " << rejected[i].second << RESET << endl;
+        if (rejected.size() > COPY_REJECTS_SHOWN)
+            cerr << ORANGE << "  ... and " << rejected.size() - COPY_REJECTS_SHOWN << " more" << RESET << endl;
+    }
+}
@@ -0,0 +1,437 @@
+#include "catalog.h"
+#include "globals.h"
+#include "wal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+static void putU32(string &out, uint32_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+static void putU64(string &out, uint64_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+
+static void putString(string &out, const string &v)
+{
+    putU32(out, v.size());
+    out += v;
+}
+
+// Bounds-checked cursor over a catalog image
+struct CatalogReader
+{
+    const string &data;
+    size_t pos = 0;
+    bool ok = true;
+
+    template <typename T>
+    T get()
+    {
+        T v{};
+        if (pos + sizeof(T) > data.size())
+        {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    string getString()
+    {
+        uint32_t length = get<uint32_t>();
+        if (!ok || pos + length > data.size())
+        {
+            ok = false;
+            return "";
+        }
+        pos += length;
+        return data.substr(pos - length, length);
+    }
+};
+
+static string beginImage(uint32_t count)
+{
+    string out;
+    putU32(out, CATALOG_MAGIC);
+    putU32(out, CATALOG_VERSION);
+    putU32(out, count);
+    return out;
+}
+
+// Replaces path with image: written to a temporary, synced, renamed, then the directory synced
+static bool writeImage(const string &path, string image)
+{
+    putU32(image, crc32(image.data(), image.size()));
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    const char *p = image.data();
+    size_t left = image.size();
+    bool ok = true;
+    while (ok && left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        ok = n > 0;
+        p += ok ? n : 0;
+        left -= ok ? n : 0;
+    }
+    ok = ok && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    int dirFd = open(filesystem::path(path).parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
+
+// Reads and verifies a catalog file; returns false if it is missing or damaged
+static bool readImage(const string &path, string &image, uint32_t &count)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+    image.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    if (image.size() < 16)
+        return false;
+    uint32_t stored;
+    memcpy(&stored, image.data() + image.size() - 4, 4);
+    image.resize(image.size() - 4);
+    if (crc32(image.data(), image.size()) != stored)
+        return false;
+    CatalogReader in{image};
+    uint32_t magic = in.get<uint32_t>(), version = in.get<uint32_t>();
+    count = in.get<uint32_t>();
+    return magic == CATALOG_MAGIC && version == CATALOG_VERSION;
+}
+
+bool Catalog::open(const string &rootDir)
+{
+    root = rootDir;
+    databases.clear();
+    string path = root + "/catalog.bin";
+    if (!filesystem::exists(path))
+        return importLegacy();
+
+    string image;
+    uint32_t count;
+    if (!readImage(path, image, count))
+    {
+        cerr << RED << "Catalog " << path << " is damaged" << RESET << endl;
+        return false;
+    }
+    CatalogReader in{image, 12};
+    for (uint32_t i = 0; i < count && in.ok; i++)
+    {
+        string name = in.getString();
+        DatabaseEntry db;
+        db.created = in.getString();
+        db.seq = in.get<uint64_t>();
+        nextSeq = max(nextSeq, db.seq + 1);
+        databases[name] = move(db);
+    }
+    if (!in.ok)
+    {
+        cerr << RED << "Catalog " << path << " is damaged" << RESET << endl;
+        return false;
+    }
+    return true;
+}
+
+DatabaseEntry *Catalog::load(const string &dbName)
+{
+    auto it = databases.find(dbName);
+    if (it == databases.end())
+        return nullptr;
+    DatabaseEntry &db = it->second;
+    if (db.loaded)
+        return &db;
+
+    string path = root + "/" + dbName + "/catalog.bin";
+    string image;
+    uint32_t count = 0;
+    if (filesystem::exists(path) && !readImage(path, image, count))
+    {
+        cerr << RED << "Catalog " << path << " is damaged" << RESET << endl;
+        return nullptr;
+    }
+    CatalogReader in{image, 12};
+    for (uint32_t i = 0; i < count && in.ok; i++)
+    {
+        string name = in.getString();
+        TableEntry table;
+        table.created = in.getString();
+        table.seq = in.get<uint64_t>();
+        uint32_t columns = in.get<uint32_t>();
+        for (uint32_t c = 0; c < columns && in.ok; c++)
+        {
+            string column = in.getString();
+            table.schema.push_back({column, in.get<uint8_t>()});
+        }
+        db.nextSeq = max(db.nextSeq, table.seq + 1);
+        db.tables[name] = move(table);
+    }
+    if (!in.ok)
+    {
+        cerr << RED << "Catalog " << path << " is damaged" << RESET << endl;
+        db.tables.clear();
+        return nullptr;
+    }
+    db.loaded = true;
+    return &db;
+}
+
+bool Catalog::saveDatabases()
+{
+    string image = beginImage(databases.size());
+    for (const auto &entry : databases)
+    {
+        putString(image, entry.first);
+        putString(image, entry.second.created);
+        putU64(image, entry.second.seq);
+    }
+    if (!writeImage(root + "/catalog.bin", move(image)))
+    {
+        cerr << RED << "Failed to write " << root << "/catalog.bin" << RESET << endl;
+        return false;
+    }
+    return true;
+}
+
+bool Catalog::saveTables(const string &dbName, const DatabaseEntry &db)
+{
+    string image = beginImage(db.tables.size());
+    for (const auto &entry : db.tables)
+    {
+        putString(image, entry.first);
+        putString(image, entry.second.created);
+        putU64(image, entry.second.seq);
+        putU32(image, entry.second.schema.size());
+        for (const auto &col : entry.second.schema)
+        {
+            putString(image, col.name);
+            image += static_cast<char>(col.type);
+        }
+    }
+    string path = root + "/" + dbName + "/catalog.bin";
+    if (!writeImage(path, move(image)))
+    {
+        cerr << RED << "Failed to write " << path << RESET << endl;
+        return false;
+    }
+    return true;
+}
+
+static vector<pair<string, string>> readNameDateFile(const filesystem::path &path)
+{
+    vector<pair<string, string>> entries;
+    ifstream file(path);
+    string line;
+    getline(file, line); // header
+    while (getline(file, line))
+    {
+        stringstream ss(line);
+        string name, created;
+        getline(ss, name, ',');
+        getline(ss, created, ',');
+        if (!name.empty())
+            entries.push_back({name, created});
+    }
+    return entries;
+}
+
+static vector<ColumnInfo> readSchemaFile(const filesystem::path &tableDir)
+{
+    ifstream columnFile(tableDir / "columns.csv");
+    vector<ColumnInfo> schema;
+    string line, colName, dataType;
+    while (getline(columnFile, line))
+    {
+        stringstream ss(line);
+        getline(ss, colName, ',');
+        getline(ss, dataType, ',');
+        if (!colName.empty() && datatype.count(dataType))
+            schema.push_back({colName, datatype[dataType]});
+    }
+    return schema;
+}
+
+// Builds the catalog from the CSV files written by older versions
+// (information_schema.csv, <db>/tables.csv, <db>/<table>/columns.csv)
+bool Catalog::importLegacy()
+{
+    filesystem::path schemaFile = filesystem::path(root) / "information_schema.csv";
+    if (!filesystem::exists(schemaFile))
+        return saveDatabases();
+
+    for (const auto &dbRow : readNameDateFile(schemaFile))
+    {
+        filesystem::path dbDir = filesystem::path(root) / dbRow.first;
+        if (databases.count(dbRow.first) || !filesystem::is_directory(dbDir))
+            continue;
+        DatabaseEntry &db = databases[dbRow.first];
+        db.created = dbRow.second;
+        db.seq = nextSeq++;
+        db.loaded = true;
+        for (const auto &tableRow : readNameDateFile(dbDir / "tables.csv"))
+        {
+            if (db.tables.count(tableRow.first))
+                continue;
+            TableEntry &table = db.tables[tableRow.first];
+            table.created = tableRow.second;
+            table.seq = db.nextSeq++;
+            table.schema = readSchemaFile(dbDir / tableRow.first);
+        }
+        if (!saveTables(dbRow.first, db))
+            return false;
+    }
+    if (!saveDatabases())
+        return false;
+
+    for (const auto &entry : databases)
+    {
+        filesystem::path tables = filesystem::path(root) / entry.first / "tables.csv";
+        if (filesystem::exists(tables))
+            filesystem::rename(tables, tables.string() + ".bak");
+    }
+    filesystem::rename(schemaFile, schemaFile.string() + ".bak");
+    cout << GREEN << "Imported " << databases.size() << " database(s) into the catalog." << RESET << endl;
+    return true;
+}
+
+bool Catalog::addDatabase(const string &dbName)
+{
+    if (databases.count(dbName))
+        return false;
+    DatabaseEntry &db = databases[dbName];
+    db.created = currentDateTime();
+    db.seq = nextSeq++;
+    db.loaded = true;
+    if (!saveTables(dbName, db) || !saveDatabases())
+    {
+        databases.erase(dbName);
+        return false;
+    }
+    return true;
+}
+
+vector<pair<string, string>> Catalog::listDatabases() const
+{
+    vector<pair<uint64_t, const string *>> order;
+    for (const auto &entry : databases)
+        order.push_back({entry.second.seq, &entry.first});
+    sort(order.begin(), order.end());
+    vector<pair<string, string>> list;
+    for (const auto &item : order)
+        list.push_back({*item.second, databases.at(*item.second).created});
+    return list;
+}
+
+const vector<ColumnInfo> *Catalog::tableSchema(const string &dbName, const string &tableName)
+{
+    DatabaseEntry *db = load(dbName);
+    if (!db)
+        return nullptr;
+    auto it = db->tables.find(tableName);
+    return it == db->tables.end() ? nullptr : &it->second.schema;
+}
+
+vector<string> Catalog::listTables(const string &dbName)
+{
+    vector<string> list;
+    DatabaseEntry *db = load(dbName);
+    if (!db)
+        return list;
+    vector<pair<uint64_t, const string *>> order;
+    for (const auto &entry : db->tables)
+        order.push_back({entry.second.seq, &entry.first});
+    sort(order.begin(), order.end());
+    for (const auto &item : order)
+        list.push_back(*item.second);
+    return list;
+}
+
+uint64_t Catalog::version(const string &dbName)
+{
+    DatabaseEntry *db = load(dbName);
+    return db ? db->version : 0;
+}
+
+bool Catalog::addTable(const string &dbName, const string &tableName, const vector<ColumnInfo> &schema)
+{
+    DatabaseEntry *db = load(dbName);
+    if (!db || db->tables.count(tableName))
+        return false;
+    TableEntry &table = db->tables[tableName];
+    table.created = currentDateTime();
+    table.seq = db->nextSeq++;
+    table.schema = schema;
+    if (!saveTables(dbName, *db))
+    {
+        db->tables.erase(tableName);
+        return false;
+    }
+    db->version++;
+    return true;
+}
+
+bool Catalog::dropTable(const string &dbName, const string &tableName)
+{
+    DatabaseEntry *db = load(dbName);
+    if (!db)
+        return false;
+    auto node = db->tables.extract(tableName);
+    if (node.empty())
+        return false;
+    if (!saveTables(dbName, *db))
+    {
+        db->tables.insert(move(node));
+        return false;
+    }
+    db->version++;
+    return true;
+}
+
+bool Catalog::renameTable(const string &dbName, const string &oldName, const string &newName)
+{
+    DatabaseEntry *db = load(dbName);
+    if (!db || db->tables.count(newName))
+        return false;
+    auto node = db->tables.extract(oldName);
+    if (node.empty())
+        return false;
+    node.key() = newName;
+    node.mapped().created = currentDateTime();
+    node.mapped().seq = db->nextSeq++;
+    auto inserted = db->tables.insert(move(node));
+    if (!saveTables(dbName, *db))
+    {
+        auto back = db->tables.extract(inserted.position);
+        back.key() = oldName;
+        db->tables.insert(move(back));
+        return false;
+    }
+    db->version++;
+    return true;
+}
+
+Catalog &catalog()
+{
+    static Catalog instance;
+    return instance;
+}
@@ -0,0 +1,70 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "storage.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Catalog of databases and their tables, hashed in memory and persisted in binary:
+//   Databases/catalog.bin        databases: name, creation time
+//   Databases/<db>/catalog.bin   tables: name, creation time, schema
+// Both files share one layout: magic, version, entry count, entries, CRC-32 of all
+// preceding bytes. A change rewrites only the affected file, into a temporary that is
+// synced and then renamed over the old one, so a crash leaves either version intact.
+// A database's table file is loaded the first time the database is used.
+
+const uint32_t CATALOG_MAGIC = 0x54414344; // "DCAT"
+const uint32_t CATALOG_VERSION = 1;
+
+struct TableEntry
+{
+    string created;
+    uint64_t seq = 0; // creation order, for listings
+    vector<ColumnInfo> schema;
+};
+
+struct DatabaseEntry
+{
+    string created;
+    uint64_t seq = 0;
+    bool loaded = false;  // tables read from disk
+    uint64_t version = 0; // bumped by every change to the tables
+    uint64_t nextSeq = 0;
+    unordered_map<string, TableEntry> tables;
+};
+
+class Catalog
+{
+private:
+    string root;
+    unordered_map<string, DatabaseEntry> databases;
+    uint64_t nextSeq = 0;
+
+    DatabaseEntry *load(const string &dbName);
+    bool saveDatabases();
+    bool saveTables(const string &dbName, const DatabaseEntry &db);
+    bool importLegacy();
+
+public:
+    bool open(const string &rootDir);
+
+    bool databaseExists(const string &dbName) const { return databases.count(dbName) > 0; }
+    bool addDatabase(const string &dbName);
+    vector<pair<string, string>> listDatabases() const; // name, creation time
+
+    const vector<ColumnInfo> *tableSchema(const string &dbName, const string &tableName);
+    vector<string> listTables(const string &dbName);
+    uint64_t version(const string &dbName);
+    bool addTable(const string &dbName, const string &tableName, const vector<ColumnInfo> &schema);
+    bool dropTable(const string &dbName, const string &tableName);
+    bool renameTable(const string &dbName, const string &oldName, const string &newName);
+};
+
+Catalog &catalog();
+
+#endif // CATALOG_H
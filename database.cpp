@@ -1,5 +1,8 @@
 #include "database.h"
 #include "globals.h"
+#include "storage.h"
+#include "catalog.h"
+#include "sink.h"
 #include <ctime>
 #include <fstream>
 #include <sstream>
@@ -8,51 +11,86 @@
 #include <vector>
 #include <algorithm>
 #include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
 using namespace std;
 
+// Reads the environment variable name as a whole non-negative number; a value that is
+// not one is reported and ignored
+static bool readSizeSetting(const char *name, size_t &out)
+{
+    const char *text = getenv(name);
+    if (!text)
+        return false;
+    const char *end = text + strlen(text);
+    size_t value;
+    auto res = from_chars(text, end, value);
+    if (text == end || res.ec != errc() || res.ptr != end)
+    {
+        cerr << ORANGE << "Ignoring invalid " << name << ": " << text << RESET << endl;
+        return false;
+    }
+    out = value;
+    return true;
+}
+
 void initializeDatabaseSystem()
 {
     std::filesystem::path dbFolder = "Databases";
-    std::filesystem::path schemaFile = dbFolder / "information_schema.csv";
     std::filesystem::path baseDb = dbFolder / "baseDb";
 
-    if (!std::filesystem::exists(dbFolder))
-    {
-        std::filesystem::create_directory(dbFolder);
-    }
-    if (!std::filesystem::exists(schemaFile))
+    size_t setting;
+    if (readSizeSetting("DBMS_BUFFER_POOL_MB", setting))
+        bufferPoolBytes = setting * 1024 * 1024;
+    if (readSizeSetting("DBMS_WAL_GROUP_COMMIT_US", setting))
+        walGroupCommitMicros = static_cast<unsigned>(setting);
+    if (readSizeSetting("DBMS_JOIN_MEMORY_MB", setting))
+        joinMemoryBytes = setting * 1024 * 1024;
+    if (readSizeSetting("DBMS_GROUP_MEMORY_MB", setting))
+        groupMemoryBytes = setting * 1024 * 1024;
+    if (readSizeSetting("DBMS_SORT_MEMORY_MB", setting))
+        sortMemoryBytes = setting * 1024 * 1024;
+    if (readSizeSetting("DBMS_PLAN_CACHE_ENTRIES", setting))
+        planCacheEntries = setting;
+
+    if (const char *format = getenv("DBMS_OUTPUT_FORMAT"))
     {
-        ofstream schema(schemaFile);
-        if (schema.is_open())
+        if (!parseOutputFormat(format, outputFormat))
         {
-            schema << "database_name,date_created\n";
-            schema << "baseDb," << currentDateTime() << endl;
-            schema.close();
-            cout << GREEN << "Created information_schema.csv file." << RESET << endl;
-        }
-        else
-        {
-            cerr << RED << "Failed to create information_schema.csv file." << RESET << endl;
+            cerr << ORANGE << "Ignoring invalid DBMS_OUTPUT_FORMAT: " << format << RESET << endl;
         }
     }
-    if (!std::filesystem::exists(baseDb))
+
+    if (!std::filesystem::exists(dbFolder))
+    {
+        std::filesystem::create_directory(dbFolder);
+    }
+    if (!catalog().open(dbFolder.string()))
     {
-        std::filesystem::create_directory(baseDb);
+        throw runtime_error("Failed to open the database catalog");
     }
-    if (!std::filesystem::exists(baseDb / "tables.csv"))
+    if (!catalog().databaseExists("baseDb"))
     {
-        ofstream tables(baseDb / "tables.csv");
-        if (tables.is_open())
+        std::filesystem::create_directories(baseDb);
+        if (catalog().addDatabase("baseDb"))
         {
-            tables << "table_name,date_created\n";
-            tables.close();
-            cout << GREEN << "Created tables.csv file in baseDb." << RESET << endl;
+            cout << GREEN << "Created database baseDb." << RESET << endl;
         }
         else
         {
-            cerr << RED << "Failed to create tables.csv file." << RESET << endl;
+            cerr << RED << "Failed to create database baseDb." << RESET << endl;
         }
     }
+
+    // Tables written by older versions still keep their rows in data.csv
+    convertLegacyTables();
+    recoverDatabases();
+}
+
+void shutdownDatabaseSystem()
+{
+    checkpointAllDatabases();
 }
 
 Database::Database()
@@ -77,41 +115,22 @@ string Database::getName() const
 
 Database createDatabase(const string &dbName)
 {
-    ifstream file("./Databases/information_schema.csv");
-    if (!file.is_open())
-    {
-        cerr << RED << "Failed to open information_schema.csv" << RESET << endl;
-        throw runtime_error("Failed to open information_schema.csv");
-    }
-
-    string line;
-    while (getline(file, line))
+    if (catalog().databaseExists(dbName))
     {
-        stringstream ss(line);
-        string database_name, date_created;
-        getline(ss, database_name, ',');
-
-        if (database_name == dbName)
-        {
-            file.close();
-            cerr << ORANGE << "Database already exists" << RESET << endl;
-            throw runtime_error("Database already exists");
-        }
+        cerr << ORANGE << "Database already exists" << RESET << endl;
+        throw runtime_error("Database already exists");
     }
-    file.close();
 
     Database db(dbName);
 
     // Create new database directory
     filesystem::create_directories("./Databases/" + dbName);
 
-    ofstream infoFile("./Databases/information_schema.csv", ios::app);
-    infoFile << dbName << "," << currentDateTime() << endl;
-    infoFile.close();
-
-    ofstream tableFile("./Databases/" + dbName + "/tables.csv");
-    tableFile << "table_name,date_created" << endl;
-    tableFile.close();
+    if (!catalog().addDatabase(dbName))
+    {
+        cerr << RED << "Failed to register database " << dbName << RESET << endl;
+        return Database();
+    }
 
     cout << GREEN << "Database " << dbName << " created successfully." << RESET << endl;
 
@@ -120,70 +139,35 @@ Database createDatabase(const string &dbName)
 
 Database selectDatabase(const string &dbName)
 {
-    ifstream file("./Databases/information_schema.csv");
-    if (!file.is_open())
-    {
-        cerr << RED << "Failed to open information_schema.csv" << RESET << endl;
-        return Database();
-    }
-
-    string line;
-    bool databaseExists = false;
-
-    while (getline(file, line))
-    {
-        stringstream ss(line);
-        string database_name, date_created;
-        getline(ss, database_name, ',');
-
-        if (database_name == dbName)
-        {
-            databaseExists = true;
-            break;
-        }
-    }
-    file.close();
-
-    if (!databaseExists)
+    if (!catalog().databaseExists(dbName))
     {
         cerr << RED << "Database does not exist" << RESET << endl;
         return Database();
     }
 
-    Database db(dbName);
-
-    ifstream dbFile("./Databases/" + dbName + "/tables.csv");
-    if (!dbFile.is_open())
-    {
-        cerr << RED << "Failed to open " << dbName << "/tables.csv" << RESET << endl;
-        return Database();
-    }
-
-    while (getline(dbFile, line))
-    {
-        stringstream ss(line);
-        string table_name;
-        getline(ss, table_name, ',');
-        if (!table_name.empty() && table_name != "table_name")
-        {
-            db.addTable(table_name);
-        }
-    }
-    dbFile.close();
-
     cout << GREEN << "Database " << dbName << " selected successfully." << RESET << endl;
 
-    return db;
+    return Database(dbName);
 }
 
 bool Database::tableExists(const string &tableName)
 {
-    return find(tables.begin(), tables.end(), tableName) != tables.end();
+    return tableSchema(tableName) != nullptr;
 }
 
-void Database::addTable(const string &tableName)
+const vector<ColumnInfo> *Database::tableSchema(const string &tableName) const
 {
-    tables.push_back(tableName);
+    return catalog().tableSchema(name, tableName);
+}
+
+uint64_t Database::catalogVersion() const
+{
+    return catalog().version(name);
+}
+
+bool Database::addTable(const string &tableName, const vector<ColumnInfo> &schema)
+{
+    return catalog().addTable(name, tableName, schema);
 }
 
 bool Database::isValid() const
@@ -193,37 +177,20 @@ bool Database::isValid() const
 
 void displayDatabases()
 {
-    ifstream file("./Databases/information_schema.csv");
-    if (!file.is_open())
-    {
-        cerr << RED << "Failed to open information_schema.csv" << RESET << endl;
-        throw runtime_error("Failed to open information_schema.csv");
-    }
-
-    string line;
-    bool isFirstLine = true;
     cout << "+----------------------+---------------------+" << endl;
     cout << "| Database Name        | Date Created        |" << endl;
     cout << "+----------------------+---------------------+" << endl;
-    while (getline(file, line))
+    for (const auto &entry : catalog().listDatabases())
     {
-        if (isFirstLine)
-        {
-            isFirstLine = false;
-            continue;
-        }
-        stringstream ss(line);
-        string database_name, date_created;
-        getline(ss, database_name, ',');
-        getline(ss, date_created, ',');
-        cout << "| " << setw(20) << left << database_name << " | " << setw(19) << left << date_created << " |" << endl;
+        cout << "| " << setw(20) << left << entry.first << " | " << setw(19) << left << entry.second << " |" << endl;
     }
     cout << "+----------------------+---------------------+" << endl;
-    file.close();
 }
 
 void Database::displayTables() const
 {
+    vector<string> tables = catalog().listTables(name);
+
     // Calculate maximum width needed
     size_t maxWidth = max(string("Tables in " + name).size(), size_t(15)); // Minimum width of 15
     for (const auto &table : tables)
@@ -263,46 +230,19 @@ void Database::displayTables() const
     cout << "+" << string(maxWidth, '-') << "+" << endl;
 }
 
-void Database::drop(const string &tableName)
+bool Database::drop(const string &tableName)
 {
     if (!tableExists(tableName))
     {
         cerr << RED << "Table does not exist" << RESET << endl;
-        return;
-    }
-
-    tables.erase(remove(tables.begin(), tables.end(), tableName), tables.end());
-    // correct the tables.csv file
-    string tablesFile = "./Databases/" + name + "/tables.csv";
-    ifstream file(tablesFile);
-    if (!file.is_open())
-    {
-        cerr << RED << "Failed to open " << tablesFile << RESET << endl;
-        return;
-    }
-
-    string line;
-    ofstream tempFile("./Databases/" + name + "/temp.csv");
-    while (getline(file, line))
-    {
-        if (line.find(tableName) == string::npos)
-        {
-            tempFile << line << endl;
-        }
-    }
-    file.close();
-    tempFile.close();
-
-    if (remove(tablesFile.c_str()) != 0)
-    {
-        cerr << RED << "Failed to remove " << tablesFile << RESET << endl;
-        return;
+        return false;
     }
-    if (rename(("./Databases/" + name + "/temp.csv").c_str(), tablesFile.c_str()) != 0)
+    if (!catalog().dropTable(name, tableName))
     {
-        cerr << RED << "Failed to rename temp.csv to " << tablesFile << RESET << endl;
-        return;
+        cerr << RED << "Failed to remove " << tableName << " from the catalog" << RESET << endl;
+        return false;
     }
+    return true;
 }
 
 bool Database::renameTable(const string &oldName, const string &newName)
@@ -327,50 +267,17 @@ bool Database::renameTable(const string &oldName, const string &newName)
 
     string oldPath = "./Databases/" + name + "/" + oldName;
     string newPath = "./Databases/" + name + "/" + newName;
-    if (rename(oldPath.c_str(), newPath.c_str()) == 0)
+    if (rename(oldPath.c_str(), newPath.c_str()) != 0)
     {
-        tables.erase(remove(tables.begin(), tables.end(), oldName), tables.end());
-        tables.push_back(newName);
-        //fix the tables.csv file
-        string tablesFile = "./Databases/" + name + "/tables.csv";
-        ifstream file(tablesFile);
-        if (!file.is_open())
-        {
-            cerr << RED << "Failed to open " << tablesFile << RESET << endl;
-            return false;
-        }
-
-        string line;
-        ofstream tempFile("./Databases/" + name + "/temp.csv");
-        while (getline(file, line))
-        {
-            if (line.find(oldName) == string::npos)
-            {
-                tempFile << line << endl;
-            }
-            else
-            {
-                tempFile << newName << "," << currentDateTime() << endl;
-            }
-        }
-        file.close();
-        tempFile.close();
-
-        if (remove(tablesFile.c_str()) != 0)
-        {
-            cerr << RED << "Failed to remove " << tablesFile << RESET << endl;
-            return false;
-        }
-        if (rename(("./Databases/" + name + "/temp.csv").c_str(), tablesFile.c_str()) != 0)
-        {
-            cerr << RED << "Failed to rename temp.csv to " << tablesFile << RESET << endl;
-            return false;
-        }
-        return true;
+        cerr << RED << "Failed to rename table " << oldName << " to " << newName << RESET << endl;
+        return false;
     }
-    else
+    if (!catalog().renameTable(name, oldName, newName))
     {
-        cerr << RED << "Failed to rename table " << oldName << " to " << newName << RESET << endl;
+        // Keep the directory where the catalog says the table is
+        rename(newPath.c_str(), oldPath.c_str());
+        cerr << RED << "Failed to rename " << oldName << " in the catalog" << RESET << endl;
         return false;
     }
-}
\ No newline at end of file
+    return true;
+}
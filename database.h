@@ -10,6 +10,7 @@
 #include <filesystem>
 #include <string>
 #include <ctime> // For currentDateTime()
+#include "storage.h"
 
 using namespace std;
 namespace fs = filesystem;
@@ -18,7 +19,6 @@ class Database
 {
 private:
     string name; // Database name
-    vector<string> tables; // List of tables
 public:
     Database();
     Database(string dbName);
@@ -27,8 +27,11 @@ public:
     string getName() const;
     void displayTables() const;
     
-    void addTable(const string &tableName);
-    void drop(const string &tableName);
+    const vector<ColumnInfo> *tableSchema(const string &tableName) const;
+    uint64_t catalogVersion() const;
+
+    bool addTable(const string &tableName, const vector<ColumnInfo> &schema);
+    bool drop(const string &tableName);
     bool renameTable(const string &oldName, const string &newName);
 };
 
@@ -36,4 +39,5 @@ Database selectDatabase(const string &dbName);
 Database createDatabase(const string &dbName);
 void displayDatabases();
 void initializeDatabaseSystem();
+void shutdownDatabaseSystem();
 #endif // DATABASE_H
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "exec.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+using namespace std;
+
+bool ProfileOperator::next(Batch &batch)
+{
+    auto start = chrono::steady_clock::now();
+    bool more = inner->next(batch);
+    elapsed += chrono::steady_clock::now() - start;
+    if (more)
+        rowsOut += batch.selected;
+    return more;
+}
+
+bool ScanOperator::next(Batch &batch)
+{
+    return scan.nextBatch(batch);
+}
+
+string ScanOperator::describe() const
+{
+    if (!scan.scansRowIds())
+    {
+        string text = "Scan " + table + " (" + countOf(scan.columnCount(), "column") + ", " + countOf(scan.rowCount(), "row");
+        if (scan.skippedZones() > 0)
+            text += ", " + to_string(scan.skippedZones()) + " of " + countOf(scan.zoneCount(), "block") + " skipped";
+        return text + ")";
+    }
+    return "Index scan " + table + " using " + index + " (" + countOf(scan.columnCount(), "column") + ", " +
+           to_string(scan.rowIdCount()) + " of " + countOf(scan.rowCount(), "row") + ", " +
+           countOf(indexPages, "index page") + ")";
+}
+
+bool FilterOperator::next(Batch &batch)
+{
+    while (input->next(batch))
+    {
+        filterBatch(*predicate, batch);
+        if (batch.selected > 0)
+            return true;
+    }
+    return false;
+}
+
+bool ProjectOperator::next(Batch &batch)
+{
+    if (!input->next(batch))
+        return false;
+    batch.projection = slots;
+    return true;
+}
+
+bool MaterializeOperator::next(Batch &batch)
+{
+    if (!input->next(batch))
+        return false;
+    for (size_t slot : slots)
+        scan.materialize(slot, batch);
+    return true;
+}
+
+bool LimitOperator::next(Batch &batch)
+{
+    while (produced < limit && input->next(batch))
+    {
+        // Drop the leading rows still owed to OFFSET, then cut at the limit
+        size_t skip = static_cast<size_t>(min<uint64_t>(offset - skipped, batch.selected));
+        skipped += skip;
+        size_t keep = static_cast<size_t>(min<uint64_t>(limit - produced, batch.selected - skip));
+        if (keep == 0)
+            continue;
+        copy(batch.selection + skip, batch.selection + skip + keep, batch.selection);
+        batch.selected = keep;
+        produced += keep;
+        return true;
+    }
+    return false;
+}
+
+string LimitOperator::describe() const
+{
+    string text = "Limit (";
+    if (limit != UINT64_MAX)
+        text += to_string(limit) + (offset > 0 ? ", " : "");
+    if (offset > 0)
+        text += "offset " + to_string(offset);
+    return text + ")";
+}
+
+// Formats one value; fixed-width types are written into text, which must hold 32 bytes
+static string_view formatCell(const ColumnVector &column, size_t pos, char *text)
+{
+    switch (column.info.type)
+    {
+    case TYPE_INT:
+        return string_view(text, to_chars(text, text + 32, column.ints[pos]).ptr - text);
+    case TYPE_FLOAT:
+        return string_view(text, to_chars(text, text + 32, column.floats[pos]).ptr - text);
+    case TYPE_BOOL:
+        return column.bools[pos] ? "TRUE" : "FALSE";
+    case TYPE_STRING:
+        return column.strings[pos];
+    case TYPE_DATE:
+        return string_view(text, formatDateTo(column.dates[pos], text) - text);
+    }
+    return "NULL";
+}
+
+void writeResults(Operator &root, ResultSink &sink)
+{
+    Batch batch;
+    vector<string_view> cells;
+    vector<bool> nulls;
+    vector<array<char, 32>> text;
+    while (root.next(batch))
+    {
+        size_t width = batch.projection.size();
+        cells.resize(width);
+        nulls.resize(width);
+        text.resize(width);
+        for (size_t i = 0; i < batch.selected; i++)
+        {
+            size_t pos = batch.selection[i];
+            for (size_t c = 0; c < width; c++)
+            {
+                const ColumnVector &column = batch.columns[batch.projection[c]];
+                nulls[c] = column.nulls[pos];
+                cells[c] = nulls[c] ? string_view("NULL") : formatCell(column, pos, text[c].data());
+            }
+            sink.row(cells, nulls);
+        }
+    }
+}
+
+static string formatBytes(uint64_t bytes)
+{
+    static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024 && unit < 4)
+    {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
+static string formatMillis(chrono::steady_clock::duration elapsed)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.3f ms", chrono::duration<double, milli>(elapsed).count());
+    return text;
+}
+
+// Wraps every operator of the tree in slot in a ProfileOperator, inputs first
+static void profile(unique_ptr<Operator> &slot)
+{
+    for (unique_ptr<Operator> *input : slot->inputs())
+        profile(*input);
+    slot = make_unique<ProfileOperator>(move(slot));
+}
+
+static void printOperator(Operator &op, size_t depth, bool analyzed, ostream &out)
+{
+    out << string(depth * 2, ' ') << (depth > 0 ? "-> " : "") << op.describe();
+    vector<unique_ptr<Operator> *> inputs = op.inputs();
+    if (analyzed)
+    {
+        // Every operator is profiled, so time and rows spent below this one can be taken out
+        const auto &profiled = static_cast<const ProfileOperator &>(op);
+        chrono::steady_clock::duration self = profiled.elapsed;
+        uint64_t rowsIn = op.rowsRead();
+        for (unique_ptr<Operator> *input : inputs)
+        {
+            const auto &child = static_cast<const ProfileOperator &>(**input);
+            self -= child.elapsed;
+            rowsIn += child.rowsOut;
+        }
+        out << "  (time " << formatMillis(profiled.elapsed) << ", self " << formatMillis(self) << ", rows in "
+            << rowsIn << ", out " << profiled.rowsOut << ", read " << formatBytes(op.bytesRead()) << ", peak memory "
+            << formatBytes(op.peakMemory()) << ")";
+    }
+    out << "\n";
+    for (unique_ptr<Operator> *input : inputs)
+        printOperator(**input, depth + 1, analyzed, out);
+}
+
+void explainPipeline(unique_ptr<Operator> &root, ExplainMode mode, ostream &out)
+{
+    bool analyzed = mode == EXPLAIN_ANALYZE;
+    chrono::steady_clock::duration total{};
+    if (analyzed)
+    {
+        profile(root);
+        Batch batch;
+        auto start = chrono::steady_clock::now();
+        while (root->next(batch))
+        {
+        }
+        total = chrono::steady_clock::now() - start;
+    }
+    printOperator(*root, 0, analyzed, out);
+    if (analyzed)
+        out << "Execution time: " << formatMillis(total) << "\n";
+}
@@ -0,0 +1,164 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "batch.h"
+#include "predicate.h"
+#include "scan.h"
+#include "sink.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Pull-based operator pipeline over column batches. next() fills batch with the
+// following rows that have at least one selected position and returns false once the
+// input is exhausted. Each operator owns its input, so a pipeline is one chain of
+// unique_ptrs rooted at the operator the sink drains.
+class Operator
+{
+protected:
+    size_t peakBytes = 0;
+    void trackMemory(size_t bytes) { peakBytes = max(peakBytes, bytes); }
+
+public:
+    virtual ~Operator() = default;
+    virtual bool next(Batch &batch) = 0;
+
+    // For EXPLAIN: one line on what the operator does, the operators it pulls from, the
+    // rows and column bytes it read from tables itself, and the most memory it held
+    virtual string describe() const = 0;
+    virtual vector<unique_ptr<Operator> *> inputs() { return {}; }
+    virtual uint64_t rowsRead() const { return 0; }
+    virtual uint64_t bytesRead() const { return 0; }
+    virtual size_t peakMemory() const { return peakBytes; }
+};
+
+// "1 key", "2 keys": a count for operator descriptions
+inline string countOf(size_t n, const string &noun)
+{
+    return to_string(n) + " " + noun + (n == 1 ? "" : "s");
+}
+
+// What EXPLAIN does with a query's pipeline: nothing, print it, or run it and print it
+// with what each operator did
+enum ExplainMode
+{
+    EXPLAIN_NONE,
+    EXPLAIN_PLAN,
+    EXPLAIN_ANALYZE
+};
+
+// Times the calls to the operator it wraps and counts the rows it returns.
+// EXPLAIN ANALYZE wraps every operator of a pipeline in one, so queries that are not
+// analyzed pay nothing for the counters.
+class ProfileOperator : public Operator
+{
+private:
+    unique_ptr<Operator> inner;
+
+public:
+    chrono::steady_clock::duration elapsed{}; // inside next(), inputs included
+    uint64_t rowsOut = 0;
+
+    explicit ProfileOperator(unique_ptr<Operator> inner) : inner(move(inner)) {}
+    bool next(Batch &batch) override;
+    string describe() const override { return inner->describe(); }
+    vector<unique_ptr<Operator> *> inputs() override { return inner->inputs(); }
+    uint64_t rowsRead() const override { return inner->rowsRead(); }
+    uint64_t bytesRead() const override { return inner->bytesRead(); }
+    size_t peakMemory() const override { return inner->peakMemory(); }
+};
+
+class ScanOperator : public Operator
+{
+private:
+    TableScan &scan;
+    string table;
+    string index;           // the index that chose the rows, if one did
+    uint64_t indexPages = 0; // index pages read to find them
+
+public:
+    ScanOperator(TableScan &scan, string table, string index = {}, uint64_t indexPages = 0)
+        : scan(scan), table(move(table)), index(move(index)), indexPages(indexPages) {}
+    bool next(Batch &batch) override;
+    string describe() const override;
+    uint64_t rowsRead() const override { return scan.rowsRead(); }
+    uint64_t bytesRead() const override { return scan.bytesRead(); }
+};
+
+// Keeps the rows for which the predicate is TRUE
+class FilterOperator : public Operator
+{
+private:
+    unique_ptr<Operator> input;
+    unique_ptr<Predicate> predicate;
+
+public:
+    FilterOperator(unique_ptr<Operator> input, unique_ptr<Predicate> predicate)
+        : input(move(input)), predicate(move(predicate)) {}
+    bool next(Batch &batch) override;
+    string describe() const override { return "Filter"; }
+    vector<unique_ptr<Operator> *> inputs() override { return {&input}; }
+};
+
+// Narrows the output to the given scan slots, in order, without copying values
+class ProjectOperator : public Operator
+{
+private:
+    unique_ptr<Operator> input;
+    vector<size_t> slots;
+
+public:
+    ProjectOperator(unique_ptr<Operator> input, vector<size_t> slots) : input(move(input)), slots(move(slots)) {}
+    bool next(Batch &batch) override;
+    string describe() const override { return "Project (" + countOf(slots.size(), "column") + ")"; }
+    vector<unique_ptr<Operator> *> inputs() override { return {&input}; }
+};
+
+// Decodes the scan's deferred slots at the positions still selected, after the filters
+// and limits below have dropped what they will
+class MaterializeOperator : public Operator
+{
+private:
+    unique_ptr<Operator> input;
+    const TableScan &scan;
+    vector<size_t> slots;
+
+public:
+    MaterializeOperator(unique_ptr<Operator> input, const TableScan &scan, vector<size_t> slots)
+        : input(move(input)), scan(scan), slots(move(slots)) {}
+    bool next(Batch &batch) override;
+    string describe() const override { return "Materialize (" + countOf(slots.size(), "deferred column") + ")"; }
+    vector<unique_ptr<Operator> *> inputs() override { return {&input}; }
+    uint64_t bytesRead() const override { return scan.materializedBytes(); }
+};
+
+// Skips the first offset rows and ends the pipeline after limit more, so nothing
+// below it is read once the limit is reached
+class LimitOperator : public Operator
+{
+private:
+    unique_ptr<Operator> input;
+    uint64_t limit, offset;
+    uint64_t skipped = 0, produced = 0;
+
+public:
+    LimitOperator(unique_ptr<Operator> input, uint64_t limit, uint64_t offset = 0)
+        : input(move(input)), limit(limit), offset(offset) {}
+    bool next(Batch &batch) override;
+    string describe() const override;
+    vector<unique_ptr<Operator> *> inputs() override { return {&input}; }
+};
+
+// Drains root into sink, formatting only the selected rows of the projected columns
+void writeResults(Operator &root, ResultSink &sink);
+
+// Prints the operator tree under root. With EXPLAIN_ANALYZE the pipeline is first run
+// to completion, its rows discarded, and each operator reports its time (in total and
+// without its inputs), rows in and out, bytes read and peak memory.
+void explainPipeline(unique_ptr<Operator> &root, ExplainMode mode, ostream &out = cout);
+
+#endif // EXEC_H
@@ -0,0 +1,11 @@
+#include "expr.h"
+#include <algorithm>
+using namespace std;
+
+void collectColumns(const Expr &expr, vector<string> &columns)
+{
+    if (expr.kind == EXPR_COLUMN && find(columns.begin(), columns.end(), expr.text) == columns.end())
+        columns.push_back(expr.text);
+    for (const auto &child : expr.children)
+        collectColumns(*child, columns);
+}
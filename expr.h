@@ -0,0 +1,52 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Boolean expression tree of a WHERE, ON or HAVING clause, as built by parser.h;
+// predicate.h compiles it
+enum ExprKind
+{
+    EXPR_COLUMN,  // column
+    EXPR_LITERAL, // literal text, NULL when isNull
+    EXPR_COMPARE, // children[0] op children[1]
+    EXPR_AND,
+    EXPR_OR,
+    EXPR_NOT,
+    EXPR_IN,      // children[0] IN (children[1..])
+    EXPR_BETWEEN, // children[0] BETWEEN children[1] AND children[2]
+    EXPR_LIKE,    // children[0] LIKE children[1]
+    EXPR_IS_NULL  // children[0] IS NULL
+};
+
+enum CompareOp
+{
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE
+};
+
+struct Expr
+{
+    ExprKind kind;
+    string text;          // column name or literal text
+    bool isNull = false;  // EXPR_LITERAL: the NULL literal
+    bool quoted = false;  // EXPR_LITERAL: written as a quoted string
+    CompareOp op = CMP_EQ;
+    bool negated = false; // NOT IN, NOT BETWEEN, NOT LIKE, IS NOT NULL
+    vector<unique_ptr<Expr>> children;
+
+    explicit Expr(ExprKind kind) : kind(kind) {}
+};
+
+// Names of the columns an expression refers to, each once
+void collectColumns(const Expr &expr, vector<string> &columns);
+
+#endif // EXPR_H
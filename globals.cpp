@@ -20,6 +20,13 @@ unordered_map<int,string> datatypeName = {
     {4,"DATE"}
 };
 
+size_t bufferPoolBytes = 64 * 1024 * 1024;
+size_t walCheckpointBytes = 64 * 1024 * 1024;
+unsigned walGroupCommitMicros = 0;
+size_t joinMemoryBytes = 256 * 1024 * 1024;
+size_t groupMemoryBytes = 256 * 1024 * 1024;
+size_t sortMemoryBytes = 256 * 1024 * 1024;
+size_t planCacheEntries = 1024;
 
 string currentDateTime()
 {
@@ -3,6 +3,7 @@
 
 #include <unordered_map>
 #include <string>
+#include <cstddef>
 
 using namespace std;
 
@@ -10,6 +11,21 @@ extern unordered_map<string, int> datatype;
 extern unordered_map<int, string> datatypeName;
 string currentDateTime();
 
+// Memory budget of the shared buffer pool, overridable with DBMS_BUFFER_POOL_MB
+extern size_t bufferPoolBytes;
+// Write-ahead log size that triggers a checkpoint
+extern size_t walCheckpointBytes;
+// How long a group commit leader waits for other committers, overridable with DBMS_WAL_GROUP_COMMIT_US
+extern unsigned walGroupCommitMicros;
+// Memory a hash join's build side may use before it spills, overridable with DBMS_JOIN_MEMORY_MB
+extern size_t joinMemoryBytes;
+// Memory GROUP BY's hash tables may use before they spill, overridable with DBMS_GROUP_MEMORY_MB
+extern size_t groupMemoryBytes;
+// Memory ORDER BY may hold before it spills sorted runs, overridable with DBMS_SORT_MEMORY_MB
+extern size_t sortMemoryBytes;
+// Ad-hoc INSERT and SELECT plans kept for reuse, overridable with DBMS_PLAN_CACHE_ENTRIES
+extern size_t planCacheEntries;
+
 extern const string RESET;
 extern const string RED;
 extern const string GREEN;
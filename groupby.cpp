@@ -0,0 +1,882 @@
+#include "groupby.h"
+#include "exec.h"
+#include "globals.h"
+#include "scan.h"
+#include "storage.h"
+#include "table.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <numeric>
+#include <unistd.h>
+using namespace std;
+
+static const char *const AGGREGATE_NAMES[] = {"COUNT", "SUM", "AVG", "MIN", "MAX"};
+
+string Aggregate::name() const
+{
+    return string(AGGREGATE_NAMES[function]) + "(" + (column.empty() ? "*" : column) + ")";
+}
+
+bool parseAggregate(const string &text, Aggregate &out)
+{
+    size_t open = text.find('('), close = text.rfind(')');
+    if (open == string::npos || close == string::npos || close < open ||
+        text.find_first_not_of(" \t", close + 1) != string::npos)
+        return false;
+    string function = text.substr(0, open), argument = text.substr(open + 1, close - open - 1);
+    function.erase(function.find_last_not_of(" \t") + 1);
+    argument.erase(0, argument.find_first_not_of(" \t"));
+    argument.erase(argument.find_last_not_of(" \t") + 1);
+    transform(function.begin(), function.end(), function.begin(), ::toupper);
+    transform(argument.begin(), argument.end(), argument.begin(), ::tolower);
+    for (int f = AGG_COUNT; f <= AGG_MAX; f++)
+    {
+        if (function != AGGREGATE_NAMES[f])
+            continue;
+        if (argument.empty() || (argument == "*" && f != AGG_COUNT))
+            return false;
+        out.function = static_cast<AggregateFunction>(f);
+        out.column = argument == "*" ? "" : argument;
+        return true;
+    }
+    return false;
+}
+
+// Partial result of one aggregate for one group. Partial states of the same group
+// from different threads or spill files combine into the final one.
+struct AggregateState
+{
+    int64_t count = 0; // rows for COUNT(*), otherwise non-NULL values seen
+    int64_t i = 0;     // INT, DATE and BOOL sums, minimums and maximums
+    double f = 0;      // FLOAT sums, minimums and maximums
+    string s;          // STRING minimums and maximums
+};
+
+// An aggregate resolved against the scan: slot of its argument and that column's type
+struct BoundAggregate
+{
+    AggregateFunction function;
+    size_t slot;
+    int type;
+    bool countRows; // COUNT(*)
+};
+
+static void update(AggregateState &state, const BoundAggregate &agg, const ColumnVector &column, size_t pos)
+{
+    if (agg.countRows)
+    {
+        state.count++;
+        return;
+    }
+    if (column.nulls[pos])
+        return;
+    bool first = state.count++ == 0;
+    switch (agg.function)
+    {
+    case AGG_COUNT:
+        break;
+    case AGG_SUM:
+    case AGG_AVG:
+        if (agg.type == TYPE_FLOAT)
+            state.f += column.floats[pos];
+        else
+            state.i += column.ints[pos];
+        break;
+    case AGG_MIN:
+    case AGG_MAX:
+    {
+        bool isMin = agg.function == AGG_MIN;
+        switch (agg.type)
+        {
+        case TYPE_INT:
+            if (first || (column.ints[pos] < state.i) == isMin)
+                state.i = column.ints[pos];
+            break;
+        case TYPE_FLOAT:
+            if (first || (column.floats[pos] < state.f) == isMin)
+                state.f = column.floats[pos];
+            break;
+        case TYPE_BOOL:
+            if (first || (column.bools[pos] < state.i) == isMin)
+                state.i = column.bools[pos];
+            break;
+        case TYPE_STRING:
+            if (first || (column.strings[pos] < state.s) == isMin)
+                state.s.assign(column.strings[pos]);
+            break;
+        case TYPE_DATE:
+            if (first || (column.dates[pos] < state.i) == isMin)
+                state.i = column.dates[pos];
+            break;
+        }
+        break;
+    }
+    }
+}
+
+static void combine(AggregateState &into, const AggregateState &from, const BoundAggregate &agg)
+{
+    if (from.count == 0)
+        return;
+    bool first = into.count == 0;
+    into.count += from.count;
+    if (agg.countRows || agg.function == AGG_COUNT)
+        return;
+    if (agg.function == AGG_SUM || agg.function == AGG_AVG)
+    {
+        into.i += from.i;
+        into.f += from.f;
+        return;
+    }
+    bool isMin = agg.function == AGG_MIN;
+    if (agg.type == TYPE_STRING)
+    {
+        if (first || (from.s < into.s) == isMin)
+            into.s = from.s;
+    }
+    else if (agg.type == TYPE_FLOAT)
+    {
+        if (first || (from.f < into.f) == isMin)
+            into.f = from.f;
+    }
+    else if (first || (from.i < into.i) == isMin)
+    {
+        into.i = from.i;
+    }
+}
+
+static uint64_t mixHash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Groups of one partition: encoded keys back to back in one arena, an open-addressing
+// index over their hashes, and the aggregate states of each group side by side
+class GroupTable
+{
+private:
+    size_t width; // aggregates per group
+    string keys;
+    vector<size_t> keyEnd;
+    vector<uint64_t> hashes;
+    vector<uint32_t> slots; // group + 1, 0 when empty
+
+    void grow()
+    {
+        slots.assign(max<size_t>(slots.size() * 2, 64), 0);
+        size_t mask = slots.size() - 1;
+        for (size_t g = 0; g < hashes.size(); g++)
+        {
+            size_t s = hashes[g] & mask;
+            while (slots[s])
+                s = (s + 1) & mask;
+            slots[s] = static_cast<uint32_t>(g + 1);
+        }
+    }
+
+public:
+    vector<AggregateState> states;
+
+    explicit GroupTable(size_t width) : width(width) {}
+
+    size_t size() const { return hashes.size(); }
+    uint64_t hash(size_t g) const { return hashes[g]; }
+    string_view key(size_t g) const
+    {
+        size_t start = g == 0 ? 0 : keyEnd[g - 1];
+        return string_view(keys.data() + start, keyEnd[g] - start);
+    }
+    size_t memory() const
+    {
+        return keys.capacity() + size() * (sizeof(size_t) + 8) + slots.size() * 4 +
+               states.size() * sizeof(AggregateState);
+    }
+
+    // Index of the group with this key, added with empty states if it is new
+    size_t find(string_view key, uint64_t hash)
+    {
+        if (hashes.size() * 2 >= slots.size())
+            grow();
+        size_t mask = slots.size() - 1, s = hash & mask;
+        for (; slots[s]; s = (s + 1) & mask)
+        {
+            size_t g = slots[s] - 1;
+            if (hashes[g] == hash && this->key(g) == key)
+                return g;
+        }
+        slots[s] = static_cast<uint32_t>(hashes.size() + 1);
+        keys.append(key);
+        keyEnd.push_back(keys.size());
+        hashes.push_back(hash);
+        states.resize(states.size() + width);
+        return hashes.size() - 1;
+    }
+
+    // Releases the memory too, as a spilled table must
+    void clear()
+    {
+        keys = string();
+        keyEnd = vector<size_t>();
+        hashes = vector<uint64_t>();
+        slots = vector<uint32_t>();
+        states = vector<AggregateState>();
+    }
+};
+
+// Group keys are encoded per column as a NULL flag byte followed by the value: 8 bytes
+// for INT and FLOAT, 4 for DATE, 1 for BOOL, and a 4-byte length and the bytes for STRING
+static void encodeKey(const Batch &batch, const vector<size_t> &slots, size_t pos, string &key)
+{
+    key.clear();
+    for (size_t slot : slots)
+    {
+        const ColumnVector &column = batch.columns[slot];
+        if (column.nulls[pos])
+        {
+            key.push_back(0);
+            continue;
+        }
+        key.push_back(1);
+        switch (column.info.type)
+        {
+        case TYPE_INT:
+            key.append(reinterpret_cast<const char *>(&column.ints[pos]), 8);
+            break;
+        case TYPE_FLOAT:
+        {
+            double value = column.floats[pos] == 0 ? 0.0 : column.floats[pos]; // -0.0 groups with 0.0
+            key.append(reinterpret_cast<const char *>(&value), 8);
+            break;
+        }
+        case TYPE_BOOL:
+            key.push_back(static_cast<char>(column.bools[pos]));
+            break;
+        case TYPE_STRING:
+        {
+            uint32_t length = static_cast<uint32_t>(column.strings[pos].size());
+            key.append(reinterpret_cast<const char *>(&length), 4);
+            key.append(column.strings[pos]);
+            break;
+        }
+        case TYPE_DATE:
+            key.append(reinterpret_cast<const char *>(&column.dates[pos]), 4);
+            break;
+        }
+    }
+}
+
+// Spill records: key length and bytes, then per aggregate count, i, f and the string
+static void writeGroups(ofstream &out, const GroupTable &table, size_t width)
+{
+    for (size_t g = 0; g < table.size(); g++)
+    {
+        string_view key = table.key(g);
+        uint32_t length = static_cast<uint32_t>(key.size());
+        uint64_t hash = table.hash(g);
+        out.write(reinterpret_cast<const char *>(&hash), 8);
+        out.write(reinterpret_cast<const char *>(&length), 4);
+        out.write(key.data(), length);
+        for (size_t a = 0; a < width; a++)
+        {
+            const AggregateState &state = table.states[g * width + a];
+            uint32_t size = static_cast<uint32_t>(state.s.size());
+            out.write(reinterpret_cast<const char *>(&state.count), 8);
+            out.write(reinterpret_cast<const char *>(&state.i), 8);
+            out.write(reinterpret_cast<const char *>(&state.f), 8);
+            out.write(reinterpret_cast<const char *>(&size), 4);
+            out.write(state.s.data(), size);
+        }
+    }
+}
+
+static void mergeSpilled(const string &path, GroupTable &into, const vector<BoundAggregate> &aggregates)
+{
+    ifstream in(path, ios::binary);
+    string key;
+    AggregateState state;
+    uint64_t hash;
+    uint32_t length;
+    while (in.read(reinterpret_cast<char *>(&hash), 8) && in.read(reinterpret_cast<char *>(&length), 4))
+    {
+        key.resize(length);
+        in.read(&key[0], length);
+        size_t g = into.find(key, hash);
+        for (size_t a = 0; a < aggregates.size(); a++)
+        {
+            uint32_t size;
+            in.read(reinterpret_cast<char *>(&state.count), 8);
+            in.read(reinterpret_cast<char *>(&state.i), 8);
+            in.read(reinterpret_cast<char *>(&state.f), 8);
+            in.read(reinterpret_cast<char *>(&size), 4);
+            state.s.resize(size);
+            in.read(&state.s[0], size);
+            combine(into.states[g * aggregates.size() + a], state, aggregates[a]);
+        }
+    }
+}
+
+// Partitions of the group hash space; each is merged by one task
+static const unsigned PARTITION_BITS = 6;
+static const size_t PARTITIONS = size_t(1) << PARTITION_BITS;
+// Rows a worker claims from the shared cursor at a time
+static const uint64_t MORSEL_ROWS = 1 << 16;
+
+// GROUP BY as a partitioned hash aggregation. Workers claim row ranges of the table,
+// each through its own scan, and pre-aggregate into thread-local tables split into
+// PARTITIONS by the top bits of the key hash; a worker over its share of the memory
+// budget spills its tables to files. Partition p of every worker and its spill files
+// then merge into one final table in a task of its own, so the merge runs in parallel
+// too. The output is a batch per BATCH_SIZE groups: the key columns, then the
+// aggregates.
+class HashAggregateOperator : public Operator
+{
+private:
+    vector<unique_ptr<TableScan>> scans; // one per worker
+    const Predicate *predicate;
+    vector<size_t> keySlots;
+    vector<BoundAggregate> aggregates;
+    vector<ColumnInfo> outputColumns;
+    bool global; // no GROUP BY: one group, even over no rows
+    string spillDir;
+
+    vector<GroupTable> results;
+    size_t partition = 0, group = 0;
+    bool done = false;
+    vector<size_t> workerPeaks; // most memory each worker's tables held
+    size_t totalSpills = 0;
+
+    void aggregateBatch(const Batch &batch, vector<GroupTable> &tables, string &key)
+    {
+        uint8_t parts[BATCH_SIZE];
+        uint32_t groups[BATCH_SIZE];
+        for (size_t i = 0; i < batch.selected; i++)
+        {
+            size_t pos = batch.selection[i];
+            encodeKey(batch, keySlots, pos, key);
+            uint64_t hash = mixHash(std::hash<string>()(key));
+            parts[i] = static_cast<uint8_t>(hash >> (64 - PARTITION_BITS));
+            groups[i] = static_cast<uint32_t>(tables[parts[i]].find(key, hash));
+        }
+        // One aggregate at a time over the whole batch keeps its column in cache
+        for (size_t a = 0; a < aggregates.size(); a++)
+        {
+            const ColumnVector &column = batch.columns[aggregates[a].slot];
+            for (size_t i = 0; i < batch.selected; i++)
+                update(tables[parts[i]].states[groups[i] * aggregates.size() + a], aggregates[a], column,
+                       batch.selection[i]);
+        }
+    }
+
+    // Returns the number of times the worker spilled
+    size_t work(size_t worker, atomic<uint64_t> &cursor, vector<GroupTable> &tables)
+    {
+        TableScan &scan = *scans[worker];
+        Batch batch;
+        string key;
+        size_t spills = 0, budget = groupMemoryBytes / scans.size();
+        uint64_t rows = scan.rowCount();
+        for (uint64_t first; (first = cursor.fetch_add(MORSEL_ROWS)) < rows;)
+        {
+            scan.setRange(first, first + MORSEL_ROWS);
+            while (scan.nextBatch(batch))
+            {
+                if (predicate)
+                    filterBatch(*predicate, batch);
+                aggregateBatch(batch, tables, key);
+            }
+            size_t memory = 0;
+            for (const auto &table : tables)
+                memory += table.memory();
+            workerPeaks[worker] = max(workerPeaks[worker], memory);
+            if (memory > budget)
+            {
+                filesystem::create_directories(spillDir);
+                for (size_t p = 0; p < PARTITIONS; p++)
+                {
+                    ofstream out(spillFile(worker, p), ios::binary | ios::app);
+                    writeGroups(out, tables[p], aggregates.size());
+                    tables[p].clear();
+                }
+                spills++;
+            }
+        }
+        return spills;
+    }
+
+    string spillFile(size_t worker, size_t p) const
+    {
+        return spillDir + "/w" + to_string(worker) + "-p" + to_string(p);
+    }
+
+    void run()
+    {
+        size_t workers = scans.size();
+        vector<vector<GroupTable>> local(workers, vector<GroupTable>(PARTITIONS, GroupTable(aggregates.size())));
+        vector<size_t> spills(workers);
+        workerPeaks.assign(workers, 0);
+        atomic<uint64_t> cursor(0);
+        {
+            ThreadPool pool(workers);
+            vector<future<size_t>> pending;
+            for (size_t w = 0; w < workers; w++)
+            {
+                auto task = make_shared<packaged_task<size_t()>>([this, w, &cursor, &local]() {
+                    return work(w, cursor, local[w]);
+                });
+                pending.push_back(task->get_future());
+                pool.submit([task]() { (*task)(); });
+            }
+            for (size_t w = 0; w < workers; w++)
+                spills[w] = pending[w].get();
+
+            results.assign(PARTITIONS, GroupTable(aggregates.size()));
+            vector<future<void>> merging;
+            for (size_t p = 0; p < PARTITIONS; p++)
+            {
+                auto task = make_shared<packaged_task<void()>>([this, p, &local, &spills]() {
+                    GroupTable &into = results[p];
+                    for (size_t w = 0; w < local.size(); w++)
+                    {
+                        const GroupTable &from = local[w][p];
+                        for (size_t g = 0; g < from.size(); g++)
+                        {
+                            size_t target = into.find(from.key(g), from.hash(g));
+                            for (size_t a = 0; a < aggregates.size(); a++)
+                                combine(into.states[target * aggregates.size() + a],
+                                        from.states[g * aggregates.size() + a], aggregates[a]);
+                        }
+                        if (spills[w] > 0)
+                            mergeSpilled(spillFile(w, p), into, aggregates);
+                    }
+                });
+                merging.push_back(task->get_future());
+                pool.submit([task]() { (*task)(); });
+            }
+            for (auto &task : merging)
+                task.get();
+
+            // The workers' tables are all still held once the merged ones are complete
+            size_t held = 0;
+            for (const auto &tables : local)
+            {
+                for (const auto &table : tables)
+                    held += table.memory();
+            }
+            for (const auto &table : results)
+                held += table.memory();
+            trackMemory(max(held, accumulate(workerPeaks.begin(), workerPeaks.end(), size_t(0))));
+        }
+        totalSpills = accumulate(spills.begin(), spills.end(), size_t(0));
+        if (global && all_of(results.begin(), results.end(), [](const GroupTable &t) { return t.size() == 0; }))
+            results[0].find("", 0);
+        if (any_of(spills.begin(), spills.end(), [](size_t s) { return s > 0; }))
+        {
+            error_code ec;
+            filesystem::remove_all(spillDir, ec);
+        }
+    }
+
+    // Kernels read values under the NULL mask too, so they must be defined
+    static void clearValue(ColumnVector &column, size_t k)
+    {
+        column.bools[k] = 0;
+        column.strings[k] = string_view();
+        if (column.info.type == TYPE_DATE)
+            column.gathered.dates[k] = 0;
+        else
+            column.gathered.ints[k] = 0;
+    }
+
+    // Writes group g's key columns and aggregates into position k of batch
+    void emitGroup(const GroupTable &table, size_t g, Batch &batch, size_t k)
+    {
+        string_view key = table.key(g);
+        size_t pos = 0;
+        for (size_t c = 0; c < keySlots.size(); c++)
+        {
+            ColumnVector &column = batch.columns[c];
+            column.nulls[k] = key[pos++] == 0;
+            if (column.nulls[k])
+            {
+                clearValue(column, k);
+                continue;
+            }
+            switch (column.info.type)
+            {
+            case TYPE_INT:
+                memcpy(&column.gathered.ints[k], key.data() + pos, 8);
+                pos += 8;
+                break;
+            case TYPE_FLOAT:
+                memcpy(&column.gathered.floats[k], key.data() + pos, 8);
+                pos += 8;
+                break;
+            case TYPE_BOOL:
+                column.bools[k] = key[pos++];
+                break;
+            case TYPE_STRING:
+            {
+                uint32_t length;
+                memcpy(&length, key.data() + pos, 4);
+                column.strings[k] = key.substr(pos + 4, length);
+                pos += 4 + length;
+                break;
+            }
+            case TYPE_DATE:
+                memcpy(&column.gathered.dates[k], key.data() + pos, 4);
+                pos += 4;
+                break;
+            }
+        }
+        for (size_t a = 0; a < aggregates.size(); a++)
+        {
+            const BoundAggregate &agg = aggregates[a];
+            const AggregateState &state = table.states[g * aggregates.size() + a];
+            ColumnVector &column = batch.columns[keySlots.size() + a];
+            column.nulls[k] = state.count == 0 && agg.function != AGG_COUNT;
+            if (column.nulls[k])
+            {
+                clearValue(column, k);
+                continue;
+            }
+            switch (agg.function)
+            {
+            case AGG_COUNT:
+                column.gathered.ints[k] = state.count;
+                break;
+            case AGG_SUM:
+                if (agg.type == TYPE_FLOAT)
+                    column.gathered.floats[k] = state.f;
+                else
+                    column.gathered.ints[k] = state.i;
+                break;
+            case AGG_AVG:
+                column.gathered.floats[k] = (agg.type == TYPE_FLOAT ? state.f : double(state.i)) / state.count;
+                break;
+            case AGG_MIN:
+            case AGG_MAX:
+                if (agg.type == TYPE_FLOAT)
+                    column.gathered.floats[k] = state.f;
+                else if (agg.type == TYPE_DATE)
+                    column.gathered.dates[k] = static_cast<int32_t>(state.i);
+                else if (agg.type == TYPE_BOOL)
+                    column.bools[k] = static_cast<uint8_t>(state.i);
+                else if (agg.type == TYPE_STRING)
+                    column.strings[k] = state.s;
+                else
+                    column.gathered.ints[k] = state.i;
+                break;
+            }
+        }
+    }
+
+public:
+    HashAggregateOperator(vector<unique_ptr<TableScan>> scans, const Predicate *predicate, vector<size_t> keySlots,
+                          vector<BoundAggregate> aggregates, vector<ColumnInfo> outputColumns, string spillDir)
+        : scans(move(scans)), predicate(predicate), keySlots(move(keySlots)), aggregates(move(aggregates)),
+          outputColumns(move(outputColumns)), global(this->keySlots.empty()), spillDir(move(spillDir)) {}
+
+    string describe() const override
+    {
+        string text = "Hash aggregate (" + countOf(keySlots.size(), "key") + ", " +
+                      countOf(aggregates.size(), "aggregate") + ", " + countOf(scans.size(), "worker");
+        if (predicate)
+            text += ", filtered";
+        if (scans[0]->skippedZones() > 0)
+            text += ", " + to_string(scans[0]->skippedZones()) + " of " + countOf(scans[0]->zoneCount(), "block") +
+                    " skipped";
+        if (totalSpills > 0)
+            text += ", " + countOf(totalSpills, "spill");
+        return text + ")";
+    }
+
+    uint64_t rowsRead() const override
+    {
+        uint64_t rows = 0;
+        for (const auto &scan : scans)
+            rows += scan->rowsRead();
+        return rows;
+    }
+
+    uint64_t bytesRead() const override
+    {
+        uint64_t bytes = 0;
+        for (const auto &scan : scans)
+            bytes += scan->bytesRead();
+        return bytes;
+    }
+
+    bool next(Batch &batch) override
+    {
+        if (!done)
+        {
+            done = true;
+            run();
+        }
+        batch.columns.resize(outputColumns.size());
+        for (size_t c = 0; c < outputColumns.size(); c++)
+        {
+            ColumnVector &column = batch.columns[c];
+            column.info = outputColumns[c];
+            column.ints = column.gathered.ints;
+            column.floats = column.gathered.floats;
+            column.dates = column.gathered.dates;
+            column.dictionary = nullptr;
+        }
+        size_t n = 0;
+        while (n < BATCH_SIZE && partition < results.size())
+        {
+            if (group < results[partition].size())
+            {
+                emitGroup(results[partition], group++, batch, n++);
+                continue;
+            }
+            partition++;
+            group = 0;
+        }
+        if (n == 0)
+            return false;
+        batch.firstRow = 0;
+        batch.size = n;
+        for (size_t k = 0; k < n; k++)
+            batch.selection[k] = static_cast<uint16_t>(k);
+        batch.selected = n;
+        batch.projection.resize(outputColumns.size());
+        for (size_t c = 0; c < outputColumns.size(); c++)
+            batch.projection[c] = c;
+        return true;
+    }
+};
+
+// The aggregates a query needs: those it selects, then any more that HAVING or ORDER BY use
+static void addAggregate(vector<Aggregate> &aggregates, const Aggregate &aggregate)
+{
+    for (const auto &existing : aggregates)
+    {
+        if (existing.name() == aggregate.name())
+            return;
+    }
+    aggregates.push_back(aggregate);
+}
+
+void displayAggregate(Database &db, const AggregateQuery &query)
+{
+    Table table = selectTable(db, query.table);
+    if (table.getName().empty())
+    {
+        return;
+    }
+    const vector<ColumnInfo> &schema = *db.tableSchema(query.table);
+    auto indexOf = [&](const string &name) -> int {
+        for (size_t i = 0; i < schema.size(); i++)
+        {
+            if (schema[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    };
+
+    // Scan slots: GROUP BY columns, aggregate arguments, then WHERE columns
+    vector<size_t> scanColumns;
+    vector<ColumnInfo> scanInfo;
+    auto slotOf = [&](size_t index) {
+        auto it = find(scanColumns.begin(), scanColumns.end(), index);
+        if (it != scanColumns.end())
+            return static_cast<size_t>(it - scanColumns.begin());
+        scanColumns.push_back(index);
+        scanInfo.push_back(schema[index]);
+        return scanColumns.size() - 1;
+    };
+
+    vector<size_t> keySlots;
+    vector<ColumnInfo> outputColumns;
+    for (const string &name : query.groupBy)
+    {
+        int index = indexOf(name);
+        if (index < 0)
+        {
+            cerr << RED << "Error: Column '" << name << "' does not exist in table '" << query.table << "'!" << RESET << endl;
+            return;
+        }
+        keySlots.push_back(slotOf(index));
+        outputColumns.push_back(schema[index]);
+    }
+
+    vector<Aggregate> wanted;
+    for (const SelectItem &item : query.items)
+    {
+        if (item.isAggregate)
+        {
+            addAggregate(wanted, item.aggregate);
+        }
+        else if (find(query.groupBy.begin(), query.groupBy.end(), item.column) == query.groupBy.end())
+        {
+            cerr << RED << "Error: Column '" << item.column << "' must appear in GROUP BY or be used in an aggregate." << RESET << endl;
+            return;
+        }
+    }
+    vector<string> havingColumns;
+    if (query.having)
+        collectColumns(*query.having, havingColumns);
+    for (const string &name : havingColumns)
+    {
+        Aggregate aggregate;
+        if (parseAggregate(name, aggregate))
+        {
+            addAggregate(wanted, aggregate);
+        }
+        else if (find(query.groupBy.begin(), query.groupBy.end(), name) == query.groupBy.end())
+        {
+            cerr << RED << "Error: HAVING may only use GROUP BY columns and aggregates; '" << name << "' is neither." << RESET << endl;
+            return;
+        }
+    }
+
+    for (const OrderItem &item : query.orderBy)
+    {
+        Aggregate aggregate;
+        if (parseAggregate(item.column, aggregate))
+        {
+            addAggregate(wanted, aggregate);
+        }
+        else if (find(query.groupBy.begin(), query.groupBy.end(), item.column) == query.groupBy.end())
+        {
+            cerr << RED << "Error: ORDER BY may only use GROUP BY columns and aggregates; '" << item.column << "' is neither." << RESET << endl;
+            return;
+        }
+    }
+
+    vector<BoundAggregate> aggregates;
+    for (const Aggregate &aggregate : wanted)
+    {
+        BoundAggregate bound{aggregate.function, 0, TYPE_INT, aggregate.column.empty()};
+        if (!bound.countRows)
+        {
+            int index = indexOf(aggregate.column);
+            if (index < 0)
+            {
+                cerr << RED << "Error: Column '" << aggregate.column << "' does not exist in table '" << query.table << "'!" << RESET << endl;
+                return;
+            }
+            bound.slot = slotOf(index);
+            bound.type = schema[index].type;
+            if ((bound.function == AGG_SUM || bound.function == AGG_AVG) && bound.type != TYPE_INT && bound.type != TYPE_FLOAT)
+            {
+                cerr << RED << "Error: " << aggregate.name() << " needs an INT or FLOAT column." << RESET << endl;
+                return;
+            }
+        }
+        int type = bound.function == AGG_COUNT ? TYPE_INT : bound.function == AGG_AVG ? TYPE_FLOAT : bound.type;
+        outputColumns.push_back({aggregate.name(), type});
+        aggregates.push_back(bound);
+    }
+
+    unique_ptr<Predicate> where, having;
+    string error;
+    if (query.where)
+    {
+        vector<string> whereColumns;
+        collectColumns(*query.where, whereColumns);
+        for (const string &name : whereColumns)
+        {
+            int index = indexOf(name);
+            if (index < 0)
+            {
+                cerr << RED << "Error: Column '" << name << "' does not exist in table '" << query.table << "'!" << RESET << endl;
+                return;
+            }
+            slotOf(index);
+        }
+        where = compilePredicate(*query.where, scanInfo, error);
+    }
+    if (!error.empty() || (query.having && !(having = compilePredicate(*query.having, outputColumns, error))))
+    {
+        cerr << RED << "Error: " << error << "." << RESET << endl;
+        return;
+    }
+
+    TableStorage *storage = table.openStorage();
+    if (!storage)
+    {
+        return;
+    }
+    // One scan per worker; small tables are not worth more than one. Each skips the
+    // blocks of rows the zone maps rule out.
+    vector<uint8_t> skip = query.where ? skippableZones(*query.where, *storage) : vector<uint8_t>();
+    vector<unique_ptr<TableScan>> scans;
+    size_t workers = max<size_t>(1, thread::hardware_concurrency());
+    for (size_t w = 0; w < workers; w++)
+    {
+        scans.push_back(make_unique<TableScan>(*storage, scanColumns));
+        if (!scans.back()->isOpen())
+        {
+            cerr << RED << "Failed to read table " << query.table << RESET << endl;
+            return;
+        }
+        scans.back()->skipZones(skip);
+        if (scans.back()->rowCount() <= (w + 1) * MORSEL_ROWS)
+            break;
+    }
+
+    static unsigned spillCount = 0;
+    string spillDir = "./Databases/" + db.getName() + "/" + query.table + "/groupby-" + to_string(getpid()) + "-" +
+                      to_string(spillCount++);
+    unique_ptr<Operator> root = make_unique<HashAggregateOperator>(move(scans), where.get(), keySlots, aggregates,
+                                                                   outputColumns, spillDir);
+    if (having)
+        root = make_unique<FilterOperator>(move(root), move(having));
+
+    vector<size_t> outputSlots;
+    vector<ColumnInfo> shown;
+    for (const SelectItem &item : query.items)
+    {
+        string name = item.isAggregate ? item.aggregate.name() : item.column;
+        for (size_t c = 0; c < outputColumns.size(); c++)
+        {
+            if (outputColumns[c].name == name)
+            {
+                outputSlots.push_back(c);
+                shown.push_back(outputColumns[c]);
+                break;
+            }
+        }
+    }
+    vector<SortKey> sortKeys;
+    for (const OrderItem &item : query.orderBy)
+    {
+        for (size_t c = 0; c < outputColumns.size(); c++)
+        {
+            if (outputColumns[c].name == item.column)
+                sortKeys.push_back({c, item.descending});
+        }
+    }
+    if (!sortKeys.empty())
+        root = make_unique<SortOperator>(move(root), move(sortKeys), move(outputSlots),
+                                         sortLimit(query.limit, query.offset),
+                                         "./Databases/" + db.getName() + "/" + query.table);
+    else
+        root = make_unique<ProjectOperator>(move(root), move(outputSlots));
+    if (query.limit != NO_LIMIT || query.offset > 0)
+        root = make_unique<LimitOperator>(move(root), query.limit, query.offset);
+
+    if (query.explain != EXPLAIN_NONE)
+    {
+        explainPipeline(root, query.explain);
+        return;
+    }
+    ResultSink sink(shown);
+    writeResults(*root, sink);
+    sink.finish("No groups in table " + query.table);
+}
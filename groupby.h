@@ -0,0 +1,59 @@
+#ifndef GROUPBY_H
+#define GROUPBY_H
+
+#include "database.h"
+#include "expr.h"
+#include "orderby.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum AggregateFunction
+{
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_AVG,
+    AGG_MIN,
+    AGG_MAX
+};
+
+struct Aggregate
+{
+    AggregateFunction function;
+    string column; // empty for COUNT(*)
+
+    // Canonical spelling, such as SUM(amount), used for the header and in HAVING
+    string name() const;
+};
+
+// Parses COUNT(*), COUNT(col), SUM(col), AVG(col), MIN(col) or MAX(col)
+bool parseAggregate(const string &text, Aggregate &out);
+
+// One item of a SELECT list: a column, or an aggregate when isAggregate is set
+struct SelectItem
+{
+    string column;
+    bool isAggregate = false;
+    Aggregate aggregate;
+};
+
+// SELECT items FROM table [WHERE where] [GROUP BY groupBy] [HAVING having]
+// [ORDER BY orderBy] [LIMIT limit] [OFFSET offset]
+struct AggregateQuery
+{
+    string table;
+    vector<SelectItem> items;
+    vector<string> groupBy;
+    Expr *where = nullptr;
+    Expr *having = nullptr;
+    vector<OrderItem> orderBy;
+    uint64_t limit = NO_LIMIT;
+    uint64_t offset = 0;
+    ExplainMode explain = EXPLAIN_NONE;
+};
+
+// Runs the query as a parallel hash aggregation and prints the result, or its plan
+void displayAggregate(Database &db, const AggregateQuery &query);
+
+#endif // GROUPBY_H
@@ -0,0 +1,386 @@
+#include "hashindex.h"
+#include "bufferpool.h"
+#include "globals.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+const size_t BUCKET_HEADER = 16;
+const size_t HASH_ENTRY = 2 * sizeof(uint64_t);
+const size_t BUCKET_CAPACITY = (PAGE_SIZE - BUCKET_HEADER) / HASH_ENTRY;
+const size_t MAX_GROUPS = 64;
+const size_t HEADER_NAME = 64 + MAX_GROUPS * sizeof(uint64_t); // offset of the column name
+
+uint64_t intKeyWord(int64_t value)
+{
+    return static_cast<uint64_t>(value);
+}
+
+uint64_t floatKeyWord(double value)
+{
+    if (value == 0)
+        value = 0; // -0.0 equals 0.0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// FNV-1a: defined here rather than taken from std::hash, whose values may change
+// between builds while the index keeps them on disk
+uint64_t stringKeyWord(string_view value)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (char c : value)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Spreads a key word over all 64 bits (the splitmix64 finalizer), so that bucket
+// numbers taken from the low bits are even for sequential keys too
+static uint64_t mix(uint64_t word)
+{
+    word ^= word >> 30;
+    word *= 0xBF58476D1CE4E5B9ULL;
+    word ^= word >> 27;
+    word *= 0x94D049BB133111EBULL;
+    return word ^ (word >> 31);
+}
+
+static size_t bucketCount(const char *page)
+{
+    uint16_t count;
+    memcpy(&count, page, sizeof(count));
+    return count;
+}
+
+static void setBucketCount(char *page, size_t count)
+{
+    uint16_t n = static_cast<uint16_t>(count);
+    memcpy(page, &n, sizeof(n));
+}
+
+static uint64_t overflowPage(const char *page)
+{
+    uint64_t next;
+    memcpy(&next, page + 8, sizeof(next));
+    return next;
+}
+
+static void setOverflowPage(char *page, uint64_t next)
+{
+    memcpy(page + 8, &next, sizeof(next));
+}
+
+HashIndex::HashIndex(const string &path) : path(path)
+{
+    fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        cerr << RED << "Failed to open index " << path << RESET << endl;
+        return;
+    }
+    char page[PAGE_SIZE];
+    uint32_t header[4] = {}, nameLength = 0;
+    uint64_t fields[6] = {};
+    ssize_t n;
+    while ((n = pread(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    if (n == static_cast<ssize_t>(PAGE_SIZE))
+    {
+        memcpy(header, page, sizeof(header));
+        memcpy(fields, page + 16, sizeof(fields));
+        memcpy(&nameLength, page + HEADER_NAME, sizeof(nameLength));
+    }
+    if (n != static_cast<ssize_t>(PAGE_SIZE) || header[0] != HASH_INDEX_MAGIC || header[1] != HASH_INDEX_VERSION ||
+        header[2] == TYPE_BOOL || header[2] > TYPE_DATE || fields[5] == 0 || fields[5] > MAX_GROUPS ||
+        nameLength > PAGE_SIZE - HEADER_NAME - sizeof(nameLength))
+    {
+        cerr << RED << "Corrupt or unsupported index " << path << RESET << endl;
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    column.type = static_cast<int>(header[2]);
+    column.name.assign(page + HEADER_NAME + sizeof(nameLength), nameLength);
+    clean = header[3] != 0;
+    level = fields[0];
+    splitNext = fields[1];
+    entries = fields[2];
+    pageCount = fields[3];
+    indexed = fields[4];
+    groupStarts.resize(fields[5]);
+    memcpy(groupStarts.data(), page + 64, fields[5] * sizeof(uint64_t));
+}
+
+HashIndex::~HashIndex()
+{
+    close();
+}
+
+void HashIndex::close()
+{
+    if (fd < 0)
+        return;
+    bufferPool().dropFile(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+static bool writeHeaderPage(int fd, const ColumnInfo &column, bool clean, const uint64_t (&fields)[5],
+                            const vector<uint64_t> &groupStarts)
+{
+    char page[PAGE_SIZE] = {};
+    uint32_t header[4] = {HASH_INDEX_MAGIC, HASH_INDEX_VERSION, static_cast<uint32_t>(column.type), clean ? 1u : 0u};
+    uint64_t groups = groupStarts.size();
+    uint32_t nameLength = static_cast<uint32_t>(min(column.name.size(), PAGE_SIZE - HEADER_NAME - sizeof(uint32_t)));
+    memcpy(page, header, sizeof(header));
+    memcpy(page + 16, fields, sizeof(fields));
+    memcpy(page + 56, &groups, sizeof(groups));
+    memcpy(page + 64, groupStarts.data(), groups * sizeof(uint64_t));
+    memcpy(page + HEADER_NAME, &nameLength, sizeof(nameLength));
+    memcpy(page + HEADER_NAME + sizeof(nameLength), column.name.data(), nameLength);
+    ssize_t n;
+    while ((n = pwrite(fd, page, PAGE_SIZE, 0)) < 0 && errno == EINTR)
+    {
+    }
+    return n == static_cast<ssize_t>(PAGE_SIZE) && fdatasync(fd) == 0;
+}
+
+bool HashIndex::writeHeader()
+{
+    uint64_t fields[5] = {level, splitNext, entries, pageCount, indexed};
+    if (writeHeaderPage(fd, column, clean, fields, groupStarts))
+        return true;
+    cerr << RED << "Failed to write the header of index " << path << RESET << endl;
+    return false;
+}
+
+// A new index has group 0 reserved right after the header
+bool createHashIndexFile(const string &path, const ColumnInfo &column)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+    uint64_t fields[5] = {0, 0, 0, 1 + HASH_INITIAL_BUCKETS, 0};
+    bool ok = writeHeaderPage(fd, column, true, fields, {1});
+    close(fd);
+    return ok;
+}
+
+bool HashIndex::keyWordOf(const Value &value, uint64_t &word) const
+{
+    if (value.type != column.type)
+        return false;
+    switch (value.type)
+    {
+    case TYPE_INT:
+        word = intKeyWord(value.i);
+        return true;
+    case TYPE_FLOAT:
+        word = floatKeyWord(value.f);
+        return true;
+    case TYPE_DATE:
+        word = intKeyWord(value.d);
+        return true;
+    case TYPE_STRING:
+        word = stringKeyWord(value.s);
+        return true;
+    }
+    return false;
+}
+
+// Buckets below the split pointer have been split this round and are addressed with
+// one more bit
+uint64_t HashIndex::bucketOf(uint64_t word) const
+{
+    uint64_t hash = mix(word), round = HASH_INITIAL_BUCKETS << level;
+    uint64_t bucket = hash % round;
+    return bucket < splitNext ? hash % (2 * round) : bucket;
+}
+
+// The primary page of a bucket, reserving its group's pages when it is the first
+uint64_t HashIndex::bucketPage(uint64_t bucket)
+{
+    size_t group = 0;
+    uint64_t first = 0;
+    if (bucket >= HASH_INITIAL_BUCKETS)
+    {
+        group = 63 - __builtin_clzll(bucket / HASH_INITIAL_BUCKETS) + 1;
+        first = HASH_INITIAL_BUCKETS << (group - 1);
+    }
+    while (groupStarts.size() <= group)
+    {
+        groupStarts.push_back(pageCount);
+        pageCount += groupStarts.size() == 1 ? HASH_INITIAL_BUCKETS : HASH_INITIAL_BUCKETS << (groupStarts.size() - 2);
+    }
+    return groupStarts[group] + (bucket - first);
+}
+
+bool HashIndex::markDirty()
+{
+    if (!clean)
+        return true;
+    clean = false;
+    return writeHeader();
+}
+
+// Adds an entry to the first page of the bucket's chain with room, extending the chain
+// with a new overflow page when all are full
+bool HashIndex::append(uint64_t bucket, uint64_t word, uint64_t rowId)
+{
+    uint64_t pageNo = bucketPage(bucket);
+    while (true)
+    {
+        PinnedPage page(fd, pageNo);
+        if (!page.data)
+            return false;
+        size_t count = bucketCount(page.data);
+        if (count < BUCKET_CAPACITY)
+        {
+            char *entry = page.data + BUCKET_HEADER + count * HASH_ENTRY;
+            memcpy(entry, &word, sizeof(word));
+            memcpy(entry + sizeof(word), &rowId, sizeof(rowId));
+            setBucketCount(page.data, count + 1);
+            page.dirty = true;
+            return true;
+        }
+        pageNo = overflowPage(page.data);
+        if (pageNo == 0)
+        {
+            pageNo = pageCount++;
+            setOverflowPage(page.data, pageNo);
+            page.dirty = true;
+        }
+    }
+}
+
+// Splits the bucket under the split pointer: its entries either stay or move to the
+// bucket one round above it. Its chain keeps its pages, refilled from the start.
+bool HashIndex::split()
+{
+    uint64_t round = HASH_INITIAL_BUCKETS << level, low = splitNext, high = round + splitNext;
+    vector<uint64_t> chain;
+    vector<pair<uint64_t, uint64_t>> stay, moved;
+    for (uint64_t pageNo = bucketPage(low); pageNo != 0;)
+    {
+        PinnedPage page(fd, pageNo);
+        if (!page.data)
+            return false;
+        chain.push_back(pageNo);
+        size_t count = bucketCount(page.data);
+        for (size_t i = 0; i < count; i++)
+        {
+            pair<uint64_t, uint64_t> entry;
+            memcpy(&entry.first, page.data + BUCKET_HEADER + i * HASH_ENTRY, sizeof(uint64_t));
+            memcpy(&entry.second, page.data + BUCKET_HEADER + i * HASH_ENTRY + sizeof(uint64_t), sizeof(uint64_t));
+            (mix(entry.first) % (2 * round) == low ? stay : moved).push_back(entry);
+        }
+        pageNo = overflowPage(page.data);
+    }
+
+    size_t next = 0;
+    for (uint64_t pageNo : chain)
+    {
+        PinnedPage page(fd, pageNo);
+        if (!page.data)
+            return false;
+        size_t count = min(BUCKET_CAPACITY, stay.size() - next);
+        for (size_t i = 0; i < count; i++, next++)
+        {
+            memcpy(page.data + BUCKET_HEADER + i * HASH_ENTRY, &stay[next].first, sizeof(uint64_t));
+            memcpy(page.data + BUCKET_HEADER + i * HASH_ENTRY + sizeof(uint64_t), &stay[next].second, sizeof(uint64_t));
+        }
+        setBucketCount(page.data, count);
+        page.dirty = true;
+    }
+
+    if (++splitNext == round)
+    {
+        level++;
+        splitNext = 0;
+    }
+    for (const auto &entry : moved)
+    {
+        if (!append(high, entry.first, entry.second))
+            return false;
+    }
+    return true;
+}
+
+// Splits one bucket whenever the table passes half full. Buckets not yet split this round
+// hold up to twice as many entries as those that have been, which then still fit a page.
+bool HashIndex::insert(uint64_t word, uint64_t rowId)
+{
+    if (!append(bucketOf(word), word, rowId))
+        return false;
+    entries++;
+    uint64_t buckets = (HASH_INITIAL_BUCKETS << level) + splitNext;
+    return entries * 2 <= buckets * BUCKET_CAPACITY || split();
+}
+
+// Appends the row IDs of the entries with the key word
+bool HashIndex::find(uint64_t word, vector<uint64_t> &rowIds)
+{
+    for (uint64_t pageNo = bucketPage(bucketOf(word)); pageNo != 0;)
+    {
+        PinnedPage page(fd, pageNo);
+        if (!page.data)
+            return false;
+        pagesRead++;
+        size_t count = bucketCount(page.data);
+        const char *entry = page.data + BUCKET_HEADER;
+        for (size_t i = 0; i < count; i++, entry += HASH_ENTRY)
+        {
+            uint64_t stored;
+            memcpy(&stored, entry, sizeof(stored));
+            if (stored == word)
+            {
+                uint64_t rowId;
+                memcpy(&rowId, entry + sizeof(word), sizeof(rowId));
+                rowIds.push_back(rowId);
+            }
+        }
+        pageNo = overflowPage(page.data);
+    }
+    return true;
+}
+
+// Empties the table back to its first group; it stays dirty until the next checkpoint
+bool HashIndex::reset()
+{
+    if (!markDirty())
+        return false;
+    bufferPool().dropFile(fd);
+    if (ftruncate(fd, PAGE_SIZE) != 0)
+        return false;
+    level = 0;
+    splitNext = 0;
+    entries = 0;
+    groupStarts = {1};
+    pageCount = 1 + HASH_INITIAL_BUCKETS;
+    indexed = 0;
+    return true;
+}
+
+// Makes the table as of rows table rows durable: pages first, then the clean header
+bool HashIndex::checkpoint(uint64_t rows)
+{
+    if (clean && indexed == rows)
+        return true;
+    if (!bufferPool().flushFile(fd) || fdatasync(fd) != 0)
+    {
+        cerr << RED << "Failed to flush index " << path << RESET << endl;
+        return false;
+    }
+    clean = true;
+    indexed = rows;
+    return writeHeader();
+}
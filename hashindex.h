@@ -0,0 +1,80 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include "storage.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// On-disk layout of a table's primary key index, <table dir>/primary.hash, a linear
+// hash table:
+//   page 0      header: magic, format version, key type, clean flag, level, split
+//               pointer, entry count, page count, rows indexed at the last
+//               checkpoint, first page of each bucket group, column name
+//   page 1..    bucket pages: 16 byte page header (entry count, next overflow page),
+//               then entries of key word and row ID
+// Buckets come in groups: group 0 holds the first HASH_INITIAL_BUCKETS, and group g
+// the buckets from HASH_INITIAL_BUCKETS * 2^(g-1) up to twice that. A group's primary
+// pages are reserved together when the first of its buckets is split off, so a
+// bucket's page follows from its number; overflow pages are appended as chains grow.
+// A key word is the value itself for INT, FLOAT and DATE, and a 64-bit hash of a
+// STRING, whose matches the caller compares with the stored values.
+
+const uint32_t HASH_INDEX_MAGIC = 0x58444948; // "HIDX"
+const uint32_t HASH_INDEX_VERSION = 1;
+const uint64_t HASH_INITIAL_BUCKETS = 4;
+const char *const PRIMARY_KEY_FILE = "primary.hash";
+
+uint64_t intKeyWord(int64_t value); // INT and DATE
+uint64_t floatKeyWord(double value);
+uint64_t stringKeyWord(string_view value);
+
+class HashIndex
+{
+private:
+    string path;
+    int fd = -1;
+    ColumnInfo column;
+    uint64_t level = 0;     // rounds of doubling completed
+    uint64_t splitNext = 0; // next bucket to split
+    uint64_t entries = 0;
+    uint64_t pageCount = 1;
+    uint64_t indexed = 0;
+    bool clean = true;
+    vector<uint64_t> groupStarts;
+    uint64_t pagesRead = 0;
+
+    bool writeHeader();
+    uint64_t bucketOf(uint64_t word) const;
+    uint64_t bucketPage(uint64_t bucket);
+    bool append(uint64_t bucket, uint64_t word, uint64_t rowId);
+    bool split();
+
+public:
+    explicit HashIndex(const string &path);
+    ~HashIndex();
+    HashIndex(const HashIndex &) = delete;
+    HashIndex &operator=(const HashIndex &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    const ColumnInfo &columnInfo() const { return column; }
+    bool exact() const { return column.type != TYPE_STRING; } // key words are the values
+    uint64_t indexedRows() const { return indexed; }
+    bool isClean() const { return clean; }
+    uint64_t pageReads() const { return pagesRead; }
+
+    bool keyWordOf(const Value &value, uint64_t &word) const;
+    bool markDirty();
+    bool insert(uint64_t word, uint64_t rowId);
+    bool find(uint64_t word, vector<uint64_t> &rowIds);
+    bool reset();
+    bool checkpoint(uint64_t rows);
+    void close();
+};
+
+bool createHashIndexFile(const string &path, const ColumnInfo &column);
+
+#endif // HASHINDEX_H
@@ -0,0 +1,841 @@
+#include "join.h"
+#include "bloom.h"
+#include "exec.h"
+#include "globals.h"
+#include "hashindex.h"
+#include "scan.h"
+#include "storage.h"
+#include "table.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <unistd.h>
+using namespace std;
+
+static const uint64_t NO_ROW = UINT64_MAX;
+static const uint64_t RUNTIME_FILTER_TESTS = 1 << 20; // Bloom filter tests, at most
+
+// How two join keys are compared. INT, DATE and BOOL keys compare as integers, FLOAT
+// keys (and INT keys joined with a FLOAT column) as normalized double bits, and STRING
+// keys by their bytes.
+enum KeyKind
+{
+    KEY_FIXED,
+    KEY_FLOAT,
+    KEY_TEXT
+};
+
+// Join keys of a run of rows, stored column-wise. NULL keys are kept, so outer joins
+// can return their rows, but they never match.
+struct JoinKeys
+{
+    vector<uint64_t> rows;
+    vector<uint64_t> hashes;
+    vector<int64_t> fixed;
+    vector<string_view> text;
+    vector<uint8_t> nulls;
+
+    size_t size() const { return rows.size(); }
+
+    void clear()
+    {
+        rows.clear();
+        hashes.clear();
+        fixed.clear();
+        text.clear();
+        nulls.clear();
+    }
+
+    void push(uint64_t row, uint64_t hash, int64_t key, string_view keyText, bool null)
+    {
+        rows.push_back(row);
+        hashes.push_back(hash);
+        fixed.push_back(key);
+        text.push_back(keyText);
+        nulls.push_back(null);
+    }
+};
+
+// Heap bytes per key held by JoinKeys and the hash table, not counting STRING bytes
+static const size_t KEY_BYTES = 8 + 8 + 8 + sizeof(string_view) + 1 + 4 + 8;
+
+static uint64_t mixHash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int64_t floatKey(double value)
+{
+    if (value == 0)
+        value = 0; // -0.0 joins 0.0
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Appends the keys of a key-column batch; returns the STRING bytes they refer to
+static size_t appendKeys(const Batch &batch, KeyKind kind, JoinKeys &keys)
+{
+    const ColumnVector &column = batch.columns[0];
+    size_t textBytes = 0;
+    for (size_t k = 0; k < batch.size; k++)
+    {
+        uint64_t row = batch.firstRow + k;
+        if (column.nulls[k])
+        {
+            keys.push(row, 0, 0, string_view(), true);
+            continue;
+        }
+        int64_t key = 0;
+        string_view text;
+        switch (column.info.type)
+        {
+        case TYPE_INT:
+            key = kind == KEY_FLOAT ? floatKey(static_cast<double>(column.ints[k])) : column.ints[k];
+            break;
+        case TYPE_FLOAT:
+            key = floatKey(column.floats[k]);
+            break;
+        case TYPE_BOOL:
+            key = column.bools[k];
+            break;
+        case TYPE_STRING:
+            text = column.strings[k];
+            textBytes += text.size();
+            break;
+        case TYPE_DATE:
+            key = column.dates[k];
+            break;
+        }
+        uint64_t keyHash = mixHash(kind == KEY_TEXT ? hash<string_view>()(text) : static_cast<uint64_t>(key));
+        keys.push(row, keyHash, key, text, false);
+    }
+    return textBytes;
+}
+
+// Build side of the join, radix-partitioned on the top bits of the hash. Every
+// partition has its own bucket array and chains, laid out contiguously, so building
+// and probing a partition touches a region small enough to stay in cache.
+class JoinHashTable
+{
+private:
+    JoinKeys keys; // build rows grouped by partition
+    KeyKind kind = KEY_FIXED;
+    unsigned partitionBits = 0;
+    vector<uint32_t> bucketStart; // first bucket of each partition, plus the end
+    vector<uint32_t> buckets;     // key index + 1 heading each chain, 0 when empty
+    vector<uint32_t> chain;       // key index + 1 of the next key in the same bucket
+
+    size_t partitionOf(uint64_t hash) const { return partitionBits ? hash >> (64 - partitionBits) : 0; }
+
+public:
+    vector<uint8_t> matched;
+
+    void build(const JoinKeys &input, KeyKind keyKind)
+    {
+        kind = keyKind;
+        size_t n = input.size();
+        partitionBits = 0;
+        while ((n >> partitionBits) > 4096 && partitionBits < 10)
+            partitionBits++;
+        size_t partitions = size_t(1) << partitionBits;
+
+        // Scatter the keys into partition order
+        vector<size_t> start(partitions + 1, 0);
+        for (size_t i = 0; i < n; i++)
+            start[partitionOf(input.hashes[i]) + 1]++;
+        for (size_t p = 0; p < partitions; p++)
+            start[p + 1] += start[p];
+        vector<size_t> order(n);
+        vector<size_t> cursor(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < n; i++)
+            order[cursor[partitionOf(input.hashes[i])]++] = i;
+        keys.clear();
+        for (size_t i : order)
+            keys.push(input.rows[i], input.hashes[i], input.fixed[i], input.text[i], input.nulls[i]);
+
+        // A power-of-two bucket array per partition, at least as large as the partition
+        bucketStart.assign(partitions + 1, 0);
+        for (size_t p = 0; p < partitions; p++)
+        {
+            size_t count = 1;
+            while (count < start[p + 1] - start[p])
+                count <<= 1;
+            bucketStart[p + 1] = static_cast<uint32_t>(bucketStart[p] + count);
+        }
+        buckets.assign(bucketStart[partitions], 0);
+        chain.assign(n, 0);
+        for (size_t p = 0; p < partitions; p++)
+        {
+            uint32_t base = bucketStart[p], mask = bucketStart[p + 1] - base - 1;
+            for (size_t i = start[p]; i < start[p + 1]; i++)
+            {
+                if (keys.nulls[i])
+                    continue;
+                uint32_t &head = buckets[base + (keys.hashes[i] & mask)];
+                chain[i] = head;
+                head = static_cast<uint32_t>(i + 1);
+            }
+        }
+        matched.assign(n, 0);
+    }
+
+    template <typename F>
+    void probe(uint64_t hash, int64_t key, string_view text, F onMatch) const
+    {
+        size_t p = partitionOf(hash);
+        uint32_t base = bucketStart[p], mask = bucketStart[p + 1] - base - 1;
+        for (uint32_t i = buckets[base + (hash & mask)]; i != 0; i = chain[i - 1])
+        {
+            size_t index = i - 1;
+            if (keys.hashes[index] == hash && (kind == KEY_TEXT ? keys.text[index] == text : keys.fixed[index] == key))
+                onMatch(index);
+        }
+    }
+
+    const JoinKeys &rows() const { return keys; }
+};
+
+// Marks the blocks of the probe table whose zone map range or Bloom filter index on the
+// key column rules out every build key, so the probe scan steps over them. Bloom filter
+// tests cost a page pin each and are only made when there are few enough of them. Empty
+// when no block can be skipped.
+static vector<uint8_t> runtimeFilter(const JoinKeys &build, KeyKind kind, const TableStorage &probe, size_t column,
+                                     uint64_t blocks)
+{
+    int type = probe.columnFiles()[column].info.type;
+    if (kind == KEY_FLOAT && type != TYPE_FLOAT)
+        return {}; // INT keys compared as doubles
+    const vector<ZoneStats> *zones = hasZoneMap(type) ? &probe.zoneMap(column) : nullptr;
+    BloomIndex *filter = probe.findBloom(column);
+    if (!zones && !filter)
+        return {};
+
+    int64_t low = INT64_MAX, high = INT64_MIN;
+    vector<uint64_t> words;
+    for (size_t i = 0; i < build.size(); i++)
+    {
+        if (build.nulls[i])
+            continue;
+        int64_t key = build.fixed[i];
+        uint64_t word;
+        if (kind == KEY_FLOAT)
+        {
+            double value;
+            memcpy(&value, &build.fixed[i], sizeof(value));
+            key = floatZoneKey(value);
+            word = floatKeyWord(value);
+        }
+        else
+        {
+            word = kind == KEY_TEXT ? stringKeyWord(build.text[i]) : intKeyWord(key);
+        }
+        low = min(low, key);
+        high = max(high, key);
+        if (filter)
+            words.push_back(word);
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    if (filter && blocks * words.size() > RUNTIME_FILTER_TESTS)
+    {
+        filter = nullptr;
+        if (!zones)
+            return {};
+    }
+
+    vector<uint8_t> skip(blocks);
+    bool any = false;
+    for (uint64_t z = 0; z < blocks; z++)
+    {
+        bool outside = zones && z < zones->size() && ((*zones)[z].low > high || (*zones)[z].high < low);
+        skip[z] = outside || (filter && none_of(words.begin(), words.end(),
+                                                 [&](uint64_t word) { return filter->mayContain(z, word); }));
+        any = any || skip[z];
+    }
+    if (!any)
+        skip.clear();
+    return skip;
+}
+
+// Spill records: row, hash, null flag, then the key as 8 bytes or a length and bytes
+static void writeKey(ofstream &out, const JoinKeys &keys, size_t i, KeyKind kind)
+{
+    out.write(reinterpret_cast<const char *>(&keys.rows[i]), 8);
+    out.write(reinterpret_cast<const char *>(&keys.hashes[i]), 8);
+    out.put(static_cast<char>(keys.nulls[i]));
+    if (keys.nulls[i])
+        return;
+    if (kind == KEY_TEXT)
+    {
+        uint32_t length = static_cast<uint32_t>(keys.text[i].size());
+        out.write(reinterpret_cast<const char *>(&length), 4);
+        out.write(keys.text[i].data(), length);
+    }
+    else
+    {
+        out.write(reinterpret_cast<const char *>(&keys.fixed[i]), 8);
+    }
+}
+
+// Reads up to maxRows records; STRING keys are views into arena. False at end of file.
+static bool readKeys(ifstream &in, KeyKind kind, size_t maxRows, JoinKeys &keys, string &arena)
+{
+    keys.clear();
+    arena.clear();
+    vector<pair<size_t, uint32_t>> spans;
+    while (keys.size() < maxRows)
+    {
+        uint64_t row, hash;
+        char null;
+        if (!in.read(reinterpret_cast<char *>(&row), 8) || !in.read(reinterpret_cast<char *>(&hash), 8) || !in.get(null))
+            break;
+        int64_t key = 0;
+        uint32_t length = 0;
+        if (!null && kind == KEY_TEXT)
+        {
+            in.read(reinterpret_cast<char *>(&length), 4);
+            spans.push_back({arena.size(), length});
+            arena.resize(arena.size() + length);
+            in.read(&arena[arena.size() - length], length);
+        }
+        else if (!null)
+        {
+            in.read(reinterpret_cast<char *>(&key), 8);
+        }
+        keys.push(row, hash, key, string_view(), null);
+    }
+    // Views are taken once the arena stops growing
+    for (size_t i = 0, s = 0; i < keys.size() && kind == KEY_TEXT; i++)
+    {
+        if (!keys.nulls[i])
+        {
+            keys.text[i] = string_view(arena.data() + spans[s].first, spans[s].second);
+            s++;
+        }
+    }
+    return keys.size() > 0;
+}
+
+// Joins key-only scans of both tables and returns batches of the output columns, read
+// by row ID from the data scans (left columns, then right). The build side is held in
+// memory until it exceeds joinMemoryBytes; past that both sides are hash-partitioned
+// into spill files under the build table's directory and joined a partition at a time
+// (grace hash join). Unless its unmatched rows are kept, the probe scan skips blocks
+// that cannot hold any key of an in-memory build side (runtimeFilter()).
+class HashJoinOperator : public Operator
+{
+private:
+    TableScan &buildKeys, &probeKeys;
+    TableScan &leftData, &rightData;
+    const TableStorage &probeStorage;
+    size_t probeColumn;
+    KeyKind kind;
+    bool buildIsLeft, keepBuild, keepProbe;
+    string spillDir;
+    bool spilled = false;
+
+    bool started = false, probeDone = false;
+    JoinHashTable table;
+    JoinKeys probe;
+    string buildArena, probeArena;
+    size_t partition = 0, partitions = 0;
+    ifstream probeFile;
+    vector<uint64_t> pendingLeft, pendingRight;
+    size_t pendingPos = 0;
+    Batch keyBatch;
+
+    size_t spillPartition(uint64_t hash) const { return (hash >> 32) & (partitions - 1); }
+    string spillFile(const char *side, size_t p) const { return spillDir + "/" + side + to_string(p); }
+
+    void emit(uint64_t buildRow, uint64_t probeRow)
+    {
+        pendingLeft.push_back(buildIsLeft ? buildRow : probeRow);
+        pendingRight.push_back(buildIsLeft ? probeRow : buildRow);
+    }
+
+    void probeAll(const JoinKeys &keys)
+    {
+        const JoinKeys &built = table.rows();
+        for (size_t k = 0; k < keys.size(); k++)
+        {
+            bool found = false;
+            if (!keys.nulls[k])
+            {
+                table.probe(keys.hashes[k], keys.fixed[k], keys.text[k], [&](size_t index) {
+                    found = true;
+                    table.matched[index] = 1;
+                    emit(built.rows[index], keys.rows[k]);
+                });
+            }
+            if (!found && keepProbe)
+                emit(NO_ROW, keys.rows[k]);
+        }
+    }
+
+    void emitUnmatchedBuild()
+    {
+        const JoinKeys &built = table.rows();
+        for (size_t i = 0; i < built.size(); i++)
+        {
+            if (!table.matched[i])
+                emit(built.rows[i], NO_ROW);
+        }
+    }
+
+    void start()
+    {
+        JoinKeys build;
+        size_t bytes = 0;
+        while (buildKeys.nextBatch(keyBatch))
+        {
+            bytes += appendKeys(keyBatch, kind, build) + keyBatch.size * KEY_BYTES;
+            trackMemory(bytes);
+            if (bytes > joinMemoryBytes)
+            {
+                spill(build, bytes);
+                return;
+            }
+        }
+        if (!keepProbe)
+            probeKeys.skipZones(runtimeFilter(build, kind, probeStorage, probeColumn, probeKeys.zoneCount()));
+        table.build(build, kind);
+    }
+
+    // Writes both inputs to partition files, sized so each build partition fits the budget
+    void spill(JoinKeys &build, size_t bytes)
+    {
+        spilled = true;
+        double estimate = double(bytes) * buildKeys.rowCount() / max<size_t>(build.size(), 1);
+        partitions = 2;
+        while (partitions < 256 && estimate / partitions > joinMemoryBytes / 2)
+            partitions <<= 1;
+        filesystem::create_directories(spillDir);
+
+        vector<ofstream> files(partitions);
+        for (size_t p = 0; p < partitions; p++)
+            files[p].open(spillFile("build", p), ios::binary);
+        while (true)
+        {
+            for (size_t i = 0; i < build.size(); i++)
+                writeKey(files[spillPartition(build.hashes[i])], build, i, kind);
+            build.clear();
+            if (!buildKeys.nextBatch(keyBatch))
+                break;
+            appendKeys(keyBatch, kind, build);
+        }
+        for (size_t p = 0; p < partitions; p++)
+        {
+            files[p].close();
+            files[p].open(spillFile("probe", p), ios::binary);
+        }
+        while (probeKeys.nextBatch(keyBatch))
+        {
+            probe.clear();
+            appendKeys(keyBatch, kind, probe);
+            for (size_t i = 0; i < probe.size(); i++)
+                writeKey(files[spillPartition(probe.hashes[i])], probe, i, kind);
+        }
+        for (auto &file : files)
+            file.close();
+        loadPartition(0);
+    }
+
+    void loadPartition(size_t p)
+    {
+        JoinKeys build;
+        ifstream in(spillFile("build", p), ios::binary);
+        readKeys(in, kind, SIZE_MAX, build, buildArena);
+        trackMemory(buildArena.size() + build.size() * KEY_BYTES);
+        table.build(build, kind);
+        probeFile.close();
+        probeFile.clear();
+        probeFile.open(spillFile("probe", p), ios::binary);
+    }
+
+    // Adds the next run of output rows to the pending list; false once there are none
+    bool fill()
+    {
+        if (!started)
+        {
+            started = true;
+            start();
+        }
+        if (!spilled)
+        {
+            if (probeDone)
+                return false;
+            if (probeKeys.nextBatch(keyBatch))
+            {
+                probe.clear();
+                appendKeys(keyBatch, kind, probe);
+                probeAll(probe);
+                return true;
+            }
+            probeDone = true;
+            if (keepBuild)
+                emitUnmatchedBuild();
+            return true;
+        }
+        if (partition >= partitions)
+            return false;
+        if (readKeys(probeFile, kind, BATCH_SIZE, probe, probeArena))
+        {
+            probeAll(probe);
+            return true;
+        }
+        if (keepBuild)
+            emitUnmatchedBuild();
+        if (++partition < partitions)
+            loadPartition(partition);
+        return true;
+    }
+
+public:
+    HashJoinOperator(TableScan &buildKeys, TableScan &probeKeys, TableScan &leftData, TableScan &rightData,
+                     const TableStorage &probeStorage, size_t probeColumn, KeyKind kind, bool buildIsLeft,
+                     bool keepBuild, bool keepProbe, string spillDir)
+        : buildKeys(buildKeys), probeKeys(probeKeys), leftData(leftData), rightData(rightData),
+          probeStorage(probeStorage), probeColumn(probeColumn), kind(kind), buildIsLeft(buildIsLeft),
+          keepBuild(keepBuild), keepProbe(keepProbe), spillDir(move(spillDir)) {}
+
+    ~HashJoinOperator() override
+    {
+        if (spilled)
+        {
+            probeFile.close();
+            error_code ec;
+            filesystem::remove_all(spillDir, ec);
+        }
+    }
+
+    string describe() const override
+    {
+        bool keepLeft = buildIsLeft ? keepBuild : keepProbe, keepRight = buildIsLeft ? keepProbe : keepBuild;
+        string type = keepLeft && keepRight ? "FULL" : keepLeft ? "LEFT" : keepRight ? "RIGHT" : "INNER";
+        string text = "Hash join (" + type + ", build on " + (buildIsLeft ? "left" : "right");
+        if (spilled)
+            text += ", " + countOf(partitions, "partition") + " spilled";
+        if (probeKeys.skippedZones() > 0)
+            text += ", " + to_string(probeKeys.skippedZones()) + " of " + countOf(probeKeys.zoneCount(), "probe block") +
+                    " skipped";
+        return text + ")";
+    }
+
+    uint64_t rowsRead() const override { return buildKeys.rowsRead() + probeKeys.rowsRead(); }
+
+    uint64_t bytesRead() const override
+    {
+        return buildKeys.bytesRead() + probeKeys.bytesRead() + leftData.materializedBytes() +
+               rightData.materializedBytes();
+    }
+
+    bool next(Batch &batch) override
+    {
+        if (pendingPos > 0)
+        {
+            pendingLeft.erase(pendingLeft.begin(), pendingLeft.begin() + pendingPos);
+            pendingRight.erase(pendingRight.begin(), pendingRight.begin() + pendingPos);
+            pendingPos = 0;
+        }
+        while (pendingLeft.size() < BATCH_SIZE && fill())
+        {
+        }
+        size_t n = min(BATCH_SIZE, pendingLeft.size());
+        if (n == 0)
+            return false;
+
+        size_t leftWidth = leftData.columnCount(), width = leftWidth + rightData.columnCount();
+        batch.firstRow = 0;
+        batch.size = n;
+        batch.columns.resize(width);
+        for (size_t i = 0; i < leftWidth; i++)
+            leftData.gather(i, pendingLeft.data(), n, batch.columns[i]);
+        for (size_t i = leftWidth; i < width; i++)
+            rightData.gather(i - leftWidth, pendingRight.data(), n, batch.columns[i]);
+        pendingPos = n;
+
+        for (size_t k = 0; k < n; k++)
+            batch.selection[k] = static_cast<uint16_t>(k);
+        batch.selected = n;
+        batch.projection.resize(width);
+        for (size_t i = 0; i < width; i++)
+            batch.projection[i] = i;
+        return true;
+    }
+};
+
+// A column of the join: side 0 is the left table, 1 the right
+struct JoinColumn
+{
+    int side;
+    size_t index;
+};
+
+static bool resolveColumn(const string &name, const JoinQuery &query, const vector<ColumnInfo> *schemas[2],
+                          JoinColumn &out, string &error)
+{
+    const string *tables[2] = {&query.leftTable, &query.rightTable};
+    size_t dot = name.find('.');
+    string table = dot == string::npos ? "" : name.substr(0, dot);
+    string column = dot == string::npos ? name : name.substr(dot + 1);
+    int found = 0;
+    for (int side = 0; side < 2; side++)
+    {
+        if (!table.empty() && table != *tables[side])
+            continue;
+        for (size_t i = 0; i < schemas[side]->size(); i++)
+        {
+            if ((*schemas[side])[i].name == column)
+            {
+                out = {side, i};
+                found++;
+            }
+        }
+    }
+    if (found == 1)
+        return true;
+    error = found > 1 ? "Column '" + name + "' is ambiguous; write it as table.column"
+                      : "Unknown column '" + name + "' in join of " + query.leftTable + " and " + query.rightTable;
+    return false;
+}
+
+// Rewrites every column of expr to its table.column form
+static bool qualifyColumns(Expr &expr, const JoinQuery &query, const vector<ColumnInfo> *schemas[2], string &error)
+{
+    if (expr.kind == EXPR_COLUMN)
+    {
+        JoinColumn column;
+        if (!resolveColumn(expr.text, query, schemas, column, error))
+            return false;
+        expr.text = (column.side == 0 ? query.leftTable : query.rightTable) + "." +
+                    (*schemas[column.side])[column.index].name;
+    }
+    for (auto &child : expr.children)
+    {
+        if (!qualifyColumns(*child, query, schemas, error))
+            return false;
+    }
+    return true;
+}
+
+static bool joinKeyKind(int leftType, int rightType, KeyKind &kind)
+{
+    if (leftType == rightType)
+    {
+        kind = leftType == TYPE_STRING ? KEY_TEXT : leftType == TYPE_FLOAT ? KEY_FLOAT : KEY_FIXED;
+        return true;
+    }
+    if ((leftType == TYPE_INT && rightType == TYPE_FLOAT) || (leftType == TYPE_FLOAT && rightType == TYPE_INT))
+    {
+        kind = KEY_FLOAT;
+        return true;
+    }
+    return false;
+}
+
+void displayJoin(Database &db, const JoinQuery &query)
+{
+    if (query.leftTable == query.rightTable)
+    {
+        cerr << RED << "Error: Joining a table with itself is not supported." << RESET << endl;
+        return;
+    }
+    Table left = selectTable(db, query.leftTable);
+    Table right = selectTable(db, query.rightTable);
+    if (left.getName().empty() || right.getName().empty())
+    {
+        return;
+    }
+    const vector<ColumnInfo> *schemas[2] = {db.tableSchema(query.leftTable), db.tableSchema(query.rightTable)};
+
+    // ON must be one equality between a column of each table
+    string error;
+    const Expr &on = *query.on;
+    JoinColumn keys[2];
+    if (on.kind != EXPR_COMPARE || on.op != CMP_EQ || on.children[0]->kind != EXPR_COLUMN ||
+        on.children[1]->kind != EXPR_COLUMN)
+    {
+        cerr << RED << "Error: JOIN ... ON must compare one column of each table with '='." << RESET << endl;
+        return;
+    }
+    if (!resolveColumn(on.children[0]->text, query, schemas, keys[0], error) ||
+        !resolveColumn(on.children[1]->text, query, schemas, keys[1], error))
+    {
+        cerr << RED << "Error: " << error << "." << RESET << endl;
+        return;
+    }
+    if (keys[0].side == keys[1].side)
+    {
+        cerr << RED << "Error: JOIN ... ON must compare one column of each table with '='." << RESET << endl;
+        return;
+    }
+    if (keys[0].side == 1)
+        swap(keys[0], keys[1]);
+    KeyKind kind;
+    const ColumnInfo &leftKey = (*schemas[0])[keys[0].index], &rightKey = (*schemas[1])[keys[1].index];
+    if (!joinKeyKind(leftKey.type, rightKey.type, kind))
+    {
+        cerr << RED << "Error: Cannot join " << datatypeName.at(leftKey.type) << " column '" << leftKey.name << "' with "
+             << datatypeName.at(rightKey.type) << " column '" << rightKey.name << "'." << RESET << endl;
+        return;
+    }
+
+    // Output columns: * is every column of the left table, then the right
+    vector<JoinColumn> output;
+    vector<string> headers;
+    if (query.columnNames.empty())
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            for (size_t i = 0; i < schemas[side]->size(); i++)
+            {
+                const string &name = (*schemas[side])[i].name;
+                JoinColumn unused;
+                bool ambiguous = !resolveColumn(name, query, schemas, unused, error);
+                output.push_back({side, i});
+                headers.push_back(ambiguous ? (side == 0 ? query.leftTable : query.rightTable) + "." + name : name);
+            }
+        }
+    }
+    for (const string &name : query.columnNames)
+    {
+        JoinColumn column;
+        if (!resolveColumn(name, query, schemas, column, error))
+        {
+            cerr << RED << "Error: " << error << "." << RESET << endl;
+            return;
+        }
+        output.push_back(column);
+        headers.push_back(name);
+    }
+
+    vector<string> whereColumns;
+    if (query.where)
+    {
+        if (!qualifyColumns(*query.where, query, schemas, error))
+        {
+            cerr << RED << "Error: " << error << "." << RESET << endl;
+            return;
+        }
+        collectColumns(*query.where, whereColumns);
+    }
+
+    // Each table's data scan maps only the columns that are shown, filtered or sorted on
+    vector<size_t> dataColumns[2];
+    auto slotOf = [&](JoinColumn column) {
+        auto &list = dataColumns[column.side];
+        auto it = find(list.begin(), list.end(), column.index);
+        if (it == list.end())
+            it = list.insert(list.end(), column.index);
+        return it - list.begin();
+    };
+    for (const JoinColumn &column : output)
+        slotOf(column);
+    for (const string &name : whereColumns)
+    {
+        JoinColumn column;
+        resolveColumn(name, query, schemas, column, error);
+        slotOf(column);
+    }
+    vector<JoinColumn> orderColumns;
+    for (const OrderItem &item : query.orderBy)
+    {
+        JoinColumn column;
+        if (!resolveColumn(item.column, query, schemas, column, error))
+        {
+            cerr << RED << "Error: " << error << "." << RESET << endl;
+            return;
+        }
+        slotOf(column);
+        orderColumns.push_back(column);
+    }
+    auto joinedSlot = [&](JoinColumn column) {
+        size_t slot = slotOf(column);
+        return column.side == 0 ? slot : dataColumns[0].size() + slot;
+    };
+
+    vector<ColumnInfo> joinedColumns;
+    for (int side = 0; side < 2; side++)
+    {
+        for (size_t index : dataColumns[side])
+        {
+            const ColumnInfo &info = (*schemas[side])[index];
+            joinedColumns.push_back({(side == 0 ? query.leftTable : query.rightTable) + "." + info.name, info.type});
+        }
+    }
+    unique_ptr<Predicate> predicate;
+    if (query.where)
+    {
+        predicate = compilePredicate(*query.where, joinedColumns, error);
+        if (!predicate)
+        {
+            cerr << RED << "Error: " << error << "." << RESET << endl;
+            return;
+        }
+    }
+
+    TableStorage *leftStorage = left.openStorage();
+    TableStorage *rightStorage = right.openStorage();
+    if (!leftStorage || !rightStorage)
+    {
+        return;
+    }
+    TableScan leftKeys(*leftStorage, {keys[0].index}), rightKeys(*rightStorage, {keys[1].index});
+    TableScan leftData(*leftStorage, dataColumns[0]), rightData(*rightStorage, dataColumns[1]);
+    if (!leftKeys.isOpen() || !rightKeys.isOpen() || !leftData.isOpen() || !rightData.isOpen())
+    {
+        cerr << RED << "Failed to read tables " << query.leftTable << " and " << query.rightTable << RESET << endl;
+        return;
+    }
+
+    // Build on the smaller input; outer joins keep unmatched rows of their preserved side
+    bool buildIsLeft = leftKeys.rowCount() < rightKeys.rowCount();
+    bool keepLeft = query.type == JOIN_LEFT || query.type == JOIN_FULL;
+    bool keepRight = query.type == JOIN_RIGHT || query.type == JOIN_FULL;
+    static unsigned spillCount = 0;
+    string spillDir = "./Databases/" + db.getName() + "/" + (buildIsLeft ? query.leftTable : query.rightTable) +
+                      "/join-" + to_string(getpid()) + "-" + to_string(spillCount++);
+
+    unique_ptr<Operator> root = make_unique<HashJoinOperator>(
+        buildIsLeft ? leftKeys : rightKeys, buildIsLeft ? rightKeys : leftKeys, leftData, rightData,
+        buildIsLeft ? *rightStorage : *leftStorage, keys[buildIsLeft ? 1 : 0].index, kind, buildIsLeft,
+        buildIsLeft ? keepLeft : keepRight, buildIsLeft ? keepRight : keepLeft, spillDir);
+    if (predicate)
+        root = make_unique<FilterOperator>(move(root), move(predicate));
+    vector<size_t> outputSlots;
+    vector<ColumnInfo> outputColumns;
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        outputSlots.push_back(joinedSlot(output[i]));
+        outputColumns.push_back({headers[i], (*schemas[output[i].side])[output[i].index].type});
+    }
+    vector<SortKey> sortKeys;
+    for (size_t i = 0; i < orderColumns.size(); i++)
+        sortKeys.push_back({joinedSlot(orderColumns[i]), query.orderBy[i].descending});
+    if (!sortKeys.empty())
+        root = make_unique<SortOperator>(move(root), move(sortKeys), move(outputSlots),
+                                         sortLimit(query.limit, query.offset),
+                                         "./Databases/" + db.getName() + "/" + query.leftTable);
+    else
+        root = make_unique<ProjectOperator>(move(root), move(outputSlots));
+    if (query.limit != NO_LIMIT || query.offset > 0)
+        root = make_unique<LimitOperator>(move(root), query.limit, query.offset);
+
+    if (query.explain != EXPLAIN_NONE)
+    {
+        explainPipeline(root, query.explain);
+        return;
+    }
+    ResultSink sink(outputColumns);
+    writeResults(*root, sink);
+    sink.finish("No rows in join of " + query.leftTable + " and " + query.rightTable);
+}
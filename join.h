@@ -0,0 +1,39 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include "database.h"
+#include "expr.h"
+#include "orderby.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum JoinType
+{
+    JOIN_INNER,
+    JOIN_LEFT,
+    JOIN_RIGHT,
+    JOIN_FULL
+};
+
+// SELECT columnNames FROM leftTable <type> JOIN rightTable ON on [WHERE where]
+// [ORDER BY orderBy] [LIMIT limit] [OFFSET offset]. Columns are written table.column, or bare when only
+// one of the tables has them.
+struct JoinQuery
+{
+    vector<string> columnNames; // empty for *
+    string leftTable, rightTable;
+    JoinType type = JOIN_INNER;
+    Expr *on = nullptr;
+    Expr *where = nullptr;
+    vector<OrderItem> orderBy;
+    uint64_t limit = NO_LIMIT;
+    uint64_t offset = 0;
+    ExplainMode explain = EXPLAIN_NONE;
+};
+
+// Runs the query as a hash join on the ON columns and prints the result, or its plan
+void displayJoin(Database &db, const JoinQuery &query);
+
+#endif // JOIN_H
@@ -112,5 +112,6 @@ int main() {
     initializeDatabaseSystem();
     cout << "Database system initialized." << endl;
     mainMenu();
+    shutdownDatabaseSystem();
     return 0;
 }
@@ -0,0 +1,450 @@
+#include "orderby.h"
+#include "globals.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <unistd.h>
+
+// Runs merged at once; beyond this many, groups of runs are first merged into longer ones
+static const size_t MERGE_FANIN = 64;
+
+static void appendBigEndian(string &out, uint64_t value, size_t bytes)
+{
+    for (size_t i = bytes; i-- > 0;)
+        out += static_cast<char>(value >> (i * 8));
+}
+
+static string_view recordKey(const char *record)
+{
+    uint32_t length;
+    memcpy(&length, record, 4);
+    return string_view(record + 8, length);
+}
+
+static size_t recordSize(const char *record)
+{
+    uint32_t lengths[2];
+    memcpy(lengths, record, 8);
+    return 8 + size_t(lengths[0]) + lengths[1];
+}
+
+// The first eight key bytes as a number that orders the same way
+static uint64_t keyPrefix(string_view key)
+{
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+        prefix = prefix << 8 | (i < key.size() ? static_cast<uint8_t>(key[i]) : 0);
+    return prefix;
+}
+
+bool SortOperator::Run::next()
+{
+    uint32_t lengths[2];
+    if (!in.read(reinterpret_cast<char *>(lengths), 8))
+        return false;
+    record.resize(8 + size_t(lengths[0]) + lengths[1]);
+    memcpy(&record[0], lengths, 8);
+    return static_cast<bool>(in.read(&record[8], lengths[0] + lengths[1]));
+}
+
+SortOperator::SortOperator(unique_ptr<Operator> input, vector<SortKey> keys, vector<size_t> outputSlots, uint64_t limit,
+                           const string &tableDir)
+    : input(move(input)), keys(move(keys)), outputSlots(move(outputSlots)), limit(limit), topN(limit != NO_LIMIT)
+{
+    static unsigned spillCount = 0;
+    spillDir = tableDir + "/sort-" + to_string(getpid()) + "-" + to_string(spillCount++);
+}
+
+string SortOperator::describe() const
+{
+    string text = (topN ? "Top-N sort (" : "Sort (") + countOf(keys.size(), "key");
+    if (topN)
+        text += ", keep " + to_string(limit);
+    if (runsSpilled > 0)
+        text += ", " + countOf(runsSpilled, "run") + " spilled";
+    return text + ")";
+}
+
+SortOperator::~SortOperator()
+{
+    runs.clear();
+    if (!runFiles.empty())
+    {
+        error_code ec;
+        filesystem::remove_all(spillDir, ec);
+    }
+}
+
+// Key order, then arrival order, which the arena offsets preserve
+bool SortOperator::less(const Entry &a, const Entry &b) const
+{
+    if (a.prefix != b.prefix)
+        return a.prefix < b.prefix;
+    int c = recordKey(arena.data() + a.offset).compare(recordKey(arena.data() + b.offset));
+    return c != 0 ? c < 0 : a.offset < b.offset;
+}
+
+// Normalized key of row pos: per key a NULL marker then the value in big-endian,
+// sign-flipped form; strings escape 0x00 and end in 0x00 0x00 so shorter sorts first.
+// Descending keys are the bitwise complement.
+void SortOperator::encodeKey(const Batch &batch, size_t pos)
+{
+    key.clear();
+    for (const SortKey &sortKey : keys)
+    {
+        const ColumnVector &column = batch.columns[sortKey.slot];
+        size_t start = key.size();
+        key += column.nulls[pos] ? '\1' : '\0';
+        if (!column.nulls[pos])
+        {
+            switch (column.info.type)
+            {
+            case TYPE_INT:
+                appendBigEndian(key, static_cast<uint64_t>(column.ints[pos]) ^ (uint64_t(1) << 63), 8);
+                break;
+            case TYPE_FLOAT:
+            {
+                double value = column.floats[pos] == 0 ? 0.0 : column.floats[pos];
+                uint64_t bits;
+                memcpy(&bits, &value, 8);
+                appendBigEndian(key, bits >> 63 ? ~bits : bits | uint64_t(1) << 63, 8);
+                break;
+            }
+            case TYPE_BOOL:
+                key += static_cast<char>(column.bools[pos]);
+                break;
+            case TYPE_STRING:
+            {
+                string_view text = column.strings[pos];
+                if (!memchr(text.data(), 0, text.size()))
+                {
+                    key.append(text);
+                }
+                else
+                {
+                    for (char c : text)
+                    {
+                        key += c;
+                        if (c == '\0')
+                            key += '\xFF';
+                    }
+                }
+                key.append(2, '\0');
+                break;
+            }
+            case TYPE_DATE:
+                appendBigEndian(key, static_cast<uint32_t>(column.dates[pos]) ^ 0x80000000u, 4);
+                break;
+            }
+        }
+        if (sortKey.descending)
+        {
+            for (size_t i = start; i < key.size(); i++)
+                key[i] = static_cast<char>(~key[i]);
+        }
+    }
+}
+
+// Adds row pos, whose key is encoded, as a record: lengths, key, then per output
+// column a NULL flag and the value
+void SortOperator::append(const Batch &batch, size_t pos)
+{
+    size_t offset = arena.size();
+    uint32_t lengths[2] = {static_cast<uint32_t>(key.size()), 0};
+    arena.append(reinterpret_cast<const char *>(lengths), 8);
+    arena += key;
+    for (size_t slot : outputSlots)
+    {
+        const ColumnVector &column = batch.columns[slot];
+        arena += column.nulls[pos] ? '\1' : '\0';
+        if (column.nulls[pos])
+            continue;
+        switch (column.info.type)
+        {
+        case TYPE_INT:
+            arena.append(reinterpret_cast<const char *>(&column.ints[pos]), 8);
+            break;
+        case TYPE_FLOAT:
+            arena.append(reinterpret_cast<const char *>(&column.floats[pos]), 8);
+            break;
+        case TYPE_BOOL:
+            arena += static_cast<char>(column.bools[pos]);
+            break;
+        case TYPE_STRING:
+        {
+            uint32_t length = static_cast<uint32_t>(column.strings[pos].size());
+            arena.append(reinterpret_cast<const char *>(&length), 4);
+            arena.append(column.strings[pos]);
+            break;
+        }
+        case TYPE_DATE:
+            arena.append(reinterpret_cast<const char *>(&column.dates[pos]), 4);
+            break;
+        }
+    }
+    lengths[1] = static_cast<uint32_t>(arena.size() - offset - 8 - key.size());
+    memcpy(&arena[offset + 4], &lengths[1], 4);
+    entries.push_back({keyPrefix(key), offset});
+}
+
+// Top-N: entries is a heap with the worst kept row on top, and a row only gets in by
+// beating it. Ties go to the row that came first.
+void SortOperator::offer(const Batch &batch, size_t pos)
+{
+    auto byKey = [this](const Entry &a, const Entry &b) { return less(a, b); };
+    encodeKey(batch, pos);
+    if (entries.size() == limit)
+    {
+        const Entry &worst = entries.front();
+        uint64_t prefix = keyPrefix(key);
+        if (prefix > worst.prefix ||
+            (prefix == worst.prefix && string_view(key).compare(recordKey(arena.data() + worst.offset)) >= 0))
+            return;
+        pop_heap(entries.begin(), entries.end(), byKey);
+        liveBytes -= recordSize(arena.data() + entries.back().offset);
+        entries.pop_back();
+    }
+    append(batch, pos);
+    liveBytes += recordSize(arena.data() + entries.back().offset);
+    push_heap(entries.begin(), entries.end(), byKey);
+
+    // Evicted rows stay in the arena until it is mostly garbage
+    if (arena.size() > 2 * liveBytes + (1 << 20))
+        compact();
+    // A limit too large to keep in memory is sorted like a query without one
+    if (liveBytes + entries.size() * sizeof(Entry) > sortMemoryBytes)
+    {
+        compact();
+        topN = false;
+    }
+}
+
+// Copies the live records to a fresh arena, keeping their order
+void SortOperator::compact()
+{
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.offset < b.offset; });
+    string packed;
+    packed.reserve(liveBytes);
+    for (Entry &entry : entries)
+    {
+        size_t size = recordSize(arena.data() + entry.offset);
+        size_t offset = packed.size();
+        packed.append(arena, entry.offset, size);
+        entry.offset = offset;
+    }
+    arena.swap(packed);
+    liveBytes = arena.size();
+    if (topN)
+        make_heap(entries.begin(), entries.end(), [this](const Entry &a, const Entry &b) { return less(a, b); });
+}
+
+// Writes the buffered rows as one sorted run and empties the buffer
+void SortOperator::spill()
+{
+    sort(entries.begin(), entries.end(), [this](const Entry &a, const Entry &b) { return less(a, b); });
+    filesystem::create_directories(spillDir);
+    string path = spillDir + "/run" + to_string(runFiles.size());
+    ofstream out(path, ios::binary);
+    for (const Entry &entry : entries)
+        out.write(arena.data() + entry.offset, recordSize(arena.data() + entry.offset));
+    if (!out)
+        cerr << RED << "Failed to write sort run " << path << RESET << endl;
+    runFiles.push_back(path);
+    runsSpilled++;
+    arena.clear();
+    entries.clear();
+    liveBytes = 0;
+}
+
+// Positions a merge over the files; earlier files win ties, so the merge is stable
+void SortOperator::openRuns(const vector<string> &files)
+{
+    runs.clear();
+    mergeHeap.clear();
+    for (const string &file : files)
+    {
+        runs.push_back(make_unique<Run>());
+        runs.back()->in.open(file, ios::binary);
+        if (runs.back()->next())
+            mergeHeap.push_back(runs.size() - 1);
+    }
+    make_heap(mergeHeap.begin(), mergeHeap.end(), [this](size_t a, size_t b) {
+        int c = recordKey(runs[a]->record.data()).compare(recordKey(runs[b]->record.data()));
+        return c != 0 ? c > 0 : a > b;
+    });
+}
+
+// Moves the smallest current record of the merge into record
+bool SortOperator::popMerged(string &record)
+{
+    auto after = [this](size_t a, size_t b) {
+        int c = recordKey(runs[a]->record.data()).compare(recordKey(runs[b]->record.data()));
+        return c != 0 ? c > 0 : a > b;
+    };
+    if (mergeHeap.empty())
+        return false;
+    pop_heap(mergeHeap.begin(), mergeHeap.end(), after);
+    Run &run = *runs[mergeHeap.back()];
+    record.swap(run.record);
+    if (run.next())
+        push_heap(mergeHeap.begin(), mergeHeap.end(), after);
+    else
+        mergeHeap.pop_back();
+    return true;
+}
+
+// Consumes the whole input, leaving the rows sorted in memory or in runs ready to merge
+void SortOperator::drain()
+{
+    drained = true;
+    Batch batch;
+    while (input->next(batch))
+    {
+        if (outputColumns.empty())
+        {
+            for (size_t slot : outputSlots)
+                outputColumns.push_back(batch.columns[slot].info);
+        }
+        for (size_t i = 0; i < batch.selected; i++)
+        {
+            if (topN)
+            {
+                offer(batch, batch.selection[i]);
+                continue;
+            }
+            encodeKey(batch, batch.selection[i]);
+            append(batch, batch.selection[i]);
+        }
+        trackMemory(arena.size() + entries.size() * sizeof(Entry));
+        if (!topN && arena.size() + entries.size() * sizeof(Entry) > sortMemoryBytes)
+            spill();
+    }
+
+    if (runFiles.empty())
+    {
+        sort(entries.begin(), entries.end(), [this](const Entry &a, const Entry &b) { return less(a, b); });
+        return;
+    }
+    if (!entries.empty())
+        spill();
+    arena = string();
+    entries = vector<Entry>();
+
+    // Merge the oldest runs into one until a single merge can take them all
+    while (runFiles.size() > MERGE_FANIN)
+    {
+        vector<string> group(runFiles.begin(), runFiles.begin() + MERGE_FANIN);
+        string path = spillDir + "/run" + to_string(runFiles.size()) + "m";
+        openRuns(group);
+        ofstream out(path, ios::binary);
+        string record;
+        while (popMerged(record))
+            out.write(record.data(), record.size());
+        if (!out)
+            cerr << RED << "Failed to write sort run " << path << RESET << endl;
+        runs.clear();
+        for (const string &file : group)
+            filesystem::remove(file);
+        runFiles.erase(runFiles.begin(), runFiles.begin() + MERGE_FANIN);
+        runFiles.insert(runFiles.begin(), path);
+    }
+    openRuns(runFiles);
+    held.resize(BATCH_SIZE);
+}
+
+// Writes a record's output values into position k of batch
+void SortOperator::decode(string_view record, Batch &batch, size_t k)
+{
+    const char *value = record.data() + 8 + recordKey(record.data()).size();
+    for (size_t c = 0; c < outputColumns.size(); c++)
+    {
+        ColumnVector &column = batch.columns[c];
+        column.nulls[k] = *value++;
+        if (column.nulls[k])
+        {
+            column.bools[k] = 0;
+            column.strings[k] = string_view();
+            if (column.info.type == TYPE_DATE)
+                column.gathered.dates[k] = 0;
+            else
+                column.gathered.ints[k] = 0;
+            continue;
+        }
+        switch (column.info.type)
+        {
+        case TYPE_INT:
+            memcpy(&column.gathered.ints[k], value, 8);
+            value += 8;
+            break;
+        case TYPE_FLOAT:
+            memcpy(&column.gathered.floats[k], value, 8);
+            value += 8;
+            break;
+        case TYPE_BOOL:
+            column.bools[k] = *value++;
+            break;
+        case TYPE_STRING:
+        {
+            uint32_t length;
+            memcpy(&length, value, 4);
+            column.strings[k] = string_view(value + 4, length);
+            value += 4 + length;
+            break;
+        }
+        case TYPE_DATE:
+            memcpy(&column.gathered.dates[k], value, 4);
+            value += 4;
+            break;
+        }
+    }
+}
+
+bool SortOperator::next(Batch &batch)
+{
+    if (limit == 0)
+        return false;
+    if (!drained)
+        drain();
+
+    batch.columns.resize(outputColumns.size());
+    for (size_t c = 0; c < outputColumns.size(); c++)
+    {
+        ColumnVector &column = batch.columns[c];
+        column.info = outputColumns[c];
+        column.ints = column.gathered.ints;
+        column.floats = column.gathered.floats;
+        column.dates = column.gathered.dates;
+        column.dictionary = nullptr;
+    }
+    size_t n = 0;
+    for (; n < BATCH_SIZE && emitted < limit; n++, emitted++)
+    {
+        if (runFiles.empty())
+        {
+            if (cursor == entries.size())
+                break;
+            decode(string_view(arena.data() + entries[cursor].offset, recordSize(arena.data() + entries[cursor].offset)),
+                   batch, n);
+            cursor++;
+        }
+        else
+        {
+            if (!popMerged(held[n]))
+                break;
+            decode(held[n], batch, n);
+        }
+    }
+    if (n == 0)
+        return false;
+
+    batch.firstRow = 0;
+    batch.size = n;
+    for (size_t k = 0; k < n; k++)
+        batch.selection[k] = static_cast<uint16_t>(k);
+    batch.selected = n;
+    batch.projection.resize(outputColumns.size());
+    for (size_t c = 0; c < outputColumns.size(); c++)
+        batch.projection[c] = c;
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef ORDERBY_H
+#define ORDERBY_H
+
+#include "exec.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A query without LIMIT
+const uint64_t NO_LIMIT = UINT64_MAX;
+
+// Rows a sort must keep to serve LIMIT limit OFFSET offset
+inline uint64_t sortLimit(uint64_t limit, uint64_t offset)
+{
+    return limit > NO_LIMIT - offset ? NO_LIMIT : limit + offset;
+}
+
+// One ORDER BY item as written: a column, or an aggregate's canonical name
+struct OrderItem
+{
+    string column;
+    bool descending = false;
+};
+
+// An ORDER BY item bound to a slot of the sort's input batches
+struct SortKey
+{
+    size_t slot;
+    bool descending;
+};
+
+// Emits the output slots of its input rows ordered by the keys, stopping after limit
+// rows. Each row is encoded once into a normalized key, which orders correctly under
+// memcmp for every type and direction (NULLs last ascending, first descending),
+// followed by its output values. With a limit only a bounded heap of the best rows is
+// kept. Otherwise rows are sorted in memory, and once they pass sortMemoryBytes sorted
+// runs are spilled under the table directory and merged k ways as the output is read.
+class SortOperator : public Operator
+{
+private:
+    // A row in the arena, with its first key bytes to decide most comparisons
+    struct Entry
+    {
+        uint64_t prefix;
+        size_t offset;
+    };
+
+    // A spilled run being merged, positioned on its current record
+    struct Run
+    {
+        ifstream in;
+        string record;
+        bool next();
+    };
+
+    unique_ptr<Operator> input;
+    vector<SortKey> keys;
+    vector<size_t> outputSlots;
+    uint64_t limit, emitted = 0;
+    string spillDir;
+    bool drained = false, topN;
+    vector<ColumnInfo> outputColumns;
+
+    // Records are key length, payload length, key and payload
+    string arena, key;
+    vector<Entry> entries;
+    size_t liveBytes = 0; // arena bytes of the rows a top-N heap still holds
+    size_t cursor = 0;
+
+    vector<string> runFiles;
+    size_t runsSpilled = 0;
+    vector<unique_ptr<Run>> runs;
+    vector<size_t> mergeHeap; // runs by current record, smallest on top
+    vector<string> held;      // merged records of the batch being emitted
+
+    bool less(const Entry &a, const Entry &b) const;
+    void encodeKey(const Batch &batch, size_t pos);
+    void append(const Batch &batch, size_t pos);
+    void offer(const Batch &batch, size_t pos);
+    void compact();
+    void spill();
+    void openRuns(const vector<string> &files);
+    bool popMerged(string &record);
+    void drain();
+    void decode(string_view record, Batch &batch, size_t k);
+
+public:
+    SortOperator(unique_ptr<Operator> input, vector<SortKey> keys, vector<size_t> outputSlots, uint64_t limit,
+                 const string &tableDir);
+    ~SortOperator() override;
+    bool next(Batch &batch) override;
+    string describe() const override;
+    vector<unique_ptr<Operator> *> inputs() override { return {&input}; }
+};
+
+#endif // ORDERBY_H
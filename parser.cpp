@@ -1,81 +1,1024 @@
-#include <iostream>
-#include <vector>
-#include <unordered_set>
+#include "parser.h"
 #include <cctype>
-#include <regex>
-
+#include <cstdlib>
 using namespace std;
 
-struct Token {
-    string type;
-    string value;
-};
+// Characters that end an unquoted word
+static bool isDelimiter(char c)
+{
+    switch (c)
+    {
+    case '(':
+    case ')':
+    case ',':
+    case ';':
+    case '\'':
+    case '"':
+    case '=':
+    case '<':
+    case '>':
+    case '!':
+        return true;
+    }
+    return isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+Token Lexer::next()
+{
+    while (pos < source.size() && isspace(static_cast<unsigned char>(source[pos])))
+        pos++;
+    Token token;
+    token.offset = pos;
+    if (pos >= source.size())
+    {
+        token.end = pos;
+        return token;
+    }
 
-// Function to tokenize SQL queries
-vector<Token> tokenize(const string &query, bool &isValid) {
-    unordered_set<string> keywords = {
-        "SELECT", "FROM", "WHERE", "INSERT", "UPDATE", "DELETE", "AND", "OR", "NOT", 
-        "INTO", "VALUES", "SET", "IN", "NULL", "LIKE", "BETWEEN", "JOIN", "ON", 
-        "ORDER", "GROUP", "BY", "HAVING", "AS", "DISTINCT", "CASE", "WHEN", "THEN", 
-        "ELSE", "END", "LIMIT", "OFFSET", "CREATE", "TABLE", "DATABASE", "PRIMARY", 
-        "KEY", "FOREIGN", "REFERENCES", "VARCHAR", "INT", "FLOAT", "CHAR", "TEXT"
-    };
-    unordered_set<string> operators = {">", "<", "=", ">=", "<=", "!=", "==", "*", "+", "-", "/"};
-
-    vector<Token> tokens;
-    regex word_regex(R"('.*?'|\b[a-zA-Z_][a-zA-Z0-9_]*\b|\d+(\.\d+)?|>=|<=|!=|==|[<>*=(),;])", regex::icase);
-    
-    auto words_begin = sregex_iterator(query.begin(), query.end(), word_regex);
-    auto words_end = sregex_iterator();
-
-    isValid = true;  // Assume query is valid initially
-
-    for (auto i = words_begin; i != words_end; ++i) {
-        string word = i->str();
-        string upper_word = word;
-        transform(upper_word.begin(), upper_word.end(), upper_word.begin(), ::toupper);
-
-        if (keywords.count(upper_word)) {
-            tokens.push_back({"KEYWORD", word});
-        } else if (operators.count(word)) {
-            tokens.push_back({"OPERATOR", word});
-        } else if (isdigit(word[0]) || (word[0] == '-' && isdigit(word[1]))) {
-            tokens.push_back({"LITERAL", word});
-        } else if (word[0] == '\'') {
-            tokens.push_back({"LITERAL", word});
-        } else if (word == "," || word == ";" || word == "(" || word == ")") {
-            tokens.push_back({"SYMBOL", word});
-        } else if (regex_match(word, regex(R"([a-zA-Z_][a-zA-Z0-9_]*)"))) {
-            tokens.push_back({"IDENTIFIER", word});
-        } else {
-            cout << "\n❌ ERROR: Invalid token found -> " << word << endl;
-            isValid = false;
-            return {}; // Return empty tokens on error
-        }
-    }
-    return tokens;
+    char c = source[pos];
+    if (c == '(' || c == ')' || c == ',' || c == ';')
+    {
+        token.type = TOKEN_PUNCT;
+        token.text = source.substr(pos++, 1);
+    }
+    else if (c == '\'' || c == '"')
+    {
+        size_t start = ++pos;
+        while (true)
+        {
+            if (pos >= source.size())
+            {
+                token.type = TOKEN_INVALID;
+                token.text = "unterminated string";
+                return token;
+            }
+            if (source[pos] == c && pos + 1 < source.size() && source[pos + 1] == c)
+            {
+                token.escaped = true;
+                pos += 2;
+            }
+            else if (source[pos] == c)
+            {
+                break;
+            }
+            else
+            {
+                pos++;
+            }
+        }
+        token.type = TOKEN_STRING;
+        token.text = source.substr(start, pos++ - start);
+    }
+    else if (c == '=' || c == '<' || c == '>' || c == '!')
+    {
+        size_t length = pos + 1 < source.size() && (source[pos + 1] == '=' || (c == '<' && source[pos + 1] == '>')) ? 2 : 1;
+        token.type = c == '!' && length == 1 ? TOKEN_INVALID : TOKEN_OPERATOR;
+        token.text = token.type == TOKEN_INVALID ? "unexpected '!'" : source.substr(pos, length);
+        pos += length;
+    }
+    else
+    {
+        size_t start = pos;
+        while (pos < source.size() && !isDelimiter(source[pos]))
+            pos++;
+        token.text = source.substr(start, pos - start);
+        // '?' is lexed as a placeholder too, for parameter() to reject with a clear message
+        bool param = token.text == "?" || (token.text.size() > 1 && token.text[0] == '$' &&
+                                           token.text.find_first_not_of("0123456789", 1) == string_view::npos);
+        token.type = param ? TOKEN_PARAM : TOKEN_WORD;
+    }
+    token.end = pos;
+    return token;
+}
+
+static string lower(string_view text)
+{
+    string out(text);
+    for (char &c : out)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+static string upper(string_view text)
+{
+    string out(text);
+    for (char &c : out)
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    return out;
 }
 
-int main() {
-    string query;
-    bool isValid;
+// Case-insensitive match of a word against an upper-case keyword
+static bool equalsKeyword(string_view word, const char *keyword)
+{
+    size_t i = 0;
+    for (; keyword[i] != '\0'; i++)
+    {
+        if (i >= word.size() || toupper(static_cast<unsigned char>(word[i])) != keyword[i])
+            return false;
+    }
+    return i == word.size();
+}
+
+// Recursive descent over the lexer with one token of lookahead (two where a name may
+// be a function call). Conditions follow SQL precedence: OR < AND < NOT < predicate.
+class Parser
+{
+private:
+    string_view source;
+    Lexer lexer;
+    Token token;
+    string &error;
+    const char *clause = "statement"; // where the parser is, for "at end of ..." messages
+    Statement *target = nullptr;      // the statement being built
+    bool allowParams = false;         // inside PREPARE
+
+    void advance() { token = lexer.next(); }
+
+    Token lookahead() const
+    {
+        Lexer copy = lexer;
+        return copy.next();
+    }
+
+    bool isKeyword(const char *keyword) const { return token.type == TOKEN_WORD && equalsKeyword(token.text, keyword); }
+    bool isPunct(char c) const { return token.type == TOKEN_PUNCT && token.text[0] == c; }
+
+    bool accept(const char *keyword)
+    {
+        if (!isKeyword(keyword))
+            return false;
+        advance();
+        return true;
+    }
+
+    bool acceptPunct(char c)
+    {
+        if (!isPunct(c))
+            return false;
+        advance();
+        return true;
+    }
+
+    // The end of the statement, past an optional ';'
+    bool atEnd() const { return token.type == TOKEN_END || (isPunct(';') && lookahead().type == TOKEN_END); }
+
+    // Records a message as is; the first problem found is the one reported
+    bool failWith(const string &message)
+    {
+        if (error.empty())
+            error = "Syntax error: " + message;
+        return false;
+    }
+
+    // Records a message about the current token
+    bool fail(const string &message)
+    {
+        if (token.type == TOKEN_INVALID)
+            return failWith(string(token.text));
+        return failWith(message + (atEnd() ? string(" at end of ") + clause : " near '" + string(token.text) + "'"));
+    }
+
+    // Copies a string token's text, undoubling escaped quotes
+    string unquote(const Token &literal) const
+    {
+        string out(literal.text);
+        if (literal.escaped)
+        {
+            char quote = source[literal.offset];
+            size_t write = 0;
+            for (size_t read = 0; read < out.size(); read++, write++)
+            {
+                out[write] = out[read];
+                if (out[read] == quote)
+                    read++;
+            }
+            out.resize(write);
+        }
+        return out;
+    }
+
+    bool name(string &out, const string &message)
+    {
+        if (token.type != TOKEN_WORD)
+            return failWith(message);
+        out = lower(token.text);
+        advance();
+        return true;
+    }
+
+    bool expectKeyword(const char *keyword, const string &message)
+    {
+        return accept(keyword) || failWith(message);
+    }
 
-    do {
-        cout << "\nEnter an SQL query: ";
-        getline(cin, query);
+    // Accepts an optional ';' and requires nothing after it
+    bool finish()
+    {
+        acceptPunct(';');
+        if (token.type == TOKEN_END)
+            return true;
+        if (token.type == TOKEN_INVALID)
+            return failWith(string(token.text));
+        string_view rest = source.substr(token.offset);
+        while (!rest.empty() && (isspace(static_cast<unsigned char>(rest.back())) || rest.back() == ';'))
+            rest.remove_suffix(1);
+        return failWith("Unexpected '" + string(rest) + "'");
+    }
 
-        vector<Token> tokens = tokenize(query, isValid);
+    // Reads a $n placeholder into ref, recording it on the statement being prepared
+    bool parameter(ParamRef ref)
+    {
+        if (token.text == "?")
+            return failWith("Placeholder '?' is not supported; number parameters $1, $2, ...");
+        if (!allowParams)
+            return failWith("Parameter " + string(token.text) + " is only allowed in PREPARE");
+        unsigned long number = 0;
+        try
+        {
+            number = stoul(string(token.text.substr(1)));
+        }
+        catch (...)
+        {
+        }
+        if (number == 0 || number > 65535)
+            return fail("parameters are numbered $1 to $65535");
+        ref.index = number - 1;
+        target->params.push_back(ref);
+        target->paramCount = max<size_t>(target->paramCount, number);
+        advance();
+        return true;
+    }
 
-        if (isValid) {
-            cout << "\n✅ Tokenized Output:\n";
-            for (const auto &token : tokens) {
-                cout << "Type: " << token.type << ", Value: " << token.value << endl;
+    // ---- conditions (WHERE, ON, HAVING) ----
+
+    unique_ptr<Expr> failExpr(const string &message)
+    {
+        fail(message);
+        return nullptr;
+    }
+
+    unique_ptr<Expr> operand()
+    {
+        if (token.type == TOKEN_STRING)
+        {
+            auto literal = make_unique<Expr>(EXPR_LITERAL);
+            literal->text = unquote(token);
+            literal->quoted = true;
+            advance();
+            return literal;
+        }
+        if (token.type == TOKEN_PARAM)
+        {
+            auto literal = make_unique<Expr>(EXPR_LITERAL);
+            ParamRef ref{0, literal.get()};
+            return parameter(ref) ? move(literal) : nullptr;
+        }
+        if (token.type != TOKEN_WORD)
+            return failExpr("expected a column or value");
+        if (isKeyword("NULL"))
+        {
+            auto literal = make_unique<Expr>(EXPR_LITERAL);
+            literal->isNull = true;
+            advance();
+            return literal;
+        }
+        bool truth = isKeyword("TRUE") || isKeyword("FALSE");
+        bool isName = (isalpha(static_cast<unsigned char>(token.text[0])) || token.text[0] == '_') && !truth;
+        if (isName && lookahead().type == TOKEN_PUNCT && lookahead().text[0] == '(')
+            return call();
+        auto node = make_unique<Expr>(isName ? EXPR_COLUMN : EXPR_LITERAL);
+        node->text = isName ? lower(token.text) : truth ? upper(token.text) : string(token.text);
+        advance();
+        return node;
+    }
+
+    // An aggregate such as SUM(amount) in HAVING names the aggregate's output column,
+    // spelled the way Aggregate::name() spells it
+    unique_ptr<Expr> call()
+    {
+        string function = upper(token.text);
+        advance();
+        advance();
+        if (token.type != TOKEN_WORD)
+            return failExpr("expected a column or * in " + function + "()");
+        string argument = lower(token.text);
+        advance();
+        if (!isPunct(')'))
+            return failExpr("expected ')'");
+        advance();
+        auto node = make_unique<Expr>(EXPR_COLUMN);
+        node->text = function + "(" + argument + ")";
+        return node;
+    }
+
+    unique_ptr<Expr> predicate()
+    {
+        if (acceptPunct('('))
+        {
+            auto inner = disjunction();
+            if (!inner)
+                return nullptr;
+            if (!acceptPunct(')'))
+                return failExpr("expected ')'");
+            return inner;
+        }
+
+        auto left = operand();
+        if (!left)
+            return nullptr;
+
+        if (token.type == TOKEN_OPERATOR)
+        {
+            static const pair<const char *, CompareOp> ops[] = {
+                {"=", CMP_EQ}, {"==", CMP_EQ}, {"!=", CMP_NE}, {"<>", CMP_NE},
+                {"<", CMP_LT}, {"<=", CMP_LE}, {">", CMP_GT}, {">=", CMP_GE}};
+            auto node = make_unique<Expr>(EXPR_COMPARE);
+            for (const auto &op : ops)
+            {
+                if (token.text == op.first)
+                    node->op = op.second;
             }
-        } else {
-            cout << "\n⚠️ Please enter a valid SQL query again.\n";
+            advance();
+            auto right = operand();
+            if (!right)
+                return nullptr;
+            node->children.push_back(move(left));
+            node->children.push_back(move(right));
+            return node;
         }
 
-    } while (!isValid);
+        if (accept("IS"))
+        {
+            auto node = make_unique<Expr>(EXPR_IS_NULL);
+            node->negated = accept("NOT");
+            if (!accept("NULL"))
+                return failExpr("expected NULL after IS");
+            node->children.push_back(move(left));
+            return node;
+        }
 
-    return 0;
+        bool negated = accept("NOT");
+        if (accept("IN"))
+        {
+            auto node = make_unique<Expr>(EXPR_IN);
+            node->negated = negated;
+            node->children.push_back(move(left));
+            if (!acceptPunct('('))
+                return failExpr("expected '('");
+            do
+            {
+                auto item = operand();
+                if (!item)
+                    return nullptr;
+                node->children.push_back(move(item));
+            } while (acceptPunct(','));
+            if (!acceptPunct(')'))
+                return failExpr("expected ')'");
+            return node;
+        }
+        if (accept("BETWEEN"))
+        {
+            auto node = make_unique<Expr>(EXPR_BETWEEN);
+            node->negated = negated;
+            node->children.push_back(move(left));
+            auto low = operand();
+            if (!low)
+                return nullptr;
+            if (!accept("AND"))
+                return failExpr("expected AND in BETWEEN");
+            auto high = operand();
+            if (!high)
+                return nullptr;
+            node->children.push_back(move(low));
+            node->children.push_back(move(high));
+            return node;
+        }
+        if (accept("LIKE"))
+        {
+            auto node = make_unique<Expr>(EXPR_LIKE);
+            node->negated = negated;
+            node->children.push_back(move(left));
+            auto pattern = operand();
+            if (!pattern)
+                return nullptr;
+            node->children.push_back(move(pattern));
+            return node;
+        }
+        if (negated)
+            return failExpr("expected IN, BETWEEN or LIKE after NOT");
+
+        // A lone column is a BOOL test: WHERE active means active = TRUE
+        if (left->kind != EXPR_COLUMN)
+            return failExpr("expected a condition");
+        auto node = make_unique<Expr>(EXPR_COMPARE);
+        auto truth = make_unique<Expr>(EXPR_LITERAL);
+        truth->text = "TRUE";
+        node->children.push_back(move(left));
+        node->children.push_back(move(truth));
+        return node;
+    }
+
+    unique_ptr<Expr> negation()
+    {
+        if (accept("NOT"))
+        {
+            auto inner = negation();
+            if (!inner)
+                return nullptr;
+            auto node = make_unique<Expr>(EXPR_NOT);
+            node->children.push_back(move(inner));
+            return node;
+        }
+        return predicate();
+    }
+
+    unique_ptr<Expr> conjunction()
+    {
+        auto left = negation();
+        while (left && accept("AND"))
+        {
+            auto right = negation();
+            if (!right)
+                return nullptr;
+            auto node = make_unique<Expr>(EXPR_AND);
+            node->children.push_back(move(left));
+            node->children.push_back(move(right));
+            left = move(node);
+        }
+        return left;
+    }
+
+    unique_ptr<Expr> disjunction()
+    {
+        auto left = conjunction();
+        while (left && accept("OR"))
+        {
+            auto right = conjunction();
+            if (!right)
+                return nullptr;
+            auto node = make_unique<Expr>(EXPR_OR);
+            node->children.push_back(move(left));
+            node->children.push_back(move(right));
+            left = move(node);
+        }
+        return left;
+    }
+
+    bool isClauseKeyword() const
+    {
+        return isKeyword("WHERE") || isKeyword("GROUP") || isKeyword("HAVING") || isKeyword("ORDER") ||
+               isKeyword("LIMIT") || isKeyword("OFFSET");
+    }
+
+    // The condition of the clause just read, such as WHERE
+    bool condition(const char *name, unique_ptr<Expr> &out)
+    {
+        clause = name;
+        if (atEnd() || isClauseKeyword())
+            return failWith(string("empty ") + name + " clause");
+        out = disjunction();
+        clause = "statement";
+        return out != nullptr;
+    }
+
+    // ---- statements ----
+
+    // name(argument), with the current token on the name and the next one on '('
+    bool aggregate(Aggregate &out)
+    {
+        string text = upper(token.text) + "(";
+        advance();
+        advance();
+        if (token.type != TOKEN_WORD)
+            return fail("expected a column or * in " + text + ")");
+        text += string(token.text) + ")";
+        advance();
+        if (!acceptPunct(')'))
+            return fail("expected ')'");
+        return parseAggregate(text, out) || failWith("Unknown aggregate '" + text + "'");
+    }
+
+    bool isCall() const
+    {
+        Token next = lookahead();
+        return token.type == TOKEN_WORD && next.type == TOKEN_PUNCT && next.text[0] == '(';
+    }
+
+    bool createTable(Statement &statement)
+    {
+        if (accept("INDEX"))
+            return createIndex(statement);
+        if (!expectKeyword("TABLE", "Expected 'TABLE' or 'INDEX' after CREATE") ||
+            !name(statement.table, "Missing table name after 'TABLE' in CREATE"))
+            return false;
+        if (!acceptPunct('('))
+            return fail("expected '(' before the column definitions");
+        do
+        {
+            ColumnDef column;
+            if (token.type != TOKEN_WORD || lookahead().type != TOKEN_WORD)
+                return fail("Invalid column definition");
+            column.name = lower(token.text);
+            advance();
+            column.type = upper(token.text);
+            advance();
+            if (accept("PRIMARY"))
+            {
+                if (!expectKeyword("KEY", "Expected 'KEY' after PRIMARY"))
+                    return false;
+                for (const ColumnDef &other : statement.columns)
+                {
+                    if (other.primaryKey)
+                        return fail("a table can have only one PRIMARY KEY");
+                }
+                column.primaryKey = true;
+            }
+            statement.columns.push_back(move(column));
+        } while (acceptPunct(','));
+        if (!acceptPunct(')'))
+            return fail("expected ',' or ')' in the column definitions");
+        return finish();
+    }
+
+    // CREATE INDEX name ON table (column) [USING BTREE | USING BLOOM [WITH (fpp = rate)]]
+    bool createIndex(Statement &statement)
+    {
+        statement.kind = STMT_CREATE_INDEX;
+        if (!name(statement.name, "Missing index name after 'INDEX' in CREATE") ||
+            !expectKeyword("ON", "Expected CREATE INDEX <name> ON <table> (<column>)") ||
+            !name(statement.table, "Missing table name after ON in CREATE INDEX"))
+            return false;
+        if (!acceptPunct('('))
+            return fail("expected '(' before the indexed column");
+        if (!name(statement.column, "Missing column name in CREATE INDEX"))
+            return false;
+        if (!acceptPunct(')'))
+            return fail("expected ')' after the indexed column; an index covers one column");
+        if (accept("USING"))
+        {
+            statement.bloom = accept("BLOOM");
+            if (!statement.bloom && !accept("BTREE"))
+                return fail("expected BTREE or BLOOM after USING");
+        }
+        if (statement.bloom && accept("WITH") && !falsePositiveRate(statement.falsePositiveRate))
+            return false;
+        return finish();
+    }
+
+    // (fpp = rate), a false positive rate strictly between 0 and 1
+    bool falsePositiveRate(double &out)
+    {
+        if (!acceptPunct('(') || !accept("FPP") || token.type != TOKEN_OPERATOR || token.text != "=")
+            return fail("expected WITH (fpp = <rate>)");
+        advance();
+        string text(token.text);
+        char *end = nullptr;
+        out = token.type == TOKEN_WORD ? strtod(text.c_str(), &end) : 0;
+        if (!end || *end != '\0' || !(out > 0 && out < 1))
+            return fail("the false positive rate must be a number between 0 and 1");
+        advance();
+        if (!acceptPunct(')'))
+            return fail("expected ')' after the false positive rate");
+        return true;
+    }
+
+    // One value of a parenthesized list: a quoted string, or the raw text up to ',' or ')'
+    bool value(string &out, bool &quoted)
+    {
+        quoted = token.type == TOKEN_STRING;
+        if (quoted)
+        {
+            out = unquote(token);
+            advance();
+            return isPunct(',') || isPunct(')') || fail("Unexpected text after a quoted value");
+        }
+        size_t start = token.offset, end = token.offset;
+        while (token.type == TOKEN_WORD || token.type == TOKEN_OPERATOR || token.type == TOKEN_STRING)
+        {
+            end = token.end;
+            advance();
+        }
+        out = string(source.substr(start, end - start));
+        return isPunct(',') || isPunct(')') || fail("expected ',' or ')' in INSERT values");
+    }
+
+    // A value that is NULL only when written as the unquoted keyword
+    bool nullableValue(ParamValue &out)
+    {
+        if (!value(out.text, out.quoted))
+            return false;
+        out.isNull = !out.quoted && equalsKeyword(out.text, "NULL");
+        return true;
+    }
+
+    bool group(vector<ParamValue> &values, size_t row)
+    {
+        if (!acceptPunct('('))
+            return failWith("Missing parentheses in INSERT statement");
+        do
+        {
+            values.emplace_back();
+            if (token.type == TOKEN_PARAM)
+            {
+                ParamRef ref{0, nullptr, row, values.size() - 1};
+                if (!parameter(ref))
+                    return false;
+                if (!isPunct(',') && !isPunct(')'))
+                    return fail("expected ',' or ')' in INSERT values");
+            }
+            else if (!nullableValue(values.back()))
+            {
+                return false;
+            }
+        } while (acceptPunct(','));
+        advance(); // ')'
+        return true;
+    }
+
+    bool rowList(vector<vector<ParamValue>> &rows)
+    {
+        do
+        {
+            rows.emplace_back();
+            if (!group(rows.back(), rows.size() - 1))
+                return false;
+        } while (acceptPunct(','));
+        return true;
+    }
+
+    // INSERT INTO t [(columns)] VALUES (...), ... or INSERT INTO t (...), ...
+    bool insert(Statement &statement)
+    {
+        if (!expectKeyword("INTO", "Expected 'INTO' after INSERT") ||
+            !name(statement.table, "Missing table name after 'INTO'"))
+            return false;
+        if (!accept("VALUES"))
+        {
+            if (!rowList(statement.rows))
+                return false;
+            if (!accept("VALUES"))
+                return finish();
+            if (statement.rows.size() != 1)
+                return failWith("Expected a single column list before VALUES");
+            if (!statement.params.empty())
+                return failWith("Parameters are not allowed in the column list");
+            for (const ParamValue &column : statement.rows[0])
+                statement.columnNames.push_back(lower(column.text));
+            statement.rows.clear();
+        }
+        return rowList(statement.rows) && finish();
+    }
+
+    bool selectList(Statement &statement)
+    {
+        if (isKeyword("FROM") || atEnd())
+            return failWith("Missing column names after SELECT");
+        if (token.type == TOKEN_WORD && token.text == "*")
+        {
+            advance();
+            return true;
+        }
+        do
+        {
+            SelectItem item;
+            if (isKeyword("FROM") || token.type != TOKEN_WORD)
+                return failWith("Empty item in the column list");
+            if (isCall())
+            {
+                if (!aggregate(item.aggregate))
+                    return false;
+                item.isAggregate = true;
+            }
+            else
+            {
+                item.column = lower(token.text);
+                advance();
+            }
+            statement.items.push_back(move(item));
+        } while (acceptPunct(','));
+        return true;
+    }
+
+    bool join(Statement &statement)
+    {
+        statement.isJoin = true;
+        if (accept("LEFT"))
+            statement.joinType = JOIN_LEFT;
+        else if (accept("RIGHT"))
+            statement.joinType = JOIN_RIGHT;
+        else if (accept("FULL"))
+            statement.joinType = JOIN_FULL;
+        else
+            accept("INNER");
+        if (statement.joinType != JOIN_INNER)
+            accept("OUTER");
+        return expectKeyword("JOIN", "Expected JOIN") && name(statement.joinTable, "Missing table name after JOIN") &&
+               expectKeyword("ON", "Expected ON after the joined table") && condition("ON", statement.on);
+    }
+
+    bool orderItem(Statement &statement)
+    {
+        OrderItem item;
+        if (token.type != TOKEN_WORD)
+            return failWith("Empty item in ORDER BY");
+        if (isCall())
+        {
+            Aggregate function;
+            if (!aggregate(function))
+                return false;
+            item.column = function.name();
+        }
+        else
+        {
+            item.column = lower(token.text);
+            advance();
+        }
+        if (accept("DESC"))
+            item.descending = true;
+        else
+            accept("ASC");
+        if (!isPunct(',') && !atEnd() && !isKeyword("LIMIT") && !isKeyword("OFFSET"))
+            return failWith("Expected ASC or DESC after '" + item.column + "' in ORDER BY");
+        statement.orderBy.push_back(move(item));
+        return true;
+    }
+
+    bool count(uint64_t &out, const string &message)
+    {
+        if (token.type != TOKEN_WORD || token.text.find_first_not_of("0123456789") != string_view::npos)
+            return failWith(message);
+        try
+        {
+            out = stoull(string(token.text));
+        }
+        catch (...)
+        {
+            return failWith(message);
+        }
+        advance();
+        return true;
+    }
+
+    bool select(Statement &statement)
+    {
+        if (!selectList(statement) || !expectKeyword("FROM", "Expected 'FROM' after column names") ||
+            !name(statement.table, "Missing table name after 'FROM'"))
+            return false;
+        if ((isKeyword("JOIN") || isKeyword("INNER") || isKeyword("LEFT") || isKeyword("RIGHT") || isKeyword("FULL")) &&
+            !join(statement))
+            return false;
+        if (accept("WHERE") && !condition("WHERE", statement.where))
+            return false;
+        if (accept("GROUP"))
+        {
+            if (!expectKeyword("BY", "Expected BY after GROUP"))
+                return false;
+            statement.hasGroupBy = true;
+            do
+            {
+                statement.groupBy.emplace_back();
+                if (!name(statement.groupBy.back(), "Empty column in GROUP BY"))
+                    return false;
+            } while (acceptPunct(','));
+        }
+        if (accept("HAVING") && !condition("HAVING", statement.having))
+            return false;
+        if (accept("ORDER"))
+        {
+            if (!expectKeyword("BY", "Expected BY after ORDER"))
+                return false;
+            do
+            {
+                if (!orderItem(statement))
+                    return false;
+            } while (acceptPunct(','));
+        }
+        if (accept("LIMIT") && !count(statement.limit, "LIMIT needs a non-negative row count"))
+            return false;
+        if (accept("OFFSET") && !count(statement.offset, "OFFSET needs a non-negative row count"))
+            return false;
+        return finish();
+    }
+
+    // RENAME TABLE old TO new
+    bool rename(Statement &statement)
+    {
+        return expectKeyword("TABLE", "Expected 'TABLE' after RENAME") &&
+               name(statement.table, "Missing table names in RENAME statement") &&
+               expectKeyword("TO", "Expected 'TO' after table name in RENAME") &&
+               name(statement.newName, "Missing table names in RENAME statement") && finish();
+    }
+
+    // DROP TABLE t or DROP INDEX i
+    bool drop(Statement &statement)
+    {
+        if (accept("INDEX"))
+        {
+            statement.kind = STMT_DROP_INDEX;
+            return name(statement.name, "Missing index name after 'INDEX' in DROP") && finish();
+        }
+        if (!isKeyword("TABLE"))
+            return failWith("Expected 'TABLE' or 'INDEX' after DROP");
+        return tableCommand(statement, "DROP");
+    }
+
+    // DROP TABLE t and TRUNCATE TABLE t
+    bool tableCommand(Statement &statement, const string &command)
+    {
+        return expectKeyword("TABLE", "Expected 'TABLE' after " + command) &&
+               name(statement.table, "Missing table name after 'TABLE' in " + command) && finish();
+    }
+
+    bool copy(Statement &statement)
+    {
+        if (!name(statement.table, "Expected COPY <table> FROM '<path>'") ||
+            !expectKeyword("FROM", "Expected COPY <table> FROM '<path>'"))
+            return false;
+        if (token.type != TOKEN_STRING)
+            return failWith("Expected a quoted file path after FROM");
+        statement.path = unquote(token);
+        advance();
+        // Optional HEADER skips the first line of the file
+        while (token.type == TOKEN_WORD)
+        {
+            if (!accept("HEADER"))
+                return failWith("Unknown COPY option '" + upper(token.text) + "'");
+            statement.header = true;
+        }
+        return finish();
+    }
+
+    bool setOutput(Statement &statement)
+    {
+        const string message = "Expected SET OUTPUT TABLE | CSV | TSV";
+        if (!accept("OUTPUT") || token.type != TOKEN_WORD || !parseOutputFormat(string(token.text), statement.format))
+            return failWith(message);
+        advance();
+        return finish();
+    }
+
+    // PREPARE name AS statement, where the statement may use $1, $2, ...
+    bool prepare(Statement &statement)
+    {
+        if (!name(statement.name, "Missing statement name after PREPARE") ||
+            !expectKeyword("AS", "Expected AS after the statement name in PREPARE"))
+            return false;
+        statement.body = this->statement(true);
+        return statement.body != nullptr;
+    }
+
+    // EXECUTE name [(value, ...)]
+    bool execute(Statement &statement)
+    {
+        if (!name(statement.name, "Missing statement name after EXECUTE"))
+            return false;
+        if (acceptPunct('('))
+        {
+            do
+            {
+                statement.arguments.emplace_back();
+                if (!nullableValue(statement.arguments.back()))
+                    return false;
+            } while (acceptPunct(','));
+            advance(); // ')'
+        }
+        return finish();
+    }
+
+public:
+    Parser(string_view source, string &error) : source(source), lexer(source), error(error) { advance(); }
+
+    // One statement; a prepared one may use placeholders but not PREPARE or EXECUTE
+    unique_ptr<Statement> statement(bool prepared = false)
+    {
+        static const pair<const char *, StatementKind> commands[] = {
+            {"CREATE", STMT_CREATE_TABLE}, {"INSERT", STMT_INSERT},       {"SELECT", STMT_SELECT},
+            {"RENAME", STMT_RENAME},       {"DROP", STMT_DROP},           {"TRUNCATE", STMT_TRUNCATE},
+            {"COPY", STMT_COPY},           {"SET", STMT_SET_OUTPUT},      {"PREPARE", STMT_PREPARE},
+            {"EXECUTE", STMT_EXECUTE},     {"DEALLOCATE", STMT_DEALLOCATE}};
+        ExplainMode explain = EXPLAIN_NONE;
+        if (accept("EXPLAIN"))
+        {
+            explain = accept("ANALYZE") ? EXPLAIN_ANALYZE : EXPLAIN_PLAN;
+            if (!isKeyword("SELECT"))
+            {
+                failWith("EXPLAIN needs a SELECT");
+                return nullptr;
+            }
+        }
+        for (const auto &command : commands)
+        {
+            if (!isKeyword(command.first))
+                continue;
+            if (prepared && command.second >= STMT_PREPARE)
+            {
+                failWith("PREPARE cannot prepare " + string(command.first));
+                return nullptr;
+            }
+            advance();
+            auto statement = make_unique<Statement>(command.second);
+            target = statement.get();
+            allowParams = prepared;
+            statement->explain = explain;
+            bool ok = false;
+            switch (command.second)
+            {
+            case STMT_CREATE_TABLE:
+                ok = createTable(*statement);
+                break;
+            case STMT_INSERT:
+                ok = insert(*statement);
+                break;
+            case STMT_SELECT:
+                ok = select(*statement);
+                break;
+            case STMT_RENAME:
+                ok = rename(*statement);
+                break;
+            case STMT_DROP:
+                ok = drop(*statement);
+                break;
+            case STMT_TRUNCATE:
+                ok = tableCommand(*statement, "TRUNCATE");
+                break;
+            case STMT_COPY:
+                ok = copy(*statement);
+                break;
+            case STMT_SET_OUTPUT:
+                ok = setOutput(*statement);
+                break;
+            case STMT_PREPARE:
+                ok = prepare(*statement);
+                break;
+            case STMT_EXECUTE:
+                ok = execute(*statement);
+                break;
+            case STMT_DEALLOCATE:
+                ok = name(statement->name, "Missing statement name after DEALLOCATE") && finish();
+                break;
+            case STMT_CREATE_INDEX:
+            case STMT_DROP_INDEX:
+                break; // reached through CREATE and DROP
+            }
+            return ok ? move(statement) : nullptr;
+        }
+        error = "Invalid SQL Query!";
+        return nullptr;
+    }
+};
+
+unique_ptr<Statement> parseStatement(string_view sql, string &error, bool prepared)
+{
+    error.clear();
+    return Parser(sql, error).statement(prepared);
+}
+
+bool bindParameters(Statement &statement, const vector<ParamValue> &values, string &error)
+{
+    if (values.size() != statement.paramCount)
+    {
+        error = "Expected " + to_string(statement.paramCount) + " parameter" + (statement.paramCount == 1 ? "" : "s") +
+                ", got " + to_string(values.size());
+        return false;
+    }
+    for (const ParamRef &ref : statement.params)
+    {
+        const ParamValue &value = values[ref.index];
+        if (ref.literal)
+        {
+            ref.literal->text = value.text;
+            ref.literal->isNull = value.isNull;
+            ref.literal->quoted = value.quoted;
+        }
+        else
+        {
+            statement.rows[ref.row][ref.column] = value;
+        }
+    }
+    return true;
+}
+
+string normalizeQuery(string_view sql)
+{
+    string out;
+    out.reserve(sql.size());
+    char quote = 0;
+    bool space = false;
+    for (char c : sql)
+    {
+        if (!quote && isspace(static_cast<unsigned char>(c)))
+        {
+            space = !out.empty();
+            continue;
+        }
+        if (space)
+            out += ' ';
+        space = false;
+        out += c;
+        if (quote ? c == quote : c == '\'' || c == '"')
+            quote = quote ? 0 : c;
+    }
+    while (!quote && !out.empty() && (out.back() == ';' || out.back() == ' '))
+        out.pop_back();
+    return out;
 }
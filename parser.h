@@ -0,0 +1,147 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "expr.h"
+#include "groupby.h"
+#include "join.h"
+#include "orderby.h"
+#include "sink.h"
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+enum TokenType
+{
+    TOKEN_WORD,     // names, keywords, numbers, dates, * and anything else unquoted
+    TOKEN_STRING,   // '...' or "...", text without the quotes
+    TOKEN_OPERATOR, // = == != <> < <= > >=
+    TOKEN_PUNCT,    // ( ) , ;
+    TOKEN_PARAM,    // $1, $2, ... in a prepared statement (and ?, which is rejected)
+    TOKEN_END,
+    TOKEN_INVALID   // text describes the problem
+};
+
+// Tokens are views into the statement, so lexing allocates nothing. A string keeps its
+// doubled quotes ('' for ') until the parser copies it into the AST.
+struct Token
+{
+    TokenType type = TOKEN_END;
+    string_view text;
+    size_t offset = 0, end = 0; // source range, quotes included
+    bool escaped = false;       // TOKEN_STRING: contains a doubled quote
+};
+
+// Single pass over the statement, one token per call
+class Lexer
+{
+private:
+    string_view source;
+    size_t pos = 0;
+
+public:
+    explicit Lexer(string_view source) : source(source) {}
+    Token next();
+};
+
+enum StatementKind
+{
+    STMT_CREATE_TABLE,
+    STMT_INSERT,
+    STMT_SELECT, // also EXPLAIN [ANALYZE] SELECT
+    STMT_RENAME,
+    STMT_DROP,
+    STMT_TRUNCATE,
+    STMT_COPY,
+    STMT_SET_OUTPUT,
+    STMT_CREATE_INDEX,
+    STMT_DROP_INDEX,
+    STMT_PREPARE,
+    STMT_EXECUTE,
+    STMT_DEALLOCATE
+};
+
+struct ColumnDef
+{
+    string name;
+    string type; // upper-cased, checked when the table is created
+    bool primaryKey = false;
+};
+
+// Where a placeholder sits: a literal of a condition, or else a value of INSERT's rows
+struct ParamRef
+{
+    size_t index;            // $1 is 0
+    Expr *literal = nullptr;
+    size_t row = 0, column = 0;
+};
+
+// A parsed statement. Names are lower-cased; which fields are used depends on kind.
+struct Statement
+{
+    StatementKind kind;
+    string table; // the table acted on; SELECT: the FROM table, RENAME: the old name
+
+    // CREATE TABLE
+    vector<ColumnDef> columns;
+
+    // INSERT: optional column list, then rows of values with quotes removed
+    vector<string> columnNames;
+    vector<vector<ParamValue>> rows;
+
+    // SELECT items FROM table [[type] JOIN joinTable ON on] [WHERE where]
+    // [GROUP BY groupBy] [HAVING having] [ORDER BY orderBy] [LIMIT limit] [OFFSET offset]
+    vector<SelectItem> items; // empty for *
+    bool isJoin = false;
+    JoinType joinType = JOIN_INNER;
+    string joinTable;
+    unique_ptr<Expr> on, where, having;
+    bool hasGroupBy = false;
+    vector<string> groupBy;
+    vector<OrderItem> orderBy;
+    uint64_t limit = NO_LIMIT, offset = 0;
+    ExplainMode explain = EXPLAIN_NONE; // EXPLAIN [ANALYZE] SELECT ...
+
+    // RENAME TABLE table TO newName
+    string newName;
+
+    // COPY table FROM 'path' [HEADER]
+    string path;
+    bool header = false;
+
+    // SET OUTPUT TABLE | CSV | TSV
+    OutputFormat format = OUTPUT_TABLE;
+
+    // CREATE INDEX name ON table (column) [USING BTREE | USING BLOOM [WITH (fpp = rate)]],
+    // DROP INDEX name
+    // PREPARE name AS body, EXECUTE name [(arguments)], DEALLOCATE name
+    string name;
+    string column;
+    bool bloom = false;
+    double falsePositiveRate = 0; // 0 for the default
+    unique_ptr<Statement> body;
+    vector<ParamValue> arguments;
+
+    // Placeholders of a statement being prepared; $paramCount is the highest used
+    vector<ParamRef> params;
+    size_t paramCount = 0;
+
+    explicit Statement(StatementKind kind) : kind(kind) {}
+};
+
+// Parses one statement, optionally ended by ';'. A prepared statement may use $1, $2, ...
+// placeholders. On failure returns null and sets error to the message to print.
+unique_ptr<Statement> parseStatement(string_view sql, string &error, bool prepared = false);
+
+// Writes values over a prepared statement's placeholders, in place
+bool bindParameters(Statement &statement, const vector<ParamValue> &values, string &error);
+
+// The query with whitespace runs outside quotes collapsed and a trailing ';' dropped,
+// so statements differing only in layout share one cached plan
+string normalizeQuery(string_view sql);
+
+#endif // PARSER_H
@@ -0,0 +1,1070 @@
+#include "predicate.h"
+#include "bloom.h"
+#include "globals.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+using namespace std;
+
+// Typed views of one batch column; the kernels below are instantiated per view. Stored
+// is the element type of the column array and Type the type values are compared as.
+
+struct IntColumn
+{
+    using Stored = int64_t;
+    using Type = int64_t;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].ints; }
+};
+
+struct FloatColumn
+{
+    using Stored = double;
+    using Type = double;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].floats; }
+};
+
+// An INT column compared with a FLOAT column or a fractional literal
+struct IntAsFloatColumn
+{
+    using Stored = int64_t;
+    using Type = double;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].ints; }
+};
+
+struct BoolColumn
+{
+    using Stored = uint8_t;
+    using Type = uint8_t;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].bools; }
+};
+
+struct DateColumn
+{
+    using Stored = int32_t;
+    using Type = int32_t;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].dates; }
+};
+
+struct StringColumn
+{
+    using Stored = string_view;
+    using Type = string_view;
+    size_t slot;
+    const Stored *values(const Batch &batch) const { return batch.columns[slot].strings; }
+};
+
+template <CompareOp Op, typename T>
+static inline bool compare(const T &a, const T &b)
+{
+    switch (Op)
+    {
+    case CMP_EQ:
+        return a == b;
+    case CMP_NE:
+        return a != b;
+    case CMP_LT:
+        return a < b;
+    case CMP_LE:
+        return a <= b;
+    case CMP_GT:
+        return a > b;
+    case CMP_GE:
+        return a >= b;
+    }
+    return false;
+}
+
+// The kernels evaluate every position of the batch, selected or not. Their loops have
+// no branches and no calls, so the compiler vectorizes them for the fixed-width types.
+
+template <CompareOp Op, typename Column>
+static void compareConstant(const Batch &batch, Column column, typename Column::Type constant,
+                            uint8_t *__restrict isTrue, uint8_t *__restrict isFalse)
+{
+    using Type = typename Column::Type;
+    const typename Column::Stored *__restrict values = column.values(batch);
+    const uint8_t *__restrict nulls = batch.columns[column.slot].nulls;
+    for (size_t k = 0, n = batch.size; k < n; k++)
+    {
+        uint8_t valid = nulls[k] ^ 1;
+        uint8_t match = compare<Op, Type>(static_cast<Type>(values[k]), constant);
+        isTrue[k] = valid & match;
+        isFalse[k] = valid & (match ^ 1);
+    }
+}
+
+template <CompareOp Op, typename Left, typename Right>
+static void compareColumns(const Batch &batch, Left left, Right right, uint8_t *__restrict isTrue,
+                           uint8_t *__restrict isFalse)
+{
+    using Type = typename Left::Type;
+    const typename Left::Stored *__restrict a = left.values(batch);
+    const typename Right::Stored *__restrict b = right.values(batch);
+    const uint8_t *__restrict aNulls = batch.columns[left.slot].nulls;
+    const uint8_t *__restrict bNulls = batch.columns[right.slot].nulls;
+    for (size_t k = 0, n = batch.size; k < n; k++)
+    {
+        uint8_t valid = (aNulls[k] | bNulls[k]) ^ 1;
+        uint8_t match = compare<Op, Type>(static_cast<Type>(a[k]), static_cast<Type>(b[k]));
+        isTrue[k] = valid & match;
+        isFalse[k] = valid & (match ^ 1);
+    }
+}
+
+template <typename Column>
+static void between(const Batch &batch, Column column, typename Column::Type low, typename Column::Type high,
+                    uint8_t negated, uint8_t *__restrict isTrue, uint8_t *__restrict isFalse)
+{
+    using Type = typename Column::Type;
+    const typename Column::Stored *__restrict values = column.values(batch);
+    const uint8_t *__restrict nulls = batch.columns[column.slot].nulls;
+    for (size_t k = 0, n = batch.size; k < n; k++)
+    {
+        Type v = static_cast<Type>(values[k]);
+        uint8_t valid = nulls[k] ^ 1;
+        uint8_t match = static_cast<uint8_t>((low <= v) & (v <= high)) ^ negated;
+        isTrue[k] = valid & match;
+        isFalse[k] = valid & (match ^ 1);
+    }
+}
+
+// Outcomes of a STRING test for each value of a column's dictionary, so that batches
+// of a dictionary-encoded column are tested by code: once per distinct value rather
+// than once per row. They are worked out on the first batch of each dictionary, under
+// a lock, as the workers of a parallel scan share the predicate.
+class DictionaryOutcomes
+{
+private:
+    mutable mutex lock;
+    mutable const StringDictionary *dictionary = nullptr;
+    mutable size_t entries = 0;
+    mutable shared_ptr<const vector<uint8_t>> outcomes; // per code: 1 TRUE, 2 FALSE, 0 UNKNOWN
+
+public:
+    // False if the column has no dictionary in this batch. test gives the outcome of
+    // one value, coded as above.
+    template <typename Test>
+    bool eval(const Batch &batch, size_t slot, Test test, uint8_t *__restrict isTrue, uint8_t *__restrict isFalse) const
+    {
+        const ColumnVector &column = batch.columns[slot];
+        if (!column.dictionary)
+            return false;
+        shared_ptr<const vector<uint8_t>> known;
+        {
+            lock_guard<mutex> guard(lock);
+            if (dictionary != column.dictionary || entries != column.dictionary->size())
+            {
+                dictionary = column.dictionary;
+                entries = dictionary->size();
+                // Codes of NULLs are 0, so there is always an entry for them to read
+                auto computed = make_shared<vector<uint8_t>>(max<size_t>(entries, 1));
+                for (size_t code = 0; code < entries; code++)
+                    (*computed)[code] = test(dictionary->value(code));
+                outcomes = move(computed);
+            }
+            known = outcomes;
+        }
+        const uint8_t *__restrict table = known->data();
+        const uint8_t *__restrict nulls = column.nulls;
+        const uint16_t *__restrict codes = column.codes;
+        for (size_t k = 0, n = batch.size; k < n; k++)
+        {
+            uint8_t valid = nulls[k] ^ 1, outcome = table[codes[k]];
+            isTrue[k] = valid & outcome;
+            isFalse[k] = valid & (outcome >> 1);
+        }
+        return true;
+    }
+};
+
+static void fill(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse, uint8_t t, uint8_t f)
+{
+    memset(isTrue, t, batch.size);
+    memset(isFalse, f, batch.size);
+}
+
+class ConstantPredicate : public Predicate
+{
+private:
+    uint8_t isTrue, isFalse;
+
+public:
+    // Both false is UNKNOWN
+    ConstantPredicate(bool isTrue, bool isFalse) : isTrue(isTrue), isFalse(isFalse) {}
+
+    void eval(const Batch &batch, uint8_t *t, uint8_t *f) const override { fill(batch, t, f, isTrue, isFalse); }
+};
+
+static unique_ptr<Predicate> unknown() { return make_unique<ConstantPredicate>(false, false); }
+
+template <typename Column, CompareOp Op>
+class CompareConstant : public Predicate
+{
+private:
+    Column column;
+    typename Column::Type constant;
+    string storage; // owns the bytes of a string_view constant
+    DictionaryOutcomes dictionaryOutcomes;
+
+public:
+    CompareConstant(Column column, typename Column::Type constant, string storage = "")
+        : column(column), constant(constant), storage(move(storage))
+    {
+        if constexpr (is_same_v<typename Column::Type, string_view>)
+            this->constant = this->storage;
+    }
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        if constexpr (is_same_v<Column, StringColumn>)
+        {
+            auto test = [&](string_view v) { return compare<Op, string_view>(v, constant) ? 1 : 2; };
+            if (dictionaryOutcomes.eval(batch, column.slot, test, isTrue, isFalse))
+                return;
+        }
+        compareConstant<Op>(batch, column, constant, isTrue, isFalse);
+    }
+};
+
+template <typename Left, typename Right, CompareOp Op>
+class CompareColumns : public Predicate
+{
+private:
+    Left left;
+    Right right;
+
+public:
+    CompareColumns(Left left, Right right) : left(left), right(right) {}
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        compareColumns<Op>(batch, left, right, isTrue, isFalse);
+    }
+};
+
+template <typename Column>
+class InList : public Predicate
+{
+private:
+    using Type = typename Column::Type;
+    Column column;
+    vector<string> storage; // owns the bytes of string_view values
+    vector<Type> values;    // searched directly when short
+    unordered_set<Type> set;
+    bool hasNull, negated;
+    DictionaryOutcomes dictionaryOutcomes;
+
+    bool contains(const Type &value) const
+    {
+        return set.empty() ? find(values.begin(), values.end(), value) != values.end() : set.count(value) > 0;
+    }
+
+public:
+    InList(Column column, vector<Type> items, vector<string> owned, bool hasNull, bool negated)
+        : column(column), storage(move(owned)), values(move(items)), hasNull(hasNull), negated(negated)
+    {
+        if constexpr (is_same_v<Type, string_view>)
+        {
+            for (size_t i = 0; i < values.size(); i++)
+                values[i] = storage[i];
+        }
+        if (values.size() > 8)
+            set.insert(values.begin(), values.end());
+    }
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        // A value not in a list holding NULL is UNKNOWN, never FALSE
+        uint8_t missTrue = !hasNull && negated, missFalse = !hasNull && !negated;
+        if constexpr (is_same_v<Column, StringColumn>)
+        {
+            auto test = [&](string_view v) { return contains(v) ? (negated ? 2 : 1) : missTrue | missFalse << 1; };
+            if (dictionaryOutcomes.eval(batch, column.slot, test, isTrue, isFalse))
+                return;
+        }
+        const Type *data = column.values(batch);
+        const uint8_t *nulls = batch.columns[column.slot].nulls;
+        for (size_t k = 0; k < batch.size; k++)
+        {
+            if (nulls[k])
+            {
+                isTrue[k] = isFalse[k] = 0;
+                continue;
+            }
+            bool found = contains(data[k]);
+            isTrue[k] = found ? !negated : missTrue;
+            isFalse[k] = found ? negated : missFalse;
+        }
+    }
+};
+
+template <typename Column>
+class Between : public Predicate
+{
+private:
+    using Type = typename Column::Type;
+    Column column;
+    string lowStorage, highStorage;
+    Type low, high;
+    bool negated;
+    DictionaryOutcomes dictionaryOutcomes;
+
+public:
+    Between(Column column, Type low, Type high, string lowText, string highText, bool negated)
+        : column(column), lowStorage(move(lowText)), highStorage(move(highText)), low(low), high(high), negated(negated)
+    {
+        if constexpr (is_same_v<Type, string_view>)
+        {
+            this->low = lowStorage;
+            this->high = highStorage;
+        }
+    }
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        if constexpr (is_same_v<Column, StringColumn>)
+        {
+            auto test = [&](string_view v) { return (low <= v && v <= high) != negated ? 1 : 2; };
+            if (dictionaryOutcomes.eval(batch, column.slot, test, isTrue, isFalse))
+                return;
+        }
+        between(batch, column, low, high, negated, isTrue, isFalse);
+    }
+};
+
+// LIKE with % (any run) and _ (any one byte); common shapes get a direct test
+class Like : public Predicate
+{
+private:
+    enum Shape
+    {
+        LIKE_EXACT,    // abc
+        LIKE_PREFIX,   // abc%
+        LIKE_SUFFIX,   // %abc
+        LIKE_CONTAINS, // %abc%
+        LIKE_GENERAL
+    };
+
+    StringColumn column;
+    string pattern, literal;
+    Shape shape;
+    bool negated;
+    DictionaryOutcomes dictionaryOutcomes;
+
+    static bool matchGeneral(string_view text, string_view pattern)
+    {
+        // Greedy match that backtracks to the last %
+        size_t t = 0, p = 0, starP = string_view::npos, starT = 0;
+        while (t < text.size())
+        {
+            if (p < pattern.size() && (pattern[p] == '_' || pattern[p] == text[t]) && pattern[p] != '%')
+            {
+                t++;
+                p++;
+            }
+            else if (p < pattern.size() && pattern[p] == '%')
+            {
+                starP = p++;
+                starT = t;
+            }
+            else if (starP != string_view::npos)
+            {
+                p = starP + 1;
+                t = ++starT;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '%')
+            p++;
+        return p == pattern.size();
+    }
+
+    bool match(string_view v) const
+    {
+        switch (shape)
+        {
+        case LIKE_EXACT:
+            return v == literal;
+        case LIKE_PREFIX:
+            return v.substr(0, literal.size()) == literal;
+        case LIKE_SUFFIX:
+            return v.size() >= literal.size() && v.substr(v.size() - literal.size()) == literal;
+        case LIKE_CONTAINS:
+            return v.find(literal) != string_view::npos;
+        default:
+            return matchGeneral(v, pattern);
+        }
+    }
+
+public:
+    Like(StringColumn column, string pattern, bool negated) : column(column), pattern(move(pattern)), negated(negated)
+    {
+        const string &pat = this->pattern;
+        size_t inner = pat.find_first_of("%_", pat.empty() || pat[0] != '%' ? 0 : 1);
+        bool leading = !pat.empty() && pat[0] == '%';
+        bool trailing = pat.size() > 1 && pat.back() == '%';
+        if (pat.find_first_of("%_") == string::npos)
+        {
+            shape = LIKE_EXACT;
+            literal = pat;
+        }
+        else if (!leading && inner == pat.size() - 1 && trailing)
+        {
+            shape = LIKE_PREFIX;
+            literal = pat.substr(0, pat.size() - 1);
+        }
+        else if (leading && pat.find_first_of("%_", 1) == string::npos)
+        {
+            shape = LIKE_SUFFIX;
+            literal = pat.substr(1);
+        }
+        else if (leading && trailing && inner == pat.size() - 1)
+        {
+            shape = LIKE_CONTAINS;
+            literal = pat.substr(1, pat.size() - 2);
+        }
+        else
+        {
+            shape = LIKE_GENERAL;
+        }
+    }
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        auto test = [&](string_view v) { return match(v) != negated ? 1 : 2; };
+        if (dictionaryOutcomes.eval(batch, column.slot, test, isTrue, isFalse))
+            return;
+        const string_view *values = column.values(batch);
+        const uint8_t *nulls = batch.columns[column.slot].nulls;
+        for (size_t k = 0; k < batch.size; k++)
+        {
+            uint8_t valid = nulls[k] ^ 1;
+            uint8_t matched = valid && match(values[k]) != negated;
+            isTrue[k] = matched;
+            isFalse[k] = valid & (matched ^ 1);
+        }
+    }
+};
+
+class IsNull : public Predicate
+{
+private:
+    size_t slot;
+    uint8_t negated;
+
+public:
+    IsNull(size_t slot, bool negated) : slot(slot), negated(negated) {}
+
+    void eval(const Batch &batch, uint8_t *__restrict isTrue, uint8_t *__restrict isFalse) const override
+    {
+        const uint8_t *__restrict nulls = batch.columns[slot].nulls;
+        for (size_t k = 0, n = batch.size; k < n; k++)
+        {
+            isTrue[k] = nulls[k] ^ negated;
+            isFalse[k] = isTrue[k] ^ 1;
+        }
+    }
+};
+
+// NOT swaps TRUE and FALSE and keeps UNKNOWN, so it only swaps the outputs
+class Not : public Predicate
+{
+private:
+    unique_ptr<Predicate> inner;
+
+public:
+    explicit Not(unique_ptr<Predicate> inner) : inner(move(inner)) {}
+
+    void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const override
+    {
+        inner->eval(batch, isFalse, isTrue);
+    }
+};
+
+// AND is TRUE when both sides are and FALSE when either is; OR is the dual
+class And : public Predicate
+{
+private:
+    unique_ptr<Predicate> left, right;
+
+public:
+    And(unique_ptr<Predicate> left, unique_ptr<Predicate> right) : left(move(left)), right(move(right)) {}
+
+    void eval(const Batch &batch, uint8_t *__restrict isTrue, uint8_t *__restrict isFalse) const override
+    {
+        uint8_t rightTrue[BATCH_SIZE], rightFalse[BATCH_SIZE];
+        left->eval(batch, isTrue, isFalse);
+        right->eval(batch, rightTrue, rightFalse);
+        for (size_t k = 0, n = batch.size; k < n; k++)
+        {
+            isTrue[k] &= rightTrue[k];
+            isFalse[k] |= rightFalse[k];
+        }
+    }
+};
+
+class Or : public Predicate
+{
+private:
+    unique_ptr<Predicate> left, right;
+
+public:
+    Or(unique_ptr<Predicate> left, unique_ptr<Predicate> right) : left(move(left)), right(move(right)) {}
+
+    void eval(const Batch &batch, uint8_t *__restrict isTrue, uint8_t *__restrict isFalse) const override
+    {
+        uint8_t rightTrue[BATCH_SIZE], rightFalse[BATCH_SIZE];
+        left->eval(batch, isTrue, isFalse);
+        right->eval(batch, rightTrue, rightFalse);
+        for (size_t k = 0, n = batch.size; k < n; k++)
+        {
+            isTrue[k] |= rightTrue[k];
+            isFalse[k] &= rightFalse[k];
+        }
+    }
+};
+
+void filterBatch(const Predicate &predicate, Batch &batch)
+{
+    uint8_t isTrue[BATCH_SIZE], isFalse[BATCH_SIZE];
+    predicate.eval(batch, isTrue, isFalse);
+    // Every selected position is written back, but only qualifying ones advance
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.selected; i++)
+    {
+        uint16_t pos = batch.selection[i];
+        batch.selection[kept] = pos;
+        kept += isTrue[pos];
+    }
+    batch.selected = kept;
+}
+
+// Compilation
+
+struct CompileContext
+{
+    const vector<ColumnInfo> &columns;
+    string &error;
+
+    bool resolve(const Expr &expr, size_t &slot)
+    {
+        for (slot = 0; slot < columns.size(); slot++)
+        {
+            if (columns[slot].name == expr.text)
+                return true;
+        }
+        error = "Unknown column '" + expr.text + "' in WHERE";
+        return false;
+    }
+
+    // Converts a literal to the type of the column it is compared with
+    bool literal(const Expr &expr, int type, const string &column, Value &value)
+    {
+        if (parseValue(type, expr.text, value))
+            return true;
+        error = invalidValueMessage(type, expr.text, column);
+        return false;
+    }
+};
+
+static CompareOp flip(CompareOp op)
+{
+    switch (op)
+    {
+    case CMP_LT:
+        return CMP_GT;
+    case CMP_LE:
+        return CMP_GE;
+    case CMP_GT:
+        return CMP_LT;
+    case CMP_GE:
+        return CMP_LE;
+    default:
+        return op;
+    }
+}
+
+template <typename Column, typename... Args>
+static unique_ptr<Predicate> makeCompare(CompareOp op, Column column, Args &&...args)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        return make_unique<CompareConstant<Column, CMP_EQ>>(column, forward<Args>(args)...);
+    case CMP_NE:
+        return make_unique<CompareConstant<Column, CMP_NE>>(column, forward<Args>(args)...);
+    case CMP_LT:
+        return make_unique<CompareConstant<Column, CMP_LT>>(column, forward<Args>(args)...);
+    case CMP_LE:
+        return make_unique<CompareConstant<Column, CMP_LE>>(column, forward<Args>(args)...);
+    case CMP_GT:
+        return make_unique<CompareConstant<Column, CMP_GT>>(column, forward<Args>(args)...);
+    case CMP_GE:
+        return make_unique<CompareConstant<Column, CMP_GE>>(column, forward<Args>(args)...);
+    }
+    return nullptr;
+}
+
+template <typename Left, typename Right>
+static unique_ptr<Predicate> makeColumnCompare(CompareOp op, Left left, Right right)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        return make_unique<CompareColumns<Left, Right, CMP_EQ>>(left, right);
+    case CMP_NE:
+        return make_unique<CompareColumns<Left, Right, CMP_NE>>(left, right);
+    case CMP_LT:
+        return make_unique<CompareColumns<Left, Right, CMP_LT>>(left, right);
+    case CMP_LE:
+        return make_unique<CompareColumns<Left, Right, CMP_LE>>(left, right);
+    case CMP_GT:
+        return make_unique<CompareColumns<Left, Right, CMP_GT>>(left, right);
+    case CMP_GE:
+        return make_unique<CompareColumns<Left, Right, CMP_GE>>(left, right);
+    }
+    return nullptr;
+}
+
+static unique_ptr<Predicate> compileCompare(CompileContext &ctx, CompareOp op, const Expr &left, const Expr &right)
+{
+    if (left.kind != EXPR_COLUMN && right.kind == EXPR_COLUMN)
+        return compileCompare(ctx, flip(op), right, left);
+    if (left.kind != EXPR_COLUMN)
+    {
+        ctx.error = "WHERE comparison needs a column";
+        return nullptr;
+    }
+    size_t slot;
+    if (!ctx.resolve(left, slot))
+        return nullptr;
+    int type = ctx.columns[slot].type;
+    const string &name = ctx.columns[slot].name;
+
+    if (right.kind == EXPR_COLUMN)
+    {
+        size_t other;
+        if (!ctx.resolve(right, other))
+            return nullptr;
+        int otherType = ctx.columns[other].type;
+        if (type == otherType)
+        {
+            switch (type)
+            {
+            case TYPE_INT:
+                return makeColumnCompare(op, IntColumn{slot}, IntColumn{other});
+            case TYPE_FLOAT:
+                return makeColumnCompare(op, FloatColumn{slot}, FloatColumn{other});
+            case TYPE_BOOL:
+                return makeColumnCompare(op, BoolColumn{slot}, BoolColumn{other});
+            case TYPE_STRING:
+                return makeColumnCompare(op, StringColumn{slot}, StringColumn{other});
+            case TYPE_DATE:
+                return makeColumnCompare(op, DateColumn{slot}, DateColumn{other});
+            }
+        }
+        if (type == TYPE_INT && otherType == TYPE_FLOAT)
+            return makeColumnCompare(op, IntAsFloatColumn{slot}, FloatColumn{other});
+        if (type == TYPE_FLOAT && otherType == TYPE_INT)
+            return makeColumnCompare(op, FloatColumn{slot}, IntAsFloatColumn{other});
+        ctx.error = "Cannot compare " + datatypeName.at(type) + " column '" + name + "' with " +
+                    datatypeName.at(otherType) + " column '" + right.text + "'";
+        return nullptr;
+    }
+
+    if (right.isNull)
+        return unknown();
+
+    Value value;
+    if (type == TYPE_INT && !parseValue(TYPE_INT, right.text, value) && parseValue(TYPE_FLOAT, right.text, value))
+        return makeCompare(op, IntAsFloatColumn{slot}, value.f);
+    if (!ctx.literal(right, type, name, value))
+        return nullptr;
+    switch (type)
+    {
+    case TYPE_INT:
+        return makeCompare(op, IntColumn{slot}, value.i);
+    case TYPE_FLOAT:
+        return makeCompare(op, FloatColumn{slot}, value.f);
+    case TYPE_BOOL:
+        return makeCompare(op, BoolColumn{slot}, value.b);
+    case TYPE_STRING:
+        return makeCompare(op, StringColumn{slot}, string_view(), value.s);
+    case TYPE_DATE:
+        return makeCompare(op, DateColumn{slot}, value.d);
+    }
+    return nullptr;
+}
+
+template <typename Column, typename Get>
+static unique_ptr<Predicate> makeIn(CompileContext &ctx, const Expr &expr, Column column, int type, Get get)
+{
+    const string &name = ctx.columns[column.slot].name;
+    vector<typename Column::Type> values;
+    vector<string> owned;
+    bool hasNull = false;
+    for (size_t i = 1; i < expr.children.size(); i++)
+    {
+        const Expr &item = *expr.children[i];
+        if (item.kind != EXPR_LITERAL)
+        {
+            ctx.error = "IN list may only hold values";
+            return nullptr;
+        }
+        if (item.isNull)
+        {
+            hasNull = true;
+            continue;
+        }
+        Value value;
+        if (!ctx.literal(item, type, name, value))
+            return nullptr;
+        values.push_back(get(value));
+        owned.push_back(value.s);
+    }
+    return make_unique<InList<Column>>(column, move(values), move(owned), hasNull, expr.negated);
+}
+
+template <typename Column, typename Get>
+static unique_ptr<Predicate> makeBetween(CompileContext &ctx, const Expr &expr, Column column, int type, Get get)
+{
+    const Expr &low = *expr.children[1], &high = *expr.children[2];
+    if (low.kind != EXPR_LITERAL || high.kind != EXPR_LITERAL)
+    {
+        ctx.error = "BETWEEN bounds must be values";
+        return nullptr;
+    }
+    if (low.isNull || high.isNull)
+        return unknown();
+    const string &name = ctx.columns[column.slot].name;
+    Value lowValue, highValue;
+    if (!ctx.literal(low, type, name, lowValue) || !ctx.literal(high, type, name, highValue))
+        return nullptr;
+    return make_unique<Between<Column>>(column, get(lowValue), get(highValue), lowValue.s, highValue.s, expr.negated);
+}
+
+// IN and BETWEEN share the dispatch on the column's type
+template <template <typename> class Maker>
+static unique_ptr<Predicate> dispatchOnColumn(CompileContext &ctx, const Expr &expr)
+{
+    const Expr &target = *expr.children[0];
+    if (target.kind != EXPR_COLUMN)
+    {
+        ctx.error = "WHERE condition needs a column";
+        return nullptr;
+    }
+    size_t slot;
+    if (!ctx.resolve(target, slot))
+        return nullptr;
+    int type = ctx.columns[slot].type;
+    switch (type)
+    {
+    case TYPE_INT:
+        return Maker<IntColumn>::make(ctx, expr, IntColumn{slot}, type, [](const Value &v) { return v.i; });
+    case TYPE_FLOAT:
+        return Maker<FloatColumn>::make(ctx, expr, FloatColumn{slot}, type, [](const Value &v) { return v.f; });
+    case TYPE_BOOL:
+        return Maker<BoolColumn>::make(ctx, expr, BoolColumn{slot}, type, [](const Value &v) { return v.b; });
+    case TYPE_STRING:
+        return Maker<StringColumn>::make(ctx, expr, StringColumn{slot}, type, [](const Value &) { return string_view(); });
+    case TYPE_DATE:
+        return Maker<DateColumn>::make(ctx, expr, DateColumn{slot}, type, [](const Value &v) { return v.d; });
+    }
+    return nullptr;
+}
+
+template <typename Column>
+struct InMaker
+{
+    template <typename Get>
+    static unique_ptr<Predicate> make(CompileContext &ctx, const Expr &expr, Column column, int type, Get get)
+    {
+        return makeIn(ctx, expr, column, type, get);
+    }
+};
+
+template <typename Column>
+struct BetweenMaker
+{
+    template <typename Get>
+    static unique_ptr<Predicate> make(CompileContext &ctx, const Expr &expr, Column column, int type, Get get)
+    {
+        return makeBetween(ctx, expr, column, type, get);
+    }
+};
+
+static unique_ptr<Predicate> compile(CompileContext &ctx, const Expr &expr)
+{
+    switch (expr.kind)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+    {
+        auto left = compile(ctx, *expr.children[0]);
+        auto right = left ? compile(ctx, *expr.children[1]) : nullptr;
+        if (!right)
+            return nullptr;
+        if (expr.kind == EXPR_AND)
+            return make_unique<And>(move(left), move(right));
+        return make_unique<Or>(move(left), move(right));
+    }
+    case EXPR_NOT:
+    {
+        auto inner = compile(ctx, *expr.children[0]);
+        return inner ? make_unique<Not>(move(inner)) : nullptr;
+    }
+    case EXPR_COMPARE:
+        return compileCompare(ctx, expr.op, *expr.children[0], *expr.children[1]);
+    case EXPR_IN:
+        return dispatchOnColumn<InMaker>(ctx, expr);
+    case EXPR_BETWEEN:
+        return dispatchOnColumn<BetweenMaker>(ctx, expr);
+    case EXPR_LIKE:
+    {
+        const Expr &target = *expr.children[0], &pattern = *expr.children[1];
+        size_t slot;
+        if (target.kind != EXPR_COLUMN || pattern.kind != EXPR_LITERAL)
+        {
+            ctx.error = "LIKE needs a column and a pattern";
+            return nullptr;
+        }
+        if (!ctx.resolve(target, slot))
+            return nullptr;
+        if (ctx.columns[slot].type != TYPE_STRING)
+        {
+            ctx.error = "LIKE needs a STRING column; '" + target.text + "' is " + datatypeName.at(ctx.columns[slot].type);
+            return nullptr;
+        }
+        if (pattern.isNull)
+            return unknown();
+        return make_unique<Like>(StringColumn{slot}, pattern.text, expr.negated);
+    }
+    case EXPR_IS_NULL:
+    {
+        const Expr &target = *expr.children[0];
+        if (target.kind == EXPR_LITERAL)
+        {
+            bool holds = target.isNull != expr.negated;
+            return make_unique<ConstantPredicate>(holds, !holds);
+        }
+        size_t slot;
+        if (!ctx.resolve(target, slot))
+            return nullptr;
+        return make_unique<IsNull>(slot, expr.negated);
+    }
+    case EXPR_COLUMN:
+    case EXPR_LITERAL:
+        break;
+    }
+    ctx.error = "Expected a condition in WHERE";
+    return nullptr;
+}
+
+unique_ptr<Predicate> compilePredicate(const Expr &expr, const vector<ColumnInfo> &columns, string &error)
+{
+    CompileContext ctx{columns, error};
+    return compile(ctx, expr);
+}
+
+// Zone map and Bloom filter pruning
+
+// Whether a condition may be TRUE for some row of block z. Parts that minimum, maximum,
+// NULL count and Bloom filters cannot decide, such as NOT, LIKE or comparisons of two
+// columns, may.
+using ZoneTest = function<bool(size_t z)>;
+
+static bool zoneKeyOf(int type, const Expr &literal, int64_t &key)
+{
+    Value value;
+    if (literal.kind != EXPR_LITERAL || literal.isNull || !parseValue(type, literal.text, value))
+        return false;
+    key = type == TYPE_FLOAT ? floatZoneKey(value.f) : type == TYPE_DATE ? value.d : value.i;
+    return true;
+}
+
+// Whether block z may hold a row whose column equals one of the literals, going by
+// the column's zone map and its Bloom filter index, whichever it has
+static ZoneTest membershipTest(const Expr &target, const vector<const Expr *> &literals, const TableStorage &storage)
+{
+    ZoneTest always = [](size_t) { return true; };
+    const auto &files = storage.columnFiles();
+    size_t c = 0;
+    while (target.kind == EXPR_COLUMN && c < files.size() && files[c].info.name != target.text)
+        c++;
+    if (target.kind != EXPR_COLUMN || c == files.size())
+        return always;
+    int type = files[c].info.type;
+    const vector<ZoneStats> *zones = hasZoneMap(type) ? &storage.zoneMap(c) : nullptr;
+    BloomIndex *filter = storage.findBloom(c);
+    if (!zones && !filter)
+        return always;
+
+    vector<int64_t> keys;
+    vector<uint64_t> words;
+    for (const Expr *literal : literals)
+    {
+        // A literal NULL never equals anything
+        if (literal->kind == EXPR_LITERAL && literal->isNull)
+            continue;
+        Value value;
+        uint64_t word = 0;
+        if (literal->kind != EXPR_LITERAL || !parseValue(type, literal->text, value) ||
+            (filter && !filter->keyWordOf(value, word)))
+            return always;
+        keys.push_back(type == TYPE_FLOAT ? floatZoneKey(value.f) : type == TYPE_DATE ? value.d : value.i);
+        words.push_back(word);
+    }
+    return [zones, filter, keys, words](size_t z)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (zones && z < zones->size() && ((*zones)[z].low > keys[i] || (*zones)[z].high < keys[i]))
+                continue;
+            if (!filter || filter->mayContain(z, words[i]))
+                return true;
+        }
+        return false;
+    };
+}
+
+static ZoneTest zoneTest(const Expr &expr, const TableStorage &storage)
+{
+    ZoneTest always = [](size_t) { return true; };
+    // The zone map of the column an operand names, if it has one
+    auto zonesOf = [&](const Expr &operand) -> const vector<ZoneStats> *
+    {
+        const auto &files = storage.columnFiles();
+        for (size_t c = 0; operand.kind == EXPR_COLUMN && c < files.size(); c++)
+        {
+            if (files[c].info.name == operand.text && hasZoneMap(files[c].info.type))
+                return &storage.zoneMap(c);
+        }
+        return nullptr;
+    };
+    auto typeOf = [&](const Expr &operand)
+    {
+        for (const auto &file : storage.columnFiles())
+        {
+            if (file.info.name == operand.text)
+                return file.info.type;
+        }
+        return -1;
+    };
+    // A literal NULL makes a comparison UNKNOWN, which never qualifies a row
+    auto isNullLiteral = [](const Expr &operand) { return operand.kind == EXPR_LITERAL && operand.isNull; };
+
+    switch (expr.kind)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+    {
+        ZoneTest left = zoneTest(*expr.children[0], storage), right = zoneTest(*expr.children[1], storage);
+        if (expr.kind == EXPR_AND)
+            return [left, right](size_t z) { return left(z) && right(z); };
+        return [left, right](size_t z) { return left(z) || right(z); };
+    }
+    case EXPR_COMPARE:
+    {
+        bool flipped = expr.children[0]->kind != EXPR_COLUMN;
+        const Expr &target = *expr.children[flipped ? 1 : 0], &literal = *expr.children[flipped ? 0 : 1];
+        CompareOp op = flipped ? flip(expr.op) : expr.op;
+        if (op == CMP_EQ)
+            return membershipTest(target, {&literal}, storage);
+        const vector<ZoneStats> *zones = zonesOf(target);
+        int64_t key;
+        if (!zones)
+            return always;
+        if (isNullLiteral(literal))
+            return [](size_t) { return false; };
+        if (!zoneKeyOf(typeOf(target), literal, key))
+            return always;
+        return [zones, op, key](size_t z)
+        {
+            if (z >= zones->size())
+                return true;
+            const ZoneStats &zone = (*zones)[z];
+            switch (op)
+            {
+            case CMP_EQ: // membershipTest()
+                return true;
+            case CMP_NE:
+                return zone.low < key || zone.high > key;
+            case CMP_LT:
+                return zone.low < key;
+            case CMP_LE:
+                return zone.low <= key;
+            case CMP_GT:
+                return zone.high > key;
+            case CMP_GE:
+                return zone.high >= key;
+            }
+            return true;
+        };
+    }
+    case EXPR_BETWEEN:
+    {
+        const vector<ZoneStats> *zones = zonesOf(*expr.children[0]);
+        int64_t low, high;
+        if (!zones || expr.negated)
+            return always;
+        if (isNullLiteral(*expr.children[1]) || isNullLiteral(*expr.children[2]))
+            return [](size_t) { return false; };
+        int type = typeOf(*expr.children[0]);
+        if (!zoneKeyOf(type, *expr.children[1], low) || !zoneKeyOf(type, *expr.children[2], high))
+            return always;
+        return [zones, low, high](size_t z)
+        { return z >= zones->size() || ((*zones)[z].low <= high && (*zones)[z].high >= low); };
+    }
+    case EXPR_IN:
+    {
+        if (expr.negated)
+            return always;
+        vector<const Expr *> literals;
+        for (size_t i = 1; i < expr.children.size(); i++)
+            literals.push_back(expr.children[i].get());
+        return membershipTest(*expr.children[0], literals, storage);
+    }
+    case EXPR_IS_NULL:
+    {
+        const vector<ZoneStats> *zones = zonesOf(*expr.children[0]);
+        if (!zones)
+            return always;
+        bool negated = expr.negated;
+        return [zones, negated](size_t z)
+        {
+            if (z >= zones->size())
+                return true;
+            const ZoneStats &zone = (*zones)[z];
+            return negated ? zone.nulls < zone.rows : zone.nulls > 0;
+        };
+    }
+    default:
+        return always;
+    }
+}
+
+vector<uint8_t> skippableZones(const Expr &expr, const TableStorage &storage)
+{
+    ZoneTest test = zoneTest(expr, storage);
+    vector<uint8_t> skip((storage.rowCount() + ZONE_ROWS - 1) / ZONE_ROWS);
+    bool any = false;
+    for (size_t z = 0; z < skip.size(); z++)
+    {
+        skip[z] = !test(z);
+        any = any || skip[z];
+    }
+    if (!any)
+        skip.clear();
+    return skip;
+}
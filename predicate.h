@@ -0,0 +1,35 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include "expr.h"
+#include "batch.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A WHERE condition compiled for one scan. Literals are converted to the column's type
+// once, and every comparison is a node specialized for that type and operator. A node
+// evaluates a whole batch per call with SQL three-valued logic: it sets isTrue[k] and
+// isFalse[k] to 0 or 1 for every position k, and a position with neither set is
+// UNKNOWN, as any comparison with NULL is.
+class Predicate
+{
+public:
+    virtual ~Predicate() = default;
+    virtual void eval(const Batch &batch, uint8_t *isTrue, uint8_t *isFalse) const = 0;
+};
+
+// Compiles expr for a scan whose slot i holds columns[i]. On failure returns null and
+// describes the problem in error.
+unique_ptr<Predicate> compilePredicate(const Expr &expr, const vector<ColumnInfo> &columns, string &error);
+
+// Drops the selected rows of batch for which predicate is not TRUE
+void filterBatch(const Predicate &predicate, Batch &batch);
+
+// Marks, per block of ZONE_ROWS rows of a table, the blocks whose zone maps or Bloom
+// filter indexes show that expr cannot be TRUE for any of their rows. Empty when no block can be ruled out.
+vector<uint8_t> skippableZones(const Expr &expr, const TableStorage &storage);
+
+#endif // PREDICATE_H
@@ -0,0 +1,592 @@
+#include "scan.h"
+#include "globals.h"
+#include "bufferpool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+template <typename T>
+static T load(const char *base, uint64_t row)
+{
+    T value;
+    memcpy(&value, base + row * sizeof(T), sizeof(T));
+    return value;
+}
+
+static uint8_t boolCode(const char *base, uint64_t row)
+{
+    return (static_cast<uint8_t>(base[row / 4]) >> ((row % 4) * 2)) & 3;
+}
+
+// Code of a row of a column of codes width bytes wide
+static uint64_t loadCode(const char *base, uint64_t row, size_t width)
+{
+    uint64_t code = 0;
+    memcpy(&code, base + row * width, width);
+    return code;
+}
+
+// Value of a row of a frame of reference column, or nullValue for NULL
+static int64_t frameValue(const char *base, uint64_t row, const ColumnEncoding &encoding, int64_t nullValue)
+{
+    uint64_t code = loadCode(base, row, encoding.width);
+    return code == nullCode(encoding.width) ? nullValue
+                                            : static_cast<int64_t>(static_cast<uint64_t>(encoding.base) + code);
+}
+
+// Decodes n consecutive rows of a frame of reference column, NULLs as nullValue
+template <typename Code, typename T>
+static void decodeFrame(const char *base, uint64_t first, size_t n, int64_t frameBase, T nullValue, T *out,
+                        uint8_t *nulls)
+{
+    const Code *codes = reinterpret_cast<const Code *>(base) + first;
+    for (size_t k = 0; k < n; k++)
+    {
+        nulls[k] = codes[k] == static_cast<Code>(~Code(0));
+        T value = static_cast<T>(static_cast<uint64_t>(frameBase) + codes[k]);
+        out[k] = nulls[k] ? nullValue : value;
+    }
+}
+
+template <typename T>
+static void decodeFrame(const char *base, uint64_t first, size_t n, const ColumnEncoding &encoding, T nullValue,
+                        T *out, uint8_t *nulls)
+{
+    switch (encoding.width)
+    {
+    case 1:
+        decodeFrame<uint8_t>(base, first, n, encoding.base, nullValue, out, nulls);
+        break;
+    case 2:
+        decodeFrame<uint16_t>(base, first, n, encoding.base, nullValue, out, nulls);
+        break;
+    default:
+        decodeFrame<uint32_t>(base, first, n, encoding.base, nullValue, out, nulls);
+        break;
+    }
+}
+
+// Decodes n consecutive rows of a dictionary-encoded column into values and codes
+template <typename Code>
+static void decodeDictionary(const char *base, uint64_t first, size_t n, const StringDictionary &dictionary,
+                             ColumnVector &out)
+{
+    const Code *codes = reinterpret_cast<const Code *>(base) + first;
+    for (size_t k = 0; k < n; k++)
+    {
+        out.nulls[k] = codes[k] == static_cast<Code>(~Code(0));
+        out.codes[k] = out.nulls[k] ? 0 : codes[k];
+        out.strings[k] = out.nulls[k] ? string_view() : dictionary.value(codes[k]);
+    }
+}
+
+// Reads one row of a dictionary-encoded column into position k of out
+static void dictionaryCell(const char *base, uint64_t row, size_t width, const StringDictionary &dictionary,
+                           ColumnVector &out, size_t k)
+{
+    uint64_t code = loadCode(base, row, width);
+    out.nulls[k] = code == nullCode(width);
+    out.codes[k] = out.nulls[k] ? 0 : static_cast<uint16_t>(code);
+    out.strings[k] = out.nulls[k] ? string_view() : dictionary.value(code);
+}
+
+MappedFile::~MappedFile()
+{
+    if (base)
+        munmap(const_cast<char *>(base), length);
+}
+
+// Maps the first minimumLength bytes of fd; an empty range needs no mapping
+bool MappedFile::map(int fd, size_t minimumLength)
+{
+    if (minimumLength == 0)
+        return true;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < minimumLength)
+        return false;
+    void *p = mmap(nullptr, minimumLength, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    madvise(p, minimumLength, MADV_SEQUENTIAL);
+    base = static_cast<const char *>(p);
+    length = minimumLength;
+    return true;
+}
+
+// Drops the mapping's pages below upTo from this process; they stay in the page cache
+void MappedFile::release(size_t upTo)
+{
+    size_t end = min(upTo, length) & ~(static_cast<size_t>(PAGE_SIZE) - 1);
+    if (base && end > 0)
+        madvise(const_cast<char *>(base), end, MADV_DONTNEED);
+}
+
+TableScan::TableScan(TableStorage &storage, const vector<size_t> &columns)
+    : mapped(columns.size()), deferred(columns.size(), false)
+{
+    // Pages still dirty in the buffer pool would be invisible to the mapping
+    if (!storage.flushPages())
+        return;
+    rows = storage.rowCount();
+    stop = rows;
+    const auto &files = storage.columnFiles();
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        const auto &file = files.at(columns[i]);
+        MappedColumn &col = mapped[i];
+        col.info = file.info;
+        col.encoding = file.encoding;
+        col.width = storedWidth(file.info.type, file.encoding);
+        col.dictionary = file.dictionary.get();
+        bool ok = col.values.map(file.fd, col.width == 0 ? (rows + 3) / 4 : rows * col.width);
+        if (ok && col.info.type == TYPE_STRING && !col.dictionary && rows > 0)
+        {
+            uint64_t last;
+            memcpy(&last, col.values.data() + (rows - 1) * sizeof(last), sizeof(last));
+            ok = col.strings.map(file.strFd, last & ~STRING_NULL_FLAG);
+        }
+        if (!ok)
+        {
+            cerr << RED << "Failed to map column " << col.info.name << RESET << endl;
+            return;
+        }
+    }
+    valid = true;
+}
+
+// Rows between releases of the pages a forward scan has left behind, which keeps the
+// resident size of a full scan flat however large the table is
+static const uint64_t SCAN_RELEASE_ROWS = 1 << 16;
+
+bool TableScan::next()
+{
+    if (++current >= stop)
+        return false;
+    if (current >= released + SCAN_RELEASE_ROWS)
+        releaseConsumed(current);
+    return true;
+}
+
+void TableScan::releaseConsumed(uint64_t upTo)
+{
+    released = upTo;
+    for (auto &col : mapped)
+    {
+        col.values.release(col.width == 0 ? upTo / 4 : upTo * col.width);
+        if (col.info.type == TYPE_STRING && !col.dictionary && upTo > 0)
+            col.strings.release(load<uint64_t>(col.values.data(), upTo - 1) & ~STRING_NULL_FLAG);
+    }
+}
+
+// Bytes n values of a column take in its .col or .off file, given its bytes per row
+static uint64_t valueBytes(size_t width, size_t n)
+{
+    return width == 0 ? (n + 3) / 4 : n * width;
+}
+
+// Fills batch with the rows after the current one. The null masks are computed with
+// plain loops over the fixed-width values so that the compiler vectorizes them.
+bool TableScan::nextBatch(Batch &batch)
+{
+    uint64_t first = current + 1; // wraps to 0 before the first row
+    size_t n, matched = 0;
+    if (byRowIds)
+    {
+        // From the next listed row to the last one listed within a batch of it
+        if (nextRowId >= rowIds.size())
+            return false;
+        first = rowIds[nextRowId];
+        while (nextRowId + matched < rowIds.size() && rowIds[nextRowId + matched] - first < BATCH_SIZE)
+            matched++;
+        n = static_cast<size_t>(rowIds[nextRowId + matched - 1] - first + 1);
+    }
+    else
+    {
+        while (first < stop && first / ZONE_ROWS < skipped.size() && skipped[first / ZONE_ROWS])
+            first = (first / ZONE_ROWS + 1) * ZONE_ROWS;
+        if (first >= stop)
+        {
+            current = stop - 1;
+            return false;
+        }
+        n = static_cast<size_t>(min<uint64_t>(BATCH_SIZE, stop - first));
+        if (!skipped.empty())
+            n = static_cast<size_t>(min<uint64_t>(n, (first / ZONE_ROWS + 1) * ZONE_ROWS - first));
+    }
+    if (first >= released + SCAN_RELEASE_ROWS)
+        releaseConsumed(first);
+    current = first + n - 1;
+
+    batch.firstRow = first;
+    batch.size = n;
+    batch.columns.resize(mapped.size());
+    batchRows += n;
+    for (size_t i = 0; i < mapped.size(); i++)
+    {
+        const MappedColumn &col = mapped[i];
+        ColumnVector &out = batch.columns[i];
+        out.info = col.info;
+        out.dictionary = col.dictionary;
+        if (deferred[i])
+            continue;
+        batchBytes += valueBytes(col.width, n);
+        const char *base = col.values.data();
+        uint8_t *nulls = out.nulls;
+        if (col.encoding.kind == ENCODING_FRAME && col.info.type == TYPE_INT)
+        {
+            decodeFrame(base, first, n, col.encoding, INT_NULL, out.gathered.ints, nulls);
+            out.ints = out.gathered.ints;
+            continue;
+        }
+        if (col.encoding.kind == ENCODING_FRAME)
+        {
+            decodeFrame(base, first, n, col.encoding, DATE_NULL, out.gathered.dates, nulls);
+            out.dates = out.gathered.dates;
+            continue;
+        }
+        if (col.dictionary)
+        {
+            if (col.width == 1)
+                decodeDictionary<uint8_t>(base, first, n, *col.dictionary, out);
+            else
+                decodeDictionary<uint16_t>(base, first, n, *col.dictionary, out);
+            continue;
+        }
+        switch (col.info.type)
+        {
+        case TYPE_INT:
+        {
+            const int64_t *values = reinterpret_cast<const int64_t *>(base) + first;
+            for (size_t k = 0; k < n; k++)
+                nulls[k] = values[k] == INT_NULL;
+            out.ints = values;
+            break;
+        }
+        case TYPE_FLOAT:
+        {
+            const uint64_t *bits = reinterpret_cast<const uint64_t *>(base) + first;
+            for (size_t k = 0; k < n; k++)
+                nulls[k] = bits[k] == FLOAT_NULL_BITS;
+            out.floats = reinterpret_cast<const double *>(base) + first;
+            break;
+        }
+        case TYPE_BOOL:
+            for (size_t k = 0; k < n; k++)
+            {
+                uint8_t code = boolCode(base, first + k);
+                out.bools[k] = code == BOOL_TRUE;
+                nulls[k] = code == BOOL_NULL;
+            }
+            break;
+        case TYPE_STRING:
+        {
+            const uint64_t *ends = reinterpret_cast<const uint64_t *>(base) + first;
+            uint64_t start = first == 0 ? 0 : ends[-1] & ~STRING_NULL_FLAG, begin = start;
+            for (size_t k = 0; k < n; k++)
+            {
+                uint64_t end = ends[k] & ~STRING_NULL_FLAG;
+                nulls[k] = (ends[k] & STRING_NULL_FLAG) != 0;
+                out.strings[k] = string_view(col.strings.data() + start, end - start);
+                start = end;
+            }
+            batchBytes += start - begin;
+            break;
+        }
+        case TYPE_DATE:
+        {
+            const int32_t *values = reinterpret_cast<const int32_t *>(base) + first;
+            for (size_t k = 0; k < n; k++)
+                nulls[k] = values[k] == DATE_NULL;
+            out.dates = values;
+            break;
+        }
+        }
+    }
+
+    if (byRowIds)
+    {
+        for (size_t k = 0; k < matched; k++)
+            batch.selection[k] = static_cast<uint16_t>(rowIds[nextRowId + k] - first);
+        nextRowId += matched;
+        batch.selected = matched;
+    }
+    else
+    {
+        for (size_t k = 0; k < n; k++)
+            batch.selection[k] = static_cast<uint16_t>(k);
+        batch.selected = n;
+    }
+    batch.projection.resize(mapped.size());
+    for (size_t i = 0; i < mapped.size(); i++)
+        batch.projection[i] = i;
+    return true;
+}
+
+// Deferred columns are left out of nextBatch until materialize decodes them, so that
+// rows the operators above drop never pay for columns only the output reads
+void TableScan::deferColumns(const vector<size_t> &columns)
+{
+    for (size_t i : columns)
+        deferred[i] = true;
+}
+
+// Decodes column i of batch at its selected positions only
+void TableScan::materialize(size_t i, Batch &batch) const
+{
+    const MappedColumn &col = mapped[i];
+    ColumnVector &out = batch.columns[i];
+    const char *base = col.values.data();
+    uint64_t first = batch.firstRow;
+    const uint16_t *selection = batch.selection;
+    size_t selected = batch.selected;
+    decodedBytes += valueBytes(col.width, selected);
+    if (col.encoding.kind == ENCODING_FRAME)
+    {
+        bool isInt = col.info.type == TYPE_INT;
+        for (size_t s = 0; s < selected; s++)
+        {
+            uint16_t pos = selection[s];
+            int64_t value = frameValue(base, first + pos, col.encoding, isInt ? INT_NULL : DATE_NULL);
+            if (isInt)
+                out.gathered.ints[pos] = value;
+            else
+                out.gathered.dates[pos] = static_cast<int32_t>(value);
+            out.nulls[pos] = value == (isInt ? INT_NULL : DATE_NULL);
+        }
+        out.ints = out.gathered.ints;
+        out.dates = out.gathered.dates;
+        return;
+    }
+    if (col.dictionary)
+    {
+        for (size_t s = 0; s < selected; s++)
+            dictionaryCell(base, first + selection[s], col.width, *col.dictionary, out, selection[s]);
+        return;
+    }
+    switch (col.info.type)
+    {
+    case TYPE_INT:
+        out.ints = reinterpret_cast<const int64_t *>(base) + first;
+        for (size_t s = 0; s < selected; s++)
+            out.nulls[selection[s]] = out.ints[selection[s]] == INT_NULL;
+        break;
+    case TYPE_FLOAT:
+        out.floats = reinterpret_cast<const double *>(base) + first;
+        for (size_t s = 0; s < selected; s++)
+            out.nulls[selection[s]] = isFloatNull(out.floats[selection[s]]);
+        break;
+    case TYPE_BOOL:
+        for (size_t s = 0; s < selected; s++)
+        {
+            uint8_t code = boolCode(base, first + selection[s]);
+            out.bools[selection[s]] = code == BOOL_TRUE;
+            out.nulls[selection[s]] = code == BOOL_NULL;
+        }
+        break;
+    case TYPE_STRING:
+        for (size_t s = 0; s < selected; s++)
+        {
+            uint64_t row = first + selection[s];
+            uint64_t start = row == 0 ? 0 : load<uint64_t>(base, row - 1) & ~STRING_NULL_FLAG;
+            uint64_t end = load<uint64_t>(base, row);
+            out.nulls[selection[s]] = (end & STRING_NULL_FLAG) != 0;
+            end &= ~STRING_NULL_FLAG;
+            out.strings[selection[s]] = string_view(col.strings.data() + start, end - start);
+            decodedBytes += end - start;
+        }
+        break;
+    case TYPE_DATE:
+        out.dates = reinterpret_cast<const int32_t *>(base) + first;
+        for (size_t s = 0; s < selected; s++)
+            out.nulls[selection[s]] = out.dates[selection[s]] == DATE_NULL;
+        break;
+    }
+}
+
+// Row IDs equal to UINT64_MAX come out NULL, as the missing side of an outer join does
+void TableScan::gather(size_t i, const uint64_t *rowIds, size_t n, ColumnVector &out) const
+{
+    const MappedColumn &col = mapped[i];
+    const char *base = col.values.data();
+    out.info = col.info;
+    out.dictionary = col.dictionary;
+    decodedBytes += valueBytes(col.width, n);
+    for (size_t k = 0; k < n; k++)
+    {
+        uint64_t row = rowIds[k];
+        if (row == UINT64_MAX)
+        {
+            // Kernels read values under the NULL mask too, so they must be defined
+            out.nulls[k] = 1;
+            out.bools[k] = 0;
+            out.strings[k] = string_view();
+            out.codes[k] = 0;
+            if (col.info.type == TYPE_DATE)
+                out.gathered.dates[k] = 0;
+            else
+                out.gathered.ints[k] = 0;
+            continue;
+        }
+        if (col.dictionary)
+        {
+            dictionaryCell(base, row, col.width, *col.dictionary, out, k);
+            continue;
+        }
+        switch (col.info.type)
+        {
+        case TYPE_INT:
+            out.gathered.ints[k] = col.encoding.kind == ENCODING_FRAME ? frameValue(base, row, col.encoding, INT_NULL)
+                                                                       : load<int64_t>(base, row);
+            out.nulls[k] = out.gathered.ints[k] == INT_NULL;
+            break;
+        case TYPE_FLOAT:
+            out.gathered.floats[k] = load<double>(base, row);
+            out.nulls[k] = isFloatNull(out.gathered.floats[k]);
+            break;
+        case TYPE_BOOL:
+        {
+            uint8_t code = boolCode(base, row);
+            out.bools[k] = code == BOOL_TRUE;
+            out.nulls[k] = code == BOOL_NULL;
+            break;
+        }
+        case TYPE_STRING:
+        {
+            uint64_t start = row == 0 ? 0 : load<uint64_t>(base, row - 1) & ~STRING_NULL_FLAG;
+            uint64_t end = load<uint64_t>(base, row);
+            out.nulls[k] = (end & STRING_NULL_FLAG) != 0;
+            end &= ~STRING_NULL_FLAG;
+            out.strings[k] = string_view(col.strings.data() + start, end - start);
+            decodedBytes += end - start;
+            break;
+        }
+        case TYPE_DATE:
+            out.gathered.dates[k] = col.encoding.kind == ENCODING_FRAME
+                                        ? static_cast<int32_t>(frameValue(base, row, col.encoding, DATE_NULL))
+                                        : load<int32_t>(base, row);
+            out.nulls[k] = out.gathered.dates[k] == DATE_NULL;
+            break;
+        }
+    }
+    out.ints = out.gathered.ints;
+    out.floats = out.gathered.floats;
+    out.dates = out.gathered.dates;
+}
+
+// Limits the scan to rows [first, end), so parallel workers can each take a range
+void TableScan::setRange(uint64_t first, uint64_t end)
+{
+    current = first - 1;
+    released = min(released, first);
+    stop = min(end, rows);
+}
+
+// Limits the scan to the given rows, which must be ascending and in the table
+void TableScan::setRows(vector<uint64_t> ids)
+{
+    rowIds = move(ids);
+    nextRowId = 0;
+    byRowIds = true;
+    current = UINT64_MAX;
+    released = 0;
+}
+
+// Marks blocks of rows, by zone map, that nextBatch() need not read
+void TableScan::skipZones(vector<uint8_t> skip)
+{
+    skipped = move(skip);
+    zonesSkipped = count(skipped.begin(), skipped.end(), 1);
+}
+
+bool TableScan::seek(uint64_t row)
+{
+    current = row;
+    released = min(released, row);
+    return current < rows;
+}
+
+bool TableScan::isNull(size_t i) const
+{
+    const MappedColumn &col = mapped[i];
+    if (col.encoding.kind != ENCODING_PLAIN)
+        return loadCode(col.values.data(), current, col.width) == nullCode(col.width);
+    switch (col.info.type)
+    {
+    case TYPE_INT:
+        return load<int64_t>(col.values.data(), current) == INT_NULL;
+    case TYPE_FLOAT:
+        return isFloatNull(load<double>(col.values.data(), current));
+    case TYPE_BOOL:
+        return boolCode(col.values.data(), current) == BOOL_NULL;
+    case TYPE_STRING:
+        return load<uint64_t>(col.values.data(), current) & STRING_NULL_FLAG;
+    case TYPE_DATE:
+        return load<int32_t>(col.values.data(), current) == DATE_NULL;
+    }
+    return true;
+}
+
+int64_t TableScan::getInt(size_t i) const
+{
+    const MappedColumn &col = mapped[i];
+    if (col.encoding.kind == ENCODING_FRAME)
+        return frameValue(col.values.data(), current, col.encoding, INT_NULL);
+    return load<int64_t>(col.values.data(), current);
+}
+
+double TableScan::getFloat(size_t i) const
+{
+    return load<double>(mapped[i].values.data(), current);
+}
+
+bool TableScan::getBool(size_t i) const
+{
+    return boolCode(mapped[i].values.data(), current) == BOOL_TRUE;
+}
+
+int32_t TableScan::getDate(size_t i) const
+{
+    const MappedColumn &col = mapped[i];
+    if (col.encoding.kind == ENCODING_FRAME)
+        return static_cast<int32_t>(frameValue(col.values.data(), current, col.encoding, DATE_NULL));
+    return load<int32_t>(col.values.data(), current);
+}
+
+// NULL values store the previous end offset, so the start is always the prior entry
+string_view TableScan::getString(size_t i) const
+{
+    const MappedColumn &col = mapped[i];
+    if (col.dictionary)
+    {
+        uint64_t code = loadCode(col.values.data(), current, col.width);
+        return code == nullCode(col.width) ? string_view() : col.dictionary->value(code);
+    }
+    uint64_t start = current == 0 ? 0 : load<uint64_t>(col.values.data(), current - 1) & ~STRING_NULL_FLAG;
+    uint64_t end = load<uint64_t>(col.values.data(), current) & ~STRING_NULL_FLAG;
+    return string_view(col.strings.data() + start, end - start);
+}
+
+string_view TableScan::cell(size_t i)
+{
+    if (isNull(i))
+        return "NULL";
+    MappedColumn &col = mapped[i];
+    switch (col.info.type)
+    {
+    case TYPE_INT:
+        return string_view(col.text, to_chars(col.text, col.text + sizeof(col.text), getInt(i)).ptr - col.text);
+    case TYPE_FLOAT:
+        return string_view(col.text, to_chars(col.text, col.text + sizeof(col.text), getFloat(i)).ptr - col.text);
+    case TYPE_BOOL:
+        return getBool(i) ? "TRUE" : "FALSE";
+    case TYPE_STRING:
+        return getString(i);
+    case TYPE_DATE:
+        return string_view(col.text, formatDateTo(getDate(i), col.text) - col.text);
+    }
+    return "NULL";
+}
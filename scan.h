@@ -0,0 +1,111 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "storage.h"
+#include "batch.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Read-only memory mapping of one file, advised for sequential access
+class MappedFile
+{
+private:
+    const char *base = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool map(int fd, size_t minimumLength);
+    void release(size_t upTo);
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// Iterator over a table's column files, mapped with mmap. Only the columns passed
+// to the constructor are mapped. Values are read in place: typed getters decode
+// straight from the mapping, STRING cells are string_views into it or into the
+// column's dictionary, frame of reference codes are added to the column's base, and
+// cell() formats other types into a per-column buffer that stays valid until the next
+// call to next(). nextBatch() reads the following BATCH_SIZE rows at once for the
+// operator pipeline, or after setRows() the listed rows only, and gather() reads one
+// column of arbitrary rows without moving the cursor. Blocks of rows marked by
+// skipZones() are stepped over.
+class TableScan
+{
+private:
+    struct MappedColumn
+    {
+        ColumnInfo info;
+        ColumnEncoding encoding;
+        size_t width = 0;   // bytes per row in values; 0 for BOOL
+        MappedFile values;  // .col, or .off for plain STRING
+        MappedFile strings; // .str for plain STRING
+        const StringDictionary *dictionary = nullptr;
+        char text[32];      // formatted cell of the current row
+    };
+
+    vector<MappedColumn> mapped;
+    vector<bool> deferred; // columns nextBatch leaves to materialize
+    uint64_t rows = 0;
+    uint64_t current = UINT64_MAX; // before the first row
+    uint64_t released = 0;         // rows whose pages were handed back
+    uint64_t stop = 0;             // end of the range being scanned
+    vector<uint64_t> rowIds;       // rows an index found, when scanning only those
+    size_t nextRowId = 0;
+    bool byRowIds = false;
+    vector<uint8_t> skipped;       // per block of ZONE_ROWS rows: 1 if no row can qualify
+    uint64_t zonesSkipped = 0;
+
+    // For EXPLAIN ANALYZE: what nextBatch read, and what materialize and gather decoded
+    uint64_t batchRows = 0, batchBytes = 0;
+    mutable uint64_t decodedBytes = 0;
+
+    void releaseConsumed(uint64_t upTo);
+    bool valid = false;
+
+public:
+    TableScan(TableStorage &storage, const vector<size_t> &columns);
+    TableScan(const TableScan &) = delete;
+    TableScan &operator=(const TableScan &) = delete;
+
+    bool isOpen() const { return valid; }
+    uint64_t rowCount() const { return rows; }
+    uint64_t row() const { return current; }
+    size_t columnCount() const { return mapped.size(); }
+    const ColumnInfo &column(size_t i) const { return mapped[i].info; }
+    uint64_t rowsRead() const { return batchRows; }
+    uint64_t bytesRead() const { return batchBytes; }
+    uint64_t materializedBytes() const { return decodedBytes; }
+    bool scansRowIds() const { return byRowIds; }
+    size_t rowIdCount() const { return rowIds.size(); }
+    uint64_t skippedZones() const { return zonesSkipped; }
+    uint64_t zoneCount() const { return (rows + ZONE_ROWS - 1) / ZONE_ROWS; }
+
+    bool next();
+    bool nextBatch(Batch &batch);
+    void deferColumns(const vector<size_t> &columns);
+    void materialize(size_t i, Batch &batch) const;
+    void gather(size_t i, const uint64_t *rowIds, size_t n, ColumnVector &out) const;
+    void rewind() { current = UINT64_MAX; released = 0; stop = rows; nextRowId = 0; }
+    void setRange(uint64_t first, uint64_t end);
+    void setRows(vector<uint64_t> ids);
+    void skipZones(vector<uint8_t> skip);
+    bool seek(uint64_t row);
+
+    bool isNull(size_t i) const;
+    int64_t getInt(size_t i) const;
+    double getFloat(size_t i) const;
+    bool getBool(size_t i) const;
+    int32_t getDate(size_t i) const;
+    string_view getString(size_t i) const;
+    string_view cell(size_t i);
+};
+
+#endif // SCAN_H
@@ -0,0 +1,201 @@
+#include "sink.h"
+#include <algorithm>
+using namespace std;
+
+OutputFormat outputFormat = OUTPUT_TABLE;
+
+// Rows held back to size the columns in table mode, bounded by count and bytes
+static const size_t SINK_SAMPLE_ROWS = 1000;
+static const size_t SINK_SAMPLE_BYTES = 1 << 20;
+
+bool parseOutputFormat(const string &name, OutputFormat &format)
+{
+    string upper = name;
+    transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    if (upper == "TABLE")
+        format = OUTPUT_TABLE;
+    else if (upper == "CSV")
+        format = OUTPUT_CSV;
+    else if (upper == "TSV")
+        format = OUTPUT_TSV;
+    else
+        return false;
+    return true;
+}
+
+ResultSink::ResultSink(const vector<ColumnInfo> &columns, ostream &out, OutputFormat format)
+    : out(out), format(format), columns(columns), widths(columns.size())
+{
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        widths[i] = columns[i].name.size();
+        if (columns[i].type == TYPE_BOOL)
+            widths[i] = max(widths[i], size_t(5)); // FALSE
+        else if (columns[i].type == TYPE_DATE)
+            widths[i] = max(widths[i], size_t(10)); // YYYY-MM-DD
+    }
+    if (format != OUTPUT_TABLE)
+        start();
+}
+
+void ResultSink::writeSeparator()
+{
+    for (size_t width : widths)
+        out << "+" << string(width + 2, '-');
+    out << "+\n";
+}
+
+static void writeCsvField(ostream &out, string_view cell, bool isNull)
+{
+    if (isNull)
+        return;
+    if (!cell.empty() && cell.find_first_of(",\"\r\n") == string_view::npos)
+    {
+        out << cell;
+        return;
+    }
+    out << '"';
+    for (char c : cell)
+    {
+        if (c == '"')
+            out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+static void writeTsvField(ostream &out, string_view cell, bool isNull)
+{
+    if (isNull)
+    {
+        out << "\\N";
+        return;
+    }
+    for (char c : cell)
+    {
+        switch (c)
+        {
+        case '\t':
+            out << "\\t";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\r':
+            out << "\\r";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        default:
+            out << c;
+        }
+    }
+}
+
+// Header, then any held back rows
+void ResultSink::start()
+{
+    started = true;
+    if (format == OUTPUT_TABLE)
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+            out << "| " << columns[i].name << string(widths[i] - columns[i].name.size() + 1, ' ');
+        out << "|\n";
+        writeSeparator();
+    }
+    else
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            if (i > 0)
+                out << (format == OUTPUT_CSV ? ',' : '\t');
+            if (format == OUTPUT_CSV)
+                writeCsvField(out, columns[i].name, false);
+            else
+                writeTsvField(out, columns[i].name, false);
+        }
+        out << "\n";
+    }
+
+    vector<string_view> cells(columns.size());
+    for (const auto &held : sample)
+    {
+        for (size_t i = 0; i < held.cells.size(); i++)
+            cells[i] = held.cells[i];
+        writeRow(cells, held.nulls);
+    }
+    sample.clear();
+    sample.shrink_to_fit();
+}
+
+void ResultSink::writeRow(const vector<string_view> &cells, const vector<bool> &nulls)
+{
+    if (format == OUTPUT_TABLE)
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            padding.assign(widths[i] > cells[i].size() ? widths[i] - cells[i].size() + 1 : 1, ' ');
+            out << "| " << cells[i] << padding;
+        }
+        out << "|\n";
+        return;
+    }
+
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        if (i > 0)
+            out << (format == OUTPUT_CSV ? ',' : '\t');
+        if (format == OUTPUT_CSV)
+            writeCsvField(out, cells[i], nulls[i]);
+        else
+            writeTsvField(out, cells[i], nulls[i]);
+    }
+    out << "\n";
+}
+
+void ResultSink::row(const vector<string_view> &cells, const vector<bool> &nulls)
+{
+    rows++;
+    if (started)
+    {
+        writeRow(cells, nulls);
+        return;
+    }
+
+    HeldRow held{vector<string>(cells.begin(), cells.end()), nulls};
+    for (size_t i = 0; i < held.cells.size(); i++)
+    {
+        widths[i] = max(widths[i], held.cells[i].size());
+        sampleBytes += held.cells[i].size();
+    }
+    sample.push_back(move(held));
+    if (sample.size() >= SINK_SAMPLE_ROWS || sampleBytes >= SINK_SAMPLE_BYTES)
+        start();
+}
+
+void ResultSink::finish(const string &emptyMessage)
+{
+    if (!started)
+        start();
+    if (format != OUTPUT_TABLE)
+    {
+        out.flush();
+        return;
+    }
+
+    if (rows == 0)
+    {
+        // A single centered message spanning all columns
+        size_t totalWidth = 0;
+        for (size_t width : widths)
+            totalWidth += width + 3; // +2 for padding, +1 for separator
+        totalWidth -= 1;             // Remove extra separator at the end
+
+        size_t padding = totalWidth > emptyMessage.size() ? (totalWidth - emptyMessage.size()) / 2 : 0;
+        size_t trailing = totalWidth > emptyMessage.size() + padding ? totalWidth - emptyMessage.size() - padding : 0;
+        out << "|" << string(padding, ' ') << emptyMessage << string(trailing, ' ') << "|\n";
+    }
+    writeSeparator();
+    out.flush();
+}
@@ -0,0 +1,59 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "storage.h"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+enum OutputFormat
+{
+    OUTPUT_TABLE, // boxed, aligned columns
+    OUTPUT_CSV,   // RFC 4180; NULL is an empty field, an empty string is ""
+    OUTPUT_TSV    // tab separated; NULL is \N, tab, newline and backslash are escaped
+};
+
+// Format used for query results, set with SET OUTPUT or DBMS_OUTPUT_FORMAT
+extern OutputFormat outputFormat;
+bool parseOutputFormat(const string &name, OutputFormat &format);
+
+// Writes result rows as they are produced. In table mode column widths are taken from
+// the schema where the type fixes them (BOOL, DATE) and otherwise from a bounded prefix
+// of rows held back before the header is printed; a later cell that is wider than its
+// column is written in full. CSV and TSV rows are written straight through.
+class ResultSink
+{
+private:
+    ostream &out;
+    OutputFormat format;
+    vector<ColumnInfo> columns;
+    vector<size_t> widths;
+    struct HeldRow
+    {
+        vector<string> cells;
+        vector<bool> nulls;
+    };
+
+    vector<HeldRow> sample; // rows held back to size the columns
+    size_t sampleBytes = 0;
+    bool started = false;
+    uint64_t rows = 0;
+    string padding;
+
+    void start();
+    void writeRow(const vector<string_view> &cells, const vector<bool> &nulls);
+    void writeSeparator();
+
+public:
+    ResultSink(const vector<ColumnInfo> &columns, ostream &out = cout, OutputFormat format = outputFormat);
+
+    // cells are formatted values; nulls marks the NULL ones, which table mode prints as given
+    void row(const vector<string_view> &cells, const vector<bool> &nulls);
+    void finish(const string &emptyMessage);
+    uint64_t rowCount() const { return rows; }
+};
+
+#endif // SINK_H
@@ -1,322 +1,329 @@
 #include "sqlparser.h"
 #include "table.h"
-#include <sstream>
+#include "sink.h"
+#include "join.h"
+#include "groupby.h"
+#include "parser.h"
+#include "globals.h"
 #include <iostream>
+#include <list>
+#include <unordered_map>
 #include <vector>
-#include <algorithm>
 
 using namespace std;
 
-// Helper function to convert a string to uppercase
-string toUpperCase(string str)
+// Whether a SELECT reads one table directly, without a join or aggregation
+static bool isPlainSelect(const Statement &select)
 {
-    transform(str.begin(), str.end(), str.begin(), ::toupper);
-    return str;
+    if (select.isJoin || select.hasGroupBy)
+        return false;
+    for (const SelectItem &item : select.items)
+    {
+        if (item.isAggregate)
+            return false;
+    }
+    return true;
 }
 
-// Helper function to convert a string to lowercase (for table/column names)
-string toLowerCase(string str)
+// Runs a SELECT as a join, an aggregation or a plain scan of one table, which is
+// resolved here unless the caller already has it
+static void executeSelect(Database &db, Statement &select, Table *resolved)
 {
-    transform(str.begin(), str.end(), str.begin(), ::tolower);
-    return str;
-}
-
-void SQLParser::executeQuery(Database &db, const string &query)
-{
-    stringstream ss(query);
-    string command;
-    ss >> command;
-    command = toUpperCase(command); // Convert command to uppercase
+    vector<string> columnNames;
+    bool hasAggregate = false;
+    for (const SelectItem &item : select.items)
+    {
+        if (item.isAggregate)
+            hasAggregate = true;
+        else
+            columnNames.push_back(item.column);
+    }
 
-    if (command == "CREATE")
+    if (select.isJoin)
     {
-        string temp, tableName;
-        ss >> temp;
-        temp = toUpperCase(temp);
-        if (temp != "TABLE")
+        if (hasAggregate)
         {
-            cerr << "Syntax error: Expected 'TABLE' after CREATE\n";
+            cerr << "Syntax error: Aggregates over a join are not supported\n";
             return;
         }
-
-        ss >> tableName;
-        tableName = toLowerCase(tableName);
-
-        string columnsDefinition;
-        getline(ss, columnsDefinition, ')');
-        columnsDefinition.erase(0, columnsDefinition.find('(') + 1);
-
-        stringstream colStream(columnsDefinition);
-        vector<string> columnNames, columnTypes;
-        string column, type;
-
-        while (getline(colStream, column, ','))
-        {
-            stringstream columnStream(column);
-            columnStream >> column >> type;
-            column = toLowerCase(column);
-            type = toUpperCase(type);
-
-            if (column.empty() || type.empty())
-            {
-                cerr << "Invalid column definition: " << column << " " << type << "\n";
-                return;
-            }
-            columnNames.push_back(column);
-            columnTypes.push_back(type);
-        }
-
-        create(db, tableName, columnNames, columnTypes);
-    }
-    else if (command == "INSERT")
-    {
-        string temp, tableName;
-        ss >> temp;
-        temp = toUpperCase(temp);
-
-        if (temp != "INTO")
+        if (select.hasGroupBy || select.having)
         {
-            cerr << "Syntax error: Expected 'INTO' after INSERT\n";
+            cerr << "Syntax error: GROUP BY over a join is not supported\n";
             return;
         }
+        JoinQuery join;
+        join.columnNames = columnNames;
+        join.leftTable = select.table;
+        join.rightTable = select.joinTable;
+        join.type = select.joinType;
+        join.on = select.on.get();
+        join.where = select.where.get();
+        join.orderBy = select.orderBy;
+        join.limit = select.limit;
+        join.offset = select.offset;
+        join.explain = select.explain;
+        displayJoin(db, join);
+        return;
+    }
 
-        ss >> tableName;
-        tableName = toLowerCase(tableName);
-
-        string rowDataStr;
-        getline(ss, rowDataStr);
-
-        size_t openParen = rowDataStr.find('(');
-        size_t closeParen = rowDataStr.find(')');
-
-        if (openParen == string::npos || closeParen == string::npos)
+    if (hasAggregate || select.hasGroupBy)
+    {
+        if (select.items.empty())
         {
-            cerr << "Syntax error: Missing parentheses in INSERT statement\n";
+            cerr << "Syntax error: SELECT * cannot be combined with GROUP BY\n";
             return;
         }
+        AggregateQuery query;
+        query.table = select.table;
+        query.items = select.items;
+        query.groupBy = select.groupBy;
+        query.where = select.where.get();
+        query.having = select.having.get();
+        query.orderBy = select.orderBy;
+        query.limit = select.limit;
+        query.offset = select.offset;
+        query.explain = select.explain;
+        displayAggregate(db, query);
+        return;
+    }
+    if (select.having)
+    {
+        cerr << "Syntax error: HAVING needs GROUP BY or an aggregate\n";
+        return;
+    }
 
-        vector<string> columnNames;
-        vector<string> rowData;
-
-        bool hasColumns = (rowDataStr.find("VALUES") != string::npos);
-        size_t valuesPos = rowDataStr.find("VALUES");
-
-        if (hasColumns)
-        {
-            string colNamesStr = rowDataStr.substr(0, valuesPos);
-            colNamesStr = colNamesStr.substr(colNamesStr.find('(') + 1, colNamesStr.find(')') - colNamesStr.find('(') - 1);
-
-            stringstream colStream(colNamesStr);
-            string colName;
-            while (getline(colStream, colName, ','))
-            {
-                colName.erase(0, colName.find_first_not_of(" \t"));
-                colName.erase(colName.find_last_not_of(" \t") + 1);
-                columnNames.push_back(colName);
-            }
+    if (resolved)
+    {
+        resolved->displayTable(columnNames, select.where.get(), select.orderBy, select.limit, select.offset,
+                               select.explain);
+        return;
+    }
 
-            rowDataStr = rowDataStr.substr(valuesPos + 6);
-            openParen = rowDataStr.find('(');
-            closeParen = rowDataStr.find(')');
-            rowDataStr = rowDataStr.substr(openParen + 1, closeParen - openParen - 1);
-        }
-        else
-        {
-            rowDataStr = rowDataStr.substr(openParen + 1, closeParen - openParen - 1);
-        }
+    Table table = selectTable(db, select.table);
 
-        stringstream rowStream(rowDataStr);
-        string value;
-        while (getline(rowStream, value, ','))
-        {
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
-            if (!value.empty() && value.front() == '\'' && value.back() == '\'')
-            {
-                value = value.substr(1, value.size() - 2);
-            }
-            rowData.push_back(value);
-        }
+    if (table.getName().empty())
+    {
+        cerr << "Table '" << select.table << "' does not exist!\n";
+        return;
+    }
 
-        Table table = selectTable(db, tableName);
+    table.displayTable(columnNames, select.where.get(), select.orderBy, select.limit, select.offset,
+                       select.explain);
+}
 
-        if (hasColumns)
-        {
-            table.insertWithColumns(columnNames, rowData);
-        }
-        else
-        {
-            table.insert(rowData);
-        }
+static void insert(Table &table, const Statement &statement)
+{
+    if (!statement.columnNames.empty())
+    {
+        table.insertRowsWithColumns(statement.columnNames, statement.rows);
     }
-    else if (command == "SELECT")
+    else
     {
-        vector<string> columnNames;
-        string temp, tableName;
+        table.insertRows(statement.rows);
+    }
+}
 
-        // Parse column names or '*' until 'FROM'
-        ss >> temp;
-        temp = toUpperCase(temp);
-        if (temp == "FROM")
+// Runs a parsed statement other than PREPARE, EXECUTE and DEALLOCATE
+static void run(Database &db, Statement &statement, Table *table)
+{
+    switch (statement.kind)
+    {
+    case STMT_CREATE_TABLE:
+    {
+        vector<string> columnNames, columnTypes;
+        string primaryKey;
+        for (const ColumnDef &column : statement.columns)
         {
-            cerr << "Syntax error: Missing column names after SELECT\n";
-            return;
+            columnNames.push_back(column.name);
+            columnTypes.push_back(column.type);
+            if (column.primaryKey)
+                primaryKey = column.name;
         }
-
-        if (temp == "*")
+        create(db, statement.table, columnNames, columnTypes, primaryKey);
+        break;
+    }
+    case STMT_INSERT:
+    {
+        if (table)
         {
-            columnNames.clear(); // Empty vector means all columns
-            ss >> temp; // Expect 'FROM' next
-            temp = toUpperCase(temp);
+            insert(*table, statement);
         }
         else
         {
-            columnNames.push_back(toLowerCase(temp)); // First column name
-            while (ss >> temp)
-            {
-                temp = toUpperCase(temp);
-                if (temp == "FROM")
-                {
-                    break; // Stop collecting column names
-                }
-                if (temp.back() == ',') // Handle trailing comma
-                {
-                    temp.pop_back();
-                }
-                columnNames.push_back(toLowerCase(temp));
-            }
-        }
-
-        // Check if 'FROM' was found
-        if (temp != "FROM")
-        {
-            cerr << "Syntax error: Expected 'FROM' after column names\n";
-            return;
-        }
-
-        // Get table name
-        ss >> tableName;
-        tableName = toLowerCase(tableName);
-
-        if (!tableName.empty() && tableName.back() == ';')
-        {
-            tableName.pop_back();
+            Table resolved = selectTable(db, statement.table);
+            insert(resolved, statement);
         }
+        break;
+    }
+    case STMT_SELECT:
+        executeSelect(db, statement, table);
+        break;
+    case STMT_RENAME:
+        rename(db, statement.table, statement.newName);
+        break;
+    case STMT_DROP:
+        drop(db, statement.table);
+        break;
+    case STMT_TRUNCATE:
+        truncate(db, statement.table);
+        break;
+    case STMT_COPY:
+        copyFrom(db, statement.table, statement.path, statement.header);
+        break;
+    case STMT_SET_OUTPUT:
+        outputFormat = statement.format;
+        break;
+    case STMT_CREATE_INDEX:
+        createIndex(db, statement.name, statement.table, statement.column, statement.bloom,
+                    statement.falsePositiveRate);
+        break;
+    case STMT_DROP_INDEX:
+        dropIndex(db, statement.name);
+        break;
+    case STMT_PREPARE:
+    case STMT_EXECUTE:
+    case STMT_DEALLOCATE:
+        break;
+    }
+}
 
-        if (tableName.empty())
-        {
-            cerr << "Syntax error: Missing table name after 'FROM'\n";
-            return;
-        }
-
-        // Removed debug output: "Searching for table: [tableName]"
-        Table table = selectTable(db, tableName);
-
-        if (table.getName().empty())
-        {
-            cerr << "Table '" << tableName << "' does not exist!\n";
-            return;
-        }
+void PreparedStatement::execute(Database &db, const vector<ParamValue> &params)
+{
+    string error;
+    if (!bindParameters(*statement, params, error))
+    {
+        cerr << RED << "Error: " << error << "." << RESET << endl;
+        return;
+    }
 
-        table.displayTable(columnNames); // Pass column names to displayTable
+    // Re-resolve the table once the catalog has changed since it was looked up
+    bool single = statement->kind == STMT_INSERT || (statement->kind == STMT_SELECT && isPlainSelect(*statement));
+    if (!single)
+    {
+        run(db, *statement, nullptr);
+        return;
     }
-    else if (command == "RENAME")
+    if (schema.empty() || dbName != db.getName() || catalogVersion != db.catalogVersion())
     {
-        string temp, oldTableName, newTableName;
-        ss >> temp;
-        temp = toUpperCase(temp);
-
-        if (temp != "TABLE")
+        schema.clear();
+        Table resolved = selectTable(db, statement->table);
+        if (resolved.getName().empty())
         {
-            cerr << "Syntax error: Expected 'TABLE' after RENAME\n";
+            if (statement->kind == STMT_SELECT)
+                cerr << "Table '" << statement->table << "' does not exist!\n";
             return;
         }
+        schema = *db.tableSchema(statement->table);
+        dbName = db.getName();
+        catalogVersion = db.catalogVersion();
+    }
+    Table table(db, statement->table, schema);
+    run(db, *statement, &table);
+}
 
-        ss >> oldTableName;
-        oldTableName = toLowerCase(oldTableName);
-
-        ss >> temp;
-        temp = toUpperCase(temp);
-        if (temp != "TO")
-        {
-            cerr << "Syntax error: Expected 'TO' after table name in RENAME\n";
-            return;
-        }
+// Least recently used plans of ad-hoc statements, by normalized query text
+class PlanCache
+{
+private:
+    using Entry = pair<string, shared_ptr<PreparedStatement>>;
+    list<Entry> plans; // most recently used first
+    unordered_map<string, list<Entry>::iterator> index;
 
-        ss >> newTableName;
-        newTableName = toLowerCase(newTableName);
+public:
+    shared_ptr<PreparedStatement> find(const string &text)
+    {
+        auto it = index.find(text);
+        if (it == index.end())
+            return nullptr;
+        plans.splice(plans.begin(), plans, it->second);
+        return it->second->second;
+    }
 
-        if (!newTableName.empty() && newTableName.back() == ';')
+    void add(const string &text, shared_ptr<PreparedStatement> plan)
+    {
+        if (planCacheEntries == 0)
+            return;
+        plans.emplace_front(text, move(plan));
+        index[text] = plans.begin();
+        while (plans.size() > planCacheEntries)
         {
-            newTableName.pop_back();
+            index.erase(plans.back().first);
+            plans.pop_back();
         }
+    }
+};
 
-        if (oldTableName.empty() || newTableName.empty())
-        {
-            cerr << "Syntax error: Missing table names in RENAME statement\n";
-            return;
-        }
+static PlanCache planCache;
+static unordered_map<string, shared_ptr<PreparedStatement>> preparedStatements; // by PREPARE name
 
-        rename(db, oldTableName, newTableName);
-    }
-    else if (command == "DROP")
+shared_ptr<PreparedStatement> SQLParser::prepare(const string &query)
+{
+    string error;
+    unique_ptr<Statement> statement = parseStatement(query, error, true);
+    if (!statement)
     {
-        string temp, tableName;
-        ss >> temp;
-        temp = toUpperCase(temp);
-
-        if (temp != "TABLE")
-        {
-            cerr << "Syntax error: Expected 'TABLE' after DROP\n";
-            return;
-        }
+        cerr << error << "\n";
+        return nullptr;
+    }
+    return make_shared<PreparedStatement>(move(statement));
+}
 
-        ss >> tableName;
-        tableName = toLowerCase(tableName);
+void SQLParser::executeQuery(Database &db, const string &query)
+{
+    string text = normalizeQuery(query);
+    if (shared_ptr<PreparedStatement> plan = planCache.find(text))
+    {
+        plan->execute(db);
+        return;
+    }
 
-        if (!tableName.empty() && tableName.back() == ';')
-        {
-            tableName.pop_back();
-        }
+    string error;
+    unique_ptr<Statement> statement = parseStatement(text, error);
+    if (!statement)
+    {
+        cerr << error << "\n";
+        return;
+    }
 
-        if (tableName.empty())
+    switch (statement->kind)
+    {
+    case STMT_INSERT:
+    case STMT_SELECT:
+    {
+        auto plan = make_shared<PreparedStatement>(move(statement));
+        planCache.add(text, plan);
+        plan->execute(db);
+        break;
+    }
+    case STMT_PREPARE:
+        if (preparedStatements.count(statement->name))
         {
-            cerr << "Syntax error: Missing table name after 'TABLE' in DROP\n";
+            cerr << RED << "Prepared statement '" << statement->name << "' already exists!" << RESET << endl;
             return;
         }
-
-        drop(db, tableName);
-    }
-    else if (command == "TRUNCATE")
+        preparedStatements[statement->name] = make_shared<PreparedStatement>(move(statement->body));
+        cout << GREEN << "Statement " << statement->name << " prepared successfully." << RESET << endl;
+        break;
+    case STMT_EXECUTE:
     {
-        string temp, tableName;
-        ss >> temp;
-        temp = toUpperCase(temp);
-
-        if (temp != "TABLE")
+        auto it = preparedStatements.find(statement->name);
+        if (it == preparedStatements.end())
         {
-            cerr << "Syntax error: Expected 'TABLE' after TRUNCATE\n";
+            cerr << RED << "Prepared statement '" << statement->name << "' does not exist!" << RESET << endl;
             return;
         }
-
-        ss >> tableName;
-        tableName = toLowerCase(tableName);
-
-        if (!tableName.empty() && tableName.back() == ';')
-        {
-            tableName.pop_back();
-        }
-
-        if (tableName.empty())
+        it->second->execute(db, statement->arguments);
+        break;
+    }
+    case STMT_DEALLOCATE:
+        if (!preparedStatements.erase(statement->name))
         {
-            cerr << "Syntax error: Missing table name after 'TABLE' in TRUNCATE\n";
+            cerr << RED << "Prepared statement '" << statement->name << "' does not exist!" << RESET << endl;
             return;
         }
-
-        truncate(db, tableName);
+        cout << GREEN << "Statement " << statement->name << " deallocated successfully." << RESET << endl;
+        break;
+    default:
+        run(db, *statement, nullptr);
     }
-    else
-    {
-        cerr << "Invalid SQL Query!\n";
-    }
-}
\ No newline at end of file
+}
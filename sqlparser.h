@@ -3,10 +3,34 @@
 #define SQLPARSER_H
 
 #include "database.h"
+#include "parser.h"
+#include "storage.h"
+#include "table.h"
+#include <memory>
+
+// A statement parsed once and executed many times, binding new values to its $1, $2, ...
+// placeholders on each run. The plan also keeps the schema of the table an INSERT or a
+// plain SELECT resolved to, until the catalog version shows the tables have changed; the
+// Table itself is made for the Database of each run.
+class PreparedStatement
+{
+private:
+    unique_ptr<Statement> statement;
+    vector<ColumnInfo> schema; // empty until resolved
+    string dbName;
+    uint64_t catalogVersion = 0;
+
+public:
+    explicit PreparedStatement(unique_ptr<Statement> statement) : statement(move(statement)) {}
+    size_t parameterCount() const { return statement->paramCount; }
+    void execute(Database &db, const vector<ParamValue> &params = {});
+};
 
 class SQLParser {
 public:
     static void executeQuery(Database& db, const std::string& query);
+    // Parses a statement that may use $1, $2, ...; prints the error and returns null if it is invalid
+    static shared_ptr<PreparedStatement> prepare(const std::string& query);
 };
 
 #endif // SQLPARSER_H
@@ -0,0 +1,2083 @@
+#include "storage.h"
+#include "btree.h"
+#include "hashindex.h"
+#include "bloom.h"
+#include "bufferpool.h"
+#include "scan.h"
+#include "wal.h"
+#include "catalog.h"
+#include "globals.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// Days since 1970-01-01 for a proleptic Gregorian date (Howard Hinnant's algorithm)
+static int32_t daysFromCivil(int y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int>(doe) - 719468;
+}
+
+static void civilFromDays(int32_t z, int &y, unsigned &m, unsigned &d)
+{
+    z += 719468;
+    const int era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int>(yoe) + era * 400 + (m <= 2);
+}
+
+bool parseDate(const string &text, int32_t &days)
+{
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-')
+        return false;
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9})
+    {
+        if (!isdigit(static_cast<unsigned char>(text[i])))
+            return false;
+    }
+    int y = stoi(text.substr(0, 4));
+    unsigned m = stoi(text.substr(5, 2));
+    unsigned d = stoi(text.substr(8, 2));
+    static const unsigned monthDays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (m < 1 || m > 12 || d < 1 || d > monthDays[m - 1])
+        return false;
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (m == 2 && d == 29 && !leap)
+        return false;
+    days = daysFromCivil(y, m, d);
+    return true;
+}
+
+char *formatDateTo(int32_t days, char *out)
+{
+    int y;
+    unsigned m, d;
+    civilFromDays(days, y, m, d);
+    if (y < 0 || y > 9999)
+        return out + snprintf(out, 16, "%04d-%02u-%02u", y, m, d);
+    for (int i = 3; i >= 0; i--, y /= 10)
+        out[i] = '0' + y % 10;
+    out[4] = '-';
+    out[5] = '0' + m / 10;
+    out[6] = '0' + m % 10;
+    out[7] = '-';
+    out[8] = '0' + d / 10;
+    out[9] = '0' + d % 10;
+    return out + 10;
+}
+
+string formatDate(int32_t days)
+{
+    char buf[16];
+    return string(buf, formatDateTo(days, buf));
+}
+
+string formatDouble(double value)
+{
+    char buf[32];
+    auto res = to_chars(buf, buf + sizeof(buf), value);
+    return string(buf, res.ptr);
+}
+
+double floatNull()
+{
+    double value;
+    memcpy(&value, &FLOAT_NULL_BITS, sizeof(value));
+    return value;
+}
+
+bool isFloatNull(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits == FLOAT_NULL_BITS;
+}
+
+bool hasZoneMap(int type)
+{
+    return type == TYPE_INT || type == TYPE_FLOAT || type == TYPE_DATE;
+}
+
+// The bits of a double, with negative values flipped so that keys order like values
+int64_t floatZoneKey(double value)
+{
+    if (value == 0)
+        value = 0; // -0.0 equals 0.0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return static_cast<int64_t>(bits >> 63 ? ~bits ^ (1ULL << 63) : bits);
+}
+
+static bool writeAll(int fd, const void *data, size_t size, uint64_t offset)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t size, uint64_t offset)
+{
+    char *p = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static size_t fixedWidth(int type)
+{
+    switch (type)
+    {
+    case TYPE_INT: return sizeof(int64_t);
+    case TYPE_FLOAT: return sizeof(double);
+    case TYPE_STRING: return sizeof(uint64_t); // offsets
+    case TYPE_DATE: return sizeof(int32_t);
+    default: return 0; // BOOL is bit packed
+    }
+}
+
+size_t storedWidth(int type, const ColumnEncoding &encoding)
+{
+    return encoding.kind == ENCODING_PLAIN ? fixedWidth(type) : encoding.width;
+}
+
+static bool validEncoding(int type, const ColumnEncoding &encoding)
+{
+    switch (encoding.kind)
+    {
+    case ENCODING_PLAIN:
+        return true;
+    case ENCODING_FRAME:
+        return (type == TYPE_INT || type == TYPE_DATE) && (encoding.width == 1 || encoding.width == 2 || encoding.width == 4) &&
+               encoding.width < fixedWidth(type);
+    case ENCODING_DICTIONARY:
+        return type == TYPE_STRING && (encoding.width == 1 || encoding.width == 2) &&
+               encoding.entries <= nullCode(encoding.width);
+    }
+    return false;
+}
+
+// The narrowest frame of reference holding the values low..high with as much room
+// again around them for later rows, or plain storage if none is narrower than the type
+static ColumnEncoding frameOfReference(int type, int64_t low, int64_t high)
+{
+    ColumnEncoding encoding;
+    uint64_t span = static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+    for (uint8_t width : {1, 2, 4})
+    {
+        uint64_t codes = nullCode(width);
+        if (width >= fixedWidth(type))
+            break;
+        if (span >= codes / 2)
+            continue;
+        uint64_t below = min((codes - 1 - span) / 2, static_cast<uint64_t>(low) - static_cast<uint64_t>(INT64_MIN) - 1);
+        encoding.kind = ENCODING_FRAME;
+        encoding.width = width;
+        encoding.base = static_cast<int64_t>(static_cast<uint64_t>(low) - below);
+        break;
+    }
+    return encoding;
+}
+
+bool StringDictionary::find(string_view value, uint32_t &code) const
+{
+    auto it = codes.find(value);
+    if (it == codes.end())
+        return false;
+    code = it->second;
+    return true;
+}
+
+uint32_t StringDictionary::add(string_view value)
+{
+    uint32_t code = static_cast<uint32_t>(views.size());
+    views.push_back(values.emplace_back(value));
+    codes.emplace(views.back(), code);
+    return code;
+}
+
+// Drops the values added after the first entries
+void StringDictionary::truncate(size_t entries)
+{
+    while (views.size() > entries)
+    {
+        codes.erase(views.back());
+        views.pop_back();
+        values.pop_back();
+    }
+}
+
+static string columnPath(const string &dir, const ColumnInfo &col, const string &ext)
+{
+    return dir + "/" + col.name + ext;
+}
+
+// A column file of the given generation; generation 0 has the plain names
+static string generationPath(const string &dir, const ColumnInfo &col, uint32_t generation, const string &ext)
+{
+    return generation == 0 ? columnPath(dir, col, ext) : columnPath(dir, col, "." + to_string(generation) + ext);
+}
+
+static int openFile(const string &path, bool create)
+{
+    return open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+}
+
+// table.meta: header, row count and LSN, then the column count (and 4 unused bytes),
+// then per column its encoding kind, width, 2 unused bytes, generation, base and entries
+const size_t META_COLUMNS = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+const size_t META_ENCODING_BYTES = 24;
+
+static bool writeMetaFile(int fd, uint64_t rows, uint64_t lsn, const vector<ColumnEncoding> &encodings)
+{
+    uint32_t header[2] = {TABLE_META_MAGIC, TABLE_META_VERSION};
+    uint32_t columns[2] = {static_cast<uint32_t>(encodings.size()), 0};
+    string buf(META_COLUMNS + sizeof(columns) + encodings.size() * META_ENCODING_BYTES, '\0');
+    memcpy(buf.data(), header, sizeof(header));
+    memcpy(buf.data() + sizeof(header), &rows, sizeof(rows));
+    memcpy(buf.data() + sizeof(header) + sizeof(rows), &lsn, sizeof(lsn));
+    memcpy(buf.data() + META_COLUMNS, columns, sizeof(columns));
+    for (size_t c = 0; c < encodings.size(); c++)
+    {
+        char *p = buf.data() + META_COLUMNS + sizeof(columns) + c * META_ENCODING_BYTES;
+        p[0] = static_cast<char>(encodings[c].kind);
+        p[1] = static_cast<char>(encodings[c].width);
+        memcpy(p + 4, &encodings[c].generation, sizeof(uint32_t));
+        memcpy(p + 8, &encodings[c].base, sizeof(int64_t));
+        memcpy(p + 16, &encodings[c].entries, sizeof(uint64_t));
+    }
+    return writeAll(fd, buf.data(), buf.size(), 0) && fdatasync(fd) == 0;
+}
+
+static bool readEncodings(int fd, vector<ColumnEncoding> &encodings)
+{
+    uint32_t columns[2];
+    if (!readAll(fd, columns, sizeof(columns), META_COLUMNS) || columns[0] != encodings.size())
+        return false;
+    string buf(encodings.size() * META_ENCODING_BYTES, '\0');
+    if (!readAll(fd, buf.data(), buf.size(), META_COLUMNS + sizeof(columns)))
+        return false;
+    for (size_t c = 0; c < encodings.size(); c++)
+    {
+        const char *p = buf.data() + c * META_ENCODING_BYTES;
+        encodings[c].kind = static_cast<uint8_t>(p[0]);
+        encodings[c].width = static_cast<uint8_t>(p[1]);
+        memcpy(&encodings[c].generation, p + 4, sizeof(uint32_t));
+        memcpy(&encodings[c].base, p + 8, sizeof(int64_t));
+        memcpy(&encodings[c].entries, p + 16, sizeof(uint64_t));
+    }
+    return true;
+}
+
+TableStorage::TableStorage(const string &dir, const vector<ColumnInfo> &schema) : dir(dir)
+{
+    metaFd = openFile(dir + "/table.meta", false);
+    if (metaFd < 0)
+    {
+        cerr << RED << "Failed to open " << dir << "/table.meta" << RESET << endl;
+        return;
+    }
+
+    uint32_t header[2];
+    uint64_t count = 0, lsn = 0;
+    vector<ColumnEncoding> encodings(schema.size());
+    if (!readAll(metaFd, header, sizeof(header), 0) || header[0] != TABLE_META_MAGIC ||
+        header[1] != TABLE_META_VERSION || !readAll(metaFd, &count, sizeof(count), sizeof(header)) ||
+        !readAll(metaFd, &lsn, sizeof(lsn), sizeof(header) + sizeof(count)) || !readEncodings(metaFd, encodings) ||
+        any_of(schema.begin(), schema.end(),
+               [&](const ColumnInfo &col) { return !validEncoding(col.type, encodings[&col - schema.data()]); }))
+    {
+        cerr << RED << "Corrupt or unsupported table.meta in " << dir << RESET << endl;
+        close(metaFd);
+        metaFd = -1;
+        return;
+    }
+    rows = savedRows = count;
+    appliedLsn = savedLsn = lsn;
+
+    for (size_t c = 0; c < schema.size(); c++)
+    {
+        const ColumnInfo &col = schema[c];
+        ColumnFile file;
+        file.info = col;
+        file.encoding = encodings[c];
+        bool ok = openColumn(file);
+        if (ok && file.encoding.kind == ENCODING_DICTIONARY)
+        {
+            ok = loadDictionary(file);
+        }
+        else if (ok && col.type == TYPE_STRING)
+        {
+            uint64_t end = 0;
+            if (rows > 0 && bufferPool().read(file.fd, &end, sizeof(end), (rows - 1) * sizeof(end)))
+                file.strEnd = end & ~STRING_NULL_FLAG;
+        }
+        if (hasZoneMap(col.type))
+            file.zoneFd = openFile(columnPath(dir, col, ".zone"), true);
+
+        if (!ok || (hasZoneMap(col.type) && file.zoneFd < 0))
+        {
+            cerr << RED << "Failed to open column file for " << col.name << " in " << dir << RESET << endl;
+            files.push_back(move(file));
+            close(metaFd);
+            metaFd = -1;
+            return;
+        }
+        files.push_back(move(file));
+    }
+    removeOtherGenerations();
+}
+
+// Opens the files of a column's encoding and generation, creating missing ones
+bool TableStorage::openColumn(ColumnFile &file)
+{
+    auto path = [&](const char *ext) { return generationPath(dir, file.info, file.encoding.generation, ext); };
+    bool isString = file.info.type == TYPE_STRING, plain = file.encoding.kind == ENCODING_PLAIN;
+    file.fd = openFile(path(isString && plain ? ".off" : ".col"), true);
+    if (isString)
+        file.strFd = openFile(path(plain ? ".str" : ".dict"), true);
+    return file.fd >= 0 && (!isString || file.strFd >= 0);
+}
+
+// Reads the dictionary values table.meta counts; any after them are from rows that
+// were never committed, and are overwritten
+bool TableStorage::loadDictionary(ColumnFile &file)
+{
+    file.dictionary = make_unique<StringDictionary>();
+    off_t size = lseek(file.strFd, 0, SEEK_END);
+    string bytes(size > 0 ? size : 0, '\0');
+    if (size < 0 || !readAll(file.strFd, bytes.data(), bytes.size(), 0))
+        return false;
+    size_t pos = 0;
+    for (uint64_t i = 0; i < file.encoding.entries; i++)
+    {
+        uint32_t length;
+        if (bytes.size() - pos < sizeof(length))
+            return false;
+        memcpy(&length, bytes.data() + pos, sizeof(length));
+        pos += sizeof(length);
+        if (bytes.size() - pos < length)
+            return false;
+        file.dictionary->add(string_view(bytes).substr(pos, length));
+        pos += length;
+    }
+    file.strEnd = pos;
+    return true;
+}
+
+// Deletes the column files of generations other than the current ones: old ones that
+// table.meta has switched away from, and new ones a crash left before it did
+void TableStorage::removeOtherGenerations()
+{
+    vector<filesystem::path> stale;
+    error_code ec;
+    for (const auto &entry : filesystem::directory_iterator(dir, ec))
+    {
+        string ext = entry.path().extension().string(), stem = entry.path().stem().string();
+        if (ext != ".col" && ext != ".off" && ext != ".str" && ext != ".dict")
+            continue;
+        uint32_t generation = 0;
+        size_t dot = stem.rfind('.');
+        if (dot != string::npos &&
+            from_chars(stem.data() + dot + 1, stem.data() + stem.size(), generation).ptr == stem.data() + stem.size())
+            stem.resize(dot);
+        else
+            generation = 0;
+        for (const auto &file : files)
+        {
+            if (file.info.name == stem && file.encoding.generation != generation)
+                stale.push_back(entry.path());
+        }
+    }
+    for (const auto &path : stale)
+        filesystem::remove(path, ec);
+}
+
+TableStorage::~TableStorage()
+{
+    flushColumns();
+    for (auto &file : files)
+    {
+        for (int fd : {file.fd, file.strFd})
+        {
+            if (fd >= 0)
+            {
+                bufferPool().dropFile(fd);
+                close(fd);
+            }
+        }
+        if (file.zoneFd >= 0)
+            close(file.zoneFd);
+    }
+    if (metaFd >= 0)
+        close(metaFd);
+}
+
+// Commits the row count, and the dictionary values stored so far, which the caller has
+// made durable
+bool TableStorage::writeMeta()
+{
+    for (auto &file : files)
+        file.encoding.entries = file.dictionary ? file.dictionary->size() : 0;
+    savedRows = rows;
+    savedLsn = appliedLsn;
+    return writeEncodings();
+}
+
+// Rewrites table.meta with the current encodings and the committed rows as they were
+bool TableStorage::writeEncodings()
+{
+    vector<ColumnEncoding> encodings;
+    for (const auto &file : files)
+        encodings.push_back(file.encoding);
+    return writeMetaFile(metaFd, savedRows, savedLsn, encodings);
+}
+
+bool TableStorage::flushColumns()
+{
+    bool ok = true;
+    for (auto &file : files)
+    {
+        for (int fd : {file.fd, file.strFd})
+        {
+            if (fd >= 0)
+                ok = bufferPool().flushFile(fd) && ok;
+        }
+    }
+    return ok;
+}
+
+// Appends the stored form of one value. BOOL yields one code byte, packed when written;
+// STRING yields its end offset relative to the start of the batch's string bytes.
+static void encodeValue(const Value &value, bool isNull, string &out, string &strOut)
+{
+    switch (value.type)
+    {
+    case TYPE_INT:
+    {
+        int64_t v = isNull ? INT_NULL : value.i;
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+        break;
+    }
+    case TYPE_FLOAT:
+    {
+        double v = isNull ? floatNull() : value.f;
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+        break;
+    }
+    case TYPE_BOOL:
+        out.push_back(isNull ? BOOL_NULL : value.b ? BOOL_TRUE : BOOL_FALSE);
+        break;
+    case TYPE_STRING:
+    {
+        if (!isNull)
+            strOut += value.s;
+        uint64_t end = strOut.size() | (isNull ? STRING_NULL_FLAG : 0);
+        out.append(reinterpret_cast<const char *>(&end), sizeof(end));
+        break;
+    }
+    case TYPE_DATE:
+    {
+        int32_t v = isNull ? DATE_NULL : value.d;
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+        break;
+    }
+    }
+}
+
+// Encodes typed rows into a column-major batch. Values were checked when they were
+// parsed, so only a row whose shape or types differ from the schema is refused.
+// Safe to call from several threads at once.
+bool TableStorage::encodeRows(const vector<Row> &rowData, EncodedBatch &batch) const
+{
+    batch.rows = 0;
+    batch.data.assign(files.size(), string());
+    batch.strings.assign(files.size(), string());
+
+    for (const Row &row : rowData)
+    {
+        bool matches = row.size() == files.size();
+        for (size_t c = 0; matches && c < files.size(); c++)
+            matches = row.values[c].type == files[c].info.type;
+        if (!matches)
+        {
+            cerr << RED << "Error: Row does not match the schema of " << dir << "." << RESET << endl;
+            return false;
+        }
+    }
+
+    for (size_t c = 0; c < files.size(); c++)
+    {
+        string &data = batch.data[c];
+        data.reserve(rowData.size() * (files[c].info.type == TYPE_BOOL ? 1 : fixedWidth(files[c].info.type)));
+        for (const Row &row : rowData)
+            encodeValue(row.values[c], row.isNull(c), data, batch.strings[c]);
+    }
+    batch.rows = rowData.size();
+    return true;
+}
+
+// Writes one column of an encoded batch from row firstRow on, in the column's encoding
+bool TableStorage::writeColumn(ColumnFile &file, const string &encoded, const string &strings, uint64_t firstRow,
+                               bool direct)
+{
+    auto put = [&](int fd, const string &bytes, uint64_t offset)
+    {
+        return direct ? writeAll(fd, bytes.data(), bytes.size(), offset)
+                      : bufferPool().write(fd, bytes.data(), bytes.size(), offset);
+    };
+    const ColumnEncoding &encoding = file.encoding;
+    size_t width = encoding.width;
+
+    if (file.info.type == TYPE_BOOL)
+    {
+        // Pack 2-bit codes, merging with the partially filled last byte
+        uint64_t firstByte = firstRow / 4;
+        uint8_t current = 0;
+        if (firstRow % 4 != 0)
+        {
+            if (direct)
+                readAll(file.fd, &current, 1, firstByte);
+            else
+                bufferPool().read(file.fd, &current, 1, firstByte);
+        }
+        string packed;
+        packed.reserve(encoded.size() / 4 + 1);
+        uint64_t row = firstRow;
+        for (char code : encoded)
+        {
+            unsigned shift = (row % 4) * 2;
+            current = (current & ~(3u << shift)) | (static_cast<uint8_t>(code) << shift);
+            if (++row % 4 == 0)
+            {
+                packed.push_back(current);
+                current = 0;
+            }
+        }
+        if (row % 4 != 0)
+            packed.push_back(current);
+        return put(file.fd, packed, firstByte);
+    }
+    if (encoding.kind == ENCODING_DICTIONARY)
+    {
+        // Look up each value's code, adding new values to the dictionary and its file
+        size_t before = file.dictionary->size();
+        string codes(encoded.size() / sizeof(uint64_t) * width, '\0'), added;
+        uint64_t start = 0;
+        for (size_t r = 0; r * sizeof(uint64_t) < encoded.size(); r++)
+        {
+            uint64_t end;
+            memcpy(&end, encoded.data() + r * sizeof(end), sizeof(end));
+            uint32_t code = static_cast<uint32_t>(nullCode(width));
+            if (!(end & STRING_NULL_FLAG))
+            {
+                string_view value = string_view(strings).substr(start, end - start);
+                if (!file.dictionary->find(value, code))
+                {
+                    code = file.dictionary->add(value);
+                    uint32_t length = static_cast<uint32_t>(value.size());
+                    added.append(reinterpret_cast<const char *>(&length), sizeof(length));
+                    added.append(value);
+                }
+            }
+            memcpy(codes.data() + r * width, &code, width);
+            start = end & ~STRING_NULL_FLAG;
+        }
+        if (!put(file.strFd, added, file.strEnd) || !put(file.fd, codes, firstRow * width))
+        {
+            file.dictionary->truncate(before);
+            return false;
+        }
+        file.strEnd += added.size();
+        return true;
+    }
+    if (file.info.type == TYPE_STRING)
+    {
+        // Rebase the batch-relative end offsets onto the string file
+        string offsets(encoded);
+        for (size_t i = 0; i < offsets.size(); i += sizeof(uint64_t))
+        {
+            uint64_t end;
+            memcpy(&end, offsets.data() + i, sizeof(end));
+            end = ((end & ~STRING_NULL_FLAG) + file.strEnd) | (end & STRING_NULL_FLAG);
+            memcpy(offsets.data() + i, &end, sizeof(end));
+        }
+        if (!put(file.fd, offsets, firstRow * sizeof(uint64_t)) || !put(file.strFd, strings, file.strEnd))
+            return false;
+        file.strEnd += strings.size();
+        return true;
+    }
+    if (encoding.kind == ENCODING_FRAME)
+    {
+        // Each value less the base; fitEncodings() has made sure they all fit
+        bool isInt = file.info.type == TYPE_INT;
+        size_t size = fixedWidth(file.info.type), n = encoded.size() / size;
+        string codes(n * width, '\0');
+        for (size_t r = 0; r < n; r++)
+        {
+            int64_t value;
+            if (isInt)
+            {
+                memcpy(&value, encoded.data() + r * size, size);
+            }
+            else
+            {
+                int32_t days;
+                memcpy(&days, encoded.data() + r * size, size);
+                value = days == DATE_NULL ? INT_NULL : days;
+            }
+            uint64_t code = value == INT_NULL ? nullCode(width)
+                                              : static_cast<uint64_t>(value) - static_cast<uint64_t>(encoding.base);
+            memcpy(codes.data() + r * width, &code, width);
+        }
+        return put(file.fd, codes, firstRow * width);
+    }
+    return put(file.fd, encoded, firstRow * fixedWidth(file.info.type));
+}
+
+// Writes an encoded batch at the end of the table. Normally pages are only dirtied
+// in the buffer pool and reach disk on eviction or at the next checkpoint; bulk
+// loads write straight to the files in one sequential write per column.
+bool TableStorage::writeRows(const EncodedBatch &batch, bool direct)
+{
+    return fitEncodings(batch) && storeRows(batch, direct);
+}
+
+// Appends a batch the column encodings already fit
+bool TableStorage::storeRows(const EncodedBatch &batch, bool direct)
+{
+    for (size_t c = 0; c < files.size(); c++)
+    {
+        if (!writeColumn(files[c], batch.data[c], batch.strings[c], rows, direct))
+        {
+            cerr << RED << "Failed to write column " << files[c].info.name << " in " << dir << RESET << endl;
+            return false;
+        }
+    }
+    // Bulk loads bring their secondary indexes up to date once, in endBulkLoad(); the
+    // primary key index is kept current, as each batch is checked against it
+    if ((!direct && !indexRows(batch)) || !indexPrimaryKey(batch) || !addBlooms(batch))
+    {
+        // abortBulkLoad() puts back the indexes of a failed bulk load
+        if (!direct)
+            dropIndexedTail();
+        return false;
+    }
+    addZones(batch);
+    rows += batch.rows;
+    return true;
+}
+
+// One value of an indexed column, as index keys are made from it
+struct IndexCell
+{
+    int type;
+    int64_t i = 0; // INT, DATE
+    double f = 0;
+    string_view s;
+};
+
+// Row r of column c of an encoded batch; false for NULL
+static bool batchCell(const EncodedBatch &batch, size_t c, int type, size_t r, IndexCell &cell)
+{
+    const char *data = batch.data[c].data();
+    cell.type = type;
+    switch (type)
+    {
+    case TYPE_INT:
+        memcpy(&cell.i, data + r * sizeof(int64_t), sizeof(int64_t));
+        return cell.i != INT_NULL;
+    case TYPE_FLOAT:
+        memcpy(&cell.f, data + r * sizeof(double), sizeof(double));
+        return !isFloatNull(cell.f);
+    case TYPE_STRING:
+    {
+        uint64_t start = 0, end;
+        if (r > 0)
+            memcpy(&start, data + (r - 1) * sizeof(start), sizeof(start));
+        memcpy(&end, data + r * sizeof(end), sizeof(end));
+        start &= ~STRING_NULL_FLAG;
+        cell.s = string_view(batch.strings[c]).substr(start, (end & ~STRING_NULL_FLAG) - start);
+        return !(end & STRING_NULL_FLAG);
+    }
+    case TYPE_DATE:
+    {
+        int32_t days;
+        memcpy(&days, data + r * sizeof(days), sizeof(days));
+        cell.i = days;
+        return days != DATE_NULL;
+    }
+    }
+    return false;
+}
+
+// Position k of a scanned column vector; false for NULL
+static bool vectorCell(const ColumnVector &column, size_t k, IndexCell &cell)
+{
+    cell.type = column.info.type;
+    switch (cell.type)
+    {
+    case TYPE_INT:
+        cell.i = column.ints[k];
+        break;
+    case TYPE_FLOAT:
+        cell.f = column.floats[k];
+        break;
+    case TYPE_STRING:
+        cell.s = column.strings[k];
+        break;
+    case TYPE_DATE:
+        cell.i = column.dates[k];
+        break;
+    }
+    return !column.nulls[k];
+}
+
+// The rows of a scanned column vector in the form encodeRows() gives them
+static void vectorData(const ColumnVector &column, size_t n, string &data, string &strings)
+{
+    data.clear();
+    strings.clear();
+    for (size_t k = 0; k < n; k++)
+    {
+        bool isNull = column.nulls[k];
+        switch (column.info.type)
+        {
+        case TYPE_INT:
+        {
+            int64_t v = isNull ? INT_NULL : column.ints[k];
+            data.append(reinterpret_cast<const char *>(&v), sizeof(v));
+            break;
+        }
+        case TYPE_STRING:
+        {
+            if (!isNull)
+                strings += column.strings[k];
+            uint64_t end = strings.size() | (isNull ? STRING_NULL_FLAG : 0);
+            data.append(reinterpret_cast<const char *>(&end), sizeof(end));
+            break;
+        }
+        case TYPE_DATE:
+        {
+            int32_t v = isNull ? DATE_NULL : column.dates[k];
+            data.append(reinterpret_cast<const char *>(&v), sizeof(v));
+            break;
+        }
+        }
+    }
+}
+
+// Whether a column needs another encoding before a batch is appended, and which. The
+// first rows of a table pick one; later rows only move a column to a wider one, or to
+// plain storage, when they do not fit it. Plain columns with rows stay plain.
+bool TableStorage::chooseEncoding(size_t column, const EncodedBatch &batch, ColumnEncoding &encoding) const
+{
+    const ColumnFile &file = files[column];
+    const ColumnEncoding &current = file.encoding;
+    int type = file.info.type;
+    IndexCell cell;
+    if (type == TYPE_INT || type == TYPE_DATE)
+    {
+        if (rows > 0 && current.kind != ENCODING_FRAME)
+            return false;
+        int64_t low = INT64_MAX, high = INT64_MIN;
+        for (size_t r = 0; r < batch.rows; r++)
+        {
+            if (batchCell(batch, column, type, r, cell))
+            {
+                low = min(low, cell.i);
+                high = max(high, cell.i);
+            }
+        }
+        if (rows > 0)
+        {
+            uint64_t limit = nullCode(current.width), base = static_cast<uint64_t>(current.base);
+            if (low > high || (static_cast<uint64_t>(low) - base < limit && static_cast<uint64_t>(high) - base < limit))
+                return false;
+            // The zone maps give the range of the rows already stored
+            for (const ZoneStats &zone : file.zones)
+            {
+                if (zone.low <= zone.high)
+                {
+                    low = min(low, zone.low);
+                    high = max(high, zone.high);
+                }
+            }
+        }
+        encoding = low <= high ? frameOfReference(type, low, high) : frameOfReference(type, 0, 0);
+        return encoding.kind != current.kind || encoding.width != current.width || encoding.base != current.base;
+    }
+    if (type == TYPE_STRING)
+    {
+        if (rows > 0 && current.kind != ENCODING_DICTIONARY)
+            return false;
+        // A dictionary pays off while it is small, or much smaller than the column
+        unordered_set<string_view> added;
+        uint32_t code;
+        for (size_t r = 0; r < batch.rows; r++)
+        {
+            if (batchCell(batch, column, type, r, cell) && !(file.dictionary && file.dictionary->find(cell.s, code)))
+                added.insert(cell.s);
+        }
+        size_t entries = (file.dictionary ? file.dictionary->size() : 0) + added.size();
+        encoding = ColumnEncoding();
+        if (entries <= DICTIONARY_MAX && (entries <= nullCode(1) || entries * 4 <= rows + batch.rows))
+        {
+            encoding.kind = ENCODING_DICTIONARY;
+            encoding.width = entries <= nullCode(1) ? 1 : 2;
+            if (rows > 0)
+                encoding.width = max(encoding.width, current.width);
+        }
+        return encoding.kind != current.kind || encoding.width != current.width;
+    }
+    return false;
+}
+
+bool TableStorage::fitEncodings(const EncodedBatch &batch)
+{
+    ColumnEncoding encoding;
+    for (size_t c = 0; c < files.size(); c++)
+    {
+        if (chooseEncoding(c, batch, encoding) && !reencodeColumn(c, encoding))
+        {
+            cerr << RED << "Failed to re-encode column " << files[c].info.name << " of " << dir << RESET << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rewrites a column whole in another encoding, as the next generation of its files.
+// The new files are durable before table.meta switches to them, so a crash leaves one
+// generation or the other complete; the files of the other are deleted.
+bool TableStorage::reencodeColumn(size_t column, ColumnEncoding encoding)
+{
+    ColumnFile &file = files[column];
+    ColumnFile next;
+    next.info = file.info;
+    next.encoding = encoding;
+    next.encoding.generation = file.encoding.generation + 1;
+    if (encoding.kind == ENCODING_DICTIONARY)
+        next.dictionary = make_unique<StringDictionary>();
+    bool ok = openColumn(next) && ftruncate(next.fd, 0) == 0 && (next.strFd < 0 || ftruncate(next.strFd, 0) == 0);
+    if (ok && rows > 0)
+    {
+        TableScan scan(*this, {column});
+        ok = scan.isOpen();
+        Batch batch;
+        string data, strings;
+        while (ok && scan.nextBatch(batch))
+        {
+            vectorData(batch.columns[0], batch.size, data, strings);
+            ok = writeColumn(next, data, strings, batch.firstRow, true);
+        }
+    }
+    ok = ok && fdatasync(next.fd) == 0 && (next.strFd < 0 || fdatasync(next.strFd) == 0);
+    // An aborted bulk load cuts the string file back to where the load began in it
+    if (ok && bulkLoading && next.encoding.kind == ENCODING_PLAIN && next.strFd >= 0)
+    {
+        uint64_t end = 0;
+        ok = bulkStartRows == 0 || readAll(next.fd, &end, sizeof(end), (bulkStartRows - 1) * sizeof(end));
+        bulkStartStrEnd[column] = end & ~STRING_NULL_FLAG;
+    }
+    if (!ok)
+    {
+        for (int fd : {next.fd, next.strFd})
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+        removeOtherGenerations();
+        return false;
+    }
+
+    for (int fd : {file.fd, file.strFd})
+    {
+        if (fd >= 0)
+        {
+            bufferPool().dropFile(fd);
+            close(fd);
+        }
+    }
+    file.encoding = next.encoding;
+    file.encoding.entries = next.dictionary ? next.dictionary->size() : 0;
+    file.fd = next.fd;
+    file.strFd = next.strFd;
+    file.strEnd = next.strEnd;
+    file.dictionary = move(next.dictionary);
+    if (!writeEncodings())
+        return false;
+    removeOtherGenerations();
+    return true;
+}
+
+static void cellKey(const IndexCell &cell, char *key)
+{
+    if (cell.type == TYPE_FLOAT)
+        floatKey(cell.f, key);
+    else if (cell.type == TYPE_STRING)
+        stringKey(cell.s, key);
+    else
+        intKey(cell.i, key);
+}
+
+static uint64_t cellKeyWord(const IndexCell &cell)
+{
+    return cell.type == TYPE_FLOAT ? floatKeyWord(cell.f) : cell.type == TYPE_STRING ? stringKeyWord(cell.s)
+                                                                                     : intKeyWord(cell.i);
+}
+
+static string cellText(const IndexCell &cell)
+{
+    switch (cell.type)
+    {
+    case TYPE_FLOAT:
+        return formatDouble(cell.f);
+    case TYPE_STRING:
+        return string(cell.s);
+    case TYPE_DATE:
+        return formatDate(static_cast<int32_t>(cell.i));
+    default:
+        return to_string(cell.i);
+    }
+}
+
+// Adds the rows of a batch about to be appended to every index of the table
+bool TableStorage::indexRows(const EncodedBatch &batch)
+{
+    IndexCell cell;
+    char key[INDEX_KEY_MAX];
+    for (auto &index : indexes)
+    {
+        if (!index.tree->markDirty())
+            return false;
+        int type = files[index.column].info.type;
+        for (size_t r = 0; r < batch.rows; r++)
+        {
+            if (!batchCell(batch, index.column, type, r, cell))
+                continue;
+            cellKey(cell, key);
+            if (!index.tree->insert(key, rows + r))
+            {
+                cerr << RED << "Failed to update index " << index.name << " of " << dir << RESET << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Adds the non-NULL values of a batch about to be appended to the Bloom filters of
+// their blocks, bulk loads included
+bool TableStorage::addBlooms(const EncodedBatch &batch)
+{
+    IndexCell cell;
+    vector<uint64_t> words(batch.rows);
+    vector<uint8_t> nulls(batch.rows);
+    for (auto &bloom : blooms)
+    {
+        int type = files[bloom.column].info.type;
+        for (size_t r = 0; r < batch.rows; r++)
+        {
+            nulls[r] = !batchCell(batch, bloom.column, type, r, cell);
+            words[r] = nulls[r] ? 0 : cellKeyWord(cell);
+        }
+        if (!bloom.filter->addRows(rows, words, nulls))
+        {
+            cerr << RED << "Failed to update index " << bloom.name << " of " << dir << RESET << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void addToZone(vector<ZoneStats> &zones, uint64_t row, bool isNull, int64_t key)
+{
+    size_t z = row / ZONE_ROWS;
+    if (z >= zones.size())
+        zones.resize(z + 1);
+    ZoneStats &zone = zones[z];
+    zone.rows++;
+    if (isNull)
+    {
+        zone.nulls++;
+        return;
+    }
+    zone.low = min(zone.low, key);
+    zone.high = max(zone.high, key);
+}
+
+// Folds the rows of a batch about to be appended into the zone maps
+void TableStorage::addZones(const EncodedBatch &batch)
+{
+    IndexCell cell;
+    for (size_t c = 0; c < files.size(); c++)
+    {
+        int type = files[c].info.type;
+        if (!hasZoneMap(type))
+            continue;
+        for (size_t r = 0; r < batch.rows; r++)
+        {
+            bool isNull = !batchCell(batch, c, type, r, cell);
+            addToZone(files[c].zones, rows + r, isNull, type == TYPE_FLOAT ? floatZoneKey(cell.f) : cell.i);
+        }
+    }
+}
+
+// Recomputes the zone maps from the block holding row from on, out of the column files
+bool TableStorage::rebuildZones(uint64_t from)
+{
+    size_t keep = from / ZONE_ROWS;
+    vector<size_t> columns;
+    for (size_t c = 0; c < files.size(); c++)
+    {
+        if (!hasZoneMap(files[c].info.type))
+            continue;
+        columns.push_back(c);
+        files[c].zones.resize(min(files[c].zones.size(), keep));
+    }
+    zonesSaved = min(zonesSaved, keep);
+    if (columns.empty() || keep * ZONE_ROWS >= rows)
+        return true;
+
+    TableScan scan(*this, columns);
+    if (!scan.isOpen())
+        return false;
+    scan.setRange(keep * ZONE_ROWS, rows);
+    Batch batch;
+    while (scan.nextBatch(batch))
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            const ColumnVector &column = batch.columns[i];
+            vector<ZoneStats> &zones = files[columns[i]].zones;
+            for (size_t k = 0; k < batch.size; k++)
+            {
+                int64_t key = column.info.type == TYPE_INT     ? column.ints[k]
+                              : column.info.type == TYPE_FLOAT ? floatZoneKey(column.floats[k])
+                                                               : column.dates[k];
+                addToZone(zones, batch.firstRow + k, column.nulls[k], key);
+            }
+        }
+    }
+    return true;
+}
+
+// Writes the blocks changed since the last checkpoint, then the rows they cover. Full
+// blocks never change again, and a block a crash leaves unsaved is recomputed on open.
+bool TableStorage::saveZones()
+{
+    const uint64_t headerSize = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+    for (auto &file : files)
+    {
+        if (file.zoneFd < 0 || file.zones.size() <= zonesSaved)
+            continue;
+        if (!writeAll(file.zoneFd, file.zones.data() + zonesSaved, (file.zones.size() - zonesSaved) * sizeof(ZoneStats),
+                      headerSize + zonesSaved * sizeof(ZoneStats)) ||
+            fdatasync(file.zoneFd) != 0)
+            return false;
+    }
+    uint32_t header[2] = {ZONE_MAP_MAGIC, ZONE_MAP_VERSION};
+    char buf[headerSize];
+    memcpy(buf, header, sizeof(header));
+    memcpy(buf + sizeof(header), &rows, sizeof(rows));
+    for (auto &file : files)
+    {
+        if (file.zoneFd >= 0 && !writeAll(file.zoneFd, buf, sizeof(buf), 0))
+            return false;
+    }
+    zonesSaved = rows / ZONE_ROWS;
+    return true;
+}
+
+// Loads the zone maps, recomputing blocks the files do not hold for the committed rows
+bool TableStorage::openZones()
+{
+    uint64_t from = rows;
+    for (auto &file : files)
+    {
+        if (file.zoneFd < 0)
+            continue;
+        // A last, partial block only holds if it was saved with the same rows
+        uint32_t header[2] = {};
+        uint64_t covered = 0, valid = 0;
+        if (readAll(file.zoneFd, header, sizeof(header), 0) && header[0] == ZONE_MAP_MAGIC &&
+            header[1] == ZONE_MAP_VERSION && readAll(file.zoneFd, &covered, sizeof(covered), sizeof(header)))
+        {
+            valid = covered == rows ? rows : min(covered, rows) / ZONE_ROWS * ZONE_ROWS;
+            file.zones.resize((valid + ZONE_ROWS - 1) / ZONE_ROWS);
+            if (!readAll(file.zoneFd, file.zones.data(), file.zones.size() * sizeof(ZoneStats),
+                         sizeof(header) + sizeof(covered)))
+                valid = 0;
+        }
+        from = min(from, valid);
+    }
+    zonesSaved = from / ZONE_ROWS;
+    if (from == rows)
+        return true;
+    if (!rebuildZones(from) || !saveZones())
+    {
+        cerr << RED << "Failed to rebuild the zone maps of " << dir << RESET << endl;
+        return false;
+    }
+    return true;
+}
+
+bool TableStorage::indexPrimaryKey(const EncodedBatch &batch)
+{
+    if (!primary)
+        return true;
+    if (!primary->markDirty())
+        return false;
+    IndexCell cell;
+    int type = files[primaryColumn].info.type;
+    for (size_t r = 0; r < batch.rows; r++)
+    {
+        // checkPrimaryKey() has turned NULLs away, except in rows replayed from the log
+        if (batchCell(batch, primaryColumn, type, r, cell) && !primary->insert(cellKeyWord(cell), rows + r))
+        {
+            cerr << RED << "Failed to update the primary key index of " << dir << RESET << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the stored STRING of a row is value, read through the buffer pool, or from
+// the files themselves while a bulk load writes past it
+bool TableStorage::storedEquals(size_t column, uint64_t rowId, string_view value)
+{
+    const ColumnFile &file = files[column];
+    auto load = [&](int fd, void *data, size_t size, uint64_t offset)
+    { return bulkLoading ? readAll(fd, data, size, offset) : bufferPool().read(fd, data, size, offset); };
+    if (file.encoding.kind == ENCODING_DICTIONARY)
+    {
+        uint64_t code = 0;
+        size_t width = file.encoding.width;
+        return load(file.fd, &code, width, rowId * width) && code < file.dictionary->size() &&
+               file.dictionary->value(code) == value;
+    }
+    uint64_t bounds[2] = {};
+    if (rowId > 0 ? !load(file.fd, bounds, sizeof(bounds), (rowId - 1) * sizeof(uint64_t))
+                  : !load(file.fd, bounds + 1, sizeof(uint64_t), 0))
+        return false;
+    uint64_t start = bounds[0] & ~STRING_NULL_FLAG, end = bounds[1];
+    if ((end & STRING_NULL_FLAG) || (end & ~STRING_NULL_FLAG) - start != value.size())
+        return false;
+    string stored(value.size(), '\0');
+    return load(file.strFd, stored.data(), stored.size(), start) && stored == value;
+}
+
+// Turns away a batch with a NULL primary key, or one already in the table or repeated
+// within the batch. Each row costs one bucket lookup; STRING keys are hashes, so their
+// matches are compared with the stored values.
+bool TableStorage::checkPrimaryKey(const EncodedBatch &batch)
+{
+    if (!primary)
+        return true;
+    const ColumnInfo &info = files[primaryColumn].info;
+    bool exact = primary->exact();
+    auto duplicate = [&](const IndexCell &cell)
+    {
+        cerr << RED << "Error: Duplicate value '" << cellText(cell) << "' for primary key column '" << info.name
+             << "'." << RESET << endl;
+        return false;
+    };
+
+    vector<pair<uint64_t, size_t>> words(batch.rows);
+    vector<uint64_t> found;
+    IndexCell cell, other;
+    for (size_t r = 0; r < batch.rows; r++)
+    {
+        if (!batchCell(batch, primaryColumn, info.type, r, cell))
+        {
+            cerr << RED << "Error: Primary key column '" << info.name << "' cannot be NULL." << RESET << endl;
+            return false;
+        }
+        words[r] = {cellKeyWord(cell), r};
+        found.clear();
+        if (!primary->find(words[r].first, found))
+            return false;
+        for (uint64_t rowId : found)
+        {
+            if (exact || storedEquals(primaryColumn, rowId, cell.s))
+                return duplicate(cell);
+        }
+    }
+
+    // Repeats within the batch end up next to each other, or among rows of equal hash
+    sort(words.begin(), words.end());
+    for (size_t i = 1; i < words.size(); i++)
+    {
+        for (size_t j = i; j-- > 0 && words[j].first == words[i].first;)
+        {
+            batchCell(batch, primaryColumn, info.type, words[i].second, cell);
+            if (exact || (batchCell(batch, primaryColumn, info.type, words[j].second, other) && other.s == cell.s))
+                return duplicate(cell);
+        }
+    }
+    return true;
+}
+
+// Adds rows [from, rows) of the column files to the primary key index
+bool TableStorage::catchUpPrimaryKey(uint64_t from)
+{
+    TableScan scan(*this, {primaryColumn});
+    if (!scan.isOpen() || !primary->markDirty())
+        return false;
+    scan.setRange(from, rows);
+    IndexCell cell;
+    Batch batch;
+    while (scan.nextBatch(batch))
+    {
+        const ColumnVector &column = batch.columns[0];
+        for (size_t k = 0; k < batch.size; k++)
+        {
+            if (vectorCell(column, k, cell) && !primary->insert(cellKeyWord(cell), batch.firstRow + k))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Adds rows [from, rows) of the column files to an index: one insert each, or a build
+// from scratch when they outnumber the rows already indexed
+bool TableStorage::catchUpIndex(TableIndex &index, uint64_t from)
+{
+    TableScan scan(*this, {index.column});
+    if (!scan.isOpen() || !index.tree->markDirty())
+        return false;
+    bool rebuild = rows - from >= from;
+    scan.setRange(rebuild ? 0 : from, rows);
+
+    string entries;
+    IndexCell cell;
+    char key[INDEX_KEY_MAX];
+    Batch batch;
+    while (scan.nextBatch(batch))
+    {
+        const ColumnVector &column = batch.columns[0];
+        for (size_t k = 0; k < batch.size; k++)
+        {
+            if (!vectorCell(column, k, cell))
+                continue;
+            cellKey(cell, key);
+            if (rebuild)
+                index.tree->addEntry(entries, key, batch.firstRow + k);
+            else if (!index.tree->insert(key, batch.firstRow + k))
+                return false;
+        }
+    }
+    return !rebuild || index.tree->build(entries, rows);
+}
+
+// Adds rows [from, rows) of the column files to a Bloom filter index
+bool TableStorage::catchUpBloom(TableBloom &bloom, uint64_t from)
+{
+    TableScan scan(*this, {bloom.column});
+    if (!scan.isOpen())
+        return false;
+    scan.setRange(from, rows);
+    IndexCell cell;
+    vector<uint64_t> words;
+    vector<uint8_t> nulls;
+    Batch batch;
+    while (scan.nextBatch(batch))
+    {
+        const ColumnVector &column = batch.columns[0];
+        words.resize(batch.size);
+        nulls.resize(batch.size);
+        for (size_t k = 0; k < batch.size; k++)
+        {
+            nulls[k] = !vectorCell(column, k, cell);
+            words[k] = nulls[k] ? 0 : cellKeyWord(cell);
+        }
+        if (!bloom.filter->addRows(batch.firstRow, words, nulls))
+            return false;
+    }
+    return true;
+}
+
+// Takes the entries a failed append added for row IDs past the table's end back out of
+// every index. Neither the B+trees nor the hash index can delete, so those are built
+// again from the rows the table holds.
+void TableStorage::dropIndexedTail()
+{
+    for (auto &index : indexes)
+    {
+        if (!catchUpIndex(index, 0))
+            cerr << RED << "Failed to restore index " << index.name << " of " << dir << RESET << endl;
+    }
+    if (primary && (!primary->reset() || !catchUpPrimaryKey(0)))
+        cerr << RED << "Failed to restore the primary key index of " << dir << RESET << endl;
+    for (auto &bloom : blooms)
+    {
+        if (!restoreBloom(bloom, rows))
+            cerr << RED << "Failed to restore index " << bloom.name << " of " << dir << RESET << endl;
+    }
+}
+
+// Empties the filters from the block holding row from onwards and fills them again
+// from the column files, dropping whatever rows past the table's end had set
+bool TableStorage::restoreBloom(TableBloom &bloom, uint64_t from)
+{
+    uint64_t block = from / ZONE_ROWS;
+    return bloom.filter->resetFrom(block) && catchUpBloom(bloom, block * ZONE_ROWS) && bloom.filter->checkpoint(rows);
+}
+
+bool TableStorage::appendRows(const vector<Row> &rowData)
+{
+    if (!isOpen())
+        return false;
+    if (rowData.empty())
+        return true;
+
+    // Encode everything first so a mismatched row leaves the table untouched, and
+    // re-encode columns the rows do not fit before they are logged
+    EncodedBatch batch;
+    if (!encodeRows(rowData, batch) || !checkPrimaryKey(batch) || !fitEncodings(batch))
+        return false;
+
+    string dbDir = filesystem::path(dir).parent_path().string();
+    WriteAheadLog *wal = walForDatabase(dbDir);
+    if (!wal)
+    {
+        cerr << RED << "No write-ahead log for " << dbDir << RESET << endl;
+        return false;
+    }
+
+    // The rows are durable once their log record is; the table files catch up later
+    uint64_t lsn = wal->append(WAL_INSERT_ROWS, encodeInsertPayload(filesystem::path(dir).filename().string(), rowData));
+    if (!wal->commit(lsn))
+        return false;
+    if (!storeRows(batch, false))
+    {
+        // The caller is told the insert failed, so replay must not bring the rows back
+        wal->commit(wal->append(WAL_ABORT, encodeAbortPayload(lsn)));
+        return false;
+    }
+    appliedLsn = lsn;
+
+    if (wal->size() > walCheckpointBytes)
+        return checkpointDatabase(dbDir);
+    return true;
+}
+
+bool TableStorage::redoRows(const vector<Row> &rowData, uint64_t lsn)
+{
+    if (lsn <= appliedLsn)
+        return true; // already in the table files
+    EncodedBatch batch;
+    if (!encodeRows(rowData, batch) || !writeRows(batch, false))
+        return false;
+    appliedLsn = lsn;
+    return true;
+}
+
+// Bypasses the log; the rows are made durable by an immediate checkpoint
+bool TableStorage::appendUnlogged(const vector<Row> &rowData)
+{
+    EncodedBatch batch;
+    if (!isOpen() || !encodeRows(rowData, batch) || !checkPrimaryKey(batch) || !writeRows(batch, false))
+        return false;
+    return checkpoint();
+}
+
+// Bulk loads skip the log: the table files are brought up to date and detached
+// from the buffer pool, batches are written directly, and the new row count is
+// only committed by endBulkLoad(). A crash in between leaves the table as it was.
+bool TableStorage::beginBulkLoad()
+{
+    if (!isOpen() || !checkpointDatabase(filesystem::path(dir).parent_path().string()))
+        return false;
+    for (auto &file : files)
+    {
+        bufferPool().dropFile(file.fd);
+        if (file.strFd >= 0)
+            bufferPool().dropFile(file.strFd);
+    }
+    bulkLoading = true;
+    bulkStartRows = rows;
+    bulkStartStrEnd.clear();
+    for (const auto &file : files)
+        bulkStartStrEnd.push_back(file.strEnd);
+    return true;
+}
+
+bool TableStorage::bulkAppend(const EncodedBatch &batch)
+{
+    return checkPrimaryKey(batch) && writeRows(batch, true);
+}
+
+bool TableStorage::endBulkLoad()
+{
+    bulkLoading = false;
+    for (auto &index : indexes)
+    {
+        if (!catchUpIndex(index, bulkStartRows))
+        {
+            cerr << RED << "Failed to update index " << index.name << " of " << dir << RESET << endl;
+            return false;
+        }
+    }
+    return checkpoint();
+}
+
+void TableStorage::abortBulkLoad()
+{
+    bulkLoading = false;
+    rows = bulkStartRows;
+    // A dictionary keeps the values the load added; no committed row has their codes
+    for (size_t c = 0; c < files.size() && c < bulkStartStrEnd.size(); c++)
+    {
+        if (files[c].encoding.kind == ENCODING_PLAIN)
+            files[c].strEnd = bulkStartStrEnd[c];
+    }
+    // Indexes were clean when the load began; one it reached is rebuilt without its rows
+    for (auto &index : indexes)
+    {
+        if (!index.tree->isClean() && (!catchUpIndex(index, 0) || !index.tree->checkpoint(rows)))
+            cerr << RED << "Failed to restore index " << index.name << " of " << dir << RESET << endl;
+    }
+    if (primary && !primary->isClean() &&
+        (!primary->reset() || !catchUpPrimaryKey(0) || !primary->checkpoint(rows)))
+        cerr << RED << "Failed to restore the primary key index of " << dir << RESET << endl;
+    for (auto &bloom : blooms)
+    {
+        if (!restoreBloom(bloom, bulkStartRows))
+            cerr << RED << "Failed to restore index " << bloom.name << " of " << dir << RESET << endl;
+    }
+    if (!rebuildZones(bulkStartRows))
+        cerr << RED << "Failed to restore the zone maps of " << dir << RESET << endl;
+}
+
+bool TableStorage::checkpoint()
+{
+    if (!isOpen())
+        return false;
+    if (!flushColumns())
+    {
+        cerr << RED << "Failed to flush columns of " << dir << RESET << endl;
+        return false;
+    }
+    for (auto &file : files)
+    {
+        for (int fd : {file.fd, file.strFd})
+        {
+            if (fd >= 0 && fdatasync(fd) != 0)
+            {
+                cerr << RED << "Failed to sync column " << file.info.name << " of " << dir << RESET << endl;
+                return false;
+            }
+        }
+    }
+    if (!saveZones())
+    {
+        cerr << RED << "Failed to write the zone maps of " << dir << RESET << endl;
+        return false;
+    }
+    // The committed row count only moves once the column data is on disk
+    if (!writeMeta())
+    {
+        cerr << RED << "Failed to update " << dir << "/table.meta" << RESET << endl;
+        return false;
+    }
+    // An index that falls behind the row count by a crash here is caught up on open
+    for (auto &index : indexes)
+    {
+        if (!index.tree->checkpoint(rows))
+            return false;
+    }
+    for (auto &bloom : blooms)
+    {
+        if (!bloom.filter->checkpoint(rows))
+            return false;
+    }
+    return !primary || primary->checkpoint(rows);
+}
+
+// Writes dirty pages back to the column files so that readers mapping them see every row
+bool TableStorage::flushPages()
+{
+    return isOpen() && flushColumns();
+}
+
+bool TableStorage::truncate()
+{
+    if (!isOpen())
+        return false;
+    // Earlier log records must not be replayed into the emptied table
+    if (!checkpointDatabase(filesystem::path(dir).parent_path().string()))
+        return false;
+    rows = 0;
+    for (auto &file : files)
+    {
+        if (file.dictionary)
+            file.dictionary->truncate(0);
+    }
+    if (!writeMeta())
+        return false;
+    for (auto &file : files)
+    {
+        file.strEnd = 0;
+        file.zones.clear();
+        bufferPool().dropFile(file.fd);
+        if (file.strFd >= 0)
+            bufferPool().dropFile(file.strFd);
+        if (ftruncate(file.fd, 0) != 0 || (file.strFd >= 0 && ftruncate(file.strFd, 0) != 0))
+            return false;
+    }
+    zonesSaved = 0;
+    if (!saveZones())
+        return false;
+    for (auto &index : indexes)
+    {
+        if (!index.tree->reset() || !index.tree->checkpoint(0))
+            return false;
+    }
+    for (auto &bloom : blooms)
+    {
+        if (!bloom.filter->resetFrom(0) || !bloom.filter->checkpoint(0))
+            return false;
+    }
+    return !primary || (primary->reset() && primary->checkpoint(0));
+}
+
+static string indexPath(const string &dir, const string &name)
+{
+    return dir + "/" + name + ".idx";
+}
+
+static string bloomPath(const string &dir, const string &name)
+{
+    return dir + "/" + name + ".bloom";
+}
+
+// Opens the indexes found in the table directory. One left dirty by a crash, or
+// ahead of the committed rows, is rebuilt; one behind them is caught up.
+bool TableStorage::openIndexes()
+{
+    vector<string> names, bloomNames;
+    for (const auto &entry : filesystem::directory_iterator(dir))
+    {
+        if (entry.path().extension() == ".idx")
+            names.push_back(entry.path().stem().string());
+        else if (entry.path().extension() == ".bloom")
+            bloomNames.push_back(entry.path().stem().string());
+    }
+    sort(names.begin(), names.end());
+    sort(bloomNames.begin(), bloomNames.end());
+
+    bool ok = true;
+    for (const string &name : names)
+    {
+        TableIndex index{name, 0, make_unique<BTreeIndex>(indexPath(dir, name))};
+        if (!index.tree->isOpen())
+        {
+            ok = false;
+            continue;
+        }
+        const ColumnInfo &info = index.tree->columnInfo();
+        auto file = find_if(files.begin(), files.end(), [&](const ColumnFile &f)
+                            { return f.info.name == info.name && f.info.type == info.type; });
+        if (file == files.end())
+        {
+            cerr << RED << "Index " << name << " of " << dir << " is on unknown column " << info.name << RESET << endl;
+            ok = false;
+            continue;
+        }
+        index.column = file - files.begin();
+        uint64_t indexed = index.tree->indexedRows();
+        if (!index.tree->isClean() || indexed != rows)
+        {
+            if (!catchUpIndex(index, index.tree->isClean() && indexed < rows ? indexed : 0) ||
+                !index.tree->checkpoint(rows))
+            {
+                cerr << RED << "Failed to recover index " << name << " of " << dir << RESET << endl;
+                ok = false;
+                continue;
+            }
+        }
+        indexes.push_back(move(index));
+    }
+
+    // Bloom filters hold a superset of the rows they were checkpointed with, so one is
+    // only refilled from the block where it and the committed rows part ways
+    for (const string &name : bloomNames)
+    {
+        TableBloom bloom{name, 0, make_unique<BloomIndex>(bloomPath(dir, name))};
+        if (!bloom.filter->isOpen())
+        {
+            ok = false;
+            continue;
+        }
+        const ColumnInfo &info = bloom.filter->columnInfo();
+        auto file = find_if(files.begin(), files.end(), [&](const ColumnFile &f)
+                            { return f.info.name == info.name && f.info.type == info.type; });
+        if (file == files.end())
+        {
+            cerr << RED << "Index " << name << " of " << dir << " is on unknown column " << info.name << RESET << endl;
+            ok = false;
+            continue;
+        }
+        bloom.column = file - files.begin();
+        uint64_t indexed = bloom.filter->indexedRows();
+        if (indexed != rows && !restoreBloom(bloom, min(indexed, rows)))
+        {
+            cerr << RED << "Failed to recover index " << name << " of " << dir << RESET << endl;
+            ok = false;
+            continue;
+        }
+        blooms.push_back(move(bloom));
+    }
+    return openPrimaryKey() && ok;
+}
+
+// Opens the primary key index, if the table has one, recovering it like the others
+bool TableStorage::openPrimaryKey()
+{
+    string path = dir + "/" + PRIMARY_KEY_FILE;
+    if (!filesystem::exists(path))
+        return true;
+    auto index = make_unique<HashIndex>(path);
+    if (!index->isOpen())
+        return false;
+    const ColumnInfo &info = index->columnInfo();
+    auto file = find_if(files.begin(), files.end(), [&](const ColumnFile &f)
+                        { return f.info.name == info.name && f.info.type == info.type; });
+    if (file == files.end())
+    {
+        cerr << RED << "Primary key of " << dir << " is on unknown column " << info.name << RESET << endl;
+        return false;
+    }
+    primary = move(index);
+    primaryColumn = file - files.begin();
+    uint64_t indexed = primary->indexedRows();
+    if (primary->isClean() && indexed == rows)
+        return true;
+    bool caughtUp = primary->isClean() && indexed < rows ? catchUpPrimaryKey(indexed)
+                                                          : primary->reset() && catchUpPrimaryKey(0);
+    if (!caughtUp || !primary->checkpoint(rows))
+    {
+        cerr << RED << "Failed to recover the primary key index of " << dir << RESET << endl;
+        return false;
+    }
+    return true;
+}
+
+bool TableStorage::createIndex(const string &name, size_t column)
+{
+    string path = indexPath(dir, name);
+    if (!createIndexFile(path, files.at(column).info))
+        return false;
+    TableIndex index{name, column, make_unique<BTreeIndex>(path)};
+    if (!index.tree->isOpen() || !catchUpIndex(index, 0) || !index.tree->checkpoint(rows))
+    {
+        index.tree->close();
+        filesystem::remove(path);
+        return false;
+    }
+    indexes.push_back(move(index));
+    return true;
+}
+
+bool TableStorage::createBloomIndex(const string &name, size_t column, double falsePositiveRate)
+{
+    string path = bloomPath(dir, name);
+    if (!createBloomIndexFile(path, files.at(column).info, falsePositiveRate))
+        return false;
+    TableBloom bloom{name, column, make_unique<BloomIndex>(path)};
+    if (!bloom.filter->isOpen() || !restoreBloom(bloom, 0))
+    {
+        bloom.filter->close();
+        filesystem::remove(path);
+        return false;
+    }
+    blooms.push_back(move(bloom));
+    return true;
+}
+
+bool TableStorage::dropIndex(const string &name)
+{
+    error_code ec;
+    auto bloom = find_if(blooms.begin(), blooms.end(), [&](const TableBloom &b) { return b.name == name; });
+    if (bloom != blooms.end())
+    {
+        bloom->filter->close();
+        blooms.erase(bloom);
+        return filesystem::remove(bloomPath(dir, name), ec);
+    }
+    auto it = find_if(indexes.begin(), indexes.end(), [&](const TableIndex &index) { return index.name == name; });
+    if (it == indexes.end())
+        return false;
+    it->tree->close();
+    indexes.erase(it);
+    return filesystem::remove(indexPath(dir, name), ec);
+}
+
+TableIndex *TableStorage::findIndex(size_t column)
+{
+    for (auto &index : indexes)
+    {
+        if (index.column == column)
+            return &index;
+    }
+    return nullptr;
+}
+
+BloomIndex *TableStorage::findBloom(size_t column) const
+{
+    for (const auto &bloom : blooms)
+    {
+        if (bloom.column == column)
+            return bloom.filter.get();
+    }
+    return nullptr;
+}
+
+bool createTableStorage(const string &dir, const vector<ColumnInfo> &schema, int primaryKey)
+{
+    closeTableStorage(dir);
+    string primaryPath = dir + "/" + PRIMARY_KEY_FILE;
+    error_code ec;
+    filesystem::remove(primaryPath, ec);
+    if (primaryKey >= 0 && !createHashIndexFile(primaryPath, schema.at(primaryKey)))
+    {
+        cerr << RED << "Failed to create the primary key index in " << dir << RESET << endl;
+        return false;
+    }
+    for (const auto &col : schema)
+    {
+        if (col.type == TYPE_STRING)
+        {
+            ofstream(columnPath(dir, col, ".off"), ios::binary | ios::trunc).close();
+            ofstream(columnPath(dir, col, ".str"), ios::binary | ios::trunc).close();
+        }
+        else
+        {
+            ofstream(columnPath(dir, col, ".col"), ios::binary | ios::trunc).close();
+        }
+    }
+
+    ofstream meta(dir + "/table.meta", ios::binary | ios::trunc);
+    if (!meta.is_open())
+    {
+        cerr << RED << "Failed to create table.meta in " << dir << RESET << endl;
+        return false;
+    }
+    meta.close();
+    int fd = openFile(dir + "/table.meta", false);
+    bool ok = fd >= 0 && writeMetaFile(fd, 0, 0, vector<ColumnEncoding>(schema.size()));
+    if (fd >= 0)
+        close(fd);
+    return ok;
+}
+
+// Open tables keep their file descriptors for the lifetime of the process
+static unordered_map<string, unique_ptr<TableStorage>> &openTables()
+{
+    // Constructed first so the pool outlives the tables that flush into it
+    bufferPool();
+    static unordered_map<string, unique_ptr<TableStorage>> tables;
+    return tables;
+}
+
+static string storageKey(const string &dir)
+{
+    return filesystem::path(dir).lexically_normal().string();
+}
+
+TableStorage *openTableStorage(const string &tableDir, const vector<ColumnInfo> &schema)
+{
+    string dir = storageKey(tableDir);
+    auto it = openTables().find(dir);
+    if (it != openTables().end())
+        return it->second.get();
+
+    if (filesystem::exists(dir + "/data.csv") && !filesystem::exists(dir + "/table.meta"))
+    {
+        if (!convertCsvTable(dir, schema))
+            return nullptr;
+    }
+
+    auto storage = make_unique<TableStorage>(dir, schema);
+    if (!storage->isOpen())
+        return nullptr;
+    storage->openZones();
+    storage->openIndexes();
+    // New log records must sort after everything the table already contains
+    if (WriteAheadLog *wal = walForDatabase(filesystem::path(dir).parent_path().string()))
+        wal->observeLsn(storage->lsn());
+    return openTables().emplace(dir, move(storage)).first->second.get();
+}
+
+void closeTableStorage(const string &dir)
+{
+    openTables().erase(storageKey(dir));
+}
+
+// Makes every logged change of the database part of its table files, then empties the log
+bool checkpointDatabase(const string &dbDir)
+{
+    string key = storageKey(dbDir);
+    bool ok = true;
+    for (auto &entry : openTables())
+    {
+        if (filesystem::path(entry.first).parent_path().string() == key)
+            ok = entry.second->checkpoint() && ok;
+    }
+    if (!ok)
+        return false;
+    WriteAheadLog *wal = walForDatabase(key);
+    return wal && wal->reset(wal->lastLsn());
+}
+
+void checkpointAllDatabases()
+{
+    vector<string> dbDirs;
+    for (const auto &entry : openTables())
+    {
+        string dbDir = filesystem::path(entry.first).parent_path().string();
+        if (find(dbDirs.begin(), dbDirs.end(), dbDir) == dbDirs.end())
+            dbDirs.push_back(dbDir);
+    }
+    for (const auto &dbDir : dbDirs)
+        checkpointDatabase(dbDir);
+}
+
+// Redo: re-applies every logged insert that had not reached its table files
+void recoverDatabases()
+{
+    filesystem::path root = "Databases";
+    if (!filesystem::exists(root))
+        return;
+    for (const auto &dbEntry : filesystem::directory_iterator(root))
+    {
+        if (!dbEntry.is_directory() || !filesystem::exists(dbEntry.path() / "wal.log"))
+            continue;
+        string dbDir = dbEntry.path().string();
+        WriteAheadLog *wal = walForDatabase(dbDir);
+        if (!wal)
+            continue;
+
+        // Inserts that failed after they were logged are followed by an abort record
+        unordered_set<uint64_t> aborted;
+        wal->replay([&](const WalRecord &record)
+                    {
+            uint64_t lsn;
+            if (record.type == WAL_ABORT && decodeAbortPayload(record.payload, lsn))
+                aborted.insert(lsn); });
+
+        uint64_t replayed = 0;
+        bool ok = true;
+        wal->replay([&](const WalRecord &record)
+                    {
+            if (record.type == WAL_ABORT || aborted.count(record.lsn))
+                return;
+            string table;
+            vector<Row> rowData;
+            if (record.type != WAL_INSERT_ROWS || !decodeInsertPayload(record.payload, table, rowData))
+            {
+                cerr << RED << "Skipping unreadable log record " << record.lsn << " in " << dbDir << RESET << endl;
+                return;
+            }
+            filesystem::path tableDir = dbEntry.path() / table;
+            if (!filesystem::exists(tableDir / "table.meta"))
+                return; // dropped after the record was written
+            const vector<ColumnInfo> *schema = catalog().tableSchema(dbEntry.path().filename().string(), table);
+            TableStorage *storage = schema ? openTableStorage(tableDir.string(), *schema) : nullptr;
+            if (!storage)
+            {
+                ok = false;
+                return;
+            }
+            if (record.lsn > storage->lsn())
+            {
+                ok = storage->redoRows(rowData, record.lsn) && ok;
+                replayed++;
+            } });
+
+        if (replayed > 0)
+            cout << GREEN << "Recovered " << replayed << " logged insert(s) in " << dbDir << RESET << endl;
+        if (ok)
+            checkpointDatabase(dbDir);
+        else
+            cerr << RED << "Recovery of " << dbDir << " incomplete; keeping its log" << RESET << endl;
+    }
+}
+
+// Builds the table in a scratch directory and moves its files in with table.meta last,
+// so a crash part way leaves no table.meta and the conversion starts over
+bool convertCsvTable(const string &dir, const vector<ColumnInfo> &schema)
+{
+    ifstream csv(dir + "/data.csv");
+    if (!csv.is_open())
+    {
+        cerr << RED << "Failed to open " << dir << "/data.csv" << RESET << endl;
+        return false;
+    }
+    string scratch = dir + "/converting";
+    error_code ec;
+    filesystem::remove_all(scratch, ec);
+    if (!filesystem::create_directory(scratch, ec))
+    {
+        cerr << RED << "Failed to create " << scratch << RESET << endl;
+        return false;
+    }
+    if (!createTableStorage(scratch, schema))
+        return false;
+
+    const size_t batchSize = 4096;
+    const size_t rejectsShown = 10;
+    vector<Row> batch;
+    string line, error;
+    uint64_t converted = 0, lineNo = 0;
+    vector<pair<uint64_t, string>> rejected;
+    bool stored = true;
+    {
+        TableStorage storage(scratch, schema);
+        if (!storage.isOpen())
+            return false;
+        auto flush = [&]()
+        {
+            stored = storage.appendUnlogged(batch);
+            converted += batch.size();
+            batch.clear();
+        };
+
+        while (stored && getline(csv, line))
+        {
+            lineNo++;
+            if (line.empty())
+                continue;
+            stringstream ss(line);
+            vector<ParamValue> row;
+            string cell;
+            for (size_t i = 0; i < schema.size(); i++)
+            {
+                // The legacy format wrote NULL for a NULL; missing fields are NULL too
+                bool present = static_cast<bool>(getline(ss, cell, ','));
+                row.push_back(present && cell != "NULL" ? ParamValue(cell) : ParamValue::null());
+            }
+            // Legacy rows were validated with looser rules; keep the ones that still parse
+            Row parsed;
+            if (!parseRow(schema, row, parsed, error))
+            {
+                rejected.push_back({lineNo, error});
+                continue;
+            }
+            batch.push_back(move(parsed));
+            if (batch.size() == batchSize)
+                flush();
+        }
+        if (stored)
+            flush();
+    }
+    csv.close();
+    if (!stored)
+    {
+        filesystem::remove_all(scratch, ec);
+        cerr << RED << "Failed to convert " << dir << " to columnar storage; data.csv is kept" << RESET << endl;
+        return false;
+    }
+
+    vector<filesystem::path> moved;
+    for (const auto &entry : filesystem::directory_iterator(scratch, ec))
+    {
+        if (entry.path().filename() != "table.meta")
+            moved.push_back(entry.path());
+    }
+    moved.push_back(filesystem::path(scratch) / "table.meta");
+    for (const auto &path : moved)
+    {
+        filesystem::rename(path, filesystem::path(dir) / path.filename(), ec);
+        if (ec)
+        {
+            cerr << RED << "Failed to move " << path.string() << " into " << dir << RESET << endl;
+            return false;
+        }
+    }
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    filesystem::remove_all(scratch, ec);
+
+    filesystem::rename(dir + "/data.csv", dir + "/data.csv.bak");
+    cout << GREEN << "Converted " << dir << " to columnar storage (" << converted << " rows)." << RESET << endl;
+    if (!rejected.empty())
+    {
+        cerr << ORANGE << "Skipped " << rejected.size() << " unreadable line(s) of data.csv:" << RESET << endl;
+        for (size_t i = 0; i < rejected.size() && i < rejectsShown; i++)
+            cerr << ORANGE << "  line " << rejected[i].first << ": " << rejected[i].second << RESET << endl;
+        if (rejected.size() > rejectsShown)
+            cerr << ORANGE << "  ... and " << rejected.size() - rejectsShown << " more" << RESET << endl;
+    }
+    return true;
+}
+
+// Converts every table that still has a data.csv and no table.meta
+void convertLegacyTables()
+{
+    filesystem::path root = "Databases";
+    if (!filesystem::exists(root))
+        return;
+    for (const auto &dbEntry : filesystem::directory_iterator(root))
+    {
+        if (!dbEntry.is_directory())
+            continue;
+        for (const auto &tableEntry : filesystem::directory_iterator(dbEntry.path()))
+        {
+            const filesystem::path &tableDir = tableEntry.path();
+            if (!tableEntry.is_directory() || !filesystem::exists(tableDir / "data.csv") ||
+                filesystem::exists(tableDir / "table.meta"))
+                continue;
+
+            const vector<ColumnInfo> *schema =
+                catalog().tableSchema(dbEntry.path().filename().string(), tableDir.filename().string());
+            if (schema && !schema->empty())
+                convertCsvTable(tableDir.string(), *schema);
+        }
+    }
+}
@@ -0,0 +1,253 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "value.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// On-disk layout of a table directory (its schema lives in the catalog, catalog.h):
+//   table.meta      magic, format version, committed row count, the LSN of the
+//                   last logged insert contained in the column files, then each
+//                   column's encoding (ColumnEncoding)
+//   <col>.col       INT: int64, FLOAT: double, DATE: int32 days since 1970-01-01,
+//                   BOOL: 2 bits per row (0 = FALSE, 1 = TRUE, 2 = NULL)
+//   <col>.off       STRING: uint64 end offset of each value in <col>.str
+//   <col>.str       STRING: value bytes, back to back
+// or, for the columns written in a compact encoding:
+//   <col>.col       INT, DATE (frame of reference): each value less the column's base,
+//                   in 1, 2 or 4 bytes; STRING (dictionary): each value's code in 1 or
+//                   2 bytes. The largest code of the width stands for NULL.
+//   <col>.dict      STRING (dictionary): the distinct values in code order, each a
+//                   uint32 length and its bytes
+//   <col>.zone      INT, FLOAT, DATE: zone map, the rows it covers, then ZoneStats for
+//                   each block of ZONE_ROWS rows
+//   <index>.idx     B+tree over one column (btree.h), kept up to date by every insert
+//   <index>.bloom   Bloom filters over one column, one per zone map block (bloom.h)
+//   primary.hash    hash index over the PRIMARY KEY column (hashindex.h), if any
+// Column files are written and read in pages through the shared buffer pool, and
+// scanned through read-only mappings (scan.h) after dirty pages are flushed. Inserts
+// are made durable by the database's write-ahead log (wal.h); dirty pages and the
+// committed row count reach disk at checkpoints. Rows beyond the committed row count
+// are ignored and rewritten by log replay.
+// Encodings are picked by the first rows written to a table. A column whose new rows
+// no longer fit its encoding is rewritten whole under the next generation of its
+// files, <col>.<generation>.col and so on, which table.meta then switches to.
+
+const uint32_t TABLE_META_MAGIC = 0x4C424454; // "TDBL"
+const uint32_t TABLE_META_VERSION = 3;
+
+// NULL sentinels for the fixed width types
+const int64_t INT_NULL = INT64_MIN;
+const int32_t DATE_NULL = INT32_MIN;
+const uint64_t FLOAT_NULL_BITS = 0x7FF8DEADBEEF0000ULL;
+const uint64_t STRING_NULL_FLAG = 1ULL << 63;
+const uint8_t BOOL_FALSE = 0, BOOL_TRUE = 1, BOOL_NULL = 2;
+
+const uint32_t ZONE_MAP_MAGIC = 0x4E4F5A54; // "TZON"
+const uint32_t ZONE_MAP_VERSION = 1;
+const uint64_t ZONE_ROWS = 8192;
+
+struct ColumnInfo
+{
+    string name;
+    int type; // datatype ID
+};
+
+const uint8_t ENCODING_PLAIN = 0, ENCODING_FRAME = 1, ENCODING_DICTIONARY = 2;
+const size_t DICTIONARY_MAX = 65535; // codes of 2 bytes, less the NULL code
+
+// How a column's values are stored, as table.meta records it
+struct ColumnEncoding
+{
+    uint8_t kind = ENCODING_PLAIN;
+    uint8_t width = 0;       // bytes per code, for ENCODING_FRAME and ENCODING_DICTIONARY
+    uint32_t generation = 0; // of the column's files
+    int64_t base = 0;        // ENCODING_FRAME: the value of code 0
+    uint64_t entries = 0;    // ENCODING_DICTIONARY: values in <col>.dict
+};
+
+// The code of NULL in codes of width bytes, one more than the largest value code
+inline uint64_t nullCode(size_t width)
+{
+    return width >= 8 ? UINT64_MAX : (1ULL << (8 * width)) - 1;
+}
+
+// Bytes per row of a column's .col or .off file; 0 for BOOL, which is bit packed
+size_t storedWidth(int type, const ColumnEncoding &encoding);
+
+// The distinct values of a dictionary-encoded STRING column, numbered in the order
+// they were first stored. A value never moves once added, so views of it stay valid.
+class StringDictionary
+{
+private:
+    deque<string> values;
+    vector<string_view> views; // by code
+    unordered_map<string_view, uint32_t> codes;
+
+public:
+    size_t size() const { return views.size(); }
+    string_view value(uint64_t code) const { return views[code]; }
+    bool find(string_view value, uint32_t &code) const;
+    uint32_t add(string_view value);
+    void truncate(size_t entries);
+};
+
+bool parseDate(const string &text, int32_t &days);
+string formatDate(int32_t days);
+char *formatDateTo(int32_t days, char *out); // at most 16 bytes, not terminated
+string formatDouble(double value);
+bool isFloatNull(double value);
+double floatNull();
+
+// Column-major rows in their stored form, ready to be appended. STRING offsets
+// are relative to the batch's own string bytes.
+struct EncodedBatch
+{
+    size_t rows = 0;
+    vector<string> data;    // per column: fixed width values, BOOL codes or STRING end offsets
+    vector<string> strings; // per column: STRING bytes
+};
+
+// Statistics of one block of rows of an INT, FLOAT or DATE column: the smallest and
+// largest non-NULL value as zone keys, which order like the values, and the NULL count.
+// A block without values has low > high.
+struct ZoneStats
+{
+    int64_t low = INT64_MAX, high = INT64_MIN;
+    uint32_t rows = 0, nulls = 0;
+};
+
+bool hasZoneMap(int type);
+int64_t floatZoneKey(double value); // INT and DATE values are their own keys
+
+class BTreeIndex;
+class HashIndex;
+class BloomIndex;
+
+struct TableIndex
+{
+    string name;
+    size_t column; // schema index
+    unique_ptr<BTreeIndex> tree;
+};
+
+struct TableBloom
+{
+    string name;
+    size_t column; // schema index
+    unique_ptr<BloomIndex> filter;
+};
+
+class TableStorage
+{
+private:
+    struct ColumnFile
+    {
+        ColumnInfo info;
+        ColumnEncoding encoding;
+        int fd = -1;         // .col, or .off for plain STRING
+        int strFd = -1;      // .str for plain STRING, .dict for a dictionary
+        uint64_t strEnd = 0; // bytes used in .str or .dict
+        unique_ptr<StringDictionary> dictionary;
+        int zoneFd = -1;     // .zone for INT, FLOAT and DATE
+        vector<ZoneStats> zones;
+    };
+
+    string dir;
+    int metaFd = -1;
+    uint64_t rows = 0;
+    uint64_t appliedLsn = 0;
+    uint64_t savedRows = 0, savedLsn = 0; // as table.meta has them
+    vector<ColumnFile> files;
+    uint64_t bulkStartRows = 0;
+    vector<uint64_t> bulkStartStrEnd;
+    bool bulkLoading = false;
+    size_t zonesSaved = 0; // blocks on disk as of the last checkpoint
+    vector<TableIndex> indexes;
+    vector<TableBloom> blooms;
+    unique_ptr<HashIndex> primary;
+    size_t primaryColumn = 0;
+
+    bool writeMeta();
+    bool writeEncodings();
+    bool openColumn(ColumnFile &file);
+    bool loadDictionary(ColumnFile &file);
+    void removeOtherGenerations();
+    bool flushColumns();
+    bool writeColumn(ColumnFile &file, const string &encoded, const string &strings, uint64_t firstRow, bool direct);
+    bool writeRows(const EncodedBatch &batch, bool direct);
+    bool storeRows(const EncodedBatch &batch, bool direct);
+    bool chooseEncoding(size_t column, const EncodedBatch &batch, ColumnEncoding &encoding) const;
+    bool fitEncodings(const EncodedBatch &batch);
+    bool reencodeColumn(size_t column, ColumnEncoding encoding);
+    void addZones(const EncodedBatch &batch);
+    bool rebuildZones(uint64_t from);
+    bool saveZones();
+    bool indexRows(const EncodedBatch &batch);
+    bool catchUpIndex(TableIndex &index, uint64_t from);
+    bool addBlooms(const EncodedBatch &batch);
+    bool catchUpBloom(TableBloom &bloom, uint64_t from);
+    bool restoreBloom(TableBloom &bloom, uint64_t from);
+    void dropIndexedTail();
+    bool openPrimaryKey();
+    bool indexPrimaryKey(const EncodedBatch &batch);
+    bool catchUpPrimaryKey(uint64_t from);
+    bool storedEquals(size_t column, uint64_t rowId, string_view value);
+    bool checkPrimaryKey(const EncodedBatch &batch);
+
+public:
+    TableStorage(const string &dir, const vector<ColumnInfo> &schema);
+    ~TableStorage();
+    TableStorage(const TableStorage &) = delete;
+    TableStorage &operator=(const TableStorage &) = delete;
+
+    bool isOpen() const { return metaFd >= 0; }
+    uint64_t rowCount() const { return rows; }
+    uint64_t lsn() const { return appliedLsn; }
+    const vector<ColumnFile> &columnFiles() const { return files; }
+
+    bool encodeRows(const vector<Row> &rowData, EncodedBatch &batch) const;
+    bool appendRows(const vector<Row> &rowData);
+    bool appendRow(const Row &row) { return appendRows({row}); }
+    bool appendUnlogged(const vector<Row> &rowData);
+    bool redoRows(const vector<Row> &rowData, uint64_t lsn);
+    bool checkpoint();
+
+    bool beginBulkLoad();
+    bool bulkAppend(const EncodedBatch &batch);
+    bool endBulkLoad();
+    void abortBulkLoad();
+    bool flushPages();
+    bool truncate();
+
+    bool openZones();
+    const vector<ZoneStats> &zoneMap(size_t column) const { return files[column].zones; }
+    bool openIndexes();
+    bool createIndex(const string &name, size_t column);
+    bool createBloomIndex(const string &name, size_t column, double falsePositiveRate);
+    bool dropIndex(const string &name);
+    TableIndex *findIndex(size_t column);
+    BloomIndex *findBloom(size_t column) const;
+    const vector<TableIndex> &tableIndexes() const { return indexes; }
+    HashIndex *primaryKey() const { return primary.get(); }
+    size_t primaryKeyColumn() const { return primaryColumn; }
+};
+
+bool createTableStorage(const string &dir, const vector<ColumnInfo> &schema, int primaryKey = -1);
+TableStorage *openTableStorage(const string &dir, const vector<ColumnInfo> &schema);
+void closeTableStorage(const string &dir);
+bool checkpointDatabase(const string &dbDir);
+void checkpointAllDatabases();
+void recoverDatabases();
+bool convertCsvTable(const string &dir, const vector<ColumnInfo> &schema);
+void convertLegacyTables();
+
+#endif // STORAGE_H
@@ -6,85 +6,39 @@
 #include <algorithm>
 #include <filesystem>
 #include <string>
+#include <cstring>
 #include <ctime>      // For currentDateTime()
 #include "database.h" // Include the header for the Database class
 #include "globals.h"
 #include "table.h"
+#include "storage.h"
+#include "btree.h"
+#include "hashindex.h"
+#include "bloom.h"
+#include "catalog.h"
+#include "exec.h"
 using namespace std;
 
-// Constructor to initialize columns
-Table::Table() : db(*(new Database())), tableName("") {}
-
-Table::Table(Database &db, string tableName, const vector<string> &columnName, const vector<string> &type)
-    : db(db), tableName(tableName)
+static vector<ColumnInfo> schemaOrder(const unordered_map<string, pair<int, int>> &columns)
 {
-    if (tableName.empty())
-    {
-        cerr << RED << "Table Name cannot be empty" << RESET << endl;
-        return;
-    }
-
-    string tablePath = "./Databases/" + db.getName() + "/" + tableName;
-
-    if (db.tableExists(tableName))
-    {
-        cout << ORANGE << "Table already exists! Loading columns..." << RESET << endl;
-        ifstream columnFile(tablePath + "/columns.csv");
-
-        if (!columnFile.is_open())
-        {
-            cerr << RED << "Failed to open columns.csv for table " << tableName << RESET << endl;
-            return;
-        }
-
-        string line, colName, dataType;
-        int index = 0;
-        while (getline(columnFile, line))
-        {
-            stringstream ss(line);
-            getline(ss, colName, ',');
-            getline(ss, dataType, ',');
-            columns[colName] = {index++, datatype[dataType]};
-        }
-        columnFile.close();
-        return;
-    }
-
-    // Create the table directory if it doesn't exist
-    if (!filesystem::exists(tablePath) && !filesystem::create_directories(tablePath))
-    {
-        throw runtime_error("Failed to create table directory");
-    }
-
-    // Ensure columnName and type vectors are valid
-    if (columnName.size() != type.size())
+    vector<ColumnInfo> schema(columns.size());
+    for (const auto &col : columns)
     {
-        cerr << RED << "Column names and types size mismatch!" << RESET << endl;
-        return;
+        schema[col.second.first] = {col.first, col.second.second};
     }
+    return schema;
+}
 
-    ofstream columnFile(tablePath + "/columns.csv");
-    if (!columnFile.is_open())
-    {
-        cerr << RED << "Failed to create columns.csv for table " << tableName << RESET << endl;
-        return;
-    }
+// Constructor to initialize columns
+Table::Table() : db(*(new Database())), tableName("") {}
 
-    for (size_t i = 0; i < columnName.size(); i++)
+Table::Table(Database &db, string tableName, const vector<ColumnInfo> &schema)
+    : db(db), tableName(tableName)
+{
+    for (size_t i = 0; i < schema.size(); i++)
     {
-        columns[columnName[i]] = {i, datatype[type[i]]};
-        columnFile << columnName[i] << "," << type[i] << endl;
+        columns[schema[i].name] = {i, schema[i].type};
     }
-    columnFile.close();
-
-    ofstream dataFile(tablePath + "/data.csv");
-    dataFile.close();
-
-    ofstream tableFile("./Databases/" + db.getName() + "/tables.csv", ios::app);
-    tableFile << tableName << "," << currentDateTime() << endl;
-    tableFile.close();
-
-    cout << GREEN << "Table " << tableName << " created successfully." << RESET << endl;
 }
 
 Table selectTable(Database &db, const string &tableName)
@@ -95,91 +49,50 @@ Table selectTable(Database &db, const string &tableName)
         return Table();
     }
 
-    if (!db.tableExists(tableName))
+    const vector<ColumnInfo> *schema = db.tableSchema(tableName);
+    if (!schema)
     {
         cerr << RED << "Table does not exist: " << tableName << RESET << endl;
         return Table();
     }
-
-    cout << GREEN << "Loading table: " << tableName << RESET << endl;
-
-    string tablePath = "./Databases/" + db.getName() + "/" + tableName + "/columns.csv";
-    ifstream columnFile(tablePath);
-    if (!columnFile.is_open())
+    if (schema->empty())
     {
-        cerr << RED << "Failed to open columns.csv for table " << tableName << RESET << endl;
+        cerr << RED << "No columns defined for table " << tableName << RESET << endl;
         return Table();
     }
 
-    vector<string> columnNames, dataTypes;
-    string line, colName, dataType;
-    while (getline(columnFile, line))
-    {
-        stringstream ss(line);
-        getline(ss, colName, ',');
-        getline(ss, dataType, ',');
-
-        if (colName.empty() || dataType.empty())
-        {
-            cerr << ORANGE << "Skipping invalid column entry: " << line << RESET << endl;
-            continue;
-        }
-
-        columnNames.push_back(colName);
-        dataTypes.push_back(dataType);
-    }
-    columnFile.close();
-
-    return Table(db, tableName, columnNames, dataTypes);
+    return Table(db, tableName, *schema);
 }
 
-
-void Table::insert(const vector<string> &rowData)
+TableStorage *Table::openStorage()
 {
-    // If columns are not yet loaded, read from columns.csv
-    if (columns.empty())
+    TableStorage *storage = openTableStorage("./Databases/" + db.getName() + "/" + tableName, schemaOrder(columns));
+    if (!storage)
     {
-        string filePath = "./Databases/" + db.getName() + "/" + tableName + "/columns.csv";
-        ifstream colFile(filePath);
-        if (!colFile.is_open())
-        {
-            cerr << RED << "Failed to open " << filePath << " for table " << tableName << RESET << endl;
-            return;
-        }
+        cerr << RED << "Failed to open storage for table " << tableName << RESET << endl;
+    }
+    return storage;
+}
 
-        string line;
-        int index = 0;
-        while (getline(colFile, line))
-        {
-            stringstream ss(line);
-            string colName, colTypeStr;
-            getline(ss, colName, ',');
-            getline(ss, colTypeStr, ',');
-
-            // Map data type string to internal type ID
-            auto it = datatype.find(colTypeStr);
-            if (it == datatype.end())
-            {
-                cerr << RED << "Unknown data type '" << colTypeStr << "' for column '" << colName << "' in " << tableName << RESET << endl;
-                colFile.close();
-                return;
-            }
-            int colType = it->second;
 
-            columns[colName] = {index++, colType}; // Store name -> (index, type)
-        }
-        colFile.close();
+static void reportInserted(size_t count, const string &tableName)
+{
+    if (count == 1)
+        cout << GREEN << "Row added successfully to table " << tableName << "." << RESET << endl;
+    else
+        cout << GREEN << count << " rows added successfully to table " << tableName << "." << RESET << endl;
+}
 
-        if (columns.empty())
-        {
-            cerr << RED << "No columns defined in " << filePath << " for table " << tableName << RESET << endl;
-            return;
-        }
-    }
+void Table::insert(const vector<ParamValue> &rowData)
+{
+    insertRows({rowData});
+}
 
-    if (rowData.size() != columns.size())
+void Table::insertRows(const vector<vector<ParamValue>> &rows)
+{
+    if (columns.empty())
     {
-        cerr << RED << "Row size mismatch! Expected " << columns.size() << " columns, got " << rowData.size() << RESET << endl;
+        cerr << RED << "Table is not loaded correctly! No columns found." << RESET << endl;
         return;
     }
 
@@ -189,78 +102,44 @@ void Table::insert(const vector<string> &rowData)
         return;
     }
 
-    // Validate data types against schema order
-    vector<pair<string, pair<int, int>>> sortedColumns(columns.begin(), columns.end());
-    sort(sortedColumns.begin(), sortedColumns.end(), 
-         [](const auto& a, const auto& b) { return a.second.first < b.second.first; });
-
-    for (size_t i = 0; i < rowData.size(); i++)
+    // Parse every row against schema order before anything is written
+    vector<ColumnInfo> schema = schemaOrder(columns);
+    vector<Row> parsed(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
     {
-        const string &colName = sortedColumns[i].first;
-        int colType = sortedColumns[i].second.second; // Type ID
-        string value = rowData[i];
-
-        bool isValid = true;
-        switch (colType)
+        const vector<ParamValue> &rowData = rows[r];
+        if (rowData.size() != schema.size())
         {
-        case 0: // INT
-            try { stoi(value); } catch (...) { isValid = false; }
-            break;
-        case 1: // FLOAT
-            try { stof(value); } catch (...) { isValid = false; }
-            break;
-        case 2: // BOOL or BOOLEAN
-            if (value != "TRUE" && value != "FALSE" && value != "1" && value != "0")
-                isValid = false;
-            break;
-        case 3: // STRING
-            if (value.front() == '\'' && value.back() == '\'')
-                value = value.substr(1, value.size() - 2);
-            break;
-        case 4: // DATE
-            if (value.size() != 10 || value[4] != '-' || value[7] != '-' || !isdigit(value[0]) || 
-                !isdigit(value[1]) || !isdigit(value[2]) || !isdigit(value[3]) || !isdigit(value[5]) || 
-                !isdigit(value[6]) || !isdigit(value[8]) || !isdigit(value[9]))
-                isValid = false;
-            break;
+            cerr << RED << "Row size mismatch! Expected " << schema.size() << " columns, got " << rowData.size();
+            if (rows.size() > 1)
+                cerr << " in row " << r + 1;
+            cerr << RESET << endl;
+            return;
         }
 
-        if (!isValid)
+        string error;
+        if (!parseRow(schema, rowData, parsed[r], error))
         {
-            // Find the type name for error reporting
-            string typeName;
-            for (const auto& [name, id] : datatype)
-            {
-                if (id == colType) { typeName = name; break; }
-            }
-            cerr << RED << "Error: Invalid value '" << value << "' for column '" << colName
-                 << "' (Expected " << typeName << ")." << RESET << endl;
+            cerr << RED << "Error: " << error << "." << RESET << endl;
             return;
         }
     }
 
-    // Write data to file
-    string dataFilePath = "./Databases/" + db.getName() + "/" + tableName + "/data.csv";
-    ofstream dataFile(dataFilePath, ios::app);
-    if (!dataFile.is_open())
+    TableStorage *storage = openStorage();
+    if (!storage || !storage->appendRows(parsed))
     {
-        cerr << RED << "Failed to open " << dataFilePath << " for table " << tableName << RESET << endl;
         return;
     }
 
-    for (size_t i = 0; i < rowData.size(); i++)
-    {
-        dataFile << rowData[i];
-        if (i < rowData.size() - 1)
-            dataFile << ",";
-    }
-    dataFile << endl;
-    dataFile.close();
+    reportInserted(rows.size(), tableName);
+}
 
-    cout << GREEN << "Row added successfully to table " << tableName << "." << RESET << endl;
+void Table::insertWithColumns(const vector<string> &columnNames, const vector<ParamValue> &rowData)
+{
+    insertRowsWithColumns(columnNames, {rowData});
 }
 
-void Table::insertWithColumns(const vector<string> &columnNames, const vector<string> &rowData)
+void Table::insertRowsWithColumns(const vector<string> &columnNames, const vector<vector<ParamValue>> &rows)
 {
     if (columns.empty())
     {
@@ -268,148 +147,320 @@ void Table::insertWithColumns(const vector<string> &columnNames, const vector<st
         return;
     }
 
-    if (columnNames.size() != rowData.size())
-    {
-        cerr << RED << "Mismatch between provided column names and values!" << RESET << endl;
-        return;
-    }
-
     if (!db.isValid())
     {
         cerr << RED << "Database reference is missing!" << RESET << endl;
         return;
     }
 
-    // Validate column names
+    // Resolve the column list once: position in the statement -> (schema index, datatype ID)
+    vector<pair<int, int>> targets;
     for (const string &colName : columnNames)
     {
-        if (columns.find(colName) == columns.end())
+        auto it = columns.find(colName);
+        if (it == columns.end())
         {
             cerr << RED << "Error: Column '" << colName << "' does not exist in table '" << tableName << "'!" << RESET << endl;
             return;
         }
+        if (datatypeName.find(it->second.second) == datatypeName.end())
+        {
+            cerr << RED << "Error: Unknown datatype ID '" << it->second.second << "' for column '" << colName << "'!" << RESET << endl;
+            return;
+        }
+        targets.push_back(it->second);
     }
 
-    // Validate data types
-    unordered_map<string, string> providedValues;
-    for (size_t i = 0; i < columnNames.size(); i++)
+    // Parse values into full rows in schema order; missing columns are NULL
+    vector<ColumnInfo> schema = schemaOrder(columns);
+    vector<Row> fullRows(rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
     {
-        string colName = columnNames[i];
-        int colType = columns[colName].second;
-        if (datatypeName.find(colType) == datatypeName.end())
+        const vector<ParamValue> &rowData = rows[r];
+        if (columnNames.size() != rowData.size())
         {
-            cerr << RED << "Error: Unknown datatype ID '" << colType << "' for column '" << colName << "'!" << RESET << endl;
+            cerr << RED << "Mismatch between provided column names and values!" << RESET << endl;
             return;
         }
 
-        string value = rowData[i];
-
-        // Check if datatype is valid
-        string typeStr = datatypeName[colType];
-        if (datatype.find(typeStr) == datatype.end())
+        Row &fullRow = fullRows[r];
+        fullRow.resize(schema.size());
+        for (size_t c = 0; c < schema.size(); c++)
         {
-            cerr << RED << "Error: Unknown datatype '" << colType << "' for column '" << colName << "'!" << RESET << endl;
-            return;
+            fullRow.values[c].type = schema[c].type;
+            fullRow.setNull(c);
         }
-        int expectedType = datatype[typeStr];
-
-        // Type validation
-        bool isValid = true;
-        switch (expectedType)
+        for (size_t i = 0; i < rowData.size(); i++)
         {
-        case 0: // INT
-            try
-            {
-                stoi(value);
-            }
-            catch (...)
-            {
-                isValid = false;
-            }
-            break;
-        case 1: // FLOAT
-            try
+            int index = targets[i].first, colType = targets[i].second;
+            if (rowData[i].isNull)
             {
-                stof(value);
+                continue;
             }
-            catch (...)
+            if (!parseValue(colType, rowData[i].text, fullRow.values[index]))
             {
-                isValid = false;
-            }
-            break;
-        case 2: // BOOL
-            if (value != "TRUE" && value != "FALSE" && value != "1" && value != "0")
-            {
-                isValid = false;
-            }
-            break;
-        case 3: // STRING
-            if (value.front() == '\'' && value.back() == '\'')
-            {
-                value = value.substr(1, value.size() - 2); // Remove quotes
-            }
-            break;
-        case 4: // DATE (YYYY-MM-DD format check)
-            if (value.size() != 10 || value[4] != '-' || value[7] != '-' ||
-                !isdigit(value[0]) || !isdigit(value[1]) || !isdigit(value[2]) || !isdigit(value[3]) ||
-                !isdigit(value[5]) || !isdigit(value[6]) ||
-                !isdigit(value[8]) || !isdigit(value[9]))
-            {
-                isValid = false;
+                cerr << RED << "Error: " << invalidValueMessage(colType, rowData[i].text, columnNames[i]) << "." << RESET
+                     << endl;
+                return;
             }
-            break;
+            fullRow.setNull(index, false);
         }
+    }
 
-        if (!isValid)
-        {
-            cerr << RED << "Error: Invalid value '" << value << "' for column '" << colName
-                 << "' (Expected " << datatypeName[expectedType] << ")." << RESET << endl;
-            return;
-        }
+    TableStorage *storage = openStorage();
+    if (!storage || !storage->appendRows(fullRows))
+    {
+        return;
+    }
+
+    reportInserted(fullRows.size(), tableName);
+}
 
-        providedValues[colName] = value;
+// Conditions that must all hold for a row to pass: the operands of the top-level ANDs
+static void conjuncts(const Expr &expr, vector<const Expr *> &out)
+{
+    if (expr.kind != EXPR_AND)
+    {
+        out.push_back(&expr);
+        return;
     }
+    for (const auto &child : expr.children)
+        conjuncts(*child, out);
+}
 
-    // Fill fullRow based on actual column order
-    vector<string> fullRow(columns.size(), "NULL");
+// What the WHERE clause says about one indexed column, as index keys
+struct IndexCandidate
+{
+    TableIndex *index = nullptr;
+    IndexRange range;
+    bool equality = false;
+    vector<string> points; // IN list
+};
 
-    // Iterate through columns in the correct schema order
-    for (const auto &col : columns)
+static void raiseLow(IndexRange &range, const char *key, bool inclusive, size_t width)
+{
+    int c = range.hasLow ? memcmp(key, range.low, width) : 1;
+    if (c > 0 || (c == 0 && !inclusive))
+    {
+        memcpy(range.low, key, width);
+        range.hasLow = true;
+        range.lowInclusive = inclusive;
+    }
+}
+
+static void lowerHigh(IndexRange &range, const char *key, bool inclusive, size_t width)
+{
+    int c = range.hasHigh ? memcmp(key, range.high, width) : -1;
+    if (c < 0 || (c == 0 && !inclusive))
     {
-        const string &colName = col.first;
-        int colIndex = col.second.first; // Correct column index
+        memcpy(range.high, key, width);
+        range.hasHigh = true;
+        range.highInclusive = inclusive;
+    }
+}
+
+// Index key of a literal compared with the column, or false if it does not parse as
+// the column's type (the predicate decides what such a comparison means)
+static bool literalKey(const BTreeIndex &tree, const Expr &literal, char *key)
+{
+    Value value;
+    return literal.kind == EXPR_LITERAL && !literal.isNull &&
+           parseValue(tree.columnInfo().type, literal.text, value) && tree.keyOf(value, key);
+}
 
-        if (providedValues.find(colName) != providedValues.end())
+// Values of the primary key a WHERE term pins it to: one for equality, or an IN list
+static bool primaryKeyValues(const Expr &term, size_t keyColumn, int type,
+                             const unordered_map<string, pair<int, int>> &columns, vector<Value> &values)
+{
+    auto isKey = [&](const Expr &operand)
+    {
+        auto column = operand.kind == EXPR_COLUMN ? columns.find(operand.text) : columns.end();
+        return column != columns.end() && static_cast<size_t>(column->second.first) == keyColumn;
+    };
+    auto add = [&](const Expr &literal)
+    {
+        Value value;
+        if (literal.kind != EXPR_LITERAL || literal.isNull || !parseValue(type, literal.text, value))
+            return false;
+        values.push_back(value);
+        return true;
+    };
+    values.clear();
+    if (term.kind == EXPR_COMPARE && term.op == CMP_EQ)
+    {
+        bool flipped = term.children[0]->kind != EXPR_COLUMN;
+        return isKey(*term.children[flipped ? 1 : 0]) && add(*term.children[flipped ? 0 : 1]);
+    }
+    if (term.kind != EXPR_IN || term.negated || !isKey(*term.children[0]))
+        return false;
+    for (size_t i = 1; i < term.children.size(); i++)
+    {
+        const Expr &literal = *term.children[i];
+        if (!(literal.kind == EXPR_LITERAL && literal.isNull) && !add(literal))
+            return false;
+    }
+    return !values.empty();
+}
+
+static bool primaryKeyLookup(HashIndex &primary, const vector<Value> &values, vector<uint64_t> &rowIds,
+                             uint64_t &pagesRead)
+{
+    uint64_t pagesBefore = primary.pageReads(), word;
+    for (const Value &value : values)
+    {
+        if (!primary.keyWordOf(value, word) || !primary.find(word, rowIds))
         {
-            fullRow[colIndex] = providedValues[colName];
+            rowIds.clear();
+            return false;
         }
     }
+    pagesRead = primary.pageReads() - pagesBefore;
+    sort(rowIds.begin(), rowIds.end());
+    rowIds.erase(unique(rowIds.begin(), rowIds.end()), rowIds.end());
+    return true;
+}
+
+// Looks the rows a WHERE clause can match up in an index on one of its columns: the
+// primary key compared for equality first, then any column compared for equality,
+// then one with an IN list, then one with a range. Returns the name of the index
+// used. Gives up, leaving the scan to read every row, when no index applies or when a
+// quarter of the table or more matches and reading it in order is cheaper.
+static string indexLookup(TableStorage &storage, const Expr &where, const unordered_map<string, pair<int, int>> &columns,
+                          vector<uint64_t> &rowIds, uint64_t &pagesRead)
+{
+    const string primaryName = "primary key";
+    vector<const Expr *> terms;
+    conjuncts(where, terms);
 
-    // Open file to append
-    string filePath = "./Databases/" + db.getName() + "/" + tableName + "/data.csv";
-    ofstream dataFile(filePath, ios::app);
-    if (!dataFile.is_open())
+    // The primary key maps a value straight to its row
+    HashIndex *primary = storage.primaryKey();
+    vector<Value> keyValues, keyList;
+    for (const Expr *term : terms)
     {
-        cerr << RED << "Failed to open " << filePath << " for table " << tableName << RESET << endl;
-        return;
+        if (!primary || !primaryKeyValues(*term, storage.primaryKeyColumn(), primary->columnInfo().type, columns,
+                                          keyValues))
+            continue;
+        if (term->kind != EXPR_IN)
+            return primaryKeyLookup(*primary, keyValues, rowIds, pagesRead) ? primaryName : "";
+        if (keyList.empty())
+            keyList = move(keyValues);
+    }
+
+    unordered_map<size_t, IndexCandidate> candidates;
+    auto candidateFor = [&](const Expr &operand) -> IndexCandidate *
+    {
+        if (operand.kind != EXPR_COLUMN)
+            return nullptr;
+        auto column = columns.find(operand.text);
+        TableIndex *index = column == columns.end() ? nullptr : storage.findIndex(column->second.first);
+        if (!index)
+            return nullptr;
+        IndexCandidate &candidate = candidates[index->column];
+        candidate.index = index;
+        return &candidate;
+    };
+
+    char key[INDEX_KEY_MAX], high[INDEX_KEY_MAX];
+    for (const Expr *term : terms)
+    {
+        if (term->kind == EXPR_COMPARE && term->op != CMP_NE)
+        {
+            // Put the column on the left
+            bool flipped = term->children[0]->kind != EXPR_COLUMN;
+            const Expr &column = *term->children[flipped ? 1 : 0], &literal = *term->children[flipped ? 0 : 1];
+            CompareOp op = term->op;
+            if (flipped)
+                op = op == CMP_LT ? CMP_GT : op == CMP_LE ? CMP_GE : op == CMP_GT ? CMP_LT : op == CMP_GE ? CMP_LE : op;
+            IndexCandidate *candidate = candidateFor(column);
+            if (!candidate || !literalKey(*candidate->index->tree, literal, key))
+                continue;
+            size_t width = candidate->index->tree->keySize();
+            if (op == CMP_EQ || op == CMP_GT || op == CMP_GE)
+                raiseLow(candidate->range, key, op != CMP_GT, width);
+            if (op == CMP_EQ || op == CMP_LT || op == CMP_LE)
+                lowerHigh(candidate->range, key, op != CMP_LT, width);
+            candidate->equality = candidate->equality || op == CMP_EQ;
+        }
+        else if (term->kind == EXPR_BETWEEN && !term->negated)
+        {
+            IndexCandidate *candidate = candidateFor(*term->children[0]);
+            if (!candidate || !literalKey(*candidate->index->tree, *term->children[1], key) ||
+                !literalKey(*candidate->index->tree, *term->children[2], high))
+                continue;
+            size_t width = candidate->index->tree->keySize();
+            raiseLow(candidate->range, key, true, width);
+            lowerHigh(candidate->range, high, true, width);
+        }
+        else if (term->kind == EXPR_IN && !term->negated)
+        {
+            IndexCandidate *candidate = candidateFor(*term->children[0]);
+            if (!candidate || !candidate->points.empty())
+                continue;
+            vector<string> points;
+            for (size_t i = 1; i < term->children.size(); i++)
+            {
+                const Expr &literal = *term->children[i];
+                if (literal.kind == EXPR_LITERAL && literal.isNull)
+                    continue; // never equal
+                if (!literalKey(*candidate->index->tree, literal, key))
+                {
+                    points.clear();
+                    break;
+                }
+                points.emplace_back(key, candidate->index->tree->keySize());
+            }
+            candidate->points = move(points);
+        }
+    }
+
+    auto score = [](const IndexCandidate &candidate)
+    {
+        return candidate.equality ? 3 : !candidate.points.empty() ? 2
+               : candidate.range.hasLow || candidate.range.hasHigh ? 1 : 0;
+    };
+    IndexCandidate *best = nullptr;
+    for (auto &entry : candidates)
+    {
+        if (score(entry.second) > 0 && (!best || score(entry.second) > score(*best) ||
+                                        (score(entry.second) == score(*best) && entry.first < best->index->column)))
+            best = &entry.second;
     }
+    if (!keyList.empty() && (!best || score(*best) < 3))
+        return primaryKeyLookup(*primary, keyList, rowIds, pagesRead) ? primaryName : "";
+    if (!best)
+        return "";
 
-    // Write row to file
-    for (size_t i = 0; i < fullRow.size(); i++)
+    BTreeIndex &tree = *best->index->tree;
+    uint64_t limit = storage.rowCount() / 4 + 1, pagesBefore = tree.pageReads();
+    bool found = true;
+    if (score(*best) == 2)
     {
-        dataFile << fullRow[i];
-        if (i < fullRow.size() - 1)
+        for (size_t i = 0; found && i < best->points.size(); i++)
         {
-            dataFile << ",";
+            IndexRange point;
+            point.hasLow = point.hasHigh = true;
+            memcpy(point.low, best->points[i].data(), tree.keySize());
+            memcpy(point.high, best->points[i].data(), tree.keySize());
+            found = tree.lookup(point, limit, rowIds);
         }
     }
-    dataFile << endl;
-    dataFile.close();
-
-    cout << GREEN << "Row added successfully to table " << tableName << "." << RESET << endl;
+    else
+    {
+        found = tree.lookup(best->range, limit, rowIds);
+    }
+    pagesRead = tree.pageReads() - pagesBefore;
+    if (!found)
+    {
+        rowIds.clear();
+        return "";
+    }
+    sort(rowIds.begin(), rowIds.end());
+    rowIds.erase(unique(rowIds.begin(), rowIds.end()), rowIds.end());
+    return best->index->name;
 }
 
-void Table::displayTable(const vector<string>& columnNames = {})
+void Table::displayTable(const vector<string>& columnNames, const Expr *where, const vector<OrderItem>& orderBy,
+                         uint64_t limit, uint64_t offset, ExplainMode explain)
 {
     // Sort columns by schema index
     vector<pair<string, pair<int, int>>> sortedColumns(columns.begin(), columns.end());
@@ -422,111 +473,167 @@ void Table::displayTable(const vector<string>& columnNames = {})
         return;
     }
 
-    // Calculate column widths and store data in memory
-    unordered_map<string, size_t> columnWidths;
-    vector<vector<string>> rows; // Store all rows for single-pass reading
-    for (const auto &col : sortedColumns)
+    TableStorage *storage = openStorage();
+    if (!storage)
     {
-        columnWidths[col.first] = col.first.size(); // Initialize with header size
+        return;
     }
 
-    string filePath = "./Databases/" + db.getName() + "/" + tableName + "/data.csv";
-    ifstream dataFile(filePath);
-    if (!dataFile.is_open())
+    // The select list is resolved once into schema indices, in the order asked for.
+    // Only those columns are mapped; cells are read in place from the mapping.
+    vector<size_t> shown;
+    vector<ColumnInfo> shownColumns;
+    for (size_t i = 0; columnNames.empty() && i < sortedColumns.size(); i++)
     {
-        cerr << RED << "Failed to open data.csv for table " << tableName << RESET << endl;
-        return;
+        shown.push_back(i);
+        shownColumns.push_back({sortedColumns[i].first, sortedColumns[i].second.second});
+    }
+    for (const string &colName : columnNames)
+    {
+        auto it = columns.find(colName);
+        if (it == columns.end())
+        {
+            cerr << RED << "Error: Column '" << colName << "' does not exist in table '" << tableName << "'!" << RESET << endl;
+            return;
+        }
+        shown.push_back(it->second.first);
+        shownColumns.push_back({colName, it->second.second});
     }
 
-    string line;
-    while (getline(dataFile, line))
+    // Columns the WHERE clause reads are mapped after the shown ones but not printed
+    vector<size_t> scanned = shown;
+    vector<ColumnInfo> scannedColumns = shownColumns;
+    vector<size_t> filterColumns;
+    unique_ptr<Predicate> predicate;
+    if (where)
     {
-        stringstream ss(line);
-        string cell;
-        vector<string> row;
-        for (const auto &col : sortedColumns)
+        vector<string> referenced;
+        collectColumns(*where, referenced);
+        for (const string &colName : referenced)
         {
-            if (getline(ss, cell, ','))
+            auto it = columns.find(colName);
+            if (it == columns.end())
             {
-                row.push_back(cell);
-                columnWidths[col.first] = max(columnWidths[col.first], cell.size());
+                cerr << RED << "Error: Column '" << colName << "' does not exist in table '" << tableName << "'!" << RESET << endl;
+                return;
             }
-            else
+            size_t index = it->second.first;
+            filterColumns.push_back(index);
+            if (find(scanned.begin(), scanned.end(), index) == scanned.end())
             {
-                row.push_back("NULL"); // Handle missing fields
-                columnWidths[col.first] = max(columnWidths[col.first], string("NULL").size());
+                scanned.push_back(index);
+                scannedColumns.push_back({colName, it->second.second});
             }
         }
-        rows.push_back(row);
+        string error;
+        predicate = compilePredicate(*where, scannedColumns, error);
+        if (!predicate)
+        {
+            cerr << RED << "Error: " << error << "." << RESET << endl;
+            return;
+        }
     }
-    dataFile.close();
 
-    // Display header
-    for (const auto &col : sortedColumns)
+    // So are the ORDER BY columns
+    vector<SortKey> sortKeys;
+    for (const OrderItem &item : orderBy)
     {
-        if (columnNames.empty() || find(columnNames.begin(), columnNames.end(), col.first) != columnNames.end())
+        auto it = columns.find(item.column);
+        if (it == columns.end())
+        {
+            cerr << RED << "Error: Column '" << item.column << "' does not exist in table '" << tableName << "'!" << RESET << endl;
+            return;
+        }
+        size_t index = it->second.first;
+        auto slot = find(scanned.begin(), scanned.end(), index);
+        if (slot == scanned.end())
         {
-            cout << "| " << col.first << string(columnWidths[col.first] - col.first.size() + 1, ' ');
+            scanned.push_back(index);
+            scannedColumns.push_back({item.column, it->second.second});
+            slot = scanned.end() - 1;
         }
+        sortKeys.push_back({static_cast<size_t>(slot - scanned.begin()), item.descending});
     }
-    cout << "|\n";
 
-    // Display separator
-    for (const auto &col : sortedColumns)
+    TableScan scan(*storage, scanned);
+    if (!scan.isOpen())
     {
-        if (columnNames.empty() || find(columnNames.begin(), columnNames.end(), col.first) != columnNames.end())
-        {
-            cout << "+" << string(columnWidths[col.first] + 2, '-');
-        }
+        cerr << RED << "Failed to read table " << tableName << RESET << endl;
+        return;
     }
-    cout << "+\n";
 
-    // Display data
-    if (rows.empty())
+    // An index on a column the WHERE clause pins to values or a range hands the scan
+    // the rows to read; the filter still checks each of them
+    string index;
+    uint64_t indexPages = 0;
+    if (where)
     {
-        // Calculate total width for a single centered message
-        size_t totalWidth = 0;
-        for (const auto &col : sortedColumns)
-        {
-            if (columnNames.empty() || find(columnNames.begin(), columnNames.end(), col.first) != columnNames.end())
-            {
-                totalWidth += columnWidths[col.first] + 3; // +2 for padding, +1 for separator
-            }
-        }
-        totalWidth -= 1; // Remove extra separator at the end
+        vector<uint64_t> rowIds;
+        index = indexLookup(*storage, *where, columns, rowIds, indexPages);
+        if (!index.empty())
+            scan.setRows(move(rowIds));
+        else
+            scan.skipZones(skippableZones(*where, *storage));
+    }
 
-        string message = "No data in table " + tableName;
-        size_t padding = totalWidth > message.size() ? (totalWidth - message.size()) / 2 : 0;
-        cout << "|" << string(padding, ' ') << message << string(totalWidth - message.size() - padding, ' ') << "|\n";
+    // Under a WHERE, columns the predicate does not read are decoded only for the rows
+    // that pass it (and LIMIT, when nothing is sorted)
+    bool filtered = predicate != nullptr;
+    vector<size_t> deferred;
+    for (size_t slot = 0; filtered && slot < scanned.size(); slot++)
+    {
+        if (find(filterColumns.begin(), filterColumns.end(), scanned[slot]) == filterColumns.end())
+            deferred.push_back(slot);
+    }
+    scan.deferColumns(deferred);
+
+    // Scan, filter and project batches; rows stream to the sink as they qualify, or
+    // once all are in when they are sorted
+    unique_ptr<Operator> root = make_unique<ScanOperator>(scan, tableName, index, indexPages);
+    if (filtered)
+        root = make_unique<FilterOperator>(move(root), move(predicate));
+    vector<size_t> outputSlots(shown.size());
+    for (size_t i = 0; i < shown.size(); i++)
+        outputSlots[i] = i;
+    bool sorted = !sortKeys.empty();
+    if (sorted)
+    {
+        if (!deferred.empty())
+            root = make_unique<MaterializeOperator>(move(root), scan, deferred);
+        root = make_unique<SortOperator>(move(root), move(sortKeys), move(outputSlots), sortLimit(limit, offset),
+                                         "./Databases/" + db.getName() + "/" + tableName);
     }
     else
     {
-        for (const auto &row : rows)
-        {
-            for (size_t i = 0; i < sortedColumns.size(); ++i)
-            {
-                const string &cell = row[i];
-                if (columnNames.empty() || find(columnNames.begin(), columnNames.end(), sortedColumns[i].first) != columnNames.end())
-                {
-                    cout << "| " << cell << string(columnWidths[sortedColumns[i].first] - cell.size() + 1, ' ');
-                }
-            }
-            cout << "|\n";
-        }
+        root = make_unique<ProjectOperator>(move(root), move(outputSlots));
     }
 
-    // Display bottom separator
-    for (const auto &col : sortedColumns)
+    // Unfiltered and unsorted, LIMIT and OFFSET are a row range: the scan seeks past
+    // the skipped rows without reading them and ends at the last one wanted
+    if (!filtered && !sorted)
     {
-        if (columnNames.empty() || find(columnNames.begin(), columnNames.end(), col.first) != columnNames.end())
-        {
-            cout << "+" << string(columnWidths[col.first] + 2, '-');
-        }
+        uint64_t first = min(offset, scan.rowCount());
+        scan.setRange(first, first + min(limit, scan.rowCount() - first));
     }
-    cout << "+\n";
+    else if (limit != NO_LIMIT || offset > 0)
+    {
+        root = make_unique<LimitOperator>(move(root), limit, offset);
+    }
+    if (!sorted && !deferred.empty())
+        root = make_unique<MaterializeOperator>(move(root), scan, deferred);
+
+    if (explain != EXPLAIN_NONE)
+    {
+        explainPipeline(root, explain);
+        return;
+    }
+    ResultSink sink(shownColumns);
+    writeResults(*root, sink);
+    sink.finish("No data in table " + tableName);
 }
 
-void create(Database &db, const string &tableName, const vector<string> &columns, const vector<string> &datatypes)
+void create(Database &db, const string &tableName, const vector<string> &columns, const vector<string> &datatypes,
+            const string &primaryKey)
 {
     if (tableName.empty())
     {
@@ -555,19 +662,39 @@ void create(Database &db, const string &tableName, const vector<string> &columns
         }
     }
 
+    vector<ColumnInfo> schema;
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        schema.push_back({columns[i], datatype.at(datatypes[i])});
+    }
+
+    int keyColumn = -1;
+    if (!primaryKey.empty())
+    {
+        keyColumn = static_cast<int>(find(columns.begin(), columns.end(), primaryKey) - columns.begin());
+        if (schema[keyColumn].type == TYPE_BOOL)
+        {
+            cerr << RED << "Error: Columns of type " << datatypeName[TYPE_BOOL] << " cannot be a primary key." << RESET
+                 << endl;
+            return;
+        }
+    }
+
     string tablePath = "./Databases/" + db.getName() + "/" + tableName;
     filesystem::create_directories(tablePath);
 
-    ofstream columnFile(tablePath + "/columns.csv");
-    for (size_t i = 0; i < columns.size(); i++)
+    if (!createTableStorage(tablePath, schema, keyColumn))
     {
-        columnFile << columns[i] << "," << datatypes[i] << endl;
+        cerr << RED << "Failed to create storage for table " << tableName << RESET << endl;
+        return;
+    }
+    if (!db.addTable(tableName, schema))
+    {
+        closeTableStorage(tablePath);
+        filesystem::remove_all(tablePath);
+        cerr << RED << "Failed to register table " << tableName << RESET << endl;
+        return;
     }
-    columnFile.close();
-
-    ofstream("./Databases/" + db.getName() + "/" + tableName + "/data.csv").close();
-    ofstream("./Databases/" + db.getName() + "/tables.csv", ios::app) << tableName << "," << currentDateTime() << endl;
-    db.addTable(tableName);
     cout << GREEN << "Table " << tableName << " created successfully." << RESET << endl;
 }
 
@@ -588,9 +715,10 @@ void rename(Database& db, const string& oldName, const string& newName) {
     }
 
     string oldPath = "./Databases/" + db.getName() + "/" + oldName;
-    string newPath = "./Databases/" + db.getName() + "/" + newName;
+    // Log records name the table, so they must be folded in before it moves
+    checkpointDatabase("./Databases/" + db.getName());
+    closeTableStorage(oldPath);
     if(db.renameTable(oldName, newName)) {
-        filesystem::rename(oldPath,newPath);
         cout << GREEN << "Table " << oldName << " renamed to " << newName << RESET << endl;
     } else {
         cerr << RED << "Failed to rename table " << oldName << " to " << newName << RESET << endl;
@@ -604,8 +732,10 @@ void drop(Database& db, const string& tableName) {
     }
 
     string tablePath = "./Databases/" + db.getName() + "/" + tableName;
-    if(filesystem::remove_all(tablePath)) {
-        db.drop(tableName);
+    checkpointDatabase("./Databases/" + db.getName());
+    closeTableStorage(tablePath);
+    if(db.drop(tableName)) {
+        filesystem::remove_all(tablePath);
         cout << GREEN << "Table " << tableName << " dropped successfully." << RESET << endl;
     } else {
         cerr << RED << "Failed to drop table " << tableName << RESET << endl;
@@ -618,8 +748,93 @@ void truncate(Database& db, const string& tableName) {
         return;
     }
 
-    string tablePath = "./Databases/" + db.getName() + "/" + tableName + "/data.csv";
-    ofstream dataFile(tablePath);
-    dataFile.close();
+    Table table = selectTable(db, tableName);
+    TableStorage *storage = table.getName().empty() ? nullptr : table.openStorage();
+    if (!storage || !storage->truncate()) {
+        cerr << RED << "Failed to truncate table " << tableName << RESET << endl;
+        return;
+    }
     cout << GREEN << "Table " << tableName << " truncated successfully." << RESET << endl;
-}
\ No newline at end of file
+}
+
+// Index names are file names in the table directory, so they are kept to plain words
+static bool validIndexName(const string &name)
+{
+    return !name.empty() && all_of(name.begin(), name.end(), [](char c)
+                                   { return isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+}
+
+// The table of the database holding an index, or an empty string
+static string indexTable(Database &db, const string &indexName)
+{
+    for (const string &tableName : catalog().listTables(db.getName()))
+    {
+        string path = "./Databases/" + db.getName() + "/" + tableName + "/" + indexName;
+        if (filesystem::exists(path + ".idx") || filesystem::exists(path + ".bloom"))
+            return tableName;
+    }
+    return "";
+}
+
+void createIndex(Database &db, const string &indexName, const string &tableName, const string &columnName, bool bloom,
+                 double falsePositiveRate)
+{
+    if (!validIndexName(indexName))
+    {
+        cerr << RED << "Invalid index name: " << indexName << RESET << endl;
+        return;
+    }
+    if (!indexTable(db, indexName).empty())
+    {
+        cerr << ORANGE << "Index already exists!" << RESET << endl;
+        return;
+    }
+    const vector<ColumnInfo> *schema = db.tableSchema(tableName);
+    if (!schema)
+    {
+        cerr << RED << "Table does not exist: " << tableName << RESET << endl;
+        return;
+    }
+    auto column = find_if(schema->begin(), schema->end(), [&](const ColumnInfo &c) { return c.name == columnName; });
+    if (column == schema->end())
+    {
+        cerr << RED << "Error: Column '" << columnName << "' does not exist in table '" << tableName << "'!" << RESET << endl;
+        return;
+    }
+    if (indexKeyWidth(column->type) == 0)
+    {
+        cerr << RED << "Error: Columns of type " << datatypeName[column->type] << " cannot be indexed." << RESET << endl;
+        return;
+    }
+
+    Table table(db, tableName, *schema);
+    TableStorage *storage = table.openStorage();
+    size_t c = column - schema->begin();
+    if (!storage || !(bloom ? storage->createBloomIndex(indexName, c, falsePositiveRate > 0 ? falsePositiveRate
+                                                                                           : BLOOM_DEFAULT_FPP)
+                            : storage->createIndex(indexName, c)))
+    {
+        cerr << RED << "Failed to create index " << indexName << RESET << endl;
+        return;
+    }
+    cout << GREEN << (bloom ? "Bloom filter index " : "Index ") << indexName << " created on " << tableName << "("
+         << columnName << ")." << RESET << endl;
+}
+
+void dropIndex(Database &db, const string &indexName)
+{
+    string tableName = validIndexName(indexName) ? indexTable(db, indexName) : "";
+    if (tableName.empty())
+    {
+        cerr << RED << "Index does not exist: " << indexName << RESET << endl;
+        return;
+    }
+    Table table = selectTable(db, tableName);
+    TableStorage *storage = table.getName().empty() ? nullptr : table.openStorage();
+    if (!storage || !storage->dropIndex(indexName))
+    {
+        cerr << RED << "Failed to drop index " << indexName << RESET << endl;
+        return;
+    }
+    cout << GREEN << "Index " << indexName << " dropped successfully." << RESET << endl;
+}
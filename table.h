@@ -2,12 +2,17 @@
 #define TABLE_H
 
 #include "database.h"
+#include "expr.h"
+#include "orderby.h"
 #include <unordered_map>
 #include <vector>
 #include <string>
 
 using namespace std;
 
+class TableStorage;
+struct ColumnInfo;
+
 class Table
 {
 private:
@@ -17,21 +22,31 @@ private:
 
 public:
     Table();
-    Table(Database& db, string tableName = "", const vector<string>& columnName = {}, const vector<string>& type = {});
+    Table(Database& db, string tableName, const vector<ColumnInfo>& schema);
     string getName() const { return tableName; }
 
-    void insert(const vector<string>& rowData);
-    void insertWithColumns(const vector<string>& columnNames, const vector<string>& rowData);
-    void displayTable(const vector<string>& columnNames);
+    void insert(const vector<ParamValue>& rowData);
+    void insertWithColumns(const vector<string>& columnNames, const vector<ParamValue>& rowData);
+    void insertRows(const vector<vector<ParamValue>>& rows);
+    void insertRowsWithColumns(const vector<string>& columnNames, const vector<vector<ParamValue>>& rows);
+    void displayTable(const vector<string>& columnNames = {}, const Expr *where = nullptr,
+                      const vector<OrderItem>& orderBy = {}, uint64_t limit = NO_LIMIT, uint64_t offset = 0,
+                      ExplainMode explain = EXPLAIN_NONE);
+    TableStorage *openStorage();
     
 };
 
 
-void create(Database &db, const string &tableName, const vector<string> &columns, const vector<string> &types);
+void create(Database &db, const string &tableName, const vector<string> &columns, const vector<string> &types,
+            const string &primaryKey = "");
 Table selectTable(Database &db, const string &tableName);
 
 void rename(Database& db, const string& oldName, const string& newName);
 void drop(Database& db, const string& tableName);
 void truncate(Database& db, const string& tableName);
+void copyFrom(Database &db, const string &tableName, const string &path, bool header);
+void createIndex(Database &db, const string &indexName, const string &tableName, const string &columnName,
+                 bool bloom = false, double falsePositiveRate = 0);
+void dropIndex(Database &db, const string &indexName);
 
 #endif // TABLE_H
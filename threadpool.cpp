@@ -0,0 +1,47 @@
+#include "threadpool.h"
+#include <algorithm>
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    threads = max(threads, size_t(1));
+    for (size_t i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        tasks.push(move(task));
+    }
+    available.notify_one();
+}
+
+void ThreadPool::run()
+{
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(mtx);
+            available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
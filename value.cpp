@@ -0,0 +1,306 @@
+#include "value.h"
+#include "storage.h"
+#include "globals.h"
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+Value Value::ofInt(int64_t v)
+{
+    Value value;
+    value.type = TYPE_INT;
+    value.i = v;
+    return value;
+}
+
+Value Value::ofFloat(double v)
+{
+    Value value;
+    value.type = TYPE_FLOAT;
+    value.f = v;
+    return value;
+}
+
+Value Value::ofBool(bool v)
+{
+    Value value;
+    value.type = TYPE_BOOL;
+    value.i = 0;
+    value.b = v;
+    return value;
+}
+
+Value Value::ofDate(int32_t v)
+{
+    Value value;
+    value.type = TYPE_DATE;
+    value.i = 0;
+    value.d = v;
+    return value;
+}
+
+Value Value::ofString(string v)
+{
+    Value value;
+    value.type = TYPE_STRING;
+    value.s = move(v);
+    return value;
+}
+
+void Row::setNull(size_t i, bool null)
+{
+    if (null)
+        nulls[i / 64] |= 1ULL << (i % 64);
+    else
+        nulls[i / 64] &= ~(1ULL << (i % 64));
+}
+
+void Row::resize(size_t columns)
+{
+    values.resize(columns);
+    nulls.assign((columns + 63) / 64, 0);
+}
+
+static bool equalsIgnoreCase(const string &text, const char *word)
+{
+    return strcasecmp(text.c_str(), word) == 0;
+}
+
+// Parses the whole of text as a value of type, so "12abc" is an error rather than 12.
+// outOfRange is set for text of the right form that the type cannot hold: a number too
+// large, NaN or infinity for FLOAT, or a value storage keeps for NULL (INT64_MIN for
+// INT, INT32_MIN days for DATE).
+static bool parseChecked(int type, const string &text, Value &out, bool &outOfRange)
+{
+    const char *begin = text.data(), *end = text.data() + text.size();
+    outOfRange = false;
+    switch (type)
+    {
+    case TYPE_INT:
+    {
+        if (begin != end && *begin == '+')
+            begin++;
+        int64_t v;
+        auto res = from_chars(begin, end, v);
+        if (begin == end || res.ptr != end)
+            return false;
+        outOfRange = res.ec == errc::result_out_of_range || (res.ec == errc() && v == INT_NULL);
+        if (res.ec != errc() || outOfRange)
+            return false;
+        out = Value::ofInt(v);
+        return true;
+    }
+    case TYPE_FLOAT:
+    {
+        if (text.empty() || isspace(static_cast<unsigned char>(text[0])))
+            return false;
+        char *stop;
+        errno = 0;
+        double v = strtod(text.c_str(), &stop);
+        if (stop != text.c_str() + text.size())
+            return false;
+        outOfRange = errno == ERANGE || !isfinite(v);
+        if (outOfRange)
+            return false;
+        out = Value::ofFloat(v);
+        return true;
+    }
+    case TYPE_BOOL:
+        if (equalsIgnoreCase(text, "TRUE") || text == "1")
+            out = Value::ofBool(true);
+        else if (equalsIgnoreCase(text, "FALSE") || text == "0")
+            out = Value::ofBool(false);
+        else
+            return false;
+        return true;
+    case TYPE_STRING:
+        out = Value::ofString(text);
+        return true;
+    case TYPE_DATE:
+    {
+        int32_t days;
+        if (!parseDate(text, days))
+            return false;
+        outOfRange = days == DATE_NULL;
+        if (outOfRange)
+            return false;
+        out = Value::ofDate(days);
+        return true;
+    }
+    }
+    return false;
+}
+
+bool parseValue(int type, const string &text, Value &out)
+{
+    bool outOfRange;
+    return parseChecked(type, text, out, outOfRange);
+}
+
+string invalidValueMessage(int type, const string &text, const string &column)
+{
+    Value value;
+    bool outOfRange;
+    parseChecked(type, text, value, outOfRange);
+    if (outOfRange)
+        return "Value '" + text + "' is out of range for column '" + column + "' (" + datatypeName.at(type) + ")";
+    return "Invalid value '" + text + "' for column '" + column + "' (Expected " + datatypeName.at(type) + ")";
+}
+
+string formatValue(const Value &value)
+{
+    switch (value.type)
+    {
+    case TYPE_INT:
+        return to_string(value.i);
+    case TYPE_FLOAT:
+        return formatDouble(value.f);
+    case TYPE_BOOL:
+        return value.b ? "TRUE" : "FALSE";
+    case TYPE_STRING:
+        return value.s;
+    case TYPE_DATE:
+        return formatDate(value.d);
+    }
+    return "";
+}
+
+int compareValues(const Value &a, const Value &b)
+{
+    switch (a.type)
+    {
+    case TYPE_INT:
+        return (a.i > b.i) - (a.i < b.i);
+    case TYPE_FLOAT:
+        return (a.f > b.f) - (a.f < b.f);
+    case TYPE_BOOL:
+        return int(a.b) - int(b.b);
+    case TYPE_STRING:
+        return a.s.compare(b.s);
+    case TYPE_DATE:
+        return (a.d > b.d) - (a.d < b.d);
+    }
+    return 0;
+}
+
+bool parseRow(const vector<ColumnInfo> &schema, const vector<ParamValue> &text, Row &row, string &error)
+{
+    if (text.size() != schema.size())
+    {
+        error = "Row size mismatch! Expected " + to_string(schema.size()) + " columns, got " + to_string(text.size());
+        return false;
+    }
+    row.resize(schema.size());
+    for (size_t c = 0; c < schema.size(); c++)
+    {
+        if (text[c].isNull)
+        {
+            row.values[c].type = schema[c].type;
+            row.setNull(c);
+        }
+        else if (!parseValue(schema[c].type, text[c].text, row.values[c]))
+        {
+            error = invalidValueMessage(schema[c].type, text[c].text, schema[c].name);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void putVarint(string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static bool getVarint(const string &in, size_t &pos, uint64_t &v)
+{
+    v = 0;
+    for (unsigned shift = 0; shift < 64 && pos < in.size(); shift += 7)
+    {
+        uint8_t byte = in[pos++];
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+void encodeRow(const Row &row, string &out)
+{
+    size_t bitmapStart = out.size();
+    out.append((row.size() + 7) / 8, '\0');
+    for (size_t c = 0; c < row.size(); c++)
+    {
+        if (row.isNull(c))
+        {
+            out[bitmapStart + c / 8] |= static_cast<char>(1 << (c % 8));
+            continue;
+        }
+        const Value &v = row.values[c];
+        switch (v.type)
+        {
+        case TYPE_INT:
+        case TYPE_FLOAT:
+            out.append(reinterpret_cast<const char *>(&v.i), 8);
+            break;
+        case TYPE_BOOL:
+            out.push_back(v.b ? 1 : 0);
+            break;
+        case TYPE_STRING:
+            putVarint(out, v.s.size());
+            out += v.s;
+            break;
+        case TYPE_DATE:
+            out.append(reinterpret_cast<const char *>(&v.d), 4);
+            break;
+        }
+    }
+}
+
+bool decodeRow(const vector<uint8_t> &types, const string &in, size_t &pos, Row &row)
+{
+    size_t bitmapSize = (types.size() + 7) / 8;
+    if (pos + bitmapSize > in.size())
+        return false;
+    size_t bitmap = pos;
+    pos += bitmapSize;
+    row.resize(types.size());
+    for (size_t c = 0; c < types.size(); c++)
+    {
+        Value &v = row.values[c];
+        v.type = types[c];
+        if ((in[bitmap + c / 8] >> (c % 8)) & 1)
+        {
+            row.setNull(c);
+            continue;
+        }
+        size_t width = types[c] == TYPE_DATE ? 4 : types[c] == TYPE_BOOL ? 1 : 8;
+        if (types[c] == TYPE_STRING)
+        {
+            uint64_t length;
+            if (!getVarint(in, pos, length) || length > in.size() - pos)
+                return false;
+            v.s.assign(in, pos, length);
+            pos += length;
+            continue;
+        }
+        if (types[c] > TYPE_DATE || pos + width > in.size())
+            return false;
+        if (types[c] == TYPE_BOOL)
+            v.b = in[pos] != 0;
+        else if (types[c] == TYPE_DATE)
+            memcpy(&v.d, in.data() + pos, 4);
+        else
+            memcpy(&v.i, in.data() + pos, 8);
+        pos += width;
+    }
+    return true;
+}
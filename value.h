@@ -0,0 +1,93 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Type tags of typed values; they are the datatype IDs of globals.h
+enum ValueType : uint8_t
+{
+    TYPE_INT = 0,    // int64 other than INT64_MIN
+    TYPE_FLOAT = 1,  // finite double
+    TYPE_BOOL = 2,   // bool
+    TYPE_STRING = 3, // bytes
+    TYPE_DATE = 4    // int32 days since 1970-01-01
+};
+
+// One non-NULL value. Text is parsed into a Value once, at ingest; storage, the log
+// and query operators all work on the native representation afterwards.
+struct Value
+{
+    uint8_t type = TYPE_INT;
+    union
+    {
+        int64_t i;
+        double f;
+        bool b;
+        int32_t d;
+    };
+    string s; // TYPE_STRING only
+
+    Value() : i(0) {}
+    static Value ofInt(int64_t v);
+    static Value ofFloat(double v);
+    static Value ofBool(bool v);
+    static Value ofDate(int32_t v);
+    static Value ofString(string v);
+};
+
+// A tuple in schema order with its NULL bitmap; a NULL slot keeps its column's type tag
+struct Row
+{
+    vector<Value> values;
+    vector<uint64_t> nulls;
+
+    size_t size() const { return values.size(); }
+    bool isNull(size_t i) const { return (nulls[i / 64] >> (i % 64)) & 1; }
+    void setNull(size_t i, bool null = true);
+    void resize(size_t columns);
+};
+
+// False for text that is not a value of type or is out of its range
+bool parseValue(int type, const string &text, Value &out);
+// Why parseValue() rejected text for the named column
+string invalidValueMessage(int type, const string &text, const string &column);
+string formatValue(const Value &value);
+int compareValues(const Value &a, const Value &b); // same type; <0, 0 or >0
+
+// A value as written in a statement or input line: text parsed against the type it is
+// compared with or stored in, or NULL. A quoted 'NULL' is the text, not a NULL.
+struct ParamValue
+{
+    string text;
+    bool isNull = false;
+    bool quoted = false; // written as a quoted string
+
+    ParamValue() = default;
+    ParamValue(string text) : text(move(text)) {}
+    ParamValue(const char *text) : text(text) {}
+    static ParamValue null()
+    {
+        ParamValue value;
+        value.isNull = true;
+        return value;
+    }
+};
+
+struct ColumnInfo;
+
+// Parses one row of values against a schema. On failure error names the offending value
+// and column.
+bool parseRow(const vector<ColumnInfo> &schema, const vector<ParamValue> &text, Row &row, string &error);
+
+// Compact tuple encoding: NULL bitmap (one bit per column, LSB first), then each non-NULL
+// value in column order: INT/FLOAT 8 bytes, DATE 4, BOOL 1, STRING varint length + bytes.
+// Column types are not stored; the decoder is given them.
+void encodeRow(const Row &row, string &out);
+bool decodeRow(const vector<uint8_t> &types, const string &in, size_t &pos, Row &row);
+
+#endif // VALUE_H
@@ -0,0 +1,356 @@
+#include "wal.h"
+#include "globals.h"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+const size_t WAL_HEADER_SIZE = 16;
+const size_t WAL_RECORD_HEADER_SIZE = 17;
+
+// Built at compile time, so concurrent writers never see it half filled
+static constexpr array<uint32_t, 256> CRC_TABLE = []
+{
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}();
+
+uint32_t crc32(const void *data, size_t size, uint32_t crc)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = CRC_TABLE[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t recordChecksum(uint64_t lsn, uint8_t type, const char *payload, size_t size)
+{
+    uint32_t crc = crc32(&lsn, sizeof(lsn));
+    crc = crc32(&type, sizeof(type), crc);
+    return crc32(payload, size, crc);
+}
+
+static bool writeFully(int fd, const char *p, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static string readFile(int fd)
+{
+    string data;
+    char buf[1 << 16];
+    uint64_t offset = 0;
+    ssize_t n;
+    while ((n = pread(fd, buf, sizeof(buf), offset)) > 0)
+    {
+        data.append(buf, n);
+        offset += n;
+    }
+    return data;
+}
+
+// Walks the records of a log image; returns the offset just past the last intact record
+static size_t scanRecords(const string &data, const function<void(const WalRecord &)> &visit)
+{
+    size_t offset = WAL_HEADER_SIZE;
+    while (offset + WAL_RECORD_HEADER_SIZE <= data.size())
+    {
+        uint32_t length, checksum;
+        uint64_t lsn;
+        uint8_t type;
+        memcpy(&length, data.data() + offset, 4);
+        memcpy(&checksum, data.data() + offset + 4, 4);
+        memcpy(&lsn, data.data() + offset + 8, 8);
+        memcpy(&type, data.data() + offset + 16, 1);
+        size_t payloadStart = offset + WAL_RECORD_HEADER_SIZE;
+        if (payloadStart + length > data.size() ||
+            recordChecksum(lsn, type, data.data() + payloadStart, length) != checksum)
+            break;
+        if (visit)
+            visit({lsn, type, data.substr(payloadStart, length)});
+        offset = payloadStart + length;
+    }
+    return offset;
+}
+
+WriteAheadLog::WriteAheadLog(const string &path) : path(path)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        cerr << RED << "Failed to open write-ahead log " << path << ": " << strerror(errno) << RESET << endl;
+        return;
+    }
+
+    string data = readFile(fd);
+    if (data.size() < WAL_HEADER_SIZE)
+    {
+        if (!writeHeader(0))
+        {
+            close(fd);
+            fd = -1;
+        }
+        return;
+    }
+
+    uint32_t magic, version;
+    uint64_t baseLsn;
+    memcpy(&magic, data.data(), 4);
+    memcpy(&version, data.data() + 4, 4);
+    memcpy(&baseLsn, data.data() + 8, 8);
+    if (magic != WAL_MAGIC || version != WAL_VERSION)
+    {
+        cerr << RED << "Unsupported write-ahead log " << path << RESET << endl;
+        close(fd);
+        fd = -1;
+        return;
+    }
+
+    uint64_t last = baseLsn;
+    size_t end = scanRecords(data, [&](const WalRecord &record) { last = max(last, record.lsn); });
+    if (end < data.size())
+    {
+        cerr << ORANGE << "Discarding " << data.size() - end << " bytes of torn log tail in " << path << RESET << endl;
+        if (ftruncate(fd, end) != 0)
+            cerr << RED << "Failed to truncate " << path << RESET << endl;
+    }
+    fileSize = end;
+    nextLsn = last + 1;
+    durableLsn = last;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    if (fd >= 0)
+    {
+        commit(lastLsn());
+        close(fd);
+    }
+}
+
+bool WriteAheadLog::writeHeader(uint64_t baseLsn)
+{
+    char header[WAL_HEADER_SIZE];
+    memcpy(header, &WAL_MAGIC, 4);
+    memcpy(header + 4, &WAL_VERSION, 4);
+    memcpy(header + 8, &baseLsn, 8);
+    if (ftruncate(fd, 0) != 0 || !writeFully(fd, header, sizeof(header), 0) || fdatasync(fd) != 0)
+    {
+        cerr << RED << "Failed to write header of " << path << RESET << endl;
+        return false;
+    }
+    fileSize = WAL_HEADER_SIZE;
+    return true;
+}
+
+void WriteAheadLog::observeLsn(uint64_t lsn)
+{
+    lock_guard<mutex> lock(mtx);
+    if (lsn >= nextLsn)
+    {
+        nextLsn = lsn + 1;
+        durableLsn = max(durableLsn, lsn);
+    }
+}
+
+uint64_t WriteAheadLog::append(uint8_t type, const string &payload)
+{
+    lock_guard<mutex> lock(mtx);
+    uint64_t lsn = nextLsn++;
+    uint32_t length = payload.size();
+    uint32_t checksum = recordChecksum(lsn, type, payload.data(), payload.size());
+    char header[WAL_RECORD_HEADER_SIZE];
+    memcpy(header, &length, 4);
+    memcpy(header + 4, &checksum, 4);
+    memcpy(header + 8, &lsn, 8);
+    memcpy(header + 16, &type, 1);
+    pending.append(header, sizeof(header));
+    pending += payload;
+    pendingLsn = lsn;
+    return lsn;
+}
+
+// Group commit: the first committer becomes the leader and writes and syncs everything
+// appended so far; committers arriving meanwhile wait and are covered by the next flush.
+bool WriteAheadLog::commit(uint64_t lsn)
+{
+    unique_lock<mutex> lock(mtx);
+    while (durableLsn < lsn && !failed)
+    {
+        if (flushing)
+        {
+            flushed.wait(lock);
+            continue;
+        }
+
+        flushing = true;
+        if (walGroupCommitMicros > 0)
+        {
+            // Give concurrent writers a chance to join this flush
+            lock.unlock();
+            this_thread::sleep_for(chrono::microseconds(walGroupCommitMicros));
+            lock.lock();
+        }
+        string batch;
+        batch.swap(pending);
+        uint64_t batchLsn = pendingLsn;
+        uint64_t offset = fileSize;
+        fileSize += batch.size();
+        lock.unlock();
+
+        bool ok = writeFully(fd, batch.data(), batch.size(), offset) && fdatasync(fd) == 0;
+
+        lock.lock();
+        flushing = false;
+        if (ok)
+        {
+            durableLsn = max(durableLsn, batchLsn);
+        }
+        else
+        {
+            failed = true;
+            cerr << RED << "Failed to write " << path << ": " << strerror(errno) << RESET << endl;
+        }
+        flushed.notify_all();
+    }
+    return durableLsn >= lsn;
+}
+
+bool WriteAheadLog::replay(const function<void(const WalRecord &)> &apply)
+{
+    if (!isOpen())
+        return false;
+    string data = readFile(fd);
+    scanRecords(data, apply);
+    return true;
+}
+
+// Called once a checkpoint has made every record up to checkpointLsn redundant
+bool WriteAheadLog::reset(uint64_t checkpointLsn)
+{
+    if (!commit(lastLsn()))
+        return false;
+    lock_guard<mutex> lock(mtx);
+    return writeHeader(checkpointLsn);
+}
+
+static void putU32(string &out, uint32_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+
+static bool getU32(const string &in, size_t &pos, uint32_t &v)
+{
+    if (pos + sizeof(v) > in.size())
+        return false;
+    memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+static bool getString(const string &in, size_t &pos, string &v)
+{
+    uint32_t length;
+    if (!getU32(in, pos, length) || pos + length > in.size())
+        return false;
+    v.assign(in, pos, length);
+    pos += length;
+    return true;
+}
+
+string encodeInsertPayload(const string &table, const vector<Row> &rows)
+{
+    string out;
+    putU32(out, table.size());
+    out += table;
+    size_t columns = rows.empty() ? 0 : rows.front().size();
+    putU32(out, columns);
+    for (size_t c = 0; c < columns; c++)
+        out.push_back(static_cast<char>(rows.front().values[c].type));
+    putU32(out, rows.size());
+    for (const auto &row : rows)
+        encodeRow(row, out);
+    return out;
+}
+
+bool decodeInsertPayload(const string &payload, string &table, vector<Row> &rows)
+{
+    size_t pos = 0;
+    uint32_t columnCount, rowCount;
+    if (!getString(payload, pos, table) || !getU32(payload, pos, columnCount) || pos + columnCount > payload.size())
+        return false;
+    vector<uint8_t> types(payload.begin() + pos, payload.begin() + pos + columnCount);
+    pos += columnCount;
+    if (!getU32(payload, pos, rowCount))
+        return false;
+    rows.assign(rowCount, Row());
+    for (auto &row : rows)
+    {
+        if (!decodeRow(types, payload, pos, row))
+            return false;
+    }
+    return pos == payload.size();
+}
+
+string encodeAbortPayload(uint64_t lsn)
+{
+    return string(reinterpret_cast<const char *>(&lsn), sizeof(lsn));
+}
+
+bool decodeAbortPayload(const string &payload, uint64_t &lsn)
+{
+    if (payload.size() != sizeof(lsn))
+        return false;
+    memcpy(&lsn, payload.data(), sizeof(lsn));
+    return true;
+}
+
+static unordered_map<string, unique_ptr<WriteAheadLog>> &openLogs()
+{
+    static unordered_map<string, unique_ptr<WriteAheadLog>> logs;
+    return logs;
+}
+
+WriteAheadLog *walForDatabase(const string &dbDir)
+{
+    string key = filesystem::path(dbDir).lexically_normal().string();
+    auto it = openLogs().find(key);
+    if (it != openLogs().end())
+        return it->second.get();
+
+    auto wal = make_unique<WriteAheadLog>(key + "/wal.log");
+    if (!wal->isOpen())
+        return nullptr;
+    return openLogs().emplace(key, move(wal)).first->second.get();
+}
+
+void closeWal(const string &dbDir)
+{
+    openLogs().erase(filesystem::path(dbDir).lexically_normal().string());
+}
@@ -0,0 +1,81 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "value.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Write-ahead log kept per database in Databases/<db>/wal.log.
+//
+// File header: magic, version, base LSN (the last LSN covered by a checkpoint).
+// Record:      u32 payload length, u32 CRC-32 of (lsn, type, payload), u64 lsn, u8 type, payload.
+// Replay stops at the first short or corrupt record, which is where a crash cut the log.
+
+const uint32_t WAL_MAGIC = 0x4C415744; // "DWAL"
+const uint32_t WAL_VERSION = 1;
+
+enum WalRecordType : uint8_t
+{
+    WAL_INSERT_ROWS = 1, // payload: table name, column types, rows in the compact encoding of value.h
+    WAL_ABORT = 2        // payload: LSN of an insert that failed after it was logged
+};
+
+struct WalRecord
+{
+    uint64_t lsn;
+    uint8_t type;
+    string payload;
+};
+
+uint32_t crc32(const void *data, size_t size, uint32_t crc = 0);
+
+class WriteAheadLog
+{
+private:
+    string path;
+    int fd = -1;
+    uint64_t nextLsn = 1;
+    uint64_t durableLsn = 0;
+    uint64_t fileSize = 0;
+    string pending;          // appended but not yet written
+    uint64_t pendingLsn = 0; // last LSN in pending
+    bool flushing = false;
+    bool failed = false;
+    mutex mtx;
+    condition_variable flushed;
+
+    bool writeHeader(uint64_t baseLsn);
+
+public:
+    explicit WriteAheadLog(const string &path);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    uint64_t size() const { return fileSize + pending.size(); }
+    uint64_t lastLsn() const { return nextLsn - 1; }
+
+    void observeLsn(uint64_t lsn);
+    uint64_t append(uint8_t type, const string &payload);
+    bool commit(uint64_t lsn);
+    bool replay(const function<void(const WalRecord &)> &apply);
+    bool reset(uint64_t checkpointLsn);
+};
+
+WriteAheadLog *walForDatabase(const string &dbDir);
+void closeWal(const string &dbDir);
+
+// Row batches as they appear in WAL_INSERT_ROWS payloads
+string encodeInsertPayload(const string &table, const vector<Row> &rows);
+bool decodeInsertPayload(const string &payload, string &table, vector<Row> &rows);
+string encodeAbortPayload(uint64_t lsn);
+bool decodeAbortPayload(const string &payload, uint64_t &lsn);
+
+#endif // WAL_H